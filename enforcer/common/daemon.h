@@ -82,6 +82,12 @@ typedef bool _Bool;
 #define DEFAULT_LOG_FACILITY_STRING "LOG_USER"
 #endif /* LOG_DAEMON */
 
+/* Zones whose updates are committed together (0: all zones of a run) */
+#define DEFAULT_TRANSACTION_BATCH 100
+
+/* Threads that finish zones in parallel (1: in the main loop) */
+#define DEFAULT_WORKER_THREADS 1
+
 /* struct to hold configuration */
 typedef struct
 {
@@ -113,8 +119,11 @@ typedef struct
     int keycreate;
     int manualKeyGeneration;
     int rolloverNotify;
+    int transactionBatch;
+    int workerThreads;
     char* DSSubmitCmd;
     int DSSubCKA_ID;
+    char* signerSocket;
 
     int log_user; /* log facility (or default of LOG_DAEMON) */
 
@@ -716,7 +716,10 @@ ReadConfig(DAEMONCONFIG *config, int verbose)
     xmlChar *iv_expr = (unsigned char*) "//Configuration/Enforcer/Interval";
     xmlChar *mk_expr = (unsigned char*) "//Configuration/Enforcer/ManualKeyGeneration";
     xmlChar *rn_expr = (unsigned char*) "//Configuration/Enforcer/RolloverNotification";
+    xmlChar *tb_expr = (unsigned char*) "//Configuration/Enforcer/TransactionBatchSize";
+    xmlChar *wt_expr = (unsigned char*) "//Configuration/Enforcer/WorkerThreads";
     xmlChar *ds_expr = (unsigned char*) "//Configuration/Enforcer/DelegationSignerSubmitCommand";
+    xmlChar *sock_expr = (unsigned char*) "//Configuration/Signer/SocketFile";
     xmlChar *litexpr = (unsigned char*) "//Configuration/Enforcer/Datastore/SQLite";
     xmlChar *mysql_host = (unsigned char*) "//Configuration/Enforcer/Datastore/MySQL/Host";
     xmlChar *mysql_port = (unsigned char*) "//Configuration/Enforcer/Datastore/MySQL/Host/@port";
@@ -905,6 +908,74 @@ ReadConfig(DAEMONCONFIG *config, int verbose)
     }
 	xmlXPathFreeObject(xpathObj);
 
+    /* Evaluate xpath expression for the number of zones per transaction */
+    xpathObj = xmlXPathEvalExpression(tb_expr, xpathCtx);
+    if(xpathObj == NULL) {
+        log_msg(config, LOG_ERR, "Error: unable to evaluate xpath expression: %s", tb_expr);
+        xmlXPathFreeContext(xpathCtx);
+        xmlFreeDoc(doc);
+        return(-1);
+    }
+
+    if (xpathObj->nodesetval != NULL && xpathObj->nodesetval->nodeNr > 0) {
+        /* Tag TransactionBatchSize is present */
+        temp_char = (char *)xmlXPathCastToString(xpathObj);
+        status = StrStrtoi(temp_char, &config->transactionBatch);
+        if (status != 0 || config->transactionBatch < 0) {
+            log_msg(config, LOG_ERR, "Error: unable to convert TransactionBatchSize %s to a number of zones", temp_char);
+            StrFree(temp_char);
+            xmlXPathFreeObject(xpathObj);
+            xmlXPathFreeContext(xpathCtx);
+            xmlFreeDoc(doc);
+            return(-1);
+        }
+        StrFree(temp_char);
+    }
+    else {
+        /* Tag absent */
+        config->transactionBatch = DEFAULT_TRANSACTION_BATCH;
+    }
+    if (verbose) {
+        if (config->transactionBatch == 0) {
+            log_msg(config, LOG_INFO, "Transaction Batch Size: all zones");
+        } else {
+            log_msg(config, LOG_INFO, "Transaction Batch Size: %i zones", config->transactionBatch);
+        }
+    }
+    xmlXPathFreeObject(xpathObj);
+
+    /* Evaluate xpath expression for the number of worker threads */
+    xpathObj = xmlXPathEvalExpression(wt_expr, xpathCtx);
+    if(xpathObj == NULL) {
+        log_msg(config, LOG_ERR, "Error: unable to evaluate xpath expression: %s", wt_expr);
+        xmlXPathFreeContext(xpathCtx);
+        xmlFreeDoc(doc);
+        return(-1);
+    }
+
+    if (xpathObj->nodesetval != NULL && xpathObj->nodesetval->nodeNr > 0) {
+        /* Tag WorkerThreads is present */
+        temp_char = (char *)xmlXPathCastToString(xpathObj);
+        status = StrStrtoi(temp_char, &config->workerThreads);
+        if (status != 0 || config->workerThreads < 1) {
+            log_msg(config, LOG_ERR, "Error: unable to convert WorkerThreads %s to a number of threads", temp_char);
+            StrFree(temp_char);
+            xmlXPathFreeObject(xpathObj);
+            xmlXPathFreeContext(xpathCtx);
+            xmlFreeDoc(doc);
+            return(-1);
+        }
+        StrFree(temp_char);
+    }
+    else {
+        /* Tag absent */
+        config->workerThreads = DEFAULT_WORKER_THREADS;
+    }
+    if (verbose) {
+        log_msg(config, LOG_INFO, "Worker Threads: %i", config->workerThreads);
+    }
+    xmlXPathFreeObject(xpathObj);
+
     /* Evaluate xpath expression for DelegationSignerSubmitCommand */
     xpathObj = xmlXPathEvalExpression(ds_expr, xpathCtx);
     if(xpathObj == NULL) {
@@ -940,6 +1011,25 @@ ReadConfig(DAEMONCONFIG *config, int verbose)
     }
 	xmlXPathFreeObject(xpathObj);
 
+    /* Evaluate xpath expression for the command socket of the signer */
+    xpathObj = xmlXPathEvalExpression(sock_expr, xpathCtx);
+    if(xpathObj == NULL) {
+        log_msg(config, LOG_ERR, "Error: unable to evaluate xpath expression: %s", sock_expr);
+        xmlXPathFreeContext(xpathCtx);
+        xmlFreeDoc(doc);
+        return(-1);
+    }
+    StrFree(config->signerSocket);
+    if (xpathObj->nodesetval != NULL && xpathObj->nodesetval->nodeNr > 0) {
+        config->signerSocket = (char *)xmlXPathCastToString(xpathObj);
+    } else {
+        config->signerSocket = StrStrdup(OPENDNSSEC_SIGNER_SOCKET);
+    }
+    if (verbose) {
+        log_msg(config, LOG_INFO, "Signer engine socket: %s", config->signerSocket);
+    }
+	xmlXPathFreeObject(xpathObj);
+
     /* Evaluate xpath expression for SQLite file location */
 		
     xpathObj = xmlXPathEvalExpression(litexpr, xpathCtx);
@@ -1139,6 +1229,7 @@ int get_lite_lock(char *lock_filename, FILE* lock_fd)
 {
     struct flock fl;
     struct timeval tv;
+    int wait = 10;      /* ms until the next attempt; doubles up to 1s */
 
     if (lock_fd == NULL) {
         log_msg(NULL, LOG_ERR, "%s could not be opened", lock_filename);
@@ -1152,12 +1243,18 @@ int get_lite_lock(char *lock_filename, FILE* lock_fd)
     
     while (fcntl(fileno(lock_fd), F_SETLK, &fl) == -1) {
         if (errno == EACCES || errno == EAGAIN) {
-            log_msg(NULL, LOG_INFO, "%s already locked, sleep", lock_filename);
+            if (wait == 10) {
+                log_msg(NULL, LOG_INFO, "%s already locked, waiting", lock_filename);
+            }
 
-            /* sleep for 10 seconds TODO make this configurable? */
-            tv.tv_sec = 10;
-            tv.tv_usec = 0;
+            /* Wait in short steps, so that we go as soon as ods-ksmutil
+               is done with the database */
+            tv.tv_sec = wait / 1000;
+            tv.tv_usec = (wait % 1000) * 1000;
             select(0, NULL, NULL, NULL, &tv);
+            if (wait < 1000) {
+                wait = (wait * 2 > 1000 ? 1000 : wait * 2);
+            }
 
         } else {
             log_msg(NULL, LOG_INFO, "couldn't get lock on %s, %s", lock_filename, strerror(errno));
@@ -49,6 +49,7 @@
 #include "daemon_util.h"
 #include "enforcer.h"
 #include "kaspaccess.h"
+#include "zonepool.h"
 
 #include "ksm/ksm.h"
 #include "ksm/memory.h"
@@ -90,6 +91,9 @@ server_main(DAEMONCONFIG *config)
     int result;
     hsm_ctx_t *ctx = NULL;
     char *hsm_error_message = NULL;
+    KEYGEN_POOL *keygen_pool = NULL;
+    SIGNER_NOTIFY *notify = NULL;
+    char *datetime = NULL;
 
     FILE *lock_fd = NULL;  /* for sqlite file locking */
     char *lock_filename = NULL;
@@ -198,9 +202,51 @@ server_main(DAEMONCONFIG *config)
             }
         }
 
+        /* The connection to the signer engine is kept between runs,
+           unless its socket has moved */
+        if (notify != NULL && strcmp(notify->sockfile, config->signerSocket) != 0) {
+            signer_notify_destroy(notify);
+            notify = NULL;
+        }
+        if (notify == NULL) {
+            notify = signer_notify_create(config->signerSocket);
+            if (notify == NULL) {
+                log_msg(config, LOG_ERR, "Malloc for signer engine notification failed");
+                unlink(config->pidfile);
+                exit(1);
+            }
+        }
+        notify->failed = 0;
+
         log_msg(config, LOG_INFO, "Connecting to Database...");
         kaspConnect(config, &dbhandle);
 
+        /* Keys are generated in the background while we go through the
+           zones */
+        if (config->manualKeyGeneration == 0) {
+            keygen_pool = keygen_pool_create(config);
+            if (keygen_pool == NULL) {
+                log_msg(config, LOG_ERR, "Malloc for key generation pool failed");
+                unlink(config->pidfile);
+                exit(1);
+            }
+        }
+
+        /* The time of this run; the keys of the zones are moved as of
+           this time, by the policy-wide pass and per zone alike */
+        datetime = DtParseDateTimeString("now");
+        if (datetime == NULL) {
+            log_msg(config, LOG_ERR, "Couldn't turn \"now\" into a date, quitting...");
+            unlink(config->pidfile);
+            exit(1);
+        }
+
+        /* Everything this run changes is committed in batches of zones,
+           see do_communication() */
+        if (DbBeginTransaction() != 0) {
+            log_msg(config, LOG_ERR, "Error starting a transaction; committing every update on its own");
+        }
+
         /* Read all policies */
         status = KsmPolicyInit(&handle, NULL);
         if (status == 0) {
@@ -226,7 +272,7 @@ server_main(DAEMONCONFIG *config)
 
                 /* Do keygen stuff if required */
                 if (config->manualKeyGeneration == 0) {
-                    status = do_keygen(config, policy, ctx);
+                    status = do_keygen(config, policy, ctx, keygen_pool);
                 }
 
                 /* TODO move communicated stuff here eventually */
@@ -237,6 +283,12 @@ server_main(DAEMONCONFIG *config)
                     status = do_purge(policy->keys->purge, policy->id);
                 }
 
+                /* Move the keys of all zones on the policy that are due to
+                   change state; the zones are finished one by one later */
+                if (KsmRequestPolicyKeys(policy->id, datetime) != 0) {
+                    log_msg(config, LOG_ERR, "Error moving keys for policy %s; its zones are done one by one", policy->name);
+                }
+
                 /* get next policy */
                 status = KsmPolicy(handle, policy);
             }
@@ -248,8 +300,21 @@ server_main(DAEMONCONFIG *config)
 
         /* Communicate zones to the signer */
         KsmParameterCollectionCache(1); /* Enable caching of policy parameters while in do_communication() */
-		do_communication(config, policy);
+		do_communication(config, policy, keygen_pool, notify, datetime);
 		KsmParameterCollectionCache(0);
+        KsmRequestPolicyClear();
+        StrFree(datetime);
+
+        /* Store the rest of the new keys before we let go of the database */
+        if (keygen_pool) {
+            keygen_pool_collect(keygen_pool, config, 1);
+            keygen_pool_destroy(keygen_pool);
+            keygen_pool = NULL;
+        }
+
+        /* Commit the last batch */
+        commit_batch(config, notify, 0);
+        signer_notify_flush(notify);
         
         DbFreeResult(handle);
 
@@ -317,6 +382,7 @@ server_main(DAEMONCONFIG *config)
     log_msg(config, LOG_INFO, "all done! hsm_close result: %d", result);
 
     KsmPolicyFree(policy);
+    signer_notify_destroy(notify);
 
     if (unlink(config->pidfile) == -1) {
         log_msg(config, LOG_ERR, "unlink pidfile %s failed: %s",
@@ -328,16 +394,12 @@ server_main(DAEMONCONFIG *config)
 
 }
 
-int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx)
+int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx, KEYGEN_POOL* pool)
 {
     int status = 0;
 
     char *rightnow;
     int i = 0;
-    char *id;
-    hsm_key_t *key = NULL;
-    char *hsm_error_message = NULL;
-    DB_ID ignore = 0;
     int ksks_needed = 0;    /* Total No of ksks needed before next generation run */
     int zsks_needed = 0;    /* Total No of zsks needed before next generation run */
     int keys_in_queue = 0;  /* number of unused keys */
@@ -413,7 +475,8 @@ int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx)
 
     /* Check capacity of HSM will not be exceeded */
     if (policy->ksk->sm_capacity != 0 && new_keys >= 0) {
-        current_count = hsm_count_keys_repository(ctx, policy->ksk->sm_name);
+        current_count = hsm_count_keys_repository(ctx, policy->ksk->sm_name) +
+            keygen_pool_pending(pool, policy->ksk->sm_name);
         if (current_count >= policy->ksk->sm_capacity) {
             log_msg(config, LOG_ERR, "Repository %s is full, cannot create more KSKs for policy %s\n", policy->ksk->sm_name, policy->name);
             new_keys = 0;
@@ -424,39 +487,16 @@ int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx)
         }
     }
 
-    /* Create the required keys */
+    /* Queue the required keys; they are generated in the background and
+       stored in the database by keygen_pool_collect() */
     for (i=new_keys ; i > 0 ; i--){
         if (hsm_supported_algorithm(policy->ksk->algorithm) == 0) {
-            /* NOTE: for now we know that libhsm only supports RSA keys */
-            key = hsm_generate_rsa_key(ctx, policy->ksk->sm_name, policy->ksk->bits);
-            if (key) {
-                log_msg(config, LOG_DEBUG, "Created key in repository %s", policy->ksk->sm_name);
-            } else {
-                log_msg(config, LOG_ERR, "Error creating key in repository %s", policy->ksk->sm_name);
-                hsm_error_message = hsm_get_error(ctx);
-                if (hsm_error_message) {
-                    log_msg(config, LOG_ERR, "%s", hsm_error_message);
-                    free(hsm_error_message);
-                }
-                unlink(config->pidfile);
-                exit(1);
-            }
-            id = hsm_get_key_id(ctx, key);
-            hsm_key_free(key);
-            status = KsmKeyPairCreate(policy->id, id, policy->ksk->sm, policy->ksk->bits, policy->ksk->algorithm, rightnow, &ignore);
+            status = keygen_pool_submit(pool, policy->ksk->sm_name, policy->id, KSM_TYPE_KSK, policy->ksk->sm, policy->ksk->bits, policy->ksk->algorithm, rightnow);
             if (status != 0) {
-                log_msg(config, LOG_ERR,"Error creating key in Database");
-                hsm_error_message = hsm_get_error(ctx);
-                if (hsm_error_message) {
-                    log_msg(config, LOG_ERR, "%s", hsm_error_message);
-                    free(hsm_error_message);
-                }
+                log_msg(config, LOG_ERR, "Error creating key in repository %s", policy->ksk->sm_name);
                 unlink(config->pidfile);
                 exit(1);
             }
-            log_msg(config, LOG_INFO, "Created KSK size: %i, alg: %i with id: %s in repository: %s and database.", policy->ksk->bits,
-                    policy->ksk->algorithm, id, policy->ksk->sm_name);
-            free(id);
         } else {
             log_msg(config, LOG_ERR, "Key algorithm %d unsupported by libhsm, exiting...", policy->ksk->algorithm);
             unlink(config->pidfile);
@@ -482,6 +522,10 @@ int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx)
         log_msg(NULL, LOG_ERR, "Could not count current zsk numbers for policy %s", policy->name);
         /* TODO exit? continue with next policy? */
     }
+    /* The KSKs queued above are not in the database yet */
+    if (same_keys && ksks_created > 0) {
+        keys_in_queue += ksks_created;
+    }
     /* Correct for shared keys */
     if (policy->shared_keys == KSM_KEYS_SHARED) {
         keys_in_queue /= zone_count;
@@ -496,7 +540,8 @@ int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx)
 
     /* Check capacity of HSM will not be exceeded */
     if (policy->zsk->sm_capacity != 0 && new_keys >= 0) {
-        current_count = hsm_count_keys_repository(ctx, policy->zsk->sm_name);
+        current_count = hsm_count_keys_repository(ctx, policy->zsk->sm_name) +
+            keygen_pool_pending(pool, policy->zsk->sm_name);
         if (current_count >= policy->zsk->sm_capacity) {
             log_msg(config, LOG_ERR, "Repository %s is full, cannot create more ZSKs for policy %s\n", policy->zsk->sm_name, policy->name);
             new_keys = 0;
@@ -507,40 +552,16 @@ int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx)
         }
     }
 
-    /* Create the required keys */
-    for (i = new_keys ; i > 0 ; i--) {
+    /* Queue the required keys; they are generated in the background and
+       stored in the database by keygen_pool_collect() */
+    for (i=new_keys ; i > 0 ; i--){
         if (hsm_supported_algorithm(policy->zsk->algorithm) == 0) {
-            /* NOTE: for now we know that libhsm only supports RSA keys */
-            key = hsm_generate_rsa_key(ctx, policy->zsk->sm_name, policy->zsk->bits);
-            if (key) {
-                log_msg(config, LOG_DEBUG, "Created key in repository %s", policy->zsk->sm_name);
-            } else {
-                log_msg(config, LOG_ERR, "Error creating key in repository %s", policy->zsk->sm_name);
-                hsm_error_message = hsm_get_error(ctx);
-                if (hsm_error_message) {
-                    log_msg(config, LOG_ERR, "%s", hsm_error_message);
-                    free(hsm_error_message);
-                }
-                unlink(config->pidfile);
-                hsm_key_free(key);
-                exit(1);
-            }
-            id = hsm_get_key_id(ctx, key);
-            hsm_key_free(key);
-            status = KsmKeyPairCreate(policy->id, id, policy->zsk->sm, policy->zsk->bits, policy->zsk->algorithm, rightnow, &ignore);
+            status = keygen_pool_submit(pool, policy->zsk->sm_name, policy->id, KSM_TYPE_ZSK, policy->zsk->sm, policy->zsk->bits, policy->zsk->algorithm, rightnow);
             if (status != 0) {
-                log_msg(config, LOG_ERR,"Error creating key in Database");
-                hsm_error_message = hsm_get_error(ctx);
-                if (hsm_error_message) {
-                    log_msg(config, LOG_ERR, "%s", hsm_error_message);
-                    free(hsm_error_message);
-                }
+                log_msg(config, LOG_ERR, "Error creating key in repository %s", policy->zsk->sm_name);
                 unlink(config->pidfile);
                 exit(1);
             }
-            log_msg(config, LOG_INFO, "Created ZSK size: %i, alg: %i with id: %s in repository: %s and database.", policy->zsk->bits,
-                    policy->zsk->algorithm, id, policy->zsk->sm_name);
-            free(id);
         } else {
             log_msg(config, LOG_ERR, "Key algorithm %d unsupported by libhsm, exiting...", policy->zsk->algorithm);
             unlink(config->pidfile);
@@ -560,7 +581,108 @@ int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx)
     return status;
 }
 
-int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
+/*
+ * Commit what the run changed so far, and have the signconfs written in
+ * it announced to the signer engine. If the commit fails, the signconfs
+ * are put back as they were, as the database does not know about them.
+ * If next is set, start the transaction for the next batch of zones.
+ *
+ * Returns 0 on success, non-zero if the updates are lost.
+ */
+int commit_batch(DAEMONCONFIG *config, SIGNER_NOTIFY* notify, int next)
+{
+    int status = 0;
+
+    if (DbTransactionDepth() > 0) {
+        status = DbCommit();
+        if (status != 0) {
+            log_msg(config, LOG_ERR, "Error committing updates to the database; they are lost and the signconfs written for them are restored");
+            DbRollback();
+            /* Any policy-wide key changes went with them */
+            KsmRequestPolicyClear();
+        }
+    }
+    if (status == 0) {
+        signer_notify_commit(notify);
+    } else {
+        signer_notify_rollback(notify, -1);
+    }
+    if (next && DbBeginTransaction() != 0) {
+        log_msg(config, LOG_ERR, "Error starting a transaction; committing every update on its own");
+    }
+    return status;
+}
+
+/*
+ * Set the savepoint of a zone, so that its updates can be undone without
+ * those of the rest of the batch.
+ *
+ * Returns 1 if the savepoint was set. If it was not, the updates of the
+ * zone can not be undone on their own, and end_zone() must not try.
+ */
+int begin_zone(DAEMONCONFIG *config, const char* zone_name)
+{
+    int depth = DbTransactionDepth();
+
+    if (DbBeginTransaction() != 0 || DbTransactionDepth() <= depth) {
+        log_msg(config, LOG_ERR, "Error starting a transaction for %s; its updates can not be undone", zone_name);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * End the savepoint of a zone (see begin_zone()). If keep is set, its
+ * updates go with the batch; otherwise they are undone and the signconf
+ * written for the zone is restored. Without a batch, the zone is
+ * committed on its own here.
+ *
+ * Returns 0 if the updates of the zone are kept, non-zero otherwise.
+ */
+int end_zone(DAEMONCONFIG *config, SIGNER_NOTIFY* notify, const char* zone_name, int zone_id, int savepoint, int keep)
+{
+    if (keep && savepoint && DbCommit() != 0) {
+        log_msg(config, LOG_ERR, "Error committing updates to the database for %s; they are lost", zone_name);
+        if (DbTransactionDepth() == 0) {
+            DbRollback();
+        }
+        keep = 0;
+        savepoint = 0;
+    }
+    if (!keep) {
+        if (savepoint) {
+            DbRollback();
+        }
+        signer_notify_rollback(notify, zone_id);
+        return 1;
+    }
+    if (DbTransactionDepth() == 0) {
+        signer_notify_commit(notify);
+    }
+    return 0;
+}
+
+/*
+ * Wait for the keys that are still being generated while a zone is in
+ * progress. The zone's work so far is kept and a new savepoint is set
+ * after the keys are stored, so that rolling back the rest of the zone
+ * cannot lose keys that exist in the repository.
+ */
+int collect_zone_keys(DAEMONCONFIG *config, KEYGEN_POOL* pool, const char* zone_name, int* savepoint)
+{
+    int count = 0;
+
+    if (*savepoint) {
+        DbCommit();
+    }
+    count = keygen_pool_collect(pool, config, 1);
+    if (*savepoint) {
+        *savepoint = begin_zone(config, zone_name);
+    }
+    return count;
+}
+
+int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy, KEYGEN_POOL* pool, SIGNER_NOTIFY* notify, const char* datetime)
 {
     int status = 0;
     int status2 = 0;
@@ -577,8 +699,12 @@ int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
     char* current_filename;
     char *tag_name = NULL;
     int zone_id = -1;
-    int signer_flag = 1; /* Is the signer responding? (1 == yes) */
-    char* ksk_expected = NULL;  /* When is the next ksk rollover expected? */
+    int savepoint = 0;          /* The zone can be undone on its own */
+    int zones_in_batch = 0;     /* Zones updated since the last commit */
+    int zones_done = 0;         /* Zones processed this run */
+    int zones_unchanged = 0;    /* ... of which the signconf was left alone */
+    int threads = config->workerThreads;
+    ZONE_POOL* zones = NULL;    /* Workers finishing the zones, if any */
 
     xmlChar *name_expr = (unsigned char*) "name";
     xmlChar *policy_expr = (unsigned char*) "//Zone/Policy";
@@ -586,10 +712,6 @@ int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
 
     char* temp_char = NULL;
 
-    /* Stuff to see if we need to log an "impending rollover" warning */
-    char* datetime = NULL;
-    int roll_time = 0;
-
     /* Let's find our zonelist from the conf.xml */
     if (config->configfile != NULL) {
         status = read_zonelist_filename(config->configfile, &zonelist_filename);
@@ -603,6 +725,18 @@ int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
         exit(1);
     }
 
+    /* Concurrent writers only wait for each other on SQLite */
+    if (threads > 1 && DbFlavour() == SQLITE_DB) {
+        log_msg(config, LOG_INFO, "WorkerThreads needs a MySQL database; doing the zones in one thread");
+        threads = 1;
+    }
+    if (threads > 1) {
+        zones = zone_pool_create(config, notify, datetime, threads);
+        if (zones == NULL) {
+            log_msg(config, LOG_ERR, "Could not start the zone workers; doing the zones in one thread");
+        }
+    }
+
     /* In case zonelist is huge use the XmlTextReader API so that we don't hold the whole file in memory */
     reader = xmlNewTextReaderFilename(zonelist_filename);
     if (reader != NULL) {
@@ -726,11 +860,23 @@ int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
                 log_msg(config, LOG_INFO, "Config will be output to %s.", current_filename);
                 xmlXPathFreeObject(xpathObj);
                 /* TODO should we check that we have not written to this file in this run?*/
+
+                /* Store the keys that have been generated in the meantime */
+                keygen_pool_collect(pool, config, 0);
+
+                /* The updates for this zone are undone if any step fails */
+                savepoint = begin_zone(config, zone_name);
+
                 /* Make sure that enough keys are allocated to this zone */
 
                 status2 = allocateKeysToZone(policy, KSM_TYPE_ZSK, zone_id, config->interval, zone_name, config->manualKeyGeneration, 0);
+                if (status2 == 2 && collect_zone_keys(config, pool, zone_name, &savepoint) > 0) {
+                    /* Not enough keys yet, but we were generating more */
+                    status2 = allocateKeysToZone(policy, KSM_TYPE_ZSK, zone_id, config->interval, zone_name, config->manualKeyGeneration, 0);
+                }
                 if (status2 != 0) {
                     log_msg(config, LOG_ERR, "Error allocating zsks to zone %s", zone_name);
+                    end_zone(config, notify, zone_name, zone_id, savepoint, 0);
                     /* Don't return? try to parse the rest of the zones? */
                     ret = xmlTextReaderRead(reader);
                     StrFree(tag_name);
@@ -739,8 +885,13 @@ int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
                     continue;
                 }
                 status2 = allocateKeysToZone(policy, KSM_TYPE_KSK, zone_id, config->interval, zone_name, config->manualKeyGeneration, policy->ksk->rollover_scheme);
+                if (status2 == 2 && collect_zone_keys(config, pool, zone_name, &savepoint) > 0) {
+                    /* Not enough keys yet, but we were generating more */
+                    status2 = allocateKeysToZone(policy, KSM_TYPE_KSK, zone_id, config->interval, zone_name, config->manualKeyGeneration, policy->ksk->rollover_scheme);
+                }
                 if (status2 != 0) {
                     log_msg(config, LOG_ERR, "Error allocating ksks to zone %s", zone_name);
+                    end_zone(config, notify, zone_name, zone_id, savepoint, 0);
                     /* Don't return? try to parse the rest of the zones? */
                     ret = xmlTextReaderRead(reader);
                     StrFree(tag_name);
@@ -749,59 +900,37 @@ int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
                     continue;
                 }
 
-                /* turn this zone and policy into a file */
-                status2 = commGenSignConf(zone_name, zone_id, current_filename, policy, &signer_flag, config->interval, config->manualKeyGeneration, config->DSSubmitCmd, config->DSSubCKA_ID);
-                if (status2 == -2) {
-                    log_msg(config, LOG_ERR, "Signconf not written for %s", zone_name);
-                    /* Don't return? try to parse the rest of the zones? */
-                    ret = xmlTextReaderRead(reader);
-                    StrFree(tag_name);
-                    StrFree(zone_name);
-                    StrFree(current_filename);
-                    continue;
-                }
-                else if (status2 != 0) {
-                    log_msg(config, LOG_ERR, "Error writing signconf for %s", zone_name);
-                    /* Don't return? try to parse the rest of the zones? */
-                    ret = xmlTextReaderRead(reader);
-                    StrFree(tag_name);
-                    StrFree(zone_name);
-                    StrFree(current_filename);
-                    continue;
-                }
-
-                /* See if we need to send a warning about an impending rollover */
-                if (config->rolloverNotify != -1) {
-                    datetime = DtParseDateTimeString("now");
+                /* The keys allocated to the zone are kept even if its
+                   signconf can not be written, whether a worker writes it
+                   or we do; the next run then tries the signconf again */
+                if (end_zone(config, notify, zone_name, zone_id, savepoint, 1) == 0) {
 
-                    /* Check datetime in case it came back NULL */
-                    if (datetime == NULL) {
-                        log_msg(config, LOG_ERR, "Couldn't turn \"now\" into a date, quiting...");
-                        unlink(config->pidfile);
-                        exit(1);
-                    }
-
-                    /* First the KSK */
-                    status2 = KsmCheckNextRollover(KSM_TYPE_KSK, zone_id, &ksk_expected);
-                    if (status2 == -1) {
-                        log_msg(config, LOG_INFO, "No active KSKs yet for zone %s, can't check for impending rollover", zone_name);
-                    }
-                    else if (status2 != 0) {
-                        log_msg(config, LOG_ERR, "Error checking for impending rollover for %s", zone_name);
-                        /* TODO should we quit or continue? */
-                    } else {
-                        status2 = DtDateDiff(ksk_expected, datetime, &roll_time);
-                        if (status2 != 0) {
-                            log_msg(config, LOG_ERR, "Error checking for impending rollover for %s", zone_name);
-                        } else {
-
-                            if (roll_time <= config->rolloverNotify) {
-                                log_msg(config, LOG_INFO, "Rollover of KSK expected at %s for %s", ksk_expected, zone_name);
+                    /* The rest of the zone is done by a worker when the
+                       batch has been committed, or else here */
+                    if (zones == NULL || zone_pool_submit(zones, zone_name, zone_id, policy, current_filename) != 0) {
+                        if (zones != NULL) {
+                            log_msg(config, LOG_ERR, "Could not hand zone %s to a worker; doing it in this thread", zone_name);
+                        }
+                        savepoint = begin_zone(config, zone_name);
+                        status2 = do_zone_signconf(config, policy, NULL, notify, datetime, zone_name, zone_id, current_filename);
+                        if (end_zone(config, notify, zone_name, zone_id, savepoint, status2 == 0 || status2 == 1) == 0) {
+                            zones_done++;
+                            if (status2 == 1) {
+                                zones_unchanged++;
                             }
                         }
-						StrFree(ksk_expected);
                     }
-                    StrFree(datetime);
+                }
+
+                /* Commit the batch, then have the workers finish its zones */
+                if (config->transactionBatch > 0 &&
+                        ++zones_in_batch >= config->transactionBatch) {
+                    if (commit_batch(config, notify, 1) != 0) {
+                        zone_pool_discard(zones);
+                    }
+                    zone_pool_run(zones);
+                    signer_notify_flush(notify);
+                    zones_in_batch = 0;
                 }
 
                 StrFree(current_filename);
@@ -819,19 +948,101 @@ int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy)
         log_msg(config, LOG_ERR, "Unable to open %s", zonelist_filename);
     }
 
+    /* The workers can only see the last batch once it is committed */
+    if (zones != NULL) {
+        if (commit_batch(config, notify, 1) != 0) {
+            zone_pool_discard(zones);
+        }
+        zone_pool_finish(zones, &zones_done, &zones_unchanged);
+    }
+
+    log_msg(config, LOG_INFO, "%d zones done, signconf of %d unchanged and skipped", zones_done, zones_unchanged);
+
     xmlFreeDoc(doc);
     StrFree(zonelist_filename);
 
     return status;
 }
 
+/*
+ * Write the signconf of a zone whose keys are allocated, and warn about an
+ * impending KSK rollover. This is the part of a zone that the zone workers
+ * do in parallel; ctx is the HSM context of the calling thread (NULL for
+ * the main one).
+ *
+ * Returns 0 on success, 1 if the signconf was up to date and non-zero
+ * otherwise (it has been logged); the caller rolls the zone back then.
+ */
+int do_zone_signconf(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx, SIGNER_NOTIFY* notify, const char* run_datetime, char* zone_name, int zone_id, char* current_filename)
+{
+    int status = 0;
+    int status2 = 0;
+    char* ksk_expected = NULL;  /* When is the next ksk rollover expected? */
+
+    /* Stuff to see if we need to log an "impending rollover" warning */
+    char* datetime = NULL;
+    int roll_time = 0;
+
+    /* turn this zone and policy into a file */
+    status = commGenSignConf(zone_name, zone_id, current_filename, policy, ctx, notify, run_datetime, config->interval, config->manualKeyGeneration, config->DSSubmitCmd, config->DSSubCKA_ID);
+    if (status == -2) {
+        log_msg(config, LOG_ERR, "Signconf not written for %s", zone_name);
+        return status;
+    }
+    else if (status == 1) {
+        log_msg(config, LOG_DEBUG, "Signconf for %s is up to date", zone_name);
+    }
+    else if (status != 0) {
+        log_msg(config, LOG_ERR, "Error writing signconf for %s", zone_name);
+        return status;
+    }
+
+    /* See if we need to send a warning about an impending rollover */
+    if (config->rolloverNotify != -1) {
+        datetime = DtParseDateTimeString("now");
+
+        /* Check datetime in case it came back NULL */
+        if (datetime == NULL) {
+            log_msg(config, LOG_ERR, "Couldn't turn \"now\" into a date, quiting...");
+            unlink(config->pidfile);
+            exit(1);
+        }
+
+        /* First the KSK */
+        status2 = KsmCheckNextRollover(KSM_TYPE_KSK, zone_id, &ksk_expected);
+        if (status2 == -1) {
+            log_msg(config, LOG_INFO, "No active KSKs yet for zone %s, can't check for impending rollover", zone_name);
+        }
+        else if (status2 != 0) {
+            log_msg(config, LOG_ERR, "Error checking for impending rollover for %s", zone_name);
+            /* TODO should we quit or continue? */
+        } else {
+            status2 = DtDateDiff(ksk_expected, datetime, &roll_time);
+            if (status2 != 0) {
+                log_msg(config, LOG_ERR, "Error checking for impending rollover for %s", zone_name);
+            } else {
+
+                if (roll_time <= config->rolloverNotify) {
+                    log_msg(config, LOG_INFO, "Rollover of KSK expected at %s for %s", ksk_expected, zone_name);
+                }
+            }
+            StrFree(ksk_expected);
+        }
+        StrFree(datetime);
+    }
+
+    return status;
+}
+
 /*
  *  generate the configuration file for the signer
 
  *  returns 0 on success and -1 if something went wrong
  *                           -2 if the RequestKeys call failed
+ *                            1 if nothing changed and the signconf was left
+ *                              alone
  */
-int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_POLICY *policy, int* signer_flag, int run_interval, int man_key_gen, const char* DSSubmitCmd, int DSSubCKA_ID)
+int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_POLICY *policy, hsm_ctx_t *ctx, SIGNER_NOTIFY* notify, const char* run_datetime, int run_interval, int man_key_gen, const char* DSSubmitCmd, int DSSubCKA_ID)
 {
     int status = 0;
     int status2 = 0;
@@ -844,9 +1055,22 @@ int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_PO
                                round potentially different behaviour of rename over existing
                                file.) */
     int     gencnt;         /* Number of keys in generate state */
-    char *signer_command;   /* how we will call the signer */
     int     NewDS = 0;      /* Did we change the DS Set in any way? */
-    char*   datetime = DtParseDateTimeString("now");
+    COMM_KEYS keys;         /* Keys that go into the signconf */
+    int     i;              /* Index into keys */
+    int     zone_policy_id = -1;    /* Policy of the zone in the database */
+    int     generation = 0;         /* Change generation of the zone */
+    int     written = 0;            /* Generation of the current signconf */
+    struct stat st;         /* To see if the current signconf exists */
+    char*   datetime = NULL;
+
+    /* Move the keys as of the time of the run, like the policy-wide pass
+       did for the zones it covered */
+    if (run_datetime != NULL) {
+        datetime = StrStrdup(run_datetime);
+    } else {
+        datetime = DtParseDateTimeString("now");
+    }
 
     /* Check datetime in case it came back NULL */
     if (datetime == NULL) {
@@ -862,6 +1086,77 @@ int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_PO
         return -1;
     }
 
+    keys.keys = NULL;
+    keys.count = 0;
+    keys.size = 0;
+
+    /* get new keys _only_ if we don't have them from before */
+    status = KsmRequestKeys(0, 0, datetime, commKeyCollect, &keys, policy->id, zone_id, run_interval, &NewDS);
+    if (status != 0) {
+        /* 
+         * Something went wrong (it should have been logged) stop this zone.
+         * Don't write a signconf, don't call the signer and move on to the
+         * next zone.
+         */
+        log_msg(NULL, LOG_ERR, "KsmRequestKeys returned: %d", status);
+
+        /* check for the specific case of not having any keys 
+           TODO check that this code can ever be executed after the restructure */
+        if (status == -1) {
+            status2 = KsmRequestGenerateCount(KSM_TYPE_KSK, &gencnt, zone_id);
+            if (status2 == 0 && gencnt == 0) {
+                if(man_key_gen == 1) {
+                    log_msg(NULL, LOG_ERR, "There are no KSKs in the generate state; please use \"ods-ksmutil key generate\" to create some.");
+                } else {
+                    log_msg(NULL, LOG_WARNING, "There are no KSKs in the generate state; ods-enforcerd will create some on its next run.");
+                }
+            }
+            else if (status2 == 0) {
+                status2 = KsmRequestGenerateCount(KSM_TYPE_ZSK, &gencnt, zone_id);
+                if (status2 == 0 && gencnt == 0) {
+                    if(man_key_gen == 1) {
+                        log_msg(NULL, LOG_ERR, "There are no ZSKs in the generate state; please use \"ods-ksmutil key generate\" to create some.");
+                    } else {
+                        log_msg(NULL, LOG_WARNING, "There are no ZSKs in the generate state; ods-enforcerd will create some on its next run.");
+                    }
+                }
+            }
+            else {
+                log_msg(NULL, LOG_ERR, "KsmRequestGenerateCount returned: %d", status2);
+            }
+        }
+
+        MemFree(keys.keys);
+        MemFree(datetime);
+
+        return -2;
+    }
+
+    /*
+     * Nothing that goes into the signconf has changed since it was last
+     * written (key states, policy, salt) and it is still there: leave it
+     * alone.  The generation is taken after KsmRequestKeys as that may
+     * have moved keys on.
+     */
+    status = KsmZoneGeneration(zone_id, &zone_policy_id, &generation, &written);
+    if (status != 0) {
+        log_msg(NULL, LOG_ERR, "Could not read the change generation of %s", zone_name);
+        MemFree(keys.keys);
+        MemFree(datetime);
+        return -1;
+    }
+    if (generation == written && zone_policy_id == policy->id &&
+            stat(current_filename, &st) == 0) {
+        MemFree(keys.keys);
+        MemFree(datetime);
+
+        if (NewDS == 1) {
+            log_msg(NULL, LOG_INFO, "DSChanged");
+            status = NewDSSet(zone_id, zone_name, ctx, DSSubmitCmd, DSSubCKA_ID);
+        }
+        return 1;
+    }
+
     old_filename = NULL;
     StrAppend(&old_filename, current_filename);
     StrAppend(&old_filename, ".OLD");
@@ -877,6 +1172,7 @@ int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_PO
         /* error */
         log_msg(NULL, LOG_ERR, "Could not open: %s (%s)", temp_filename,
 		strerror(errno));
+        MemFree(keys.keys);
         MemFree(datetime);
         StrFree(temp_filename);
         StrFree(old_filename);
@@ -929,49 +1225,10 @@ int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_PO
     fprintf(file, "\t\t<Keys>\n");
     fprintf(file, "\t\t\t<TTL>PT%dS</TTL>\n", policy->ksk->ttl);
 
-    /* get new keys _only_ if we don't have them from before */
-    status = KsmRequestKeys(0, 0, datetime, commKeyConfig, file, policy->id, zone_id, run_interval, &NewDS);
-    if (status != 0) {
-        /* 
-         * Something went wrong (it should have been logged) stop this zone.
-         * Clean up the files, don't call the signer and move on to the next zone.
-         */
-        log_msg(NULL, LOG_ERR, "KsmRequestKeys returned: %d", status);
-
-        /* check for the specific case of not having any keys 
-           TODO check that this code can ever be executed after the restructure */
-        if (status == -1) {
-            status2 = KsmRequestGenerateCount(KSM_TYPE_KSK, &gencnt, zone_id);
-            if (status2 == 0 && gencnt == 0) {
-                if(man_key_gen == 1) {
-                    log_msg(NULL, LOG_ERR, "There are no KSKs in the generate state; please use \"ods-ksmutil key generate\" to create some.");
-                } else {
-                    log_msg(NULL, LOG_WARNING, "There are no KSKs in the generate state; ods-enforcerd will create some on its next run.");
-                }
-            }
-            else if (status2 == 0) {
-                status2 = KsmRequestGenerateCount(KSM_TYPE_ZSK, &gencnt, zone_id);
-                if (status2 == 0 && gencnt == 0) {
-                    if(man_key_gen == 1) {
-                        log_msg(NULL, LOG_ERR, "There are no ZSKs in the generate state; please use \"ods-ksmutil key generate\" to create some.");
-                    } else {
-                        log_msg(NULL, LOG_WARNING, "There are no ZSKs in the generate state; ods-enforcerd will create some on its next run.");
-                    }
-                }
-            }
-            else {
-                log_msg(NULL, LOG_ERR, "KsmRequestGenerateCount returned: %d", status2);
-            }
-        }
-
-        status = fclose(file);
-        unlink(temp_filename);
-        MemFree(datetime);
-        StrFree(temp_filename);
-        StrFree(old_filename);
-
-        return -2;
+    for (i = 0; i < keys.count; i++) {
+        commKeyConfig(file, &keys.keys[i]);
     }
+    MemFree(keys.keys);
 
     fprintf(file, "\t\t</Keys>\n");
 
@@ -1099,30 +1356,9 @@ int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_PO
             return -1;
         }
 
-        if (*signer_flag == 1) {
-            /* call the signer engine to tell it that something changed */
-            /* TODO for beta version connect straight to the socket
-               should we make a blocking call on this?
-               should we call it here or after we have written all of the files?
-               have timeout if call is blocking */
-            signer_command = NULL;
-            StrAppend(&signer_command, SIGNER_CLI_UPDATE);
-            StrAppend(&signer_command, " ");
-            StrAppend(&signer_command, zone_name);
-
-            status = system(signer_command);
-            if (status != 0)
-            {
-                log_msg(NULL, LOG_ERR, "Could not call signer engine");
-                log_msg(NULL, LOG_INFO, "Will continue: call '%s' to manually update the zone", signer_command);
-                *signer_flag = 0;
-            }
-            else {
-                log_msg(NULL, LOG_INFO, "Called signer engine: %s", signer_command);
-            }
-
-            StrFree(signer_command);
-        }
+        /* Tell the signer engine that something changed once this is
+           committed; the zones are sent to it in batches */
+        signer_notify_zone(notify, zone_name, zone_id, current_filename, status == 0);
     }
     else {
         log_msg(NULL, LOG_INFO, "No change to: %s", current_filename);
@@ -1135,10 +1371,19 @@ int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_PO
         }
     }
 
+    /* The signconf is now up to date with this generation */
+    status = KsmZoneSetSignconfGeneration(zone_id, generation);
+    if (status != 0) {
+        log_msg(NULL, LOG_ERR, "Could not record the signconf generation of %s", zone_name);
+        StrFree(old_filename);
+        StrFree(temp_filename);
+        return -1;
+    }
+
     /* If the DS set changed then log/do something about it */
     if (NewDS == 1) {
         log_msg(NULL, LOG_INFO, "DSChanged");
-        status = NewDSSet(zone_id, zone_name, DSSubmitCmd, DSSubCKA_ID);
+        status = NewDSSet(zone_id, zone_name, ctx, DSSubmitCmd, DSSubCKA_ID);
     }
 
     StrFree(old_filename);
@@ -1178,6 +1423,24 @@ int commKeyConfig(void* context, KSM_KEYDATA* key_data)
     return 0;
 }
 
+/*
+ * CallBack to keep key info until we know whether the signerConfiguration
+ * needs writing
+ */
+
+int commKeyCollect(void* context, KSM_KEYDATA* key_data)
+{
+    COMM_KEYS *keys = (COMM_KEYS *)context;
+
+    if (keys->count == keys->size) {
+        keys->size = keys->size ? 2 * keys->size : 8;
+        keys->keys = MemRealloc(keys->keys, keys->size * sizeof(KSM_KEYDATA));
+    }
+    keys->keys[keys->count++] = *key_data;
+
+    return 0;
+}
+
 /* allocateKeysToZone
  *
  * Description:
@@ -1598,7 +1861,7 @@ int do_purge(int interval, int policy_id)
     return status;
 }
 
-int NewDSSet(int zone_id, const char* zone_name, const char* DSSubmitCmd, int DSSubCKA_ID) {
+int NewDSSet(int zone_id, const char* zone_name, hsm_ctx_t *ctx, const char* DSSubmitCmd, int DSSubCKA_ID) {
     int     where = 0;		/* for the SELECT statement */
     char*   sql = NULL;     /* SQL statement (when verifying) */
     char*   sql2 = NULL;    /* SQL statement (if getting DS) */
@@ -1790,7 +2053,7 @@ int NewDSSet(int zone_id, const char* zone_name, const char* DSSubmitCmd, int DS
         while (status == 0) {
 
             /* Code to output the DNSKEY record  (stolen from hsmutil) */
-            key = hsm_find_key_by_id(NULL, data3.location);
+            key = hsm_find_key_by_id(ctx, data3.location);
 
             if (!key) {
                 log_msg(NULL, LOG_ERR, "Key %s in DB but not repository.", data3.location);
@@ -1806,7 +2069,7 @@ int NewDSSet(int zone_id, const char* zone_name, const char* DSSubmitCmd, int DS
             sign_params->algorithm = data3.algorithm;
             sign_params->flags = LDNS_KEY_ZONE_KEY;
             sign_params->flags += LDNS_KEY_SEP_KEY;
-            dnskey_rr = hsm_get_dnskey(NULL, key, sign_params);
+            dnskey_rr = hsm_get_dnskey(ctx, key, sign_params);
 
 			/* Set TTL if we can find it; else leave it as the default */
 			/* We need a policy id */
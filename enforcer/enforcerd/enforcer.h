@@ -38,19 +38,34 @@
 
 #include "ksm/ksm.h"
 #include "libhsm.h"
+#include "keygen.h"
+#include "signer_notify.h"
+
+/* Keys collected for the signconf of a zone */
+typedef struct {
+    KSM_KEYDATA* keys;
+    int count;
+    int size;
+} COMM_KEYS;
 
 int server_init(DAEMONCONFIG *config);
 void server_main(DAEMONCONFIG *config);
 
-int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx);
-int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy);
+int do_keygen(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx, KEYGEN_POOL* pool);
+int do_communication(DAEMONCONFIG *config, KSM_POLICY* policy, KEYGEN_POOL* pool, SIGNER_NOTIFY* notify, const char* datetime);
+int commit_batch(DAEMONCONFIG *config, SIGNER_NOTIFY* notify, int next);
+int begin_zone(DAEMONCONFIG *config, const char* zone_name);
+int end_zone(DAEMONCONFIG *config, SIGNER_NOTIFY* notify, const char* zone_name, int zone_id, int savepoint, int keep);
+int collect_zone_keys(DAEMONCONFIG *config, KEYGEN_POOL* pool, const char* zone_name, int* savepoint);
 
-int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_POLICY *policy, int* signer_flag, int run_interval, int man_key_gen, const char* DSSubmitCmd, int DSSubCKA_ID);
+int do_zone_signconf(DAEMONCONFIG *config, KSM_POLICY* policy, hsm_ctx_t *ctx, SIGNER_NOTIFY* notify, const char* run_datetime, char* zone_name, int zone_id, char* current_filename);
+int commGenSignConf(char* zone_name, int zone_id, char* current_filename, KSM_POLICY *policy, hsm_ctx_t *ctx, SIGNER_NOTIFY* notify, const char* run_datetime, int run_interval, int man_key_gen, const char* DSSubmitCmd, int DSSubCKA_ID);
 int commKeyConfig(void* context, KSM_KEYDATA* key_data);
+int commKeyCollect(void* context, KSM_KEYDATA* key_data);
 int allocateKeysToZone(KSM_POLICY *policy, int key_type, int zone_id, uint16_t interval, const char* zone_name, int man_key_gen, int rollover_scheme);
 int read_zonelist_filename(const char* filename, char** zone_list_filename);
 int do_purge(int interval, int policy_id);
-int NewDSSet(int zone_id, const char* zone_name, const char* DSSubmitCmd, int DSSubCKA_ID);
+int NewDSSet(int zone_id, const char* zone_name, hsm_ctx_t *ctx, const char* DSSubmitCmd, int DSSubCKA_ID);
 void check_hsm_connection(hsm_ctx_t **ctx, DAEMONCONFIG *config);
 
 #endif /* ENFORCER_H */
@@ -0,0 +1,461 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * keygen.c: background key generation for the enforcer
+ *
+ * do_keygen() queues the keys that a policy needs, and the workers of
+ * the repository generate them, each in its own HSM session. The
+ * enforcer stores whatever has been generated in one transaction
+ * whenever it calls keygen_pool_collect(), in between zones and at the
+ * end of the run.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include <libxml/parser.h>
+#include <libxml/tree.h>
+#include <libxml/xpath.h>
+
+#include "daemon.h"
+#include "daemon_util.h"
+#include "keygen.h"
+
+#include "ksm/ksm.h"
+#include "ksm/database.h"
+#include "ksm/string_util.h"
+#include "ksm/string_util2.h"
+
+#include "libhsm.h"
+
+static KEYGEN_REPO*
+keygen_repo_add(KEYGEN_POOL* pool, const char* name, int threads)
+{
+    KEYGEN_REPO* repo = NULL;
+
+    repo = (KEYGEN_REPO*) calloc(1, sizeof(KEYGEN_REPO));
+    if (repo == NULL) {
+        return NULL;
+    }
+    repo->workers = (KEYGEN_WORKER*) calloc(threads, sizeof(KEYGEN_WORKER));
+    if (repo->workers == NULL) {
+        free(repo);
+        return NULL;
+    }
+    repo->pool = pool;
+    repo->name = StrStrdup(name);
+    repo->threads = threads;
+    repo->queue_tail = &repo->queue;
+    repo->next = pool->repos;
+    pool->repos = repo;
+    return repo;
+}
+
+static KEYGEN_REPO*
+keygen_repo_find(KEYGEN_POOL* pool, const char* name)
+{
+    KEYGEN_REPO* repo = NULL;
+
+    for (repo = pool->repos; repo != NULL; repo = repo->next) {
+        if (strcmp(repo->name, name) == 0) {
+            return repo;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Read <KeyGenerationThreads> of each repository from conf.xml
+ */
+static void
+keygen_read_threads(KEYGEN_POOL* pool, DAEMONCONFIG *config)
+{
+    xmlDocPtr doc = NULL;
+    xmlXPathContextPtr xpathCtx = NULL;
+    xmlXPathObjectPtr xpathObj = NULL;
+    xmlNodePtr curNode = NULL;
+    xmlChar *repo_expr = (unsigned char*) "//Configuration/RepositoryList/Repository";
+    xmlChar *name = NULL;
+    char* temp_char = NULL;
+    int threads;
+    int i;
+
+    doc = xmlParseFile(config->configfile ? config->configfile : OPENDNSSEC_CONFIG_FILE);
+    if (doc == NULL) {
+        /* ReadConfig() has already complained */
+        return;
+    }
+    xpathCtx = xmlXPathNewContext(doc);
+    if (xpathCtx != NULL) {
+        xpathObj = xmlXPathEvalExpression(repo_expr, xpathCtx);
+    }
+    if (xpathObj != NULL && xpathObj->nodesetval != NULL) {
+        for (i = 0; i < xpathObj->nodesetval->nodeNr; i++) {
+            name = xmlGetProp(xpathObj->nodesetval->nodeTab[i], (const xmlChar *)"name");
+            if (name == NULL) {
+                continue;
+            }
+            threads = KEYGEN_DEFAULT_THREADS;
+            for (curNode = xpathObj->nodesetval->nodeTab[i]->children; curNode; curNode = curNode->next) {
+                if (xmlStrEqual(curNode->name, (const xmlChar *)"KeyGenerationThreads")) {
+                    temp_char = (char *) xmlNodeGetContent(curNode);
+                    threads = atoi(temp_char);
+                    StrFree(temp_char);
+                }
+            }
+            if (threads < 1) {
+                threads = KEYGEN_DEFAULT_THREADS;
+            }
+            if (keygen_repo_find(pool, (char*) name) == NULL &&
+                keygen_repo_add(pool, (char*) name, threads) == NULL) {
+                log_msg(config, LOG_ERR, "Malloc for key generation of repository %s failed", (char*) name);
+            }
+            xmlFree(name);
+        }
+    }
+    if (xpathObj) {
+        xmlXPathFreeObject(xpathObj);
+    }
+    if (xpathCtx) {
+        xmlXPathFreeContext(xpathCtx);
+    }
+    xmlFreeDoc(doc);
+}
+
+KEYGEN_POOL*
+keygen_pool_create(DAEMONCONFIG *config)
+{
+    KEYGEN_POOL* pool = NULL;
+
+    pool = (KEYGEN_POOL*) calloc(1, sizeof(KEYGEN_POOL));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->done_tail = &pool->done_jobs;
+    keygen_read_threads(pool, config);
+    return pool;
+}
+
+static void
+keygen_job_free(KEYGEN_JOB* job)
+{
+    StrFree(job->generate);
+    StrFree(job->id);
+    StrFree(job->error);
+    free(job);
+}
+
+/*
+ * Worker: generate the keys queued for its repository until the pool
+ * is stopped
+ */
+static void*
+keygen_worker(void* arg)
+{
+    KEYGEN_WORKER* worker = (KEYGEN_WORKER*) arg;
+    KEYGEN_REPO* repo = worker->repo;
+    KEYGEN_POOL* pool = repo->pool;
+    KEYGEN_JOB* job = NULL;
+    hsm_key_t *key = NULL;
+    char *id = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (repo->queue == NULL && !pool->stop) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (repo->queue == NULL) {
+            break;
+        }
+        job = repo->queue;
+        repo->queue = job->next;
+        if (repo->queue == NULL) {
+            repo->queue_tail = &repo->queue;
+        }
+        job->next = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        /* NOTE: for now we know that libhsm only supports RSA keys */
+        key = hsm_generate_rsa_key(worker->ctx, repo->name, job->bits);
+        if (key) {
+            id = hsm_get_key_id(worker->ctx, key);
+            hsm_key_free(key);
+            job->id = StrStrdup(id);
+            free(id);
+        } else {
+            job->error = hsm_get_error(worker->ctx);
+            if (job->error == NULL) {
+                job->error = StrStrdup("unknown HSM error");
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        repo->pending--;
+        pool->pending--;
+        *pool->done_tail = job;
+        pool->done_tail = &job->next;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * Queue a key for generation. Workers are started as keys come in, up
+ * to the number configured for the repository.
+ *
+ * Returns 0 on success, non-zero if the key could not be queued.
+ */
+int
+keygen_pool_submit(KEYGEN_POOL* pool, const char* repository, int policy_id, int keytype, int sm, int bits, int algorithm, const char* generate)
+{
+    KEYGEN_REPO* repo = NULL;
+    KEYGEN_WORKER* worker = NULL;
+    KEYGEN_JOB* job = NULL;
+    int pending = 0;
+
+    if (pool == NULL || repository == NULL) {
+        return 1;
+    }
+    repo = keygen_repo_find(pool, repository);
+    if (repo == NULL) {
+        repo = keygen_repo_add(pool, repository, KEYGEN_DEFAULT_THREADS);
+        if (repo == NULL) {
+            log_msg(NULL, LOG_ERR, "Malloc for key generation of repository %s failed", repository);
+            return 1;
+        }
+    }
+
+    /* Start another worker if there is more work than workers */
+    pthread_mutex_lock(&pool->lock);
+    pending = repo->pending;
+    pthread_mutex_unlock(&pool->lock);
+    if (repo->started < repo->threads && repo->started <= pending) {
+        worker = &repo->workers[repo->started];
+        worker->repo = repo;
+        worker->ctx = hsm_create_context();
+        if (worker->ctx == NULL) {
+            log_msg(NULL, LOG_ERR, "Could not create an HSM context for key generation in repository %s", repository);
+        } else if (pthread_create(&worker->thread, NULL, keygen_worker, worker) != 0) {
+            log_msg(NULL, LOG_ERR, "Could not start key generation thread for repository %s", repository);
+            hsm_destroy_context(worker->ctx);
+            worker->ctx = NULL;
+        } else {
+            repo->started++;
+        }
+        if (repo->started == 0) {
+            return 1;
+        }
+    }
+
+    job = (KEYGEN_JOB*) calloc(1, sizeof(KEYGEN_JOB));
+    if (job == NULL) {
+        log_msg(NULL, LOG_ERR, "Malloc for key generation job failed");
+        return 1;
+    }
+    job->repo = repo;
+    job->policy_id = policy_id;
+    job->keytype = keytype;
+    job->sm = sm;
+    job->bits = bits;
+    job->algorithm = algorithm;
+    job->generate = StrStrdup(generate);
+
+    pthread_mutex_lock(&pool->lock);
+    *repo->queue_tail = job;
+    repo->queue_tail = &job->next;
+    repo->pending++;
+    pool->pending++;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/*
+ * Number of keys queued or being generated in a repository. These are
+ * not in the HSM yet, but count against its capacity.
+ */
+int
+keygen_pool_pending(KEYGEN_POOL* pool, const char* repository)
+{
+    KEYGEN_REPO* repo = NULL;
+    int pending = 0;
+
+    if (pool == NULL || repository == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&pool->lock);
+    repo = keygen_repo_find(pool, repository);
+    if (repo != NULL) {
+        pending = repo->pending;
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return pending;
+}
+
+/*
+ * Store the keys that have been generated so far in the database, in
+ * one transaction (nested in the transaction of the run, if there is one).
+ * If wait is set, wait until all queued keys have been generated first.
+ * As before, a failure to create a key exits the enforcer; the keys that
+ * did get created are committed first, so they do not go missing from the
+ * database while they exist in the repository.
+ *
+ * Returns the number of keys stored.
+ */
+int
+keygen_pool_collect(KEYGEN_POOL* pool, DAEMONCONFIG *config, int wait)
+{
+    KEYGEN_JOB* jobs = NULL;
+    KEYGEN_JOB* job = NULL;
+    KEYGEN_JOB* failed = NULL;
+    DB_ID ignore = 0;
+    int status = 0;
+    int count = 0;
+
+    if (pool == NULL) {
+        return 0;
+    }
+    pthread_mutex_lock(&pool->lock);
+    if (wait && pool->pending > 0) {
+        log_msg(config, LOG_INFO, "Waiting for %d keys to be generated...", pool->pending);
+        while (pool->pending > 0) {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+    }
+    jobs = pool->done_jobs;
+    pool->done_jobs = NULL;
+    pool->done_tail = &pool->done_jobs;
+    pthread_mutex_unlock(&pool->lock);
+
+    if (jobs == NULL) {
+        return 0;
+    }
+
+    status = DbBeginTransaction();
+    for (job = jobs; job != NULL && status == 0; job = job->next) {
+        if (job->error) {
+            if (failed == NULL) {
+                failed = job;
+            }
+            continue;
+        }
+        status = KsmKeyPairCreate(job->policy_id, job->id, job->sm, job->bits, job->algorithm, job->generate, &ignore);
+        if (status != 0) {
+            break;
+        }
+        count++;
+    }
+    if (status == 0) {
+        status = DbCommit();
+    } else {
+        DbRollback();
+    }
+    if (status != 0) {
+        log_msg(config, LOG_ERR,"Error creating key in Database");
+        unlink(config->pidfile);
+        exit(1);
+    }
+
+    for (job = jobs; job != NULL; job = job->next) {
+        if (job->id) {
+            log_msg(config, LOG_INFO, "Created %s size: %i, alg: %i with id: %s in repository: %s and database.",
+                (job->keytype == KSM_TYPE_KSK ? "KSK" : "ZSK"), job->bits,
+                job->algorithm, job->id, job->repo->name);
+        }
+    }
+    if (failed) {
+        log_msg(config, LOG_ERR, "Error creating key in repository %s", failed->repo->name);
+        log_msg(config, LOG_ERR, "%s", failed->error);
+        while (DbTransactionDepth() > 0) {
+            DbCommit();
+        }
+        unlink(config->pidfile);
+        exit(1);
+    }
+
+    while (jobs) {
+        job = jobs;
+        jobs = job->next;
+        keygen_job_free(job);
+    }
+    return count;
+}
+
+/*
+ * Stop the workers and release the pool. Keys that were generated but
+ * not collected are forgotten, call keygen_pool_collect() first.
+ */
+void
+keygen_pool_destroy(KEYGEN_POOL* pool)
+{
+    KEYGEN_REPO* repo = NULL;
+    KEYGEN_JOB* job = NULL;
+    int i;
+
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    while (pool->repos) {
+        repo = pool->repos;
+        pool->repos = repo->next;
+        for (i = 0; i < repo->started; i++) {
+            pthread_join(repo->workers[i].thread, NULL);
+            hsm_destroy_context(repo->workers[i].ctx);
+        }
+        while (repo->queue) {
+            job = repo->queue;
+            repo->queue = job->next;
+            keygen_job_free(job);
+        }
+        free(repo->workers);
+        StrFree(repo->name);
+        free(repo);
+    }
+    while (pool->done_jobs) {
+        job = pool->done_jobs;
+        pool->done_jobs = job->next;
+        keygen_job_free(job);
+    }
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
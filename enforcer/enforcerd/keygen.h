@@ -0,0 +1,101 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef KEYGEN_H
+#define KEYGEN_H
+
+/*
+ * keygen.h: background key generation for the enforcer
+ *
+ * Keys are generated by a pool of threads, each with its own HSM
+ * context, while the enforcer carries on with the zones. The enforcer
+ * stores the generated keys in the database in batches.
+ */
+
+#include <pthread.h>
+
+#include "daemon.h"
+#include "libhsm.h"
+
+/* Number of keys generated at the same time in a repository, unless
+   <KeyGenerationThreads> says otherwise */
+#define KEYGEN_DEFAULT_THREADS 1
+
+/* A key to generate, and the result */
+typedef struct keygen_job {
+    struct keygen_job* next;
+    struct keygen_repo* repo;
+    int policy_id;
+    int keytype;        /* KSM_TYPE_KSK or KSM_TYPE_ZSK */
+    int sm;
+    int bits;
+    int algorithm;
+    char* generate;     /* generate time of the key */
+    char* id;           /* CKA_ID of the new key */
+    char* error;        /* HSM error message, if generation failed */
+} KEYGEN_JOB;
+
+/* A thread generating keys in one repository */
+typedef struct keygen_worker {
+    struct keygen_repo* repo;
+    hsm_ctx_t* ctx;
+    pthread_t thread;
+} KEYGEN_WORKER;
+
+/* Key generation in one repository */
+typedef struct keygen_repo {
+    struct keygen_repo* next;
+    struct keygen_pool* pool;
+    char* name;
+    int threads;            /* maximum number of workers */
+    int started;            /* number of workers running */
+    KEYGEN_WORKER* workers;
+    int pending;            /* keys queued or being generated */
+    KEYGEN_JOB* queue;
+    KEYGEN_JOB** queue_tail;
+} KEYGEN_REPO;
+
+/* All key generation of one enforcer run */
+typedef struct keygen_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* a key was queued, or the pool stops */
+    pthread_cond_t done;    /* a key was generated */
+    KEYGEN_REPO* repos;
+    int pending;            /* keys queued or being generated */
+    KEYGEN_JOB* done_jobs;  /* generated but not yet stored */
+    KEYGEN_JOB** done_tail;
+    int stop;
+} KEYGEN_POOL;
+
+KEYGEN_POOL* keygen_pool_create(DAEMONCONFIG *config);
+int keygen_pool_submit(KEYGEN_POOL* pool, const char* repository, int policy_id, int keytype, int sm, int bits, int algorithm, const char* generate);
+int keygen_pool_pending(KEYGEN_POOL* pool, const char* repository);
+int keygen_pool_collect(KEYGEN_POOL* pool, DAEMONCONFIG *config, int wait);
+void keygen_pool_destroy(KEYGEN_POOL* pool);
+
+#endif /* KEYGEN_H */
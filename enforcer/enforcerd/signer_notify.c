@@ -0,0 +1,407 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+/*
+ * signer_notify.c: tell the signer engine which signconfs changed
+ *
+ * commGenSignConf() adds every zone whose signconf it rewrote. The zone
+ * goes into the command when its transaction has been committed, and the
+ * command is sent whenever the next zone would not fit in it, when a
+ * batch of zones has been committed and at the end of the run. The
+ * signer answers every command with its prompt, so we wait for that
+ * before sending the next one.
+ */
+
+#include "config.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/un.h>
+
+#include "daemon.h"
+#include "daemon_util.h"
+#include "signer_notify.h"
+
+#include "ksm/memory.h"
+#include "ksm/string_util.h"
+#include "ksm/string_util2.h"
+
+#define NOTIFY_COMMAND "update zones "
+#define NOTIFY_PROMPT "\ncmd> "
+#define NOTIFY_PROMPT_LEN 6
+
+static int
+notify_connect(SIGNER_NOTIFY* notify)
+{
+    struct sockaddr_un servaddr;
+
+    notify->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (notify->fd < 0) {
+        return -1;
+    }
+    memset(&servaddr, 0, sizeof(servaddr));
+    servaddr.sun_family = AF_UNIX;
+    strncpy(servaddr.sun_path, notify->sockfile, sizeof(servaddr.sun_path) - 1);
+    if (connect(notify->fd, (const struct sockaddr*) &servaddr, sizeof(servaddr)) != 0) {
+        close(notify->fd);
+        notify->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+static void
+notify_disconnect(SIGNER_NOTIFY* notify)
+{
+    if (notify->fd >= 0) {
+        close(notify->fd);
+        notify->fd = -1;
+    }
+}
+
+/* Send the command and wait until the signer engine has handled it */
+static int
+notify_send(SIGNER_NOTIFY* notify)
+{
+    char buf[ODS_SE_MAXLINE];
+    char tail[NOTIFY_PROMPT_LEN];
+    size_t done = 0;
+    size_t have = 0;
+    ssize_t n = 0;
+    fd_set rset;
+    struct timeval tv;
+
+    while (done < notify->len) {
+        n = write(notify->fd, notify->buf + done, notify->len - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += n;
+    }
+
+    /* The answer ends with the prompt */
+    while (have < NOTIFY_PROMPT_LEN || memcmp(tail, NOTIFY_PROMPT, NOTIFY_PROMPT_LEN) != 0) {
+        FD_ZERO(&rset);
+        FD_SET(notify->fd, &rset);
+        tv.tv_sec = SIGNER_NOTIFY_TIMEOUT;
+        tv.tv_usec = 0;
+        n = select(notify->fd + 1, &rset, NULL, NULL, &tv);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            errno = ETIMEDOUT;
+            return -1;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        n = read(notify->fd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n == 0) {
+            errno = ECONNRESET;
+            return -1;
+        }
+        if (n < 0) {
+            return -1;
+        }
+        if (n >= NOTIFY_PROMPT_LEN) {
+            memcpy(tail, buf + n - NOTIFY_PROMPT_LEN, NOTIFY_PROMPT_LEN);
+        } else {
+            memmove(tail, tail + n, NOTIFY_PROMPT_LEN - n);
+            memcpy(tail + NOTIFY_PROMPT_LEN - n, buf, n);
+        }
+        have += n;
+    }
+    return 0;
+}
+
+/*
+ * Send the zones collected so far to the signer engine. A connection
+ * left over from an earlier run may have been closed by the signer in
+ * the meantime, so we try again once on a new connection.
+ *
+ * Returns 0 on success, -1 if the signer could not be told.
+ */
+static int
+notify_flush(SIGNER_NOTIFY* notify)
+{
+    int status = -1;
+    int attempt;
+
+    if (notify->zones == 0) {
+        return 0;
+    }
+
+    if (notify->failed == 0) {
+        notify->buf[notify->len++] = '\n';
+        for (attempt = 0; attempt < 2 && status != 0; attempt++) {
+            if (notify->fd < 0 && notify_connect(notify) != 0) {
+                break;
+            }
+            status = notify_send(notify);
+            if (status != 0) {
+                notify_disconnect(notify);
+            }
+        }
+        notify->buf[--notify->len] = '\0';
+        if (status == 0) {
+            log_msg(NULL, LOG_INFO, "Called signer engine: %s", notify->buf);
+        } else {
+            log_msg(NULL, LOG_ERR, "Could not call signer engine: %s", strerror(errno));
+            notify->failed = 1;
+        }
+    }
+    if (status != 0) {
+        log_msg(NULL, LOG_INFO, "Will continue: call '%s zones %s' to manually update the zones", SIGNER_CLI_UPDATE, notify->buf + strlen(NOTIFY_COMMAND));
+    }
+
+    notify->len = 0;
+    notify->zones = 0;
+    return status;
+}
+
+SIGNER_NOTIFY*
+signer_notify_create(const char* sockfile)
+{
+    SIGNER_NOTIFY* notify = NULL;
+
+    notify = (SIGNER_NOTIFY*) calloc(1, sizeof(SIGNER_NOTIFY));
+    if (notify == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&notify->lock, NULL);
+    notify->sockfile = StrStrdup(sockfile);
+    notify->fd = -1;
+    return notify;
+}
+
+static void
+notify_zone_free(SIGNER_NOTIFY_ZONE* zone)
+{
+    StrFree(zone->zone_name);
+    StrFree(zone->filename);
+    free(zone);
+}
+
+/*
+ * Add a zone to the command, sending the command first if the zone does
+ * not fit in it any more. The notifier must be locked.
+ */
+static void
+notify_add(SIGNER_NOTIFY* notify, const char* zone_name)
+{
+    size_t len = strlen(zone_name);
+
+    /* Room for the comma and the newline at the end */
+    if (notify->zones > 0 && notify->len + len + 2 > ODS_SE_MAXLINE) {
+        notify_flush(notify);
+    }
+    if (notify->zones == 0) {
+        strcpy(notify->buf, NOTIFY_COMMAND);
+        notify->len = strlen(NOTIFY_COMMAND);
+    } else {
+        notify->buf[notify->len++] = ',';
+    }
+    if (notify->len + len + 1 > ODS_SE_MAXLINE) {
+        /* A zone name never gets this long */
+        log_msg(NULL, LOG_ERR, "Zone name %s too long to notify the signer engine", zone_name);
+        if (notify->zones == 0) {
+            notify->len = 0;
+        } else {
+            notify->len--;
+        }
+        return;
+    }
+    memcpy(notify->buf + notify->len, zone_name, len);
+    notify->len += len;
+    notify->buf[notify->len] = '\0';
+    notify->zones++;
+}
+
+/*
+ * Put the previous signconf of a zone back, or remove the signconf if
+ * there was none, so that the next run writes it again.
+ */
+static void
+notify_restore(SIGNER_NOTIFY_ZONE* zone)
+{
+    char* old_filename = NULL;
+
+    if (zone->had_old) {
+        StrAppend(&old_filename, zone->filename);
+        StrAppend(&old_filename, ".OLD");
+        if (rename(old_filename, zone->filename) != 0) {
+            log_msg(NULL, LOG_ERR, "Could not rename: %s -> %s", old_filename, zone->filename);
+        } else {
+            log_msg(NULL, LOG_INFO, "Restored the previous signconf of %s", zone->zone_name);
+        }
+        StrFree(old_filename);
+    } else if (remove(zone->filename) != 0) {
+        log_msg(NULL, LOG_ERR, "Could not remove: %s", zone->filename);
+    } else {
+        log_msg(NULL, LOG_INFO, "Removed the signconf of %s", zone->zone_name);
+    }
+}
+
+/*
+ * Remember that the signconf of a zone was rewritten in the transaction
+ * of the calling thread. had_old is set if the previous signconf was
+ * moved to <filename>.OLD.
+ */
+void
+signer_notify_zone(SIGNER_NOTIFY* notify, const char* zone_name, int zone_id, const char* filename, int had_old)
+{
+    SIGNER_NOTIFY_ZONE* zone = NULL;
+
+    zone = (SIGNER_NOTIFY_ZONE*) calloc(1, sizeof(SIGNER_NOTIFY_ZONE));
+    if (zone == NULL) {
+        /* Better to tell the signer too early than never */
+        log_msg(NULL, LOG_ERR, "Malloc for signer engine notification of %s failed", zone_name);
+        pthread_mutex_lock(&notify->lock);
+        notify_add(notify, zone_name);
+        pthread_mutex_unlock(&notify->lock);
+        return;
+    }
+    zone->owner = pthread_self();
+    zone->zone_id = zone_id;
+    zone->zone_name = StrStrdup(zone_name);
+    zone->filename = StrStrdup(filename);
+    zone->had_old = had_old;
+
+    pthread_mutex_lock(&notify->lock);
+    zone->next = notify->pending;
+    notify->pending = zone;
+    pthread_mutex_unlock(&notify->lock);
+}
+
+/*
+ * The transaction of the calling thread has been committed: its pending
+ * zones go into the command, in the order they were written.
+ */
+void
+signer_notify_commit(SIGNER_NOTIFY* notify)
+{
+    SIGNER_NOTIFY_ZONE** prev = NULL;
+    SIGNER_NOTIFY_ZONE* zone = NULL;
+    SIGNER_NOTIFY_ZONE* committed = NULL;
+
+    pthread_mutex_lock(&notify->lock);
+    prev = &notify->pending;
+    while ((zone = *prev) != NULL) {
+        if (pthread_equal(zone->owner, pthread_self())) {
+            *prev = zone->next;
+            /* pending is newest first, so this restores the order */
+            zone->next = committed;
+            committed = zone;
+        } else {
+            prev = &zone->next;
+        }
+    }
+    while ((zone = committed) != NULL) {
+        committed = zone->next;
+        notify_add(notify, zone->zone_name);
+        notify_zone_free(zone);
+    }
+    pthread_mutex_unlock(&notify->lock);
+}
+
+/*
+ * The transaction of the calling thread has been rolled back: restore the
+ * signconfs written in it, of all zones or only of zone_id. The signer is
+ * not told about them.
+ */
+void
+signer_notify_rollback(SIGNER_NOTIFY* notify, int zone_id)
+{
+    SIGNER_NOTIFY_ZONE** prev = NULL;
+    SIGNER_NOTIFY_ZONE* zone = NULL;
+
+    pthread_mutex_lock(&notify->lock);
+    prev = &notify->pending;
+    while ((zone = *prev) != NULL) {
+        if (pthread_equal(zone->owner, pthread_self()) &&
+                (zone_id == -1 || zone->zone_id == zone_id)) {
+            *prev = zone->next;
+            notify_restore(zone);
+            notify_zone_free(zone);
+        } else {
+            prev = &zone->next;
+        }
+    }
+    pthread_mutex_unlock(&notify->lock);
+}
+
+/*
+ * Send the zones collected so far to the signer engine.
+ *
+ * Returns 0 on success, -1 if the signer could not be told.
+ */
+int
+signer_notify_flush(SIGNER_NOTIFY* notify)
+{
+    int status = 0;
+
+    pthread_mutex_lock(&notify->lock);
+    status = notify_flush(notify);
+    pthread_mutex_unlock(&notify->lock);
+    return status;
+}
+
+
+void
+signer_notify_destroy(SIGNER_NOTIFY* notify)
+{
+    SIGNER_NOTIFY_ZONE* zone = NULL;
+
+    if (notify == NULL) {
+        return;
+    }
+    while ((zone = notify->pending) != NULL) {
+        notify->pending = zone->next;
+        notify_zone_free(zone);
+    }
+    notify_disconnect(notify);
+    StrFree(notify->sockfile);
+    pthread_mutex_destroy(&notify->lock);
+    free(notify);
+}
@@ -0,0 +1,84 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#ifndef SIGNER_NOTIFY_H
+#define SIGNER_NOTIFY_H
+
+/*
+ * signer_notify.h: tell the signer engine which signconfs changed
+ *
+ * The zones are sent over the command socket of the signer in batches,
+ * as "update zones <zone>,<zone>,...". The connection is kept open
+ * between runs of the enforcer. The zone worker threads share one
+ * notifier.
+ *
+ * A signconf is only announced once the transaction it was written in
+ * has been committed. Until then it is pending for the thread that wrote
+ * it; if the transaction is rolled back, the previous signconf is put
+ * back, so that the signer never sees a signconf that the database does
+ * not know about.
+ */
+
+#include "config.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+/* Seconds to wait for the signer engine to answer */
+#define SIGNER_NOTIFY_TIMEOUT 300
+
+/* A signconf written in a transaction that is not committed yet */
+typedef struct signer_notify_zone {
+    struct signer_notify_zone* next;
+    pthread_t owner;                /* thread of the transaction */
+    int zone_id;
+    char* zone_name;
+    char* filename;                 /* signconf */
+    int had_old;                    /* previous signconf kept as .OLD */
+} SIGNER_NOTIFY_ZONE;
+
+typedef struct signer_notify {
+    pthread_mutex_t lock;
+    SIGNER_NOTIFY_ZONE* pending;     /* newest first */
+    char* sockfile;
+    int fd;                         /* -1 if not connected */
+    char buf[ODS_SE_MAXLINE + 1];   /* the command being built */
+    size_t len;
+    int zones;                      /* zones in the command */
+    int failed;                     /* signer not reachable this run */
+} SIGNER_NOTIFY;
+
+SIGNER_NOTIFY* signer_notify_create(const char* sockfile);
+void signer_notify_zone(SIGNER_NOTIFY* notify, const char* zone_name, int zone_id, const char* filename, int had_old);
+void signer_notify_commit(SIGNER_NOTIFY* notify);
+void signer_notify_rollback(SIGNER_NOTIFY* notify, int zone_id);
+int signer_notify_flush(SIGNER_NOTIFY* notify);
+void signer_notify_destroy(SIGNER_NOTIFY* notify);
+
+#endif /* SIGNER_NOTIFY_H */
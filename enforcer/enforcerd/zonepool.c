@@ -0,0 +1,365 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*
+ * zonepool.c: finish zones in parallel worker threads
+ *
+ * do_communication() submits every zone once its keys are allocated;
+ * the zones are held until the batch they are in has been committed, so
+ * that the workers see the keys. The workers then finish the batch while
+ * the enforcer waits, so that no key is allocated while zones that may
+ * share it are moved on.
+ *
+ * Zones that share keys change the same key rows, so they all go to the
+ * same worker; otherwise the zone itself decides. A worker does its zones
+ * in the order they were submitted, each in a transaction of its own, so
+ * the result does not depend on the number of workers. A zone whose
+ * signconf fails keeps the keys allocated to it in the batch; without
+ * workers that is the same.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "daemon.h"
+#include "daemon_util.h"
+#include "enforcer.h"
+#include "kaspaccess.h"
+#include "zonepool.h"
+
+#include "ksm/ksm.h"
+#include "ksm/database.h"
+#include "ksm/string_util.h"
+
+#include "libhsm.h"
+
+static void
+zone_job_free(ZONE_JOB* job)
+{
+    StrFree(job->zone_name);
+    StrFree(job->policy_name);
+    StrFree(job->filename);
+    free(job);
+}
+
+/*
+ * Finish a zone with the database connection and HSM context of the
+ * worker. The policy is read again whenever the zone has another one.
+ *
+ * Returns 0 if the signconf was written, 1 if it was up to date and -1
+ * otherwise.
+ */
+static int
+zone_worker_do(ZONE_WORKER* worker, KSM_POLICY* policy, hsm_ctx_t* ctx, ZONE_JOB* job)
+{
+    DAEMONCONFIG* config = worker->pool->config;
+    int status = 0;
+    int savepoint = 0;
+
+    if (strcmp(policy->name, job->policy_name) != 0) {
+        kaspSetPolicyDefaults(policy, job->policy_name);
+        if (KsmPolicyRead(policy) != 0) {
+            log_msg(config, LOG_ERR, "Error reading policy %s", job->policy_name);
+            policy->name[0] = '\0';
+            return -1;
+        }
+    }
+
+    /* The updates for this zone are undone if any step fails; the signer
+       is told about the signconf once they are committed */
+    savepoint = begin_zone(config, job->zone_name);
+    status = do_zone_signconf(config, policy, ctx, worker->pool->notify, worker->pool->datetime, job->zone_name, job->zone_id, job->filename);
+    if (end_zone(config, worker->pool->notify, job->zone_name, job->zone_id, savepoint, status == 0 || status == 1) != 0) {
+        return -1;
+    }
+    return status;
+}
+
+/*
+ * Worker: finish the zones released to it until the pool is stopped
+ */
+static void*
+zone_worker(void* arg)
+{
+    ZONE_WORKER* worker = (ZONE_WORKER*) arg;
+    ZONE_POOL* pool = worker->pool;
+    DAEMONCONFIG* config = pool->config;
+    ZONE_JOB* job = NULL;
+    DB_HANDLE dbhandle = NULL;
+    hsm_ctx_t* ctx = NULL;
+    KSM_POLICY* policy = NULL;
+    int ready = 0;
+    int status = 0;
+
+    if (kaspTryConnect(config, &dbhandle) != 0) {
+        log_msg(config, LOG_ERR, "Zone worker could not connect to the database");
+    } else {
+        ctx = hsm_create_context();
+        policy = KsmPolicyAlloc();
+        if (ctx == NULL) {
+            log_msg(config, LOG_ERR, "Could not create an HSM context for a zone worker");
+        } else if (policy == NULL) {
+            log_msg(config, LOG_ERR, "Malloc for policy struct failed");
+        } else {
+            policy->name[0] = '\0';
+            /* Cache the policy parameters of this thread, as the main one does */
+            KsmParameterCollectionCache(1);
+            ready = 1;
+        }
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (worker->queue == NULL && !pool->stop) {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+        if (worker->queue == NULL) {
+            break;
+        }
+        job = worker->queue;
+        worker->queue = job->next;
+        if (worker->queue == NULL) {
+            worker->queue_tail = &worker->queue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        if (ready) {
+            status = zone_worker_do(worker, policy, ctx, job);
+        } else {
+            status = -1;
+        }
+        if (status == -1) {
+            log_msg(config, LOG_ERR, "Zone %s not done; it is tried again on the next run", job->zone_name);
+        }
+        zone_job_free(job);
+
+        pthread_mutex_lock(&pool->lock);
+        if (status != -1) {
+            worker->done++;
+        }
+        if (status == 1) {
+            worker->unchanged++;
+        }
+        pool->pending--;
+        pthread_cond_broadcast(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (ready) {
+        KsmParameterCollectionCache(0);
+    }
+    if (policy) {
+        KsmPolicyFree(policy);
+    }
+    if (ctx) {
+        hsm_destroy_context(ctx);
+    }
+    if (dbhandle) {
+        kaspDisconnect(&dbhandle);
+    }
+    return NULL;
+}
+
+/*
+ * Start the workers of a run; datetime is the time of the run, which the
+ * zones' keys are moved as of.
+ *
+ * Returns the pool, or NULL if no worker could be started.
+ */
+ZONE_POOL*
+zone_pool_create(DAEMONCONFIG* config, SIGNER_NOTIFY* notify, const char* datetime, int threads)
+{
+    ZONE_POOL* pool = NULL;
+    ZONE_WORKER* worker = NULL;
+    int i;
+
+    pool = (ZONE_POOL*) calloc(1, sizeof(ZONE_POOL));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = (ZONE_WORKER*) calloc(threads, sizeof(ZONE_WORKER));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+    pool->config = config;
+    pool->notify = notify;
+    pool->datetime = datetime;
+    pool->held_tail = &pool->held;
+
+    for (i = 0; i < threads; i++) {
+        worker = &pool->workers[pool->threads];
+        worker->pool = pool;
+        worker->queue_tail = &worker->queue;
+        if (pthread_create(&worker->thread, NULL, zone_worker, worker) != 0) {
+            log_msg(config, LOG_ERR, "Could not start zone worker thread");
+            break;
+        }
+        pool->threads++;
+    }
+    if (pool->threads == 0) {
+        zone_pool_finish(pool, NULL, NULL);
+        return NULL;
+    }
+    log_msg(config, LOG_INFO, "Started %d zone workers.", pool->threads);
+    return pool;
+}
+
+/*
+ * Submit a zone whose keys are allocated. It is held until
+ * zone_pool_run() is called, after the keys have been committed.
+ * Only the thread going through the zonelist calls this.
+ *
+ * Returns 0 on success, non-zero if the zone could not be queued.
+ */
+int
+zone_pool_submit(ZONE_POOL* pool, const char* zone_name, int zone_id, KSM_POLICY* policy, const char* filename)
+{
+    ZONE_JOB* job = NULL;
+    int shard = 0;
+
+    if (pool == NULL || zone_name == NULL || policy == NULL || filename == NULL) {
+        return 1;
+    }
+    job = (ZONE_JOB*) calloc(1, sizeof(ZONE_JOB));
+    if (job == NULL) {
+        log_msg(pool->config, LOG_ERR, "Malloc for zone %s failed", zone_name);
+        return 1;
+    }
+
+    /* Shared keys are moved on by every zone of the policy */
+    shard = policy->keys->share_keys ? policy->id : zone_id;
+    job->worker = shard % pool->threads;
+    job->zone_name = StrStrdup(zone_name);
+    job->zone_id = zone_id;
+    job->policy_name = StrStrdup(policy->name);
+    job->filename = StrStrdup(filename);
+
+    *pool->held_tail = job;
+    pool->held_tail = &job->next;
+    return 0;
+}
+
+/*
+ * Drop the zones submitted so far, as the batch they are in could not be
+ * committed
+ */
+void
+zone_pool_discard(ZONE_POOL* pool)
+{
+    ZONE_JOB* job = NULL;
+
+    if (pool == NULL) {
+        return;
+    }
+    while (pool->held) {
+        job = pool->held;
+        pool->held = job->next;
+        log_msg(pool->config, LOG_ERR, "Zone %s not done; it is tried again on the next run", job->zone_name);
+        zone_job_free(job);
+    }
+    pool->held_tail = &pool->held;
+}
+
+/*
+ * Hand the zones submitted so far to their workers and wait until they
+ * are finished
+ */
+void
+zone_pool_run(ZONE_POOL* pool)
+{
+    ZONE_JOB* job = NULL;
+    ZONE_WORKER* worker = NULL;
+
+    if (pool == NULL || pool->held == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    while (pool->held) {
+        job = pool->held;
+        pool->held = job->next;
+        job->next = NULL;
+        worker = &pool->workers[job->worker];
+        *worker->queue_tail = job;
+        worker->queue_tail = &job->next;
+        pool->pending++;
+    }
+    pool->held_tail = &pool->held;
+    pthread_cond_broadcast(&pool->work);
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/*
+ * Finish the last zones, stop the workers and release the pool. The
+ * zones finished are added to done, and those whose signconf was up to
+ * date to unchanged.
+ */
+void
+zone_pool_finish(ZONE_POOL* pool, int* done, int* unchanged)
+{
+    ZONE_JOB* job = NULL;
+    int i;
+
+    if (pool == NULL) {
+        return;
+    }
+    zone_pool_run(pool);
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->threads; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        if (done) {
+            *done += pool->workers[i].done;
+        }
+        if (unchanged) {
+            *unchanged += pool->workers[i].unchanged;
+        }
+        while (pool->workers[i].queue) {
+            job = pool->workers[i].queue;
+            pool->workers[i].queue = job->next;
+            zone_job_free(job);
+        }
+    }
+    pthread_cond_destroy(&pool->work);
+    pthread_cond_destroy(&pool->done);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,89 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef ZONEPOOL_H
+#define ZONEPOOL_H
+
+/*
+ * zonepool.h: finish zones in parallel worker threads
+ *
+ * The enforcer allocates keys to the zones itself, in zonelist order,
+ * and leaves the signconf of each zone to a pool of <WorkerThreads>
+ * workers. Every worker has its own database connection and HSM context.
+ */
+
+#include <pthread.h>
+
+#include "daemon.h"
+#include "signer_notify.h"
+
+#include "ksm/ksm.h"
+
+/* A zone whose keys are allocated */
+typedef struct zone_job {
+    struct zone_job* next;
+    int worker;             /* index of the worker that does it */
+    char* zone_name;
+    int zone_id;
+    char* policy_name;
+    char* filename;         /* signconf */
+} ZONE_JOB;
+
+/* A thread finishing zones */
+typedef struct zone_worker {
+    struct zone_pool* pool;
+    pthread_t thread;
+    ZONE_JOB* queue;
+    ZONE_JOB** queue_tail;
+    int done;               /* zones finished */
+    int unchanged;          /* ... of which the signconf was left alone */
+} ZONE_WORKER;
+
+/* The zone workers of one enforcer run */
+typedef struct zone_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;    /* zones were released, or the pool stops */
+    pthread_cond_t done;    /* a zone was finished */
+    DAEMONCONFIG* config;
+    SIGNER_NOTIFY* notify;
+    const char* datetime;   /* time of the run */
+    int threads;            /* number of workers running */
+    ZONE_WORKER* workers;
+    ZONE_JOB* held;         /* submitted, not yet committed */
+    ZONE_JOB** held_tail;
+    int pending;            /* released, not yet finished */
+    int stop;
+} ZONE_POOL;
+
+ZONE_POOL* zone_pool_create(DAEMONCONFIG* config, SIGNER_NOTIFY* notify, const char* datetime, int threads);
+int zone_pool_submit(ZONE_POOL* pool, const char* zone_name, int zone_id, KSM_POLICY* policy, const char* filename);
+void zone_pool_discard(ZONE_POOL* pool);
+void zone_pool_run(ZONE_POOL* pool);
+void zone_pool_finish(ZONE_POOL* pool, int* done, int* unchanged);
+
+#endif /* ZONEPOOL_H */
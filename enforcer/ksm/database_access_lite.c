@@ -55,26 +55,6 @@
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 
-/* possible wrapper for sqlite3_step which will wait for a block to go */
-int sqlite3_my_step(sqlite3_stmt *pStmt)
-{
-	int rc;
-    struct timeval tv;
-
-    rc = sqlite3_step(pStmt);
-    
-    while (rc == SQLITE_LOCKED || rc == SQLITE_BUSY) {
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
-        select(0, NULL, NULL, NULL, &tv);
-
-        rc = sqlite3_step(pStmt);
-    }
-
-    return rc;
-
-}
-
 /*+
  * DbExecuteSqlStatement - Execute SQL Statement
  *
@@ -217,6 +197,7 @@ int DbExecuteSql(DB_HANDLE handle, const char* stmt_str, DB_RESULT* result)
         /* Query failed.  Log the error and free up the structure */
 
         status = MsgLog(DBS_SQLFAIL, DbErrmsg(handle));
+		sqlite3_finalize((sqlite3_stmt*) (*result)->data);
 		MemFree(*result);
 		*result = NULL;
     }
@@ -243,9 +224,17 @@ void DbFreeResult(DB_RESULT result)
     if (result) {
 		if (result->magic == DB_RESULT_MAGIC) {
 
-			/* Free up data */
+			/*
+			 * Free up data.  The statement of a prepared statement result
+			 * is only reset; it is handed back with DbFreeStatement().
+			 */
 
-			sqlite3_finalize(result->data);
+			if (result->statement) {
+				sqlite3_reset(result->data);
+			}
+			else {
+				sqlite3_finalize(result->data);
+			}
 			MemFree(result);
 			result = NULL;
 		}
@@ -451,11 +440,50 @@ void DbStringFree(char* string)
     MemFree(string);
 }
 
+/*
+ * Transactions nest: the outermost DbBeginTransaction() starts a real
+ * transaction, the inner ones set a savepoint that DbCommit() releases and
+ * DbRollback() rolls back to, leaving the work of the enclosing levels
+ * alone.  The depth is kept per thread, with the connection, and is only
+ * trusted while the connection is actually in a transaction, so that a new
+ * connection or a transaction that the database ended by itself starts
+ * counting at zero again.
+ */
+
+static int DbTransactionLevel(void)
+{
+    DB_THREAD* thread = DbThread();
+
+    if (DbHandle() == NULL || sqlite3_get_autocommit(DbHandle())) {
+        thread->transaction_depth = 0;
+    }
+    return thread->transaction_depth;
+}
+
+/*+
+ * DbTransactionDepth - Number of open transaction levels
+ *
+ * Arguments:
+ *              NONE
+ *
+ * Returns:
+ *      int
+ *          0 outside a transaction, 1 in a transaction, more than 1 when
+ *          nested transactions (savepoints) are open.
+-*/
+
+int DbTransactionDepth(void)
+{
+    return DbTransactionLevel();
+}
+
 /*+
- * DbBeginTransaction - Start a (non-nested) transaction
+ * DbBeginTransaction - Start a transaction
  *
  * Description:
- *      
+ *      Starts a transaction or, if one is already open, a nested one by
+ *      setting savepoint ksm_<depth>.
+ *
  *
  * Arguments:
  *              NONE
@@ -463,15 +491,30 @@ void DbStringFree(char* string)
 
 int DbBeginTransaction(void)
 {
-    const char* sql = "begin transaction";
-	return DbExecuteSqlNoResult(DbHandle(), sql);
+    char sql[32];
+    int status = 0;
+    DB_THREAD* thread = DbThread();
+
+    if (DbTransactionLevel() == 0) {
+        status = DbExecuteSqlNoResult(DbHandle(), "begin transaction");
+    }
+    else {
+        snprintf(sql, sizeof(sql), "savepoint ksm_%d", thread->transaction_depth);
+        status = DbExecuteSqlNoResult(DbHandle(), sql);
+    }
+    if (status == 0) {
+        thread->transaction_depth++;
+    }
+	return status;
 }
 
 /*+
- * DbCommit - End a (non-nested) transaction by commiting it
+ * DbCommit - End a transaction by commiting it
  *
  * Description:
- *      
+ *      Commits the outermost transaction.  A nested transaction is ended by
+ *      releasing its savepoint; its work is committed with the enclosing
+ *      transaction.
  *
  * Arguments:
  *              NONE
@@ -479,15 +522,25 @@ int DbBeginTransaction(void)
 
 int DbCommit(void)
 {
-    const char* sql = "commit transaction";
+    char sql[40];
+    DB_THREAD* thread = DbThread();
+
+    if (DbTransactionLevel() <= 1) {
+        thread->transaction_depth = 0;
+        return DbExecuteSqlNoResult(DbHandle(), "commit transaction");
+    }
+
+    thread->transaction_depth--;
+    snprintf(sql, sizeof(sql), "release savepoint ksm_%d", thread->transaction_depth);
 	return DbExecuteSqlNoResult(DbHandle(), sql);
 }
 
 /*+
- * DbRollback - End a (non-nested) transaction by rolling it back
+ * DbRollback - End a transaction by rolling it back
  *
  * Description:
- *      
+ *      Rolls back the outermost transaction.  A nested transaction only
+ *      undoes the work done since its savepoint was set.
  *
  * Arguments:
  *              NONE
@@ -495,6 +548,21 @@ int DbCommit(void)
 
 int DbRollback(void)
 {
-    const char* sql = "rollback transaction";
-    return DbExecuteSqlNoResult(DbHandle(), sql);
+    char sql[40];
+    int status = 0;
+    DB_THREAD* thread = DbThread();
+
+    if (DbTransactionLevel() <= 1) {
+        thread->transaction_depth = 0;
+        return DbExecuteSqlNoResult(DbHandle(), "rollback transaction");
+    }
+
+    thread->transaction_depth--;
+    snprintf(sql, sizeof(sql), "rollback to savepoint ksm_%d", thread->transaction_depth);
+    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    if (status == 0) {
+        snprintf(sql, sizeof(sql), "release savepoint ksm_%d", thread->transaction_depth);
+        status = DbExecuteSqlNoResult(DbHandle(), sql);
+    }
+    return status;
 }
@@ -204,9 +204,17 @@ void DbFreeResult(DB_RESULT result)
     if (result) {
 		if (result->magic == DB_RESULT_MAGIC) {
 
-			/* Free up data */
+			/*
+			 * Free up data.  The statement of a prepared statement result
+			 * is handed back with DbFreeStatement().
+			 */
 
-			mysql_free_result((MYSQL_RES*) result->data);
+			if (result->statement) {
+				mysql_stmt_free_result(result->statement->data);
+			}
+			else {
+				mysql_free_result((MYSQL_RES*) result->data);
+			}
 			MemFree(result);
 		}
 		else {
@@ -253,7 +261,13 @@ int DbFetchRow(DB_RESULT result, DB_ROW* row)
 
 		/* There is a result structure (and row pointer), do something */
 
-		rowdata = mysql_fetch_row(result->data);
+		if (result->statement) {
+			status = DbStatementFetch(result->statement);
+			rowdata = (status == 0) ? result->statement->column_data : NULL;
+		}
+		else {
+			rowdata = mysql_fetch_row(result->data);
+		}
 		if (rowdata) {
 
 			/* Something returned, encapsulate the result in a structure */
@@ -272,7 +286,9 @@ int DbFetchRow(DB_RESULT result, DB_ROW* row)
 
             /* leave freeing the row to the calling function */
 			/* *row = NULL; */
-			status = -1;
+			if (status == 0) {
+				status = -1;
+			}
 		}
 	}
 	else {
@@ -354,7 +370,12 @@ int DbString(DB_ROW row, int field_index, char** result)
 
 			/* Get the lengths of the fields in the row */
 
-			lengths = mysql_fetch_lengths((MYSQL_RES*) row->result->data);
+			if (row->result->statement) {
+				lengths = row->result->statement->column_length;
+			}
+			else {
+				lengths = mysql_fetch_lengths((MYSQL_RES*) row->result->data);
+			}
 
 			/* Get string into null-terminated form */
 
@@ -404,12 +425,52 @@ void DbStringFree(char* string)
     MemFree(string);
 }
 
+/*
+ * Transactions nest: the outermost DbBeginTransaction() starts a real
+ * transaction, the inner ones set a savepoint that DbCommit() releases and
+ * DbRollback() rolls back to, leaving the work of the enclosing levels
+ * alone.  The depth is kept per thread, with the connection, and is only
+ * trusted while the connection is actually in a transaction, so that a new
+ * connection or a transaction that the database ended by itself starts
+ * counting at zero again.
+ */
+
+static int DbTransactionLevel(void)
+{
+    DB_THREAD* thread = DbThread();
+
+    if (DbHandle() == NULL || (DbHandle()->server_status & SERVER_STATUS_IN_TRANS) == 0) {
+        thread->transaction_depth = 0;
+    }
+    return thread->transaction_depth;
+}
+
+/*+
+ * DbTransactionDepth - Number of open transaction levels
+ *
+ * Arguments:
+ *              NONE
+ *
+ * Returns:
+ *      int
+ *          0 outside a transaction, 1 in a transaction, more than 1 when
+ *          nested transactions (savepoints) are open.
+-*/
+
+int DbTransactionDepth(void)
+{
+    return DbTransactionLevel();
+}
+
 /*+
- * DbBeginTransaction - Start a (non-nested) transaction
+ * DbBeginTransaction - Start a transaction
  *
  * Description:
- *              NB the following will not work if your tables are MyISAM
- *              as transactions are not supported
+ *      Starts a transaction or, if one is already open, a nested one by
+ *      setting savepoint ksm_<depth>.
+ *
+ *      NB the following will not work if your tables are MyISAM
+ *      as transactions are not supported
  *
  * Arguments:
  *              NONE
@@ -417,15 +478,30 @@ void DbStringFree(char* string)
 
 int DbBeginTransaction(void)
 {
-    const char* sql = "start transaction";
-	return DbExecuteSqlNoResult(DbHandle(), sql);
+    char sql[32];
+    int status = 0;
+    DB_THREAD* thread = DbThread();
+
+    if (DbTransactionLevel() == 0) {
+        status = DbExecuteSqlNoResult(DbHandle(), "start transaction");
+    }
+    else {
+        snprintf(sql, sizeof(sql), "savepoint ksm_%d", thread->transaction_depth);
+        status = DbExecuteSqlNoResult(DbHandle(), sql);
+    }
+    if (status == 0) {
+        thread->transaction_depth++;
+    }
+	return status;
 }
 
 /*+
- * DbCommit - End a (non-nested) transaction by commiting it
+ * DbCommit - End a transaction by commiting it
  *
  * Description:
- *      
+ *      Commits the outermost transaction.  A nested transaction is ended by
+ *      releasing its savepoint; its work is committed with the enclosing
+ *      transaction.
  *
  * Arguments:
  *              NONE
@@ -433,15 +509,25 @@ int DbBeginTransaction(void)
 
 int DbCommit(void)
 {
-    const char* sql = "commit";
+    char sql[40];
+    DB_THREAD* thread = DbThread();
+
+    if (DbTransactionLevel() <= 1) {
+        thread->transaction_depth = 0;
+        return DbExecuteSqlNoResult(DbHandle(), "commit");
+    }
+
+    thread->transaction_depth--;
+    snprintf(sql, sizeof(sql), "release savepoint ksm_%d", thread->transaction_depth);
 	return DbExecuteSqlNoResult(DbHandle(), sql);
 }
 
 /*+
- * DbRollback - End a (non-nested) transaction by rolling it back
+ * DbRollback - End a transaction by rolling it back
  *
  * Description:
- *      
+ *      Rolls back the outermost transaction.  A nested transaction only
+ *      undoes the work done since its savepoint was set.
  *
  * Arguments:
  *              NONE
@@ -449,6 +535,21 @@ int DbCommit(void)
 
 int DbRollback(void)
 {
-    const char* sql = "rollback";
-    return DbExecuteSqlNoResult(DbHandle(), sql);
+    char sql[40];
+    int status = 0;
+    DB_THREAD* thread = DbThread();
+
+    if (DbTransactionLevel() <= 1) {
+        thread->transaction_depth = 0;
+        return DbExecuteSqlNoResult(DbHandle(), "rollback");
+    }
+
+    thread->transaction_depth--;
+    snprintf(sql, sizeof(sql), "rollback to savepoint ksm_%d", thread->transaction_depth);
+    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    if (status == 0) {
+        snprintf(sql, sizeof(sql), "release savepoint ksm_%d", thread->transaction_depth);
+        status = DbExecuteSqlNoResult(DbHandle(), sql);
+    }
+    return status;
 }
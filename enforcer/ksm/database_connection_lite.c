@@ -36,6 +36,9 @@
 
 #include <stdarg.h>
 #include <stdlib.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <unistd.h>
 
 #include <sqlite3.h>
 
@@ -43,7 +46,60 @@
 #include "ksm/dbsdef.h"
 #include "ksm/message.h"
 
-static sqlite3* m_dbhandle = NULL;  /* Non-NULL if connected */
+
+/* Longest wait for a lock held by another connection, and the steps
+   the wait is taken in: 1ms, doubling up to the maximum */
+#define DB_BUSY_TIMEOUT     60000   /* ms */
+#define DB_BUSY_MAX_STEP    100     /* ms */
+
+
+/*+
+ * DbBusyHandler - Wait for a Locked Database
+ *
+ * Description:
+ *      Called by SQLite when the database is locked by another connection,
+ *      e.g. ods-ksmutil while the enforcer writes.  Sleeps for a step that
+ *      starts at a millisecond and doubles up to DB_BUSY_MAX_STEP, so that
+ *      short waits stay short, and gives up after DB_BUSY_TIMEOUT.
+ *
+ * Arguments:
+ *      void* data
+ *          Unused.
+ *
+ *      int count
+ *          Number of times the handler was called for this lock.
+ *
+ * Returns:
+ *      int
+ *          Non-zero to try again, 0 to give up (SQLITE_BUSY is returned).
+-*/
+
+static int DbBusyHandler(void* data, int count)
+{
+    struct timeval tv;
+    int step = 1;       /* Wait of this call, in ms */
+    int waited = 0;     /* Time waited by the earlier calls, in ms */
+    int i;
+
+    (void) data;
+
+    for (i = 0; i < count && waited < DB_BUSY_TIMEOUT; ++i) {
+        waited += step;
+        step *= 2;
+        if (step > DB_BUSY_MAX_STEP) {
+            step = DB_BUSY_MAX_STEP;
+        }
+    }
+    if (waited >= DB_BUSY_TIMEOUT) {
+        return 0;
+    }
+
+    tv.tv_sec = 0;
+    tv.tv_usec = step * 1000;
+    select(0, NULL, NULL, NULL, &tv);
+
+    return 1;
+}
 
 
 /*+
@@ -52,7 +108,7 @@ static sqlite3* m_dbhandle = NULL;  /* Non-NULL if connected */
  * Description:
  *      Creates a connection to the specified database using the parameters
  *      supplied.  If successful, the handle to the connection is stored
- *      locally, for retrieval by DbHandle().
+ *      locally, for retrieval by DbHandle() in the calling thread.
  *
  *      Should there be an error, a suitable message is output.
  *
@@ -104,11 +160,25 @@ int DbConnect(DB_HANDLE* dbhandle, const char* database, ...)
     if (status) {
         /* Unable to connect */
         status = MsgLog(DBS_CONNFAIL, sqlite3_errmsg(connection));
+    }
+    else {
+        /* Wait for locks in millisecond steps rather than failing */
+        sqlite3_busy_handler(connection, DbBusyHandler, NULL);
+
+        /*
+         * Write-ahead logging lets readers (e.g. "ods-ksmutil key list")
+         * work while the enforcer writes, and vice versa.  The mode is
+         * stored in the database; where it cannot be used (e.g. on a
+         * network file system) SQLite keeps the rollback journal.
+         */
+#if SQLITE_VERSION_NUMBER >= 3007000
+        (void) sqlite3_exec(connection, "PRAGMA journal_mode=WAL", NULL, NULL, NULL);
+#endif
     }
 
 	/* Store the returned handle for retrieval by DbHandle() */
 
-	m_dbhandle = connection;
+	DbThread()->handle = (DB_HANDLE) connection;
 
 	/* ... and pass back to the caller via the argument list */
 
@@ -154,9 +224,10 @@ int DbDisconnect(DB_HANDLE dbhandle)
     int status = 0;     /* Return status */
 
 	if (dbhandle) {
-		if (dbhandle == m_dbhandle) {
-			m_dbhandle = NULL;
+		if (dbhandle == DbThread()->handle) {
+			DbThread()->handle = NULL;
 		}
+		DbStatementCacheFlush(dbhandle);
 		sqlite3_close((sqlite3*) dbhandle);
 	}
     else {
@@ -168,6 +239,45 @@ int DbDisconnect(DB_HANDLE dbhandle)
 
 
 
+/*+
+ * DbCheckpoint - Copy the Log into the Database File
+ *
+ * Description:
+ *      In WAL mode, committed transactions can be in the log (the "-wal"
+ *      file) until a checkpoint copies them into the database file.  This
+ *      waits for readers of older data and copies all of them, so that the
+ *      database file can be copied on its own (e.g. for a backup).  Outside
+ *      WAL mode this is a no-op.
+ *
+ * Arguments:
+ *      None.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error, a message will have been output.
+-*/
+
+int DbCheckpoint(void)
+{
+    int status = 0;     /* Return status */
+
+#if SQLITE_VERSION_NUMBER >= 3007006
+    if (DbHandle() == NULL) {
+        return MsgLog(DBS_NOTCONN);
+    }
+    status = sqlite3_wal_checkpoint_v2(DbHandle(), NULL,
+        SQLITE_CHECKPOINT_FULL, NULL, NULL);
+    if (status != SQLITE_OK) {
+        status = MsgLog(DBS_SQLFAIL, sqlite3_errmsg(DbHandle()));
+    }
+#endif
+
+    return status;
+}
+
+
+
 /*+
  * DbConnected - Check if Connected to a Database
  *
@@ -222,8 +332,8 @@ int DbCheckConnected(DB_HANDLE dbhandle)
  * DbHandle - Return Database Handle
  *
  * Description:
- *      Returns the handle to the database (the pointer to the MYSQL
- *      structure).
+ *      Returns the handle to the database connection of the calling thread
+ *      (the pointer to the sqlite3 structure).
  *
  * Arguments:
  *      None.
@@ -235,5 +345,5 @@ int DbCheckConnected(DB_HANDLE dbhandle)
 
 DB_HANDLE DbHandle(void)
 {
-    return (DB_HANDLE) m_dbhandle;
+    return DbThread()->handle;
 }
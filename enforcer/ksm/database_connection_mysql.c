@@ -34,6 +34,7 @@
  *      disconnect) and holds session-specific database information.
 -*/
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 
@@ -44,7 +45,12 @@
 #include "ksm/message.h"
 #include "ksm/string_util2.h"
 
-static MYSQL* m_dbhandle = NULL;  /* Non-NULL if connected */
+/* Open connections over all threads; the client library is shut down when
+   the last one is closed */
+
+static int m_connections = 0;
+static pthread_mutex_t m_connections_lock = PTHREAD_MUTEX_INITIALIZER;
+
 
 
 /*+
@@ -53,7 +59,7 @@ static MYSQL* m_dbhandle = NULL;  /* Non-NULL if connected */
  * Description:
  *      Creates a connection to the specified database using the parameters
  *      supplied.  If successful, the handle to the connection is stored
- *      locally, for retrieval by DbHandle().
+ *      locally, for retrieval by DbHandle() in the calling thread.
  *
  *      Should there be an error, a suitable message is output.
  *
@@ -129,7 +135,12 @@ int DbConnect(DB_HANDLE* dbhandle, const char* database, ...)
 
     /* ... and connect */
 
+    pthread_mutex_lock(&m_connections_lock);
     connection = mysql_init(NULL);
+    if (connection) {
+        ++m_connections;
+    }
+    pthread_mutex_unlock(&m_connections_lock);
     if (connection) {
 
         /* Connect to the database */
@@ -161,7 +172,7 @@ int DbConnect(DB_HANDLE* dbhandle, const char* database, ...)
 
 	/* Store the returned handle for retrieval by DbHandle() */
 
-	m_dbhandle = connection;
+	DbThread()->handle = (DB_HANDLE) connection;
 
 	/* ... and pass back to the caller via the argument list */
 
@@ -207,11 +218,19 @@ int DbDisconnect(DB_HANDLE dbhandle)
     int status = 0;     /* Return status */
 
     if (dbhandle) {
-		if (dbhandle == m_dbhandle) {
-			m_dbhandle = NULL;
+		if (dbhandle == DbThread()->handle) {
+			DbThread()->handle = NULL;
 		}
+        DbStatementCacheFlush(dbhandle);
         mysql_close((MYSQL*) dbhandle);
-        mysql_library_end();
+        pthread_mutex_lock(&m_connections_lock);
+        if (--m_connections == 0) {
+            mysql_library_end();
+        }
+        else {
+            mysql_thread_end();
+        }
+        pthread_mutex_unlock(&m_connections_lock);
     }
     else {
         status = MsgLog(DBS_NOTCONN);
@@ -222,6 +241,27 @@ int DbDisconnect(DB_HANDLE dbhandle)
 
 
 
+/*+
+ * DbCheckpoint - Copy the Log into the Database File
+ *
+ * Description:
+ *      Only meaningful for SQLite in WAL mode; a no-op for MySQL.
+ *
+ * Arguments:
+ *      None.
+ *
+ * Returns:
+ *      int
+ *          0       Always
+-*/
+
+int DbCheckpoint(void)
+{
+    return 0;
+}
+
+
+
 /*+
  * DbConnected - Check if Connected to a Database
  *
@@ -276,8 +316,8 @@ int DbCheckConnected(DB_HANDLE dbhandle)
  * DbHandle - Return Database Handle
  *
  * Description:
- *      Returns the handle to the database (the pointer to the MYSQL
- *      structure).
+ *      Returns the handle to the database connection of the calling thread
+ *      (the pointer to the MYSQL structure).
  *
  * Arguments:
  *      None.
@@ -289,5 +329,5 @@ int DbCheckConnected(DB_HANDLE dbhandle)
 
 DB_HANDLE DbHandle(void)
 {
-    return (DB_HANDLE) m_dbhandle;
+    return DbThread()->handle;
 }
@@ -34,16 +34,34 @@
  *      database access module.
 -*/
 
+#include <pthread.h>
+
 #include "ksm/database.h"
 #include "ksm/dbsdef.h"
 #include "ksm/dbsmsg.h"
 #include "ksm/kmedef.h"
+#include "ksm/memory.h"
 #include "ksm/message.h"
 
 /* Flag as to whether the database modules have been initialized */
 
 static int m_initialized = 0;       /* Default is not */
 
+/* Connection state of each thread */
+
+static pthread_key_t m_thread_key;
+static pthread_once_t m_thread_once = PTHREAD_ONCE_INIT;
+
+static void DbThreadFree(void* data)
+{
+    MemFree(data);
+}
+
+static void DbThreadKeyCreate(void)
+{
+    (void) pthread_key_create(&m_thread_key, DbThreadFree);
+}
+
 
 
 /*+
@@ -83,6 +101,38 @@ void DbRundown(void)
 	return;
 }
 
+
+
+/*+
+ * DbThread - Connection State of the Calling Thread
+ *
+ * Description:
+ *      Returns the connection state of the calling thread, creating it on
+ *      first use.  It is freed when the thread exits.
+ *
+ * Arguments:
+ *      None.
+ *
+ * Returns:
+ *      DB_THREAD*
+ *          Connection state; the handle is NULL if the thread has not
+ *          connected.
+-*/
+
+DB_THREAD* DbThread(void)
+{
+    DB_THREAD*  thread = NULL;  /* State of this thread */
+
+    (void) pthread_once(&m_thread_once, DbThreadKeyCreate);
+    thread = (DB_THREAD*) pthread_getspecific(m_thread_key);
+    if (thread == NULL) {
+        thread = (DB_THREAD*) MemCalloc(1, sizeof(DB_THREAD));
+        (void) pthread_setspecific(m_thread_key, thread);
+    }
+
+    return thread;
+}
+
 int DbFlavour(void)
 {
 #ifdef USE_MYSQL
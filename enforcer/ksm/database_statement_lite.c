@@ -0,0 +1,501 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*+
+ * database_statement_lite.c - Prepared Statement Functions
+ *
+ * Description:
+ *      Prepared statements with bound parameters for the sqlite database.
+ *
+ *      Statements are kept in a small cache, keyed by connection and by the
+ *      text of the SQL.  The enforcer issues the same handful of queries for
+ *      every zone, differing only in the values, so with placeholders these
+ *      are compiled once per connection rather than once per zone.
+ *
+ *      A statement is obtained with DbPrepare(), bound with DbBindInt() and
+ *      DbBindString(), executed with one of the DbExecuteStatement()
+ *      functions and handed back with DbFreeStatement().  Any result set
+ *      must be freed (with DbFreeResult()) before the statement is.
+-*/
+
+#include <pthread.h>
+#include <string.h>
+
+#include <sqlite3.h>
+
+#include "ksm/dbsdef.h"
+#include "ksm/database.h"
+#include "ksm/debug.h"
+#include "ksm/memory.h"
+#include "ksm/message.h"
+#include "ksm/string_util.h"
+
+#define DB_STATEMENT_CACHE_SIZE 64  /* Statements cached over all connections */
+
+static DB_STATEMENT m_cache[DB_STATEMENT_CACHE_SIZE];
+static unsigned long m_cache_clock = 0;
+static pthread_mutex_t m_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*+
+ * DbStatementDestroy - Destroy Prepared Statement
+ *
+ * Description:
+ *      Finalizes the statement and frees the structure.  The statement must
+ *      not be in the cache.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement to destroy.
+-*/
+
+static void DbStatementDestroy(DB_STATEMENT statement)
+{
+    sqlite3_finalize(statement->data);
+    StrFree(statement->sql);
+    statement->magic = 0;
+    MemFree(statement);
+
+    return;
+}
+
+
+
+/*+
+ * DbPrepare - Prepare SQL Statement
+ *
+ * Description:
+ *      Returns a prepared statement for the given SQL, from the cache of
+ *      the connection if the same SQL has been prepared before and is not
+ *      in use.  Otherwise the statement is compiled and, if there is room
+ *      (or an unused statement of the same connection can be evicted),
+ *      added to the cache.
+ *
+ * Arguments:
+ *      DB_HANDLE handle
+ *          Handle to the currently opened database.
+ *
+ *      const char* stmt_str
+ *          SQL statement, with "?" placeholders for the parameters.
+ *
+ *      DB_STATEMENT* statement
+ *          The statement is returned here.  It must be handed back with
+ *          DbFreeStatement().  On error, this is NULL.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbPrepare(DB_HANDLE handle, const char* stmt_str, DB_STATEMENT* statement)
+{
+    DB_STATEMENT    stmt = NULL;    /* Statement found or created */
+    int             slot = -1;      /* Free cache slot */
+    int             victim = -1;    /* Cache slot to evict */
+    int             i;              /* Loop counter */
+    int             status = 0;     /* Status return */
+
+    if ((!handle) || (!stmt_str) || (*stmt_str == '\0') || (!statement)) {
+        return MsgLog(DBS_INVARG, "DbPrepare");
+    }
+    *statement = NULL;
+
+    pthread_mutex_lock(&m_cache_lock);
+
+    /* Look for an unused statement of this connection with the same SQL */
+
+    for (i = 0; i < DB_STATEMENT_CACHE_SIZE; i++) {
+        if (m_cache[i] == NULL) {
+            if (slot == -1) {
+                slot = i;
+            }
+        }
+        else if ((m_cache[i]->handle == handle) && (!m_cache[i]->in_use)) {
+            if (strcmp(m_cache[i]->sql, stmt_str) == 0) {
+                stmt = m_cache[i];
+                break;
+            }
+            if ((victim == -1) ||
+                (m_cache[i]->last_used < m_cache[victim]->last_used)) {
+                victim = i;
+            }
+        }
+    }
+
+    if (stmt == NULL) {
+
+        /* Not cached (or all copies busy), so compile it */
+
+        stmt = (DB_STATEMENT) MemCalloc(1, sizeof(struct db_statement));
+        stmt->magic = DB_STATEMENT_MAGIC;
+        stmt->handle = handle;
+        stmt->sql = StrStrdup(stmt_str);
+        status = sqlite3_prepare_v2((sqlite3*) handle, stmt_str, -1,
+            &stmt->data, NULL);
+        if (status != SQLITE_OK) {
+            status = MsgLog(DBS_STMTPREP, DbErrmsg(handle));
+            DbStatementDestroy(stmt);
+            pthread_mutex_unlock(&m_cache_lock);
+            return status;
+        }
+
+        if (slot == -1 && victim != -1) {
+            DbStatementDestroy(m_cache[victim]);
+            m_cache[victim] = NULL;
+            slot = victim;
+        }
+        if (slot != -1) {
+            stmt->cached = 1;
+            m_cache[slot] = stmt;
+        }
+    }
+
+    stmt->in_use = 1;
+    stmt->last_used = ++m_cache_clock;
+
+    pthread_mutex_unlock(&m_cache_lock);
+
+    *statement = stmt;
+    return 0;
+}
+
+
+
+/*+
+ * DbBindInt - Bind Integer Parameter
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      int index
+ *          Index of the parameter, starting at 1.
+ *
+ *      int value
+ *          Value of the parameter.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbBindInt(DB_STATEMENT statement, int index, int value)
+{
+    if ((!statement) || (statement->magic != DB_STATEMENT_MAGIC)) {
+        return MsgLog(DBS_INVARG, "DbBindInt");
+    }
+
+    if (sqlite3_bind_int(statement->data, index, value) != SQLITE_OK) {
+        statement->bind_status = MsgLog(DBS_STMTBIND, index,
+            DbErrmsg(statement->handle));
+        return statement->bind_status;
+    }
+
+    return 0;
+}
+
+
+
+/*+
+ * DbBindString - Bind String Parameter
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      int index
+ *          Index of the parameter, starting at 1.
+ *
+ *      const char* value
+ *          Value of the parameter; NULL binds an SQL NULL.  The string is
+ *          copied, so it need not outlive the call.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbBindString(DB_STATEMENT statement, int index, const char* value)
+{
+    int status; /* Status return from sqlite */
+
+    if ((!statement) || (statement->magic != DB_STATEMENT_MAGIC)) {
+        return MsgLog(DBS_INVARG, "DbBindString");
+    }
+
+    if (value) {
+        status = sqlite3_bind_text(statement->data, index, value, -1,
+            SQLITE_TRANSIENT);
+    }
+    else {
+        status = sqlite3_bind_null(statement->data, index);
+    }
+    if (status != SQLITE_OK) {
+        statement->bind_status = MsgLog(DBS_STMTBIND, index,
+            DbErrmsg(statement->handle));
+        return statement->bind_status;
+    }
+
+    return 0;
+}
+
+
+
+/*+
+ * DbExecuteStatement - Execute Prepared Statement
+ *
+ * Description:
+ *      Executes the prepared statement with the parameters bound so far and
+ *      returns the results (if any), as DbExecuteSql() does.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      DB_RESULT* result
+ *          Pointer to the result set is put here.  It must be freed by
+ *          DbFreeResult() before the statement is executed again or freed.
+ *          This is NULL if no data is returned.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbExecuteStatement(DB_STATEMENT statement, DB_RESULT* result)
+{
+    int status;     /* Status return */
+
+    if ((!statement) || (statement->magic != DB_STATEMENT_MAGIC) ||
+        (!result)) {
+        return MsgLog(DBS_INVARG, "DbExecuteStatement");
+    }
+    *result = NULL;
+    if (statement->bind_status != 0) {
+        return statement->bind_status;
+    }
+
+    DbgOutput(DBG_M_SQL, "%s\n", statement->sql);
+
+    *result = (DB_RESULT) MemCalloc(1, sizeof(struct db_result));
+    (*result)->magic = DB_RESULT_MAGIC;
+    (*result)->handle = statement->handle;
+    (*result)->data = statement->data;
+    (*result)->first_row = 1;
+    (*result)->statement = statement;
+
+    status = sqlite3_step(statement->data);
+    if (status == SQLITE_ROW) {
+        (*result)->count = sqlite3_data_count(statement->data);
+        status = 0;
+    }
+    else {
+
+        /*
+         * Either a statement with no results (such as INSERT), or an error.
+         * Reset the statement straight away so that it does not hold a lock
+         * on the database.
+         */
+
+        if (status == SQLITE_DONE) {
+            status = 0;
+        }
+        else {
+            status = MsgLog(DBS_SQLFAIL, DbErrmsg(statement->handle));
+        }
+        sqlite3_reset(statement->data);
+        MemFree(*result);
+        *result = NULL;
+    }
+
+    return status;
+}
+
+
+
+/*+
+ * DbExecuteStatementNoResult - Execute Prepared Statement, No Result
+ *
+ * Description:
+ *      Executes a prepared statement that is not expected to return data,
+ *      such as an INSERT or UPDATE.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbExecuteStatementNoResult(DB_STATEMENT statement)
+{
+    DB_RESULT   result = NULL;  /* Result set */
+    int         status;         /* Status return */
+
+    status = DbExecuteStatement(statement, &result);
+    if ((status == 0) && result) {
+        status = MsgLog(DBS_UNEXRES, statement->sql);
+        DbFreeResult(result);
+    }
+
+    return status;
+}
+
+
+
+/*+
+ * DbIntQueryStatement - Perform Integer Query With Prepared Statement
+ *
+ * Description:
+ *      Executes a prepared statement that returns a single integer, such as
+ *      a SELECT COUNT(*).
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      int* value
+ *          Result of the query.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbIntQueryStatement(DB_STATEMENT statement, int* value)
+{
+    DB_RESULT   result = NULL;  /* Result object */
+    DB_ROW      row = NULL;     /* Row object */
+    int         status;         /* Status return */
+
+    status = DbExecuteStatement(statement, &result);
+    if (status == 0) {
+        status = DbFetchRow(result, &row);
+        if (status == 0) {
+            status = DbInt(row, 0, value);
+            DbFreeRow(row);
+            row = NULL;
+
+            /* Query succeeded, but are there any more rows? */
+
+            if (DbFetchRow(result, &row) != -1) {
+                (void) MsgLog(DBS_TOOMANYROW, statement->sql);
+            }
+        }
+        else {
+            status = MsgLog(DBS_NORESULT);
+        }
+        DbFreeResult(result);
+        DbFreeRow(row);
+    }
+
+    return status;
+}
+
+
+
+/*+
+ * DbFreeStatement - Free Prepared Statement
+ *
+ * Description:
+ *      Hands the statement back.  A cached statement is reset and kept for
+ *      the next DbPrepare() of the same SQL; any other is finalized.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().  May be NULL, in which case
+ *          this function is a no-op.
+-*/
+
+void DbFreeStatement(DB_STATEMENT statement)
+{
+    if (statement) {
+        if (statement->magic == DB_STATEMENT_MAGIC) {
+            sqlite3_reset(statement->data);
+            sqlite3_clear_bindings(statement->data);
+
+            statement->bind_status = 0;
+
+            pthread_mutex_lock(&m_cache_lock);
+            statement->in_use = 0;
+            if (!statement->cached) {
+                DbStatementDestroy(statement);
+            }
+            pthread_mutex_unlock(&m_cache_lock);
+        }
+        else {
+            (void) MsgLog(DBS_INVARG, "DbFreeStatement");
+        }
+    }
+
+    return;
+}
+
+
+
+/*+
+ * DbStatementCacheFlush - Flush Statement Cache
+ *
+ * Description:
+ *      Finalizes the cached statements of a connection; called before the
+ *      connection is closed.  Statements still in use are taken out of the
+ *      cache and are finalized when they are freed.
+ *
+ * Arguments:
+ *      DB_HANDLE handle
+ *          Handle to the database connection.
+-*/
+
+void DbStatementCacheFlush(DB_HANDLE handle)
+{
+    int i;  /* Loop counter */
+
+    pthread_mutex_lock(&m_cache_lock);
+    for (i = 0; i < DB_STATEMENT_CACHE_SIZE; i++) {
+        if (m_cache[i] && (m_cache[i]->handle == handle)) {
+            if (m_cache[i]->in_use) {
+                m_cache[i]->cached = 0;
+            }
+            else {
+                DbStatementDestroy(m_cache[i]);
+            }
+            m_cache[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&m_cache_lock);
+
+    return;
+}
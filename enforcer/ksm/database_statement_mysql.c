@@ -0,0 +1,676 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2012 Nominet UK. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/*+
+ * database_statement_mysql.c - Prepared Statement Functions
+ *
+ * Description:
+ *      Prepared statements with bound parameters for the MySQL database.
+ *
+ *      Statements are kept in a small cache, keyed by connection and by the
+ *      text of the SQL.  The enforcer issues the same handful of queries for
+ *      every zone, differing only in the values, so with placeholders these
+ *      are compiled once per connection rather than once per zone.
+ *
+ *      A statement is obtained with DbPrepare(), bound with DbBindInt() and
+ *      DbBindString(), executed with one of the DbExecuteStatement()
+ *      functions and handed back with DbFreeStatement().  Any result set
+ *      must be freed (with DbFreeResult()) before the statement is.
+-*/
+
+#include <pthread.h>
+#include <string.h>
+
+#include <mysql.h>
+
+#include "ksm/dbsdef.h"
+#include "ksm/database.h"
+#include "ksm/debug.h"
+#include "ksm/memory.h"
+#include "ksm/message.h"
+#include "ksm/string_util.h"
+
+#define DB_STATEMENT_CACHE_SIZE 64  /* Statements cached over all connections */
+
+static DB_STATEMENT m_cache[DB_STATEMENT_CACHE_SIZE];
+static unsigned long m_cache_clock = 0;
+static pthread_mutex_t m_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/*+
+ * DbStatementDestroy - Destroy Prepared Statement
+ *
+ * Description:
+ *      Closes the statement and frees the structure.  The statement must
+ *      not be in the cache.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement to destroy.
+-*/
+
+static void DbStatementDestroy(DB_STATEMENT statement)
+{
+    int i;  /* Loop counter */
+
+    if (statement->data) {
+        mysql_stmt_close(statement->data);
+    }
+    for (i = 0; i < statement->params; i++) {
+        StrFree(statement->param_string[i]);
+    }
+    for (i = 0; i < statement->columns; i++) {
+        MemFree(statement->column_data[i]);
+    }
+    MemFree(statement->param_bind);
+    MemFree(statement->param_int);
+    MemFree(statement->param_string);
+    MemFree(statement->param_length);
+    MemFree(statement->column_bind);
+    MemFree(statement->column_data);
+    MemFree(statement->column_length);
+    MemFree(statement->column_null);
+    StrFree(statement->sql);
+    statement->magic = 0;
+    MemFree(statement);
+
+    return;
+}
+
+
+
+/*+
+ * DbStatementCreate - Create Prepared Statement
+ *
+ * Description:
+ *      Prepares the statement on the server and sets up the parameter and
+ *      result bindings.  Result columns are fetched as strings, so that
+ *      DbString() and friends work on them as on any other result.
+ *
+ * Arguments:
+ *      DB_HANDLE handle
+ *          Handle to the currently opened database.
+ *
+ *      const char* stmt_str
+ *          SQL statement.
+ *
+ *      DB_STATEMENT* statement
+ *          The new statement is returned here, NULL on error.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+static int DbStatementCreate(DB_HANDLE handle, const char* stmt_str,
+    DB_STATEMENT* statement)
+{
+    DB_STATEMENT    stmt;           /* New statement */
+    MYSQL_RES*      metadata;       /* Result set metadata */
+    int             i;              /* Loop counter */
+    int             status = 0;     /* Status return */
+
+    *statement = NULL;
+    stmt = (DB_STATEMENT) MemCalloc(1, sizeof(struct db_statement));
+    stmt->magic = DB_STATEMENT_MAGIC;
+    stmt->handle = handle;
+    stmt->sql = StrStrdup(stmt_str);
+
+    stmt->data = mysql_stmt_init((MYSQL*) handle);
+    if (stmt->data == NULL) {
+        status = MsgLog(DBS_STMTALLOC);
+        DbStatementDestroy(stmt);
+        return status;
+    }
+    if (mysql_stmt_prepare(stmt->data, stmt_str, strlen(stmt_str)) != 0) {
+        status = MsgLog(DBS_STMTPREP, mysql_stmt_error(stmt->data));
+        DbStatementDestroy(stmt);
+        return status;
+    }
+
+    stmt->params = (int) mysql_stmt_param_count(stmt->data);
+    if (stmt->params > 0) {
+        stmt->param_bind = MemCalloc(stmt->params, sizeof(MYSQL_BIND));
+        stmt->param_int = MemCalloc(stmt->params, sizeof(int));
+        stmt->param_string = MemCalloc(stmt->params, sizeof(char*));
+        stmt->param_length = MemCalloc(stmt->params, sizeof(unsigned long));
+        for (i = 0; i < stmt->params; i++) {
+            stmt->param_bind[i].buffer_type = MYSQL_TYPE_NULL;
+        }
+    }
+
+    metadata = mysql_stmt_result_metadata(stmt->data);
+    if (metadata) {
+        stmt->columns = (int) mysql_num_fields(metadata);
+        mysql_free_result(metadata);
+    }
+    if (stmt->columns > 0) {
+        stmt->column_bind = MemCalloc(stmt->columns, sizeof(MYSQL_BIND));
+        stmt->column_data = MemCalloc(stmt->columns, sizeof(char*));
+        stmt->column_length = MemCalloc(stmt->columns,
+            sizeof(unsigned long));
+        stmt->column_null = MemCalloc(stmt->columns, sizeof(my_bool));
+
+        /*
+         * No buffers: mysql_stmt_fetch() just reports the lengths and the
+         * values are fetched column by column into buffers of the right
+         * size in DbStatementFetch().
+         */
+
+        for (i = 0; i < stmt->columns; i++) {
+            stmt->column_bind[i].buffer_type = MYSQL_TYPE_STRING;
+            stmt->column_bind[i].length = &stmt->column_length[i];
+            stmt->column_bind[i].is_null = &stmt->column_null[i];
+        }
+    }
+
+    *statement = stmt;
+    return 0;
+}
+
+
+
+/*+
+ * DbPrepare - Prepare SQL Statement
+ *
+ * Description:
+ *      Returns a prepared statement for the given SQL, from the cache of
+ *      the connection if the same SQL has been prepared before and is not
+ *      in use.  Otherwise the statement is compiled and, if there is room
+ *      (or an unused statement of the same connection can be evicted),
+ *      added to the cache.
+ *
+ * Arguments:
+ *      DB_HANDLE handle
+ *          Handle to the currently opened database.
+ *
+ *      const char* stmt_str
+ *          SQL statement, with "?" placeholders for the parameters.
+ *
+ *      DB_STATEMENT* statement
+ *          The statement is returned here.  It must be handed back with
+ *          DbFreeStatement().  On error, this is NULL.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbPrepare(DB_HANDLE handle, const char* stmt_str, DB_STATEMENT* statement)
+{
+    DB_STATEMENT    stmt = NULL;    /* Statement found or created */
+    int             slot = -1;      /* Free cache slot */
+    int             victim = -1;    /* Cache slot to evict */
+    int             i;              /* Loop counter */
+    int             status = 0;     /* Status return */
+
+    if ((!handle) || (!stmt_str) || (*stmt_str == '\0') || (!statement)) {
+        return MsgLog(DBS_INVARG, "DbPrepare");
+    }
+    *statement = NULL;
+
+    pthread_mutex_lock(&m_cache_lock);
+
+    /* Look for an unused statement of this connection with the same SQL */
+
+    for (i = 0; i < DB_STATEMENT_CACHE_SIZE; i++) {
+        if (m_cache[i] == NULL) {
+            if (slot == -1) {
+                slot = i;
+            }
+        }
+        else if ((m_cache[i]->handle == handle) && (!m_cache[i]->in_use)) {
+            if (strcmp(m_cache[i]->sql, stmt_str) == 0) {
+                stmt = m_cache[i];
+                break;
+            }
+            if ((victim == -1) ||
+                (m_cache[i]->last_used < m_cache[victim]->last_used)) {
+                victim = i;
+            }
+        }
+    }
+
+    if (stmt == NULL) {
+
+        /* Not cached (or all copies busy), so compile it */
+
+        status = DbStatementCreate(handle, stmt_str, &stmt);
+        if (status != 0) {
+            pthread_mutex_unlock(&m_cache_lock);
+            return status;
+        }
+
+        if (slot == -1 && victim != -1) {
+            DbStatementDestroy(m_cache[victim]);
+            m_cache[victim] = NULL;
+            slot = victim;
+        }
+        if (slot != -1) {
+            stmt->cached = 1;
+            m_cache[slot] = stmt;
+        }
+    }
+
+    stmt->in_use = 1;
+    stmt->last_used = ++m_cache_clock;
+
+    pthread_mutex_unlock(&m_cache_lock);
+
+    *statement = stmt;
+    return 0;
+}
+
+
+
+/*+
+ * DbBindInt - Bind Integer Parameter
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      int index
+ *          Index of the parameter, starting at 1.
+ *
+ *      int value
+ *          Value of the parameter.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbBindInt(DB_STATEMENT statement, int index, int value)
+{
+    MYSQL_BIND* bind;   /* Binding of the parameter */
+
+    if ((!statement) || (statement->magic != DB_STATEMENT_MAGIC)) {
+        return MsgLog(DBS_INVARG, "DbBindInt");
+    }
+    if ((index < 1) || (index > statement->params)) {
+        statement->bind_status = MsgLog(DBS_INVINDEX, index,
+            statement->params);
+        return statement->bind_status;
+    }
+
+    statement->param_int[index - 1] = value;
+    bind = &statement->param_bind[index - 1];
+    memset(bind, 0, sizeof(MYSQL_BIND));
+    bind->buffer_type = MYSQL_TYPE_LONG;
+    bind->buffer = &statement->param_int[index - 1];
+
+    return 0;
+}
+
+
+
+/*+
+ * DbBindString - Bind String Parameter
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      int index
+ *          Index of the parameter, starting at 1.
+ *
+ *      const char* value
+ *          Value of the parameter; NULL binds an SQL NULL.  The string is
+ *          copied, so it need not outlive the call.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbBindString(DB_STATEMENT statement, int index, const char* value)
+{
+    MYSQL_BIND* bind;   /* Binding of the parameter */
+
+    if ((!statement) || (statement->magic != DB_STATEMENT_MAGIC)) {
+        return MsgLog(DBS_INVARG, "DbBindString");
+    }
+    if ((index < 1) || (index > statement->params)) {
+        statement->bind_status = MsgLog(DBS_INVINDEX, index,
+            statement->params);
+        return statement->bind_status;
+    }
+
+    StrFree(statement->param_string[index - 1]);
+    bind = &statement->param_bind[index - 1];
+    memset(bind, 0, sizeof(MYSQL_BIND));
+    if (value) {
+        statement->param_string[index - 1] = StrStrdup(value);
+        statement->param_length[index - 1] = strlen(value);
+        bind->buffer_type = MYSQL_TYPE_STRING;
+        bind->buffer = statement->param_string[index - 1];
+        bind->buffer_length = statement->param_length[index - 1];
+        bind->length = &statement->param_length[index - 1];
+    }
+    else {
+        bind->buffer_type = MYSQL_TYPE_NULL;
+    }
+
+    return 0;
+}
+
+
+
+/*+
+ * DbExecuteStatement - Execute Prepared Statement
+ *
+ * Description:
+ *      Executes the prepared statement with the parameters bound so far and
+ *      returns the results (if any), as DbExecuteSql() does.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      DB_RESULT* result
+ *          Pointer to the result set is put here.  It must be freed by
+ *          DbFreeResult() before the statement is executed again or freed.
+ *          This is NULL if no data is returned.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbExecuteStatement(DB_STATEMENT statement, DB_RESULT* result)
+{
+    MYSQL_STMT* stmt;   /* MySQL statement */
+
+    if ((!statement) || (statement->magic != DB_STATEMENT_MAGIC) ||
+        (!result)) {
+        return MsgLog(DBS_INVARG, "DbExecuteStatement");
+    }
+    *result = NULL;
+    if (statement->bind_status != 0) {
+        return statement->bind_status;
+    }
+    stmt = statement->data;
+
+    DbgOutput(DBG_M_SQL, "%s\n", statement->sql);
+
+    if ((statement->params > 0) &&
+        (mysql_stmt_bind_param(stmt, statement->param_bind) != 0)) {
+        return MsgLog(DBS_STMTBIND, 0, mysql_stmt_error(stmt));
+    }
+    if (mysql_stmt_execute(stmt) != 0) {
+        return MsgLog(DBS_SQLFAIL, mysql_stmt_error(stmt));
+    }
+
+    if (statement->columns == 0) {
+
+        /* A statement with no results, such as INSERT */
+
+        return 0;
+    }
+
+    if ((mysql_stmt_bind_result(stmt, statement->column_bind) != 0) ||
+        (mysql_stmt_store_result(stmt) != 0)) {
+        return MsgLog(DBS_SQLFAIL, mysql_stmt_error(stmt));
+    }
+
+    *result = (DB_RESULT) MemCalloc(1, sizeof(struct db_result));
+    (*result)->magic = DB_RESULT_MAGIC;
+    (*result)->handle = statement->handle;
+    (*result)->count = statement->columns;
+    (*result)->statement = statement;
+
+    return 0;
+}
+
+
+
+/*+
+ * DbStatementFetch - Fetch Row of Prepared Statement
+ *
+ * Description:
+ *      Fetches the next row of the result of a prepared statement into
+ *      column_data, where DbFetchRow() picks it up as a MYSQL_ROW.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Executed statement.
+ *
+ * Returns:
+ *      int
+ *          0       Success, row fetched
+ *          -1      No more rows
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbStatementFetch(DB_STATEMENT statement)
+{
+    MYSQL_BIND  bind;       /* Binding to fetch a single column */
+    int         i;          /* Loop counter */
+    int         status;     /* Status return */
+
+    status = mysql_stmt_fetch(statement->data);
+    if (status == MYSQL_NO_DATA) {
+        return -1;
+    }
+    else if ((status != 0) && (status != MYSQL_DATA_TRUNCATED)) {
+        return MsgLog(DBS_SQLFAIL, mysql_stmt_error(statement->data));
+    }
+
+    for (i = 0; i < statement->columns; i++) {
+        MemFree(statement->column_data[i]);
+        if (statement->column_null[i]) {
+            continue;
+        }
+        statement->column_data[i] = MemMalloc(statement->column_length[i] + 1);
+        if (statement->column_length[i] > 0) {
+            memset(&bind, 0, sizeof(bind));
+            bind.buffer_type = MYSQL_TYPE_STRING;
+            bind.buffer = statement->column_data[i];
+            bind.buffer_length = statement->column_length[i];
+            if (mysql_stmt_fetch_column(statement->data, &bind, i, 0) != 0) {
+                return MsgLog(DBS_SQLFAIL, mysql_stmt_error(statement->data));
+            }
+        }
+        statement->column_data[i][statement->column_length[i]] = '\0';
+    }
+
+    return 0;
+}
+
+
+
+/*+
+ * DbExecuteStatementNoResult - Execute Prepared Statement, No Result
+ *
+ * Description:
+ *      Executes a prepared statement that is not expected to return data,
+ *      such as an INSERT or UPDATE.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbExecuteStatementNoResult(DB_STATEMENT statement)
+{
+    DB_RESULT   result = NULL;  /* Result set */
+    int         status;         /* Status return */
+
+    status = DbExecuteStatement(statement, &result);
+    if ((status == 0) && result) {
+        status = MsgLog(DBS_UNEXRES, statement->sql);
+        DbFreeResult(result);
+    }
+
+    return status;
+}
+
+
+
+/*+
+ * DbIntQueryStatement - Perform Integer Query With Prepared Statement
+ *
+ * Description:
+ *      Executes a prepared statement that returns a single integer, such as
+ *      a SELECT COUNT(*).
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().
+ *
+ *      int* value
+ *          Result of the query.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error code.  A message will have been output.
+-*/
+
+int DbIntQueryStatement(DB_STATEMENT statement, int* value)
+{
+    DB_RESULT   result = NULL;  /* Result object */
+    DB_ROW      row = NULL;     /* Row object */
+    int         status;         /* Status return */
+
+    status = DbExecuteStatement(statement, &result);
+    if (status == 0) {
+        status = DbFetchRow(result, &row);
+        if (status == 0) {
+            status = DbInt(row, 0, value);
+            DbFreeRow(row);
+            row = NULL;
+
+            /* Query succeeded, but are there any more rows? */
+
+            if (DbFetchRow(result, &row) != -1) {
+                (void) MsgLog(DBS_TOOMANYROW, statement->sql);
+            }
+        }
+        else {
+            status = MsgLog(DBS_NORESULT);
+        }
+        DbFreeResult(result);
+        DbFreeRow(row);
+    }
+
+    return status;
+}
+
+
+
+/*+
+ * DbFreeStatement - Free Prepared Statement
+ *
+ * Description:
+ *      Hands the statement back.  A cached statement has its parameters
+ *      cleared and is kept for the next DbPrepare() of the same SQL; any
+ *      other is closed.
+ *
+ * Arguments:
+ *      DB_STATEMENT statement
+ *          Statement returned by DbPrepare().  May be NULL, in which case
+ *          this function is a no-op.
+-*/
+
+void DbFreeStatement(DB_STATEMENT statement)
+{
+    int i;  /* Loop counter */
+
+    if (statement) {
+        if (statement->magic == DB_STATEMENT_MAGIC) {
+            mysql_stmt_free_result(statement->data);
+            for (i = 0; i < statement->params; i++) {
+                StrFree(statement->param_string[i]);
+                memset(&statement->param_bind[i], 0, sizeof(MYSQL_BIND));
+                statement->param_bind[i].buffer_type = MYSQL_TYPE_NULL;
+            }
+
+            statement->bind_status = 0;
+
+            pthread_mutex_lock(&m_cache_lock);
+            statement->in_use = 0;
+            if (!statement->cached) {
+                DbStatementDestroy(statement);
+            }
+            pthread_mutex_unlock(&m_cache_lock);
+        }
+        else {
+            (void) MsgLog(DBS_INVARG, "DbFreeStatement");
+        }
+    }
+
+    return;
+}
+
+
+
+/*+
+ * DbStatementCacheFlush - Flush Statement Cache
+ *
+ * Description:
+ *      Closes the cached statements of a connection; called before the
+ *      connection is closed.  Statements still in use are taken out of the
+ *      cache and are closed when they are freed.
+ *
+ * Arguments:
+ *      DB_HANDLE handle
+ *          Handle to the database connection.
+-*/
+
+void DbStatementCacheFlush(DB_HANDLE handle)
+{
+    int i;  /* Loop counter */
+
+    pthread_mutex_lock(&m_cache_lock);
+    for (i = 0; i < DB_STATEMENT_CACHE_SIZE; i++) {
+        if (m_cache[i] && (m_cache[i]->handle == handle)) {
+            if (m_cache[i]->in_use) {
+                m_cache[i]->cached = 0;
+            }
+            else {
+                DbStatementDestroy(m_cache[i]);
+            }
+            m_cache[i] = NULL;
+        }
+    }
+    pthread_mutex_unlock(&m_cache_lock);
+
+    return;
+}
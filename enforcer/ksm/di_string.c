@@ -116,9 +116,12 @@ char* DisSpecifyInit(const char* table, const char* cols)
 /*+
  * DisAppendInt - Append Integer Field
  * DisAppendString - Append String Field
+ * DisAppendParam - Append Parameter Field
  *
  * Description:
- *      Appends an integer or string field to the sql.
+ *      Appends an integer or string field to the sql.  DisAppendParam
+ *      appends a "?" placeholder, for a value bound to a prepared statement
+ *      (see DbPrepare).
  *
  * Arguments:
  *      char** sql
@@ -155,6 +158,13 @@ void DisAppendString(char** sql, const char* what)
     return;
 }
 
+void DisAppendParam(char** sql)
+{
+    StrAppend(sql, ", ?");
+
+    return;
+}
+
 
 
 /*+
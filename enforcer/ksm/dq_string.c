@@ -197,6 +197,7 @@ static void DqsAppendComparison(char** query, DQS_COMPARISON compare)
  * DqsConditionInt - Append Integer Condition to Query
  * DqsConditionString - Append String Condition to Query
  * DqsConditionKeyword - Append Keyword Condition to Query
+ * DqsConditionParam - Append Parameter Condition to Query
  *
  * Description:
  *      Appends a condition to the basic query.
@@ -204,6 +205,9 @@ static void DqsAppendComparison(char** query, DQS_COMPARISON compare)
  *      -Int        Appends a comparison with an integer
  *      -String     Appends a comparison with a string, quoting the string
  *      -Keyword    Appends more complicated condition
+ *      -Param      Appends a comparison with a "?" placeholder, for a value
+ *                  bound to a prepared statement (see DbPrepare).  No value
+ *                  argument is given.
  *
  * Arguments:
  *      char** query
@@ -261,6 +265,14 @@ void DqsConditionKeyword(char** query, const char* field,
     return;
 }
 
+void DqsConditionParam(char** query, const char* field, DQS_COMPARISON compare,
+    int index)
+{
+    DqsConditionKeyword(query, field, compare, "?", index);
+
+    return;
+}
+
 
 /*+
  * DqsOrderBy - Add Order By Clause
@@ -42,7 +42,7 @@ extern "C" {
 
 #include <stdlib.h>
 
-#define KSM_DB_VERSION 3    /* This needs to match that given in the dbadmin table */
+#define KSM_DB_VERSION 4    /* This needs to match that given in the dbadmin table */
 
 #define MYSQL_DB 1
 #define SQLITE_DB 2
@@ -54,11 +54,35 @@ extern "C" {
 typedef MYSQL*	DB_HANDLE;				/* Connection handle */
 typedef unsigned long DB_ID;			/* Database row identification */
 
+struct db_statement {					/* Prepared statement */
+	unsigned int	magic;				/* Identification */
+	DB_HANDLE		handle;				/* Parent database handle */
+	MYSQL_STMT*		data;				/* Prepared statement */
+	char*			sql;				/* Statement text, the cache key */
+	int				cached;				/* Set if held in the statement cache */
+	int				in_use;				/* Set while handed out by DbPrepare */
+	unsigned long	last_used;			/* Cache age, for eviction */
+	int				bind_status;		/* First binding error, if any */
+	int				params;				/* Number of parameters */
+	MYSQL_BIND*		param_bind;			/* Parameter bindings */
+	int*			param_int;			/* Integer parameter values */
+	char**			param_string;		/* String parameter values */
+	unsigned long*	param_length;		/* String parameter lengths */
+	int				columns;			/* Number of result columns */
+	MYSQL_BIND*		column_bind;		/* Result column bindings */
+	char**			column_data;		/* Current row, as a MYSQL_ROW */
+	unsigned long*	column_length;		/* Lengths of the current row */
+	my_bool*		column_null;		/* NULL flags of the current row */
+};
+#define DB_STATEMENT_MAGIC	(0x5e1ec7ed)
+typedef struct db_statement* DB_STATEMENT;	/* Handle to a prepared statement */
+
 struct db_result {						/* Result structure */
 	unsigned int	magic;				/* Identification */
 	int				count;				/* Field count */
 	DB_HANDLE		handle;				/* Parent database handle */
 	MYSQL_RES*		data;				/* Pointer to the result set */
+	DB_STATEMENT	statement;			/* Prepared statement, if any */
 };
 #define DB_RESULT_MAGIC	(0x10203044)
 
@@ -72,6 +96,8 @@ struct db_row {							/* Row structure */
 #define DB_ROW_MAGIC	(0xbedea133)
 typedef	struct db_row*	DB_ROW;			/* Handle to the row structure */
 
+int DbStatementFetch(DB_STATEMENT statement);	/* Row of a DB_STATEMENT result */
+
 #else
 
 #include <sqlite3.h>
@@ -79,6 +105,19 @@ typedef	struct db_row*	DB_ROW;			/* Handle to the row structure */
 typedef sqlite3* DB_HANDLE;             /* Connection handle*/
 typedef unsigned long DB_ID;			/* Database row identification */
 
+struct db_statement {					/* Prepared statement */
+	unsigned int	magic;				/* Identification */
+	DB_HANDLE		handle;				/* Parent database handle */
+	sqlite3_stmt*	data;				/* Prepared statement */
+	char*			sql;				/* Statement text, the cache key */
+	int				cached;				/* Set if held in the statement cache */
+	int				in_use;				/* Set while handed out by DbPrepare */
+	unsigned long	last_used;			/* Cache age, for eviction */
+	int				bind_status;		/* First binding error, if any */
+};
+#define DB_STATEMENT_MAGIC	(0x5e1ec7ed)
+typedef struct db_statement* DB_STATEMENT;	/* Handle to a prepared statement */
+
 struct db_result {						/* Result structure */
 	unsigned int	magic;				/* Identification */
 	int				count;				/* Field count */
@@ -86,6 +125,7 @@ struct db_result {						/* Result structure */
     sqlite3_stmt*   data;               /* current result set (or as close to 
                                            this as sqlite gets) */
 	short			first_row;			/* Set to 1 when no rows have been fetched */
+	DB_STATEMENT	statement;			/* Prepared statement, if any */
 };
 #define DB_RESULT_MAGIC	(0x10203044)
 
@@ -101,10 +141,22 @@ typedef	struct db_row*	DB_ROW;
 
 #endif
 
+/*
+ * Each thread has its own connection: DbConnect() stores the handle for the
+ * calling thread, and DbHandle() and the transaction functions work on the
+ * connection of the calling thread.
+ */
+
+typedef struct {
+    DB_HANDLE   handle;             /* Connection, NULL if not connected */
+    int         transaction_depth;  /* Open transaction levels */
+} DB_THREAD;
+
 /* Initialization and rundown */
 
 void DbInit(void);
 void DbRundown(void);
+DB_THREAD* DbThread(void);
 
 /* Basic connection to the database */
 
@@ -112,6 +164,7 @@ int DbConnect(DB_HANDLE* dbhandle, const char* database, ...);
 int DbDisconnect(DB_HANDLE dbhandle);
 int DbConnected(DB_HANDLE dbhandle);
 int DbCheckConnected(DB_HANDLE dbhandle);
+int DbCheckpoint(void);
 
 DB_HANDLE DbHandle(void);
 
@@ -139,11 +192,29 @@ const char* DbErrmsg(DB_HANDLE handle);
 int DbErrno(DB_HANDLE handle);
 int DbLastRowId(DB_HANDLE handle, DB_ID* id);
 
+/*
+ * Prepared statements.  Statements are cached per connection, keyed by the
+ * text of the SQL, so a statement built with "?" placeholders is compiled
+ * once and then only re-bound.  Parameter indexes start at 1.  A binding
+ * error is also returned by the next execution of the statement, so a run
+ * of DbBind calls need only be checked there.
+ */
+
+int DbPrepare(DB_HANDLE handle, const char* stmt_str, DB_STATEMENT* statement);
+int DbBindInt(DB_STATEMENT statement, int index, int value);
+int DbBindString(DB_STATEMENT statement, int index, const char* value);
+int DbExecuteStatement(DB_STATEMENT statement, DB_RESULT* result);
+int DbExecuteStatementNoResult(DB_STATEMENT statement);
+int DbIntQueryStatement(DB_STATEMENT statement, int* value);
+void DbFreeStatement(DB_STATEMENT statement);
+void DbStatementCacheFlush(DB_HANDLE handle);
+
 /* Transaction stuff */
 
 int DbBeginTransaction(void);
 int DbCommit(void);
 int DbRollback(void);
+int DbTransactionDepth(void);
 
 /* Utility "quote" function */
 int DbQuoteString(DB_HANDLE handle, const char* in, char* buffer, size_t buflen);
@@ -80,6 +80,8 @@ void DqsConditionString(char** query, const char* field, DQS_COMPARISON compare,
     const char* value, int clause);
 void DqsConditionKeyword(char** query, const char* field,
     DQS_COMPARISON compare, const char* value, int clause);
+void DqsConditionParam(char** query, const char* field, DQS_COMPARISON compare,
+    int clause);
 void DqsOrderBy(char** query, const char* field);
 void DqsEnd(char** query);
 void DqsFree(char* query);
@@ -90,6 +92,7 @@ char* DisInit(const char* table);
 char* DisSpecifyInit(const char* table, const char* cols);
 void DisAppendInt(char** sql, int what);
 void DisAppendString(char** sql, const char* what);
+void DisAppendParam(char** sql);
 void DisEnd(char** sql);
 void DisFree(char* sql);
 
@@ -59,6 +59,7 @@ extern "C" {
 #define DBS_STMTPREP	(DBS_BASE + 13)	/* ERROR: unable to create prepared statement - %s */
 #define DBS_TOOMANYROW	(DBS_BASE + 14)	/* WARNING: query '%s' returned too many rows, excess ignored */
 #define DBS_UNEXRES		(DBS_BASE + 15)	/* ERROR: unexpected result from executing SQL statement '%s' */
+#define DBS_STMTBIND	(DBS_BASE + 16)	/* ERROR: unable to bind parameter %d of prepared statement - %s */
 
 #ifdef __cplusplus
 };
@@ -300,6 +300,10 @@ int KsmZoneIdFromName(const char* zone_name, int* zone_id);
 int KsmZoneIdAndPolicyFromName(const char* zone_name, int* policy_id, int* zone_id);
 int KsmDeleteZone(int zone_id);
 int KsmZoneNameFromId(int zone_id, char** zone_name);
+int KsmZoneGenerationBump(int zone_id, int policy_id);
+int KsmZoneGenerationBumpIn(const char* zones_in);
+int KsmZoneGeneration(int zone_id, int* policy_id, int* generation, int* signconf_generation);
+int KsmZoneSetSignconfGeneration(int zone_id, int generation);
 
 #define UNSIGNED 0
 #define SIGNED 1
@@ -541,6 +545,9 @@ void KsmUpdateDSPublishKeyTime(KSM_KEYDATA* data, KSM_PARCOLL* collection, int z
 void KsmUpdateKEYPublishKeyTime(KSM_KEYDATA* data, KSM_PARCOLL* collection, int zone_id);
 int KsmUpdateKeyTime(const KSM_KEYDATA* data, const char* source,
     const char* destination, int interval, int zone_id);
+int KsmUpdatePolicy(int policy_id);
+int KsmUpdatePolicyKeyTime(int policy_id, int keytype, int state,
+    const char* source, const char* destination, int interval, int not_fixed);
 
 /* ksm_request */
 
@@ -587,6 +594,10 @@ int KsmRequestCheckCompromisedFlag(int keytype, int zone_id, int* comp_flag);
 int KsmRequestIssueKeys(int keytype, KSM_REQUEST_CALLBACK callback,
 	void* context, int zone_id);
 
+int KsmRequestPolicyKeys(int policy_id, const char* datetime);
+int KsmRequestPolicyDone(int policy_id, int zone_id, int* NewDS);
+void KsmRequestPolicyClear(void);
+
 int KsmRequestPrintKey(void* context, KSM_KEYDATA* data);
 
 int KsmRequestDNSSECKeys(const char* datetime, KSM_POLICY* policy);
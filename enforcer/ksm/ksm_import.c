@@ -224,6 +224,8 @@ int KsmImportZone(const char* zone_name, int policy_id, int fail_if_exists, int
     int         count = 0;      /* Do we already have a zone with this name? */
 	char*		zone_name_td = NULL; /* zone name with td swapped */
 	char 		in_clause[KSM_SQL_SIZE]; /* in part of where clause */
+    int         zone_id = -1;   /* ID of an existing zone */
+    int         old_policy_id = -1; /* Policy of an existing zone */
 
     /* check the arguments */
     if (zone_name == NULL || policy_id == 0) {
@@ -282,6 +284,21 @@ int KsmImportZone(const char* zone_name, int policy_id, int fail_if_exists, int
         if (fail_if_exists == 1) {
             return -2;
         }
+
+        /* A zone moving to another policy needs a new signconf */
+        status = KsmZoneIdAndPolicyFromName(zone_name, &old_policy_id, &zone_id);
+        if (status == 0 && old_policy_id != policy_id) {
+            status = KsmZoneGenerationBump(zone_id, -1);
+        }
+        else if (status == -1) {
+            /* Only known with the trailing dot the other way round */
+            status = 0;
+        }
+        if (status != 0) {
+            StrFree(zone_name_td);
+            return status;
+        }
+
         sql = DusInit(DB_ZONE_TABLE);
         DusSetInt(&sql, "policy_id", policy_id, 0);
         DusSetString(&sql, "signconf", signconf, 1);
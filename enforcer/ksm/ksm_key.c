@@ -88,6 +88,7 @@ int KsmKeyPairCreate(int policy_id, const char* HSMKeyID, int smID, int size, in
     unsigned long rowid;			/* ID of last inserted row */
     int         status = 0;         /* Status return */
     char*       sql = NULL;         /* SQL Statement */
+    DB_STATEMENT stmt = NULL;       /* Prepared statement */
 
     /* Check arguments */
     if (id == NULL) {
@@ -95,18 +96,28 @@ int KsmKeyPairCreate(int policy_id, const char* HSMKeyID, int smID, int size, in
     }
 
     sql = DisSpecifyInit("keypairs", "policy_id, HSMkey_id, securitymodule_id, size, algorithm, generate");
-    DisAppendInt(&sql, policy_id);
-    DisAppendString(&sql, HSMKeyID);
-    DisAppendInt(&sql, smID);
-    DisAppendInt(&sql, size);
-    DisAppendInt(&sql, alg);
-    DisAppendString(&sql, generate);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
     DisEnd(&sql);
 
-    /* Execute the statement */
+    /* Execute the statement; it is the same for every key generated */
 
-    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DisFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, policy_id);
+        DbBindString(stmt, 2, HSMKeyID);
+        DbBindInt(stmt, 3, smID);
+        DbBindInt(stmt, 4, size);
+        DbBindInt(stmt, 5, alg);
+        DbBindString(stmt, 6, generate);
+        status = DbExecuteStatementNoResult(stmt);
+    }
+    DbFreeStatement(stmt);
 
     if (status == 0) {
 
@@ -146,6 +157,8 @@ int KsmDnssecKeyCreate(int zone_id, int keypair_id, int keytype, int state, cons
     int         status = 0;         /* Status return */
     char*       sql = NULL;         /* SQL Statement */
     char*       columns = NULL;     /* what columns are we setting */
+    DB_STATEMENT stmt = NULL;       /* Prepared statement */
+    int         param = 0;          /* Parameter index */
 
     /* Check arguments */
     if (id == NULL) {
@@ -161,24 +174,40 @@ int KsmDnssecKeyCreate(int zone_id, int keypair_id, int keytype, int state, cons
         StrAppend(&columns, ", retire");
     }
 
+    /* The columns depend only on the state, so the statement is reused */
+
     sql = DisSpecifyInit("dnsseckeys", columns);
-    DisAppendInt(&sql, zone_id);
-    DisAppendInt(&sql, keypair_id);
-    DisAppendInt(&sql, keytype);
-    DisAppendInt(&sql, state);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
+    DisAppendParam(&sql);
     if (state != KSM_STATE_GENERATE) {
-        DisAppendString(&sql, time);
+        DisAppendParam(&sql);
     }
 	if (state == KSM_STATE_ACTIVE && (retTime != NULL && retTime[0] != '\0')) {
-        DisAppendString(&sql, retTime);
+        DisAppendParam(&sql);
     }
     DisEnd(&sql);
 
     /* Execute the statement */
 
-    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DisFree(sql);
     StrFree(columns);
+    if (status == 0) {
+        DbBindInt(stmt, ++param, zone_id);
+        DbBindInt(stmt, ++param, keypair_id);
+        DbBindInt(stmt, ++param, keytype);
+        DbBindInt(stmt, ++param, state);
+        if (state != KSM_STATE_GENERATE) {
+            DbBindString(stmt, ++param, time);
+        }
+        if (state == KSM_STATE_ACTIVE && (retTime != NULL && retTime[0] != '\0')) {
+            DbBindString(stmt, ++param, retTime);
+        }
+        status = DbExecuteStatementNoResult(stmt);
+    }
+    DbFreeStatement(stmt);
 
     if (status == 0) {
 
@@ -190,6 +219,11 @@ int KsmDnssecKeyCreate(int zone_id, int keypair_id, int keytype, int state, cons
 		}
     }
 
+    /* A key that is not just waiting to be used goes into the signconf */
+    if (status == 0 && state != KSM_STATE_GENERATE) {
+        status = KsmZoneGenerationBump(zone_id, -1);
+    }
+
     return status;
 }
 
@@ -659,6 +693,7 @@ int KsmKeyCountQueue(int keytype, int* count, int zone_id)
     int     status = 0;     /* Status return */ 
     char    in[128];        /* Easily large enought for 7 keys */ 
     size_t  nchar;          /* Number of output characters */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
 
     /* Create the SQL command to interrogate the database */ 
 
@@ -670,17 +705,25 @@ int KsmKeyCountQueue(int keytype, int* count, int zone_id)
     }
 
     sql = DqsCountInit("KEYDATA_VIEW"); 
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++); 
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++); 
     DqsConditionKeyword(&sql, "STATE", DQS_COMPARE_IN, in, clause++);
     if (zone_id != -1) { 
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++); 
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++); 
     } 
     DqsEnd(&sql); 
  
     /* Execute the query and free resources */ 
  
-    status = DbIntQuery(DbHandle(), count, sql); 
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql); 
+    if (status == 0) {
+        DbBindInt(stmt, 1, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, 2, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, count);
+    }
+    DbFreeStatement(stmt);
  
     /* Report any errors */ 
  
@@ -873,42 +916,53 @@ int KsmKeyGetUnallocated(int policy_id, int sm, int bits, int algorithm, int zon
 
     int     where = 0;          /* WHERE clause value */
     char*   sql = NULL;         /* SQL query */
-    DB_RESULT       result;     /* Handle converted to a result object */
+    DB_STATEMENT    stmt = NULL;    /* Prepared statement */
+    DB_RESULT       result = NULL;  /* Handle converted to a result object */
     DB_ROW      row = NULL;     /* Row data */
     int     status = 0;         /* Status return */
-    char    in_sql[1024];
+    int     param = 0;          /* Parameter index */
     char    in_sql2[1024];
 
     if (share_keys == KSM_KEYS_NOT_SHARED) {
         /* Construct the query */
         sql = DqsSpecifyInit("KEYDATA_VIEW","min(id)");
-        DqsConditionInt(&sql, "policy_id", DQS_COMPARE_EQ, policy_id, where++);
-        DqsConditionInt(&sql, "securitymodule_id", DQS_COMPARE_EQ, sm, where++);
-        DqsConditionInt(&sql, "size", DQS_COMPARE_EQ, bits, where++);
-        DqsConditionInt(&sql, "algorithm", DQS_COMPARE_EQ, algorithm, where++);
+        DqsConditionParam(&sql, "policy_id", DQS_COMPARE_EQ, where++);
+        DqsConditionParam(&sql, "securitymodule_id", DQS_COMPARE_EQ, where++);
+        DqsConditionParam(&sql, "size", DQS_COMPARE_EQ, where++);
+        DqsConditionParam(&sql, "algorithm", DQS_COMPARE_EQ, where++);
         DqsConditionKeyword(&sql, "zone_id", DQS_COMPARE_IS, "NULL", where++);
     } else {
-        snprintf(in_sql, 1024, "(select id from KEYALLOC_VIEW where zone_id = %d)", zone_id);
-        snprintf(in_sql2, 1024, "(select distinct id from KEYDATA_VIEW where policy_id = %d and state in (%d, %d))", policy_id, KSM_STATE_RETIRE, KSM_STATE_DEAD);
+        snprintf(in_sql2, 1024, "(select distinct id from KEYDATA_VIEW where policy_id = ? and state in (%d, %d))", KSM_STATE_RETIRE, KSM_STATE_DEAD);
 
         /* Construct the query */
         sql = DqsSpecifyInit("KEYALLOC_VIEW","min(id)");
-        DqsConditionInt(&sql, "policy_id", DQS_COMPARE_EQ, policy_id, where++);
-        DqsConditionInt(&sql, "securitymodule_id", DQS_COMPARE_EQ, sm, where++);
-        DqsConditionInt(&sql, "size", DQS_COMPARE_EQ, bits, where++);
-        DqsConditionInt(&sql, "algorithm", DQS_COMPARE_EQ, algorithm, where++);
+        DqsConditionParam(&sql, "policy_id", DQS_COMPARE_EQ, where++);
+        DqsConditionParam(&sql, "securitymodule_id", DQS_COMPARE_EQ, where++);
+        DqsConditionParam(&sql, "size", DQS_COMPARE_EQ, where++);
+        DqsConditionParam(&sql, "algorithm", DQS_COMPARE_EQ, where++);
         DqsConditionKeyword(&sql, "zone_id", DQS_COMPARE_IS, "NULL", where++);
-        DqsConditionKeyword(&sql, "id", DQS_COMPARE_NOT_IN, in_sql, where++);
+        DqsConditionKeyword(&sql, "id", DQS_COMPARE_NOT_IN, "(select id from KEYALLOC_VIEW where zone_id = ?)", where++);
         DqsConditionKeyword(&sql, "id", DQS_COMPARE_NOT_IN, in_sql2, where++);
     }
-    /* Execute query and free up the query string */
-    status = DbExecuteSql(DbHandle(), sql, &result);
+    /* Prepare (or reuse) the statement and free up the query string */
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, ++param, policy_id);
+        DbBindInt(stmt, ++param, sm);
+        DbBindInt(stmt, ++param, bits);
+        DbBindInt(stmt, ++param, algorithm);
+        if (share_keys != KSM_KEYS_NOT_SHARED) {
+            DbBindInt(stmt, ++param, zone_id);
+            DbBindInt(stmt, ++param, policy_id);
+        }
+        status = DbExecuteStatement(stmt, &result);
+    }
     
     if (status != 0)
     {
         status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
-        DbFreeResult(result);
+        DbFreeStatement(stmt);
         return status;
 	}
 
@@ -925,6 +979,7 @@ int KsmKeyGetUnallocated(int policy_id, int sm, int bits, int algorithm, int zon
 
     DbFreeRow(row);
     DbFreeResult(result);
+    DbFreeStatement(stmt);
     return status;
 }
 
@@ -1011,6 +1066,7 @@ int KsmKillKey(int keypair_id, int zone_id)
     int         status = 0;         /* Status return */
     char*       sql = NULL;         /* SQL Statement */
     int         set = 0;
+    char        in[128];            /* Zones holding the key */
     char*       now = DtParseDateTimeString("now");
 
     /* Check datetime in case it came back NULL */
@@ -1019,6 +1075,19 @@ int KsmKillKey(int keypair_id, int zone_id)
         exit(1);
     }
 
+    /* Mark the zones that lose the key as changed */
+    if (zone_id != -1) {
+        status = KsmZoneGenerationBump(zone_id, -1);
+    }
+    else {
+        snprintf(in, sizeof(in), "(SELECT zone_id FROM dnsseckeys WHERE keypair_id = %d)", keypair_id);
+        status = KsmZoneGenerationBumpIn(in);
+    }
+    if (status != 0) {
+        StrFree(now);
+        return status;
+    }
+
     sql = DusInit("dnsseckeys");
     DusSetInt(&sql, "STATE", KSM_STATE_DEAD, set++);
     DusSetString(&sql, "DEAD", now, set++);
@@ -38,6 +38,7 @@
 -*/
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,6 +53,7 @@
 #include "ksm/ksmdef.h"
 #include "ksm/ksm.h"
 #include "ksm/ksm_internal.h"
+#include "ksm/memory.h"
 #include "ksm/message.h"
 #include "ksm/string_util.h"
 
@@ -382,18 +384,51 @@ int KsmCollectionInit(KSM_PARCOLL* data)
  *                  output.
 -*/
 
-static KSM_PARCOLL __parcoll_cache;
-static int __parcoll_cache_policy_id;
-static int __parcoll_cached = 0;
-static int __parcoll_cache_enabled = 0;
+/* The last collection read, kept per thread like the database connection */
+
+typedef struct {
+    KSM_PARCOLL data;
+    int policy_id;
+    int cached;
+    int enabled;
+} KSM_PARCOLL_CACHE;
+
+static pthread_key_t __parcoll_cache_key;
+static pthread_once_t __parcoll_cache_once = PTHREAD_ONCE_INIT;
+
+static void KsmParameterCollectionCacheFree(void* data)
+{
+    MemFree(data);
+}
+
+static void KsmParameterCollectionCacheKey(void)
+{
+    (void) pthread_key_create(&__parcoll_cache_key,
+        KsmParameterCollectionCacheFree);
+}
+
+static KSM_PARCOLL_CACHE* KsmParameterCollectionCacheGet(void)
+{
+    KSM_PARCOLL_CACHE* cache = NULL;
+
+    (void) pthread_once(&__parcoll_cache_once, KsmParameterCollectionCacheKey);
+    cache = (KSM_PARCOLL_CACHE*) pthread_getspecific(__parcoll_cache_key);
+    if (cache == NULL) {
+        cache = (KSM_PARCOLL_CACHE*) MemCalloc(1, sizeof(KSM_PARCOLL_CACHE));
+        (void) pthread_setspecific(__parcoll_cache_key, cache);
+    }
+    return cache;
+}
 
 void KsmParameterCollectionCache(int enable) {
-    if (enable && !__parcoll_cache_enabled) {
-        __parcoll_cache_enabled = 1;
-        __parcoll_cached = 0;
+    KSM_PARCOLL_CACHE* cache = KsmParameterCollectionCacheGet();
+
+    if (enable && !cache->enabled) {
+        cache->enabled = 1;
+        cache->cached = 0;
     }
-    else if (!enable && __parcoll_cache_enabled) {
-        __parcoll_cache_enabled = 0;
+    else if (!enable && cache->enabled) {
+        cache->enabled = 0;
     }
 }
 
@@ -401,14 +436,15 @@ int KsmParameterCollection(KSM_PARCOLL* data, int policy_id)
 {
     int status = 0;
     int param_id;
+    KSM_PARCOLL_CACHE* cache = KsmParameterCollectionCacheGet();
 
     /* check the arguments */
     if (data == NULL) {
         return MsgLog(KSM_INVARG, "NULL data");
     }
 
-    if (__parcoll_cache_enabled && __parcoll_cached && __parcoll_cache_policy_id == policy_id) {
-        memcpy(data, &__parcoll_cache, sizeof(KSM_PARCOLL));
+    if (cache->enabled && cache->cached && cache->policy_id == policy_id) {
+        memcpy(data, &cache->data, sizeof(KSM_PARCOLL));
         return 0;
     }
 
@@ -478,10 +514,10 @@ int KsmParameterCollection(KSM_PARCOLL* data, int policy_id)
         data->kskroll = KSM_ROLL_DEFAULT;
     /*}*/
 
-    if (__parcoll_cache_enabled) {
-        memcpy(&__parcoll_cache, data, sizeof(KSM_PARCOLL));
-        __parcoll_cache_policy_id = policy_id;
-        __parcoll_cached = 1;
+    if (cache->enabled) {
+        memcpy(&cache->data, data, sizeof(KSM_PARCOLL));
+        cache->policy_id = policy_id;
+        cache->cached = 1;
     }
 
     return 0;
@@ -518,6 +554,7 @@ int KsmParameterSet(const char* name, const char* category, int value, int polic
     int             set = 0;                /* SET clause value */
     char*           sql = NULL;             /* SQL for the insert */
     int             where = 0;              /* WHERE clause value */
+    int             changed = 0;            /* Did the value change? */
 
     /* Check to see if the parameter exists */
 
@@ -526,6 +563,8 @@ int KsmParameterSet(const char* name, const char* category, int value, int polic
 
         /* It does.  Update the value */
 
+        changed = (curvalue != value);
+
         sql = DusInit("parameters_policies");
         DusSetInt(&sql, "value", value, set++);
         DusConditionInt(&sql, "parameter_id", DQS_COMPARE_EQ, param_id, where++);
@@ -537,6 +576,7 @@ int KsmParameterSet(const char* name, const char* category, int value, int polic
     }
     else if (status == -2) {
         /* param name is legal, but is not set for this policy */
+        changed = 1;
         sql = DisInit("parameters_policies");
         DisAppendInt(&sql, param_id);
         DisAppendInt(&sql, policy_id);
@@ -552,6 +592,11 @@ int KsmParameterSet(const char* name, const char* category, int value, int polic
      * }
      */
 
+    /* The signconf of zones on the policy may depend on the value */
+    if (status == 0 && changed) {
+        status = KsmZoneGenerationBump(-1, policy_id);
+    }
+
     return status;
 }
 
@@ -625,6 +625,11 @@ int KsmPolicyUpdateSalt(KSM_POLICY* policy)
                 /* All OK, execute the statement */
 
                 status = DbExecuteSqlNoResult(DbHandle(), buffer);
+
+                /* The new salt goes into the signconf of every zone */
+                if (status == 0) {
+                    status = KsmZoneGenerationBump(-1, policy->id);
+                }
             }
             else {
                 /* Unable to create update statement */
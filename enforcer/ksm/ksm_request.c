@@ -37,6 +37,7 @@
 
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "ksm/database.h"
@@ -60,6 +61,10 @@
  *      Updates the key times and then calls KsmRequestKeysByType to process
  *      keys of the type chosen by the keytype argument.
  *
+ *      If KsmRequestPolicyKeys has dealt with the zone already, the key times
+ *      are not updated first and KsmRequestKeysByType skips the state changes
+ *      made there.
+ *
  * Arguments:
  *      int keytype
  *          Key type for which the request should happen.
@@ -109,8 +114,13 @@ int KsmRequestKeys(int keytype, int rollover, const char* datetime,
         return status;
     }
 
-    /* Update the estimated times of state change */
-    status = KsmUpdate(policy_id, zone_id);
+    /*
+     * Update the estimated times of state change, unless that was done for
+     * all zones of the policy (KsmRequestPolicyKeys)
+     */
+    if (rollover || !KsmRequestPolicyDone(policy_id, zone_id, NULL)) {
+        status = KsmUpdate(policy_id, zone_id);
+    }
     if (status == 0) {
 
         /* Process all key types */
@@ -220,6 +230,7 @@ int KsmRequestKeysByType(int keytype, int rollover, const char* datetime,
     int     status;         /* Status return */
     char*   zone_name = NULL;  /* For rollover message, if needed */
     int     manual_rollover = 0;    /* Flag specific to keytype */
+    int     evaluated = 0;  /* Steps 0a to 2a done by KsmRequestPolicyKeys? */
 
 	/* Check that we have a valid key type */
 
@@ -251,6 +262,17 @@ int KsmRequestKeysByType(int keytype, int rollover, const char* datetime,
         return status;
     }
 
+    /*
+     * If the keys of all zones on the policy have been through
+     * KsmRequestPolicyKeys, steps 0a to 2a have been done already; that only
+     * leaves their effect on NewDS to pick up.
+     */
+
+    if (!rollover) {
+        evaluated = KsmRequestPolicyDone(policy_id, zone_id,
+            (keytype == KSM_TYPE_KSK) ? NewDS : NULL);
+    }
+
     /*
      * Step 0: If rolling over the key, set the expected retirement date of
      * active keys to the given date/time.
@@ -275,7 +297,7 @@ int KsmRequestKeysByType(int keytype, int rollover, const char* datetime,
      * Step 0a: Complete Key rollover of standbykeys in KEYPUBLISH state
      * if we are after their active time, move them into the active state
      */
-    if (keytype == KSM_TYPE_KSK) {
+    if (keytype == KSM_TYPE_KSK && !evaluated) {
         status = KsmRequestChangeStateKeyPublishActive(datetime, zone_id, policy_id, NewDS);
         if (status != 0) {
             return status;
@@ -299,9 +321,11 @@ int KsmRequestKeysByType(int keytype, int rollover, const char* datetime,
      * time.
      */
 
-    status = KsmRequestChangeStateRetireDead(keytype, datetime, zone_id, policy_id, collection.kskroll, NewDS);
-    if (status != 0) {
-        return status;
+    if (!evaluated) {
+        status = KsmRequestChangeStateRetireDead(keytype, datetime, zone_id, policy_id, collection.kskroll, NewDS);
+        if (status != 0) {
+            return status;
+        }
     }
 
     /*
@@ -309,9 +333,9 @@ int KsmRequestKeysByType(int keytype, int rollover, const char* datetime,
      * been in the zone long enough.
      */
 
-    if (keytype == KSM_TYPE_ZSK ||
+    if (!evaluated && (keytype == KSM_TYPE_ZSK ||
             collection.kskroll == KSM_ROLL_DNSKEY ||
-            first_pass == 1) {
+            first_pass == 1)) {
         status = KsmRequestChangeStatePublishReady(keytype, datetime, zone_id, policy_id, NewDS);
         if (status != 0) {
             return status;
@@ -323,7 +347,7 @@ int KsmRequestKeysByType(int keytype, int rollover, const char* datetime,
      * been in the zone long enough.
      */
 
-    if (keytype == KSM_TYPE_KSK) {
+    if (keytype == KSM_TYPE_KSK && !evaluated) {
         status = KsmRequestChangeStateDSPublishDSReady(keytype, datetime, zone_id, policy_id);
         if (status != 0) {
             return status;
@@ -522,6 +546,7 @@ int KsmRequestSetActiveExpectedRetire(int keytype, const char* datetime, int zon
 {
     int     count = 0;      /* Count of keys whose date will be set */
     char*   sql = NULL;     /* For creating the SQL command */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status = 0;     /* Status return */
     int     where = 0;      /* For the SQL selection */
     int     i = 0;          /* A counter */
@@ -535,15 +560,23 @@ int KsmRequestSetActiveExpectedRetire(int keytype, const char* datetime, int zon
     /* Count how many keys will have the retire date set */
 
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, where++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, where++);
     DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, KSM_STATE_ACTIVE, where++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, where++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, where++);
     }
     DqsEnd(&sql);
 
-    status = DbIntQuery(DbHandle(), &count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, 2, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, &count);
+    }
+    DbFreeStatement(stmt);
 
     if (status != 0) {
         status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
@@ -913,6 +946,10 @@ int KsmRequestChangeState(int keytype, const char* datetime,
     if (status != 0) {
         status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
     }
+    else {
+        /* The signer configuration of the zone changes with its keys */
+        status = KsmZoneGenerationBump(zone_id, -1);
+    }
 
     /* See if we need to log a message about the DS records */
     if (keytype == KSM_TYPE_KSK && ((dst_state == KSM_STATE_DEAD && rollover_scheme == KSM_ROLL_DS) || dst_state == KSM_STATE_READY))
@@ -1219,6 +1256,9 @@ int KsmRequestChangeStateN(int keytype, const char* datetime, int count,
         if (status != 0) {
             status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
         }
+        else {
+            status = KsmZoneGenerationBump(zone_id, -1);
+        }
     }
     
     /* Free up resources */
@@ -1482,10 +1522,15 @@ int KsmRequestChangeStateGeneratePublishConditional(int keytype,
 int KsmRequestPendingRetireCount(int keytype, const char* datetime,
     KSM_PARCOLL* parameters, int* count, int zone_id, int interval)
 {
-    char    buffer[256];    /* For constructing part of the command */
-    int     clause = 0;     /* Used in constructing SQL statement */
+#ifdef USE_MYSQL
+#else
+    char    buffer[32];     /* For constructing the date modifier */
     size_t  nchar;          /* Number of characters written */
+#endif /* USE_MYSQL */
+    int     clause = 0;     /* Used in constructing SQL statement */
     char*   sql;            /* SQL command to be isssued */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
+    int     param = 0;      /* Parameter index */
     int     status;         /* Status return */
     int     total_interval; /* The PublicationInterval + interval (when we will run again) */
 
@@ -1530,10 +1575,10 @@ int KsmRequestPendingRetireCount(int keytype, const char* datetime,
     /* Create the SQL command to interrogate the database */
 
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++);
     DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, KSM_STATE_ACTIVE, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
 
     /* Calculate the initial publication interval & add to query */
@@ -1541,33 +1586,45 @@ int KsmRequestPendingRetireCount(int keytype, const char* datetime,
     /* 
      * TODO is there an alternative to DATE_ADD which is more generic? 
      */
+    /*
+     * The date and interval are parameters, so that the statement is the
+     * same for every zone.
+     */
+
 #ifdef USE_MYSQL
-    nchar = snprintf(buffer, sizeof(buffer),
-        "DATE_ADD('%s', INTERVAL %d SECOND)",
-        datetime, total_interval);
+    DqsConditionKeyword(&sql, "RETIRE", DQS_COMPARE_LE,
+        "DATE_ADD(?, INTERVAL ? SECOND)", clause++);
 #else
-    nchar = snprintf(buffer, sizeof(buffer),
-        "DATETIME('%s', '+%d SECONDS')",
-        datetime, total_interval);
-#endif /* USE_MYSQL */
+    DqsConditionKeyword(&sql, "DATETIME(RETIRE)", DQS_COMPARE_LE,
+        "DATETIME(?, ?)", clause++);
+    nchar = snprintf(buffer, sizeof(buffer), "+%d SECONDS", total_interval);
     if (nchar >= sizeof(buffer)) {
         status = MsgLog(KME_BUFFEROVF, "KsmRequestKeys");
 		DqsFree(sql);
         return status;
     }
-
-#ifdef USE_MYSQL
-    DqsConditionKeyword(&sql, "RETIRE", DQS_COMPARE_LE, buffer, clause++);
-#else
-    DqsConditionKeyword(&sql, "DATETIME(RETIRE)", DQS_COMPARE_LE, buffer, clause++);
 #endif /* USE_MYSQL */
 
     DqsEnd(&sql);
 
     /* Execute the query and free resources */
 
-    status = DbIntQuery(DbHandle(), count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, ++param, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, ++param, zone_id);
+        }
+        DbBindString(stmt, ++param, datetime);
+#ifdef USE_MYSQL
+        DbBindInt(stmt, ++param, total_interval);
+#else
+        DbBindString(stmt, ++param, buffer);
+#endif /* USE_MYSQL */
+        status = DbIntQueryStatement(stmt, count);
+    }
+    DbFreeStatement(stmt);
 
     /* Report any errors */
 
@@ -1618,6 +1675,7 @@ int KsmRequestAvailableCount(int keytype, const char* datetime, KSM_PARCOLL* par
     int     clause = 0;     /* Used in constructing SQL statement */
     size_t  nchar;          /* Number of characters written */
     char*   sql;            /* SQL command to be isssued */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status;         /* Status return */
 
     /* Unused parameters */
@@ -1627,7 +1685,7 @@ int KsmRequestAvailableCount(int keytype, const char* datetime, KSM_PARCOLL* par
     /* Create the SQL command to interrogate the database */
 
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++);
 
     /* Calculate the initial publication interval & add to query */
 
@@ -1640,14 +1698,22 @@ int KsmRequestAvailableCount(int keytype, const char* datetime, KSM_PARCOLL* par
     }
     DqsConditionKeyword(&sql, "STATE", DQS_COMPARE_IN, buffer, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
     DqsEnd(&sql);
 
     /* Execute the query and free resources */
 
-    status = DbIntQuery(DbHandle(), count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, 2, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, count);
+    }
+    DbFreeStatement(stmt);
 
     /* Report any errors */
 
@@ -1686,22 +1752,31 @@ int KsmRequestGenerateCount(int keytype, int* count, int zone_id)
 {
     int     clause = 0;     /* Clause count */
     char*   sql = NULL;     /* SQL to interrogate database */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status = 0;     /* Status return */
 
     /* Create the SQL */
 
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++);
     DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, KSM_STATE_GENERATE, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
     DqsEnd(&sql);
 
     /* Execute the query and free resources */
 
-    status = DbIntQuery(DbHandle(), count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, 2, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, count);
+    }
+    DbFreeStatement(stmt);
 
     /* Report any errors */
 
@@ -1738,6 +1813,7 @@ int KsmRequestStandbyKSKCount(int* count, int zone_id)
     int     clause = 0;     /* Used in constructing SQL statement */
     size_t  nchar;          /* Number of characters written */
     char*   sql;            /* SQL command to be isssued */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status;         /* Status return */
 
     /* Create the SQL command to interrogate the database */
@@ -1756,14 +1832,21 @@ int KsmRequestStandbyKSKCount(int* count, int zone_id)
     }
     DqsConditionKeyword(&sql, "STATE", DQS_COMPARE_IN, buffer, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
     DqsEnd(&sql);
 
     /* Execute the query and free resources */
 
-    status = DbIntQuery(DbHandle(), count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        if (zone_id != -1) {
+            DbBindInt(stmt, 1, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, count);
+    }
+    DbFreeStatement(stmt);
 
     /* Report any errors */
 
@@ -1815,29 +1898,35 @@ int KsmRequestCheckActiveKey(int keytype, const char* datetime, int* count, int
 {
     int     clause = 0;     /* Clause counter */
     char*   sql = NULL;     /* SQL command */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status;         /* Status return */
-#ifdef USE_MYSQL
-#else
-    char    buf[256];       /* For constructing part of the command */
-#endif /* USE_MYSQL */
+    int     param = 0;      /* Parameter index */
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++);
     DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, KSM_STATE_ACTIVE, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
 
 #ifdef USE_MYSQL
-    DqsConditionString(&sql, "RETIRE", DQS_COMPARE_GT, datetime, clause++);
+    DqsConditionParam(&sql, "RETIRE", DQS_COMPARE_GT, clause++);
 #else
-    snprintf(buf, sizeof(buf), "DATETIME('%s')", datetime);
-    DqsConditionKeyword(&sql, "DATETIME(RETIRE)", DQS_COMPARE_GT, buf, clause++);
+    DqsConditionKeyword(&sql, "DATETIME(RETIRE)", DQS_COMPARE_GT, "DATETIME(?)", clause++);
 #endif /* USE_MYSQL */
 
     DqsEnd(&sql);
 
-    status = DbIntQuery(DbHandle(), count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, ++param, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, ++param, zone_id);
+        }
+        DbBindString(stmt, ++param, datetime);
+        status = DbIntQueryStatement(stmt, count);
+    }
+    DbFreeStatement(stmt);
 
     if (status != 0) {
         status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
@@ -1879,21 +1968,30 @@ int KsmRequestCountReadyKey(int keytype, const char* datetime, int* count, int z
 {
     int     clause = 0;     /* Clause counter */
     char*   sql = NULL;     /* SQL command */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status;         /* Status return */
 
     /* Unused parameter */
     (void)datetime;
 
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++);
     DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, KSM_STATE_READY, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
     DqsEnd(&sql);
 
-    status = DbIntQuery(DbHandle(), count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, 2, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, count);
+    }
+    DbFreeStatement(stmt);
 
     if (status != 0) {
         status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
@@ -1931,19 +2029,28 @@ int KsmRequestCheckFirstPass(int keytype, int* first_pass_flag, int zone_id)
 {
     int     clause = 0;     /* Clause counter */
     char*   sql = NULL;     /* SQL command */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status;         /* Status return */
     int     count = 0;      /* Number of matching keys */
 
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++);
     DqsConditionInt(&sql, "STATE", DQS_COMPARE_GE, KSM_STATE_PUBLISH, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
     DqsEnd(&sql);
 
-    status = DbIntQuery(DbHandle(), &count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, 2, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, &count);
+    }
+    DbFreeStatement(stmt);
 
     if (status != 0) {
         status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
@@ -1987,20 +2094,29 @@ int KsmRequestCheckCompromisedFlag(int keytype, int zone_id, int* comp_flag)
 {
     int     clause = 0;     /* Clause counter */
     char*   sql = NULL;     /* SQL command */
+    DB_STATEMENT stmt = NULL; /* Prepared statement */
     int     status;         /* Status return */
     int     count = 0;      /* Number of matching keys */
 
     sql = DqsCountInit("KEYDATA_VIEW");
-    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, clause++);
+    DqsConditionParam(&sql, "KEYTYPE", DQS_COMPARE_EQ, clause++);
     DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, KSM_STATE_ACTIVE, clause++);
     if (zone_id != -1) {
-        DqsConditionInt(&sql, "ZONE_ID", DQS_COMPARE_EQ, zone_id, clause++);
+        DqsConditionParam(&sql, "ZONE_ID", DQS_COMPARE_EQ, clause++);
     }
     DqsConditionInt(&sql, "compromisedflag", DQS_COMPARE_EQ, 1, clause++);
     DqsEnd(&sql);
 
-    status = DbIntQuery(DbHandle(), &count, sql);
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, keytype);
+        if (zone_id != -1) {
+            DbBindInt(stmt, 2, zone_id);
+        }
+        status = DbIntQueryStatement(stmt, &count);
+    }
+    DbFreeStatement(stmt);
 
     if (status != 0) {
         status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
@@ -2134,3 +2250,559 @@ int KsmRequestPrintKey(void* context, KSM_KEYDATA* data)
 
     return 0;
 }
+
+
+
+/*
+ * Zones whose keys have been through KsmRequestPolicyKeys in this run, sorted
+ * by zone ID.  newds is the value that steps 0a to 2a of KsmRequestKeysByType
+ * left in NewDS for the zone, or -1 if they did not change it.
+ */
+
+typedef struct {
+    int     zone_id;
+    int     policy_id;
+    int     newds;
+} KSM_POLICY_ZONE;
+
+static KSM_POLICY_ZONE* m_policy_zones = NULL;
+static int m_policy_zone_count = 0;
+
+static int KsmRequestPolicyZoneCompare(const void* a, const void* b)
+{
+    return ((const KSM_POLICY_ZONE*) a)->zone_id -
+        ((const KSM_POLICY_ZONE*) b)->zone_id;
+}
+
+static KSM_POLICY_ZONE* KsmRequestPolicyZoneFind(KSM_POLICY_ZONE* zones,
+    int count, int zone_id)
+{
+    KSM_POLICY_ZONE key;    /* What we are looking for */
+
+    if (zones == NULL || count == 0) {
+        return NULL;
+    }
+    key.zone_id = zone_id;
+    return bsearch(&key, zones, count, sizeof(KSM_POLICY_ZONE),
+        KsmRequestPolicyZoneCompare);
+}
+
+
+
+/*+
+ * KsmRequestPolicyZones - List Zones on a Policy
+ *
+ * Description:
+ *      Reads the IDs of all zones on the policy, in order.
+ *
+ * Arguments:
+ *      int policy_id
+ *          ID of the policy.
+ *
+ *      KSM_POLICY_ZONE** zones (returned)
+ *          Array of zones, to be freed with MemFree.  NULL if there are none.
+ *
+ *      int* count (returned)
+ *          Number of zones in the array.
+ *
+ * Returns:
+ *      int
+ *          Status return. 0 => success, Other => failure, in which case an
+ *          error message will have been output.
+-*/
+
+static int KsmRequestPolicyZones(int policy_id, KSM_POLICY_ZONE** zones,
+    int* count)
+{
+    char*   sql = NULL;     /* SQL query */
+    DB_RESULT   result;     /* Result of the query */
+    DB_ROW  row = NULL;     /* Row data */
+    int     size = 0;       /* Allocated size of the array */
+    int     status = 0;     /* Status return */
+    int     zone_id = -1;   /* ID of this zone */
+
+    *zones = NULL;
+    *count = 0;
+
+    sql = DqsSpecifyInit("zones", "id");
+    DqsConditionInt(&sql, "POLICY_ID", DQS_COMPARE_EQ, policy_id, 0);
+    DqsOrderBy(&sql, "id");
+
+    status = DbExecuteSql(DbHandle(), sql, &result);
+    DqsFree(sql);
+    if (status != 0) {
+        return MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
+    }
+
+    status = DbFetchRow(result, &row);
+    while (status == 0) {
+        status = DbInt(row, 0, &zone_id);
+        if (status == 0) {
+            if (*count == size) {
+                size = size ? 2 * size : 64;
+                *zones = MemRealloc(*zones, size * sizeof(KSM_POLICY_ZONE));
+            }
+            (*zones)[*count].zone_id = zone_id;
+            (*zones)[*count].policy_id = policy_id;
+            (*zones)[*count].newds = -1;
+            ++(*count);
+            DbFreeRow(row);
+            row = NULL;
+            status = DbFetchRow(result, &row);
+        }
+    }
+
+    /* Convert EOF status to success */
+
+    if (status == -1) {
+        status = 0;
+    }
+    else {
+        status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
+    }
+
+    DbFreeRow(row);
+    DbFreeResult(result);
+    return status;
+}
+
+
+
+/*+
+ * KsmRequestPolicyChangeState - Change State of Keys in Many Zones
+ *
+ * Description:
+ *      Does what KsmRequestChangeState does, for a set of zones at once: keys
+ *      of the given type move between the two states if the estimated time of
+ *      entering the target state is equal to or earlier than the given time,
+ *      and that time is set to the given time.
+ *
+ * Arguments:
+ *      int keytype
+ *          Type of keys being changed.
+ *
+ *      const char* datetime
+ *          Date/time for which the calculation is being done.
+ *
+ *      int src_state
+ *          ID of the state that the key is moving from.
+ *
+ *      int dst_state
+ *          ID of the state that the key is moving to.
+ *
+ *      const char* zones_in
+ *          SQL "IN" clause giving the zones to look at.
+ *
+ *      int** changed (returned)
+ *          If not NULL, the IDs of the zones in which keys were moved, in
+ *          order, to be freed with MemFree.
+ *
+ *      int* nchanged (returned)
+ *          Number of IDs in changed.
+ *
+ *  Returns:
+ *      int
+ *          Status return. 0 => success, Other => failure, in which case an
+ *          error message will have been output.
+-*/
+
+static int KsmRequestPolicyChangeState(int keytype, const char* datetime,
+    int src_state, int dst_state, const char* zones_in, int** changed,
+    int* nchanged)
+{
+    int     where = 0;      /* For the SELECT statement */
+    int     set = 0;        /* For UPDATE */
+    int     size = 0;       /* Allocated size of changed */
+    int     zone_id = -1;   /* ID of a zone with keys to move */
+    char*   dst_col = NULL; /* Destination column */
+    char*   sql = NULL;     /* SQL statement */
+    DB_RESULT   result;     /* Zones with keys to move */
+    DB_ROW  row = NULL;     /* Row data */
+    int     status = 0;     /* Status return */
+
+    /* Create the destination column name, as KsmRequestChangeState does */
+    if (dst_state == KSM_STATE_DSREADY) {
+        StrAppend(&dst_col, KSM_STATE_READY_STRING);
+    } else if (dst_state == KSM_STATE_KEYPUBLISH) {
+        StrAppend(&dst_col, KSM_STATE_PUBLISH_STRING);
+    } else {
+        dst_col = StrStrdup(KsmKeywordStateValueToName(dst_state));
+    }
+    (void) StrToUpper(dst_col);
+
+    /* Find out which zones are affected if the caller wants to know */
+    if (changed != NULL) {
+        *changed = NULL;
+        *nchanged = 0;
+
+        sql = DqsSpecifyInit("dnsseckeys", "distinct zone_id");
+        DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, where++);
+        DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, src_state, where++);
+        DqsConditionString(&sql, dst_col, DQS_COMPARE_LE, datetime, where++);
+        DqsConditionKeyword(&sql, "ZONE_ID", DQS_COMPARE_IN, zones_in, where++);
+        DqsOrderBy(&sql, "zone_id");
+
+        status = DbExecuteSql(DbHandle(), sql, &result);
+        DqsFree(sql);
+        if (status != 0) {
+            StrFree(dst_col);
+            return MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
+        }
+
+        status = DbFetchRow(result, &row);
+        while (status == 0) {
+            status = DbInt(row, 0, &zone_id);
+            if (status == 0) {
+                if (*nchanged == size) {
+                    size = size ? 2 * size : 16;
+                    *changed = MemRealloc(*changed, size * sizeof(int));
+                }
+                (*changed)[(*nchanged)++] = zone_id;
+                DbFreeRow(row);
+                row = NULL;
+                status = DbFetchRow(result, &row);
+            }
+        }
+        DbFreeRow(row);
+        DbFreeResult(result);
+
+        if (status != -1) {
+            StrFree(dst_col);
+            return MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
+        }
+        if (*nchanged == 0) {
+            /* Nothing to do */
+            StrFree(dst_col);
+            return 0;
+        }
+    }
+
+    /* Mark the zones whose keys are about to move as changed */
+
+    where = 0;
+    sql = StrStrdup("(");
+    StrAppend(&sql, "SELECT zone_id FROM dnsseckeys");
+    DqsConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, where++);
+    DqsConditionInt(&sql, "STATE", DQS_COMPARE_EQ, src_state, where++);
+    DqsConditionString(&sql, dst_col, DQS_COMPARE_LE, datetime, where++);
+    DqsConditionKeyword(&sql, "ZONE_ID", DQS_COMPARE_IN, zones_in, where++);
+    StrAppend(&sql, ")");
+
+    status = KsmZoneGenerationBumpIn(sql);
+    StrFree(sql);
+    if (status != 0) {
+        StrFree(dst_col);
+        return status;
+    }
+
+    /* Move the keys */
+
+    sql = DusInit("dnsseckeys");
+    DusSetInt(&sql, "STATE", dst_state, set++);
+    DusSetString(&sql, dst_col, datetime, set++);
+
+    where = 0;
+    DusConditionInt(&sql, "KEYTYPE", DQS_COMPARE_EQ, keytype, where++);
+    DusConditionInt(&sql, "STATE", DQS_COMPARE_EQ, src_state, where++);
+    DusConditionString(&sql, dst_col, DQS_COMPARE_LE, datetime, where++);
+    DusConditionKeyword(&sql, "ZONE_ID", DQS_COMPARE_IN, zones_in, where++);
+    DusEnd(&sql);
+    StrFree(dst_col);
+
+    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    DusFree(sql);
+
+    if (status != 0) {
+        status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
+    }
+
+    return status;
+}
+
+
+
+/*+
+ * KsmRequestPolicyNewDS - Record a Change of the DS Set
+ *
+ * Description:
+ *      Sets the NewDS value of the zones in which keys were moved and, if
+ *      asked to, logs the message about the DS records that
+ *      KsmRequestChangeState would have logged for each zone.
+ *
+ * Arguments:
+ *      KSM_POLICY_ZONE* zones
+ *          Zones on the policy.
+ *
+ *      int count
+ *          Number of zones.
+ *
+ *      int* changed
+ *          IDs of the zones in which keys were moved.
+ *
+ *      int nchanged
+ *          Number of IDs in changed.
+ *
+ *      int newds
+ *          Value for NewDS.
+ *
+ *      int message
+ *          Message to log for each zone, or 0 for none.
+-*/
+
+static void KsmRequestPolicyNewDS(KSM_POLICY_ZONE* zones, int count,
+    int* changed, int nchanged, int newds, int message)
+{
+    KSM_POLICY_ZONE* zone = NULL;   /* Zone in which keys moved */
+    char*   zone_name = NULL;       /* For the message */
+    int     i;                      /* Index into changed */
+
+    for (i = 0; i < nchanged; ++i) {
+        zone = KsmRequestPolicyZoneFind(zones, count, changed[i]);
+        if (zone != NULL) {
+            zone->newds = newds;
+        }
+        if (message != 0 && KsmZoneNameFromId(changed[i], &zone_name) == 0) {
+            (void) MsgLog(message, zone_name);
+        }
+        StrFree(zone_name);
+    }
+
+    return;
+}
+
+
+
+/*+
+ * KsmRequestPolicyKeys - Request Keys for All Zones on a Policy
+ *
+ * Description:
+ *      Policy-wide evaluation mode of KsmRequestKeys, for callers that go
+ *      through all zones of a policy (the enforcer).  It updates the key times
+ *      for all zones on the policy (KsmUpdatePolicy) and makes the key state
+ *      changes that depend on time alone (steps 0a to 2a of
+ *      KsmRequestKeysByType) with a few set-based statements.
+ *
+ *      Later calls to KsmRequestKeys for a zone on the policy (without a
+ *      forced rollover) then skip the initial update of the key times and
+ *      those steps; the rest of the processing is done per zone, as before.
+ *      This holds until KsmRequestPolicyClear is called.
+ *
+ *      The changes are made in a savepoint of their own, so that they are
+ *      either all made or none is.
+ *
+ * Arguments:
+ *      int policy_id
+ *          ID of the policy.
+ *
+ *      const char* datetime
+ *          Time at which the request is issued.
+ *
+ *  Returns:
+ *      int
+ *          Status return. 0 => success, Other => failure, in which case an
+ *          error message will have been output.  On failure nothing is
+ *          recorded for the zones of the policy, and KsmRequestKeys does all
+ *          steps for them.
+-*/
+
+int KsmRequestPolicyKeys(int policy_id, const char* datetime)
+{
+    KSM_PARCOLL collection;         /* Parameters collection */
+    KSM_POLICY_ZONE* zones = NULL;  /* Zones on the policy */
+    int     count = 0;              /* Number of zones */
+    int*    changed = NULL;         /* Zones in which keys moved */
+    int     nchanged = 0;           /* Number of zones in changed */
+    char*   all_in = NULL;          /* "IN" clause for all zones */
+    char*   changed_in = NULL;      /* "IN" clause for the changed zones */
+    char    buffer[128];            /* For the clauses */
+    int     status = 0;             /* Status return */
+    int     i;                      /* Index into changed */
+
+    if (datetime == NULL) {
+        return MsgLog(KSM_INVARG, "NULL datetime");
+    }
+
+    KsmCollectionInit(&collection);
+    status = KsmParameterCollection(&collection, policy_id);
+    if (status != 0) {
+        return status;
+    }
+
+    status = KsmRequestPolicyZones(policy_id, &zones, &count);
+    if (status != 0 || count == 0) {
+        MemFree(zones);
+        return status;
+    }
+
+    snprintf(buffer, sizeof(buffer),
+        "(select id from zones where policy_id = %d)", policy_id);
+    StrAppend(&all_in, buffer);
+
+    status = DbBeginTransaction();
+    if (status != 0) {
+        status = MsgLog(KME_SQLFAIL, DbErrmsg(DbHandle()));
+        StrFree(all_in);
+        MemFree(zones);
+        return status;
+    }
+
+    /* Update the estimated times of state change */
+    status = KsmUpdatePolicy(policy_id);
+
+    /*
+     * Step 0a (KSK): standby keys in KEYPUBLISH become active after their
+     * active time; the old active keys of those zones are then retired and
+     * NewDS is reset.
+     */
+
+    if (status == 0) {
+        status = KsmRequestPolicyChangeState(KSM_TYPE_KSK, datetime,
+            KSM_STATE_KEYPUBLISH, KSM_STATE_ACTIVE, all_in, &changed,
+            &nchanged);
+    }
+    if (status == 0 && nchanged > 0) {
+        StrAppend(&changed_in, "(");
+        for (i = 0; i < nchanged; ++i) {
+            snprintf(buffer, sizeof(buffer), i ? ",%d" : "%d", changed[i]);
+            StrAppend(&changed_in, buffer);
+        }
+        StrAppend(&changed_in, ")");
+
+        status = KsmRequestPolicyChangeState(KSM_TYPE_KSK, datetime,
+            KSM_STATE_ACTIVE, KSM_STATE_RETIRE, changed_in, NULL, NULL);
+        KsmRequestPolicyNewDS(zones, count, changed, nchanged, 0, 0);
+        StrFree(changed_in);
+    }
+    MemFree(changed);
+
+    /*
+     * Step 1 (KSK): retired keys die.  With the double DS scheme the old DS
+     * can then be removed.
+     */
+
+    if (status == 0) {
+        status = KsmRequestPolicyChangeState(KSM_TYPE_KSK, datetime,
+            KSM_STATE_RETIRE, KSM_STATE_DEAD, all_in,
+            (collection.kskroll == KSM_ROLL_DS) ? &changed : NULL, &nchanged);
+        if (status == 0 && changed != NULL) {
+            KsmRequestPolicyNewDS(zones, count, changed, nchanged, 1,
+                KME_DS_REM_ZONE);
+        }
+        MemFree(changed);
+    }
+
+    /*
+     * Step 2 (KSK): published keys become ready.  KsmRequestKeysByType also
+     * does this on the first pass of a zone with other schemes, but a zone on
+     * its first pass has no KSK in the publish state, so there is nothing to
+     * do for those.
+     */
+
+    if (status == 0 && collection.kskroll == KSM_ROLL_DNSKEY) {
+        status = KsmRequestPolicyChangeState(KSM_TYPE_KSK, datetime,
+            KSM_STATE_PUBLISH, KSM_STATE_READY, all_in, &changed, &nchanged);
+        if (status == 0) {
+            KsmRequestPolicyNewDS(zones, count, changed, nchanged, 1,
+                KME_NEW_DS);
+        }
+        MemFree(changed);
+    }
+
+    /* Step 2a (KSK): keys in DSPUBLISH become DSREADY */
+
+    if (status == 0) {
+        status = KsmRequestPolicyChangeState(KSM_TYPE_KSK, datetime,
+            KSM_STATE_DSPUBLISH, KSM_STATE_DSREADY, all_in, NULL, NULL);
+    }
+
+    /* Steps 1 and 2 (ZSK) */
+
+    if (status == 0) {
+        status = KsmRequestPolicyChangeState(KSM_TYPE_ZSK, datetime,
+            KSM_STATE_RETIRE, KSM_STATE_DEAD, all_in, NULL, NULL);
+    }
+    if (status == 0) {
+        status = KsmRequestPolicyChangeState(KSM_TYPE_ZSK, datetime,
+            KSM_STATE_PUBLISH, KSM_STATE_READY, all_in, NULL, NULL);
+    }
+    StrFree(all_in);
+
+    if (status != 0) {
+        DbRollback();
+        MemFree(zones);
+        return status;
+    }
+    DbCommit();
+
+    /* Remember the zones for KsmRequestKeys */
+
+    m_policy_zones = MemRealloc(m_policy_zones,
+        (m_policy_zone_count + count) * sizeof(KSM_POLICY_ZONE));
+    memcpy(m_policy_zones + m_policy_zone_count, zones,
+        count * sizeof(KSM_POLICY_ZONE));
+    m_policy_zone_count += count;
+    qsort(m_policy_zones, m_policy_zone_count, sizeof(KSM_POLICY_ZONE),
+        KsmRequestPolicyZoneCompare);
+    MemFree(zones);
+
+    return 0;
+}
+
+
+
+/*+
+ * KsmRequestPolicyDone - Check for a Policy-Wide Evaluation
+ *
+ * Description:
+ *      Checks whether KsmRequestPolicyKeys has dealt with the zone.
+ *
+ * Arguments:
+ *      int policy_id
+ *          ID of the policy the zone is processed with.
+ *
+ *      int zone_id
+ *          ID of the zone.
+ *
+ *      int* NewDS
+ *          If not NULL, set to the value KsmRequestKeysByType would have
+ *          left in it after steps 0a to 2a, if they changed it.
+ *
+ * Returns:
+ *      int
+ *          1 if the zone was dealt with for this policy, 0 if not.
+-*/
+
+int KsmRequestPolicyDone(int policy_id, int zone_id, int* NewDS)
+{
+    KSM_POLICY_ZONE* zone = NULL;   /* Entry for the zone */
+
+    zone = KsmRequestPolicyZoneFind(m_policy_zones, m_policy_zone_count,
+        zone_id);
+    if (zone == NULL || zone->policy_id != policy_id) {
+        return 0;
+    }
+
+    if (NewDS != NULL && zone->newds != -1) {
+        *NewDS = zone->newds;
+    }
+
+    return 1;
+}
+
+
+
+/*+
+ * KsmRequestPolicyClear - End Policy-Wide Evaluation
+ *
+ * Description:
+ *      Forgets the zones dealt with by KsmRequestPolicyKeys, so that
+ *      KsmRequestKeys does all steps for every zone again.
+-*/
+
+void KsmRequestPolicyClear(void)
+{
+    MemFree(m_policy_zones);
+    m_policy_zone_count = 0;
+
+    return;
+}
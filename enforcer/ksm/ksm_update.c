@@ -131,6 +131,101 @@ int KsmUpdate(int policy_id, int zone_id)
 }
 
 
+/*+
+ * KsmUpdatePolicy - Update Times for Keys of All Zones on a Policy
+ *
+ * Description:
+ *      Does what KsmUpdate does for every zone on the policy, but with one
+ *      UPDATE statement per key state and type instead of one per key.  The
+ *      intervals are the ones the KsmUpdateXxxxKeyTime functions use.
+ *
+ * Arguments:
+ *      int policy_id
+ *          ID of the policy whose zones are updated.
+ *
+ * Returns:
+ *      int
+ *          0       Success
+ *          Other   Error.  A message will have been output.
+-*/
+
+int KsmUpdatePolicy(int policy_id)
+{
+    KSM_PARCOLL collection;     /* Collection of parameters for policy */
+    int         status = 0;     /* Status return */
+    int         Ipc;            /* Child zone publication interval */
+    int         kskpub = 0;     /* Publish to ready interval of a KSK */
+    int         zsklife;        /* Active to retire interval of a ZSK */
+    int         ksklife;        /* Active to retire interval of a KSK */
+
+    KsmCollectionInit(&collection);
+    status = KsmParameterCollection(&collection, policy_id);
+    if (status != 0) {
+        return status;
+    }
+
+    Ipc = collection.zskttl + collection.propdelay + collection.pub_safety;
+    if (collection.kskroll == KSM_ROLL_DNSKEY) {
+        kskpub = Ipc;
+    }
+    else if (collection.kskroll == KSM_ROLL_DS) {
+        kskpub = collection.kskttl + collection.kskpropdelay +
+            collection.pub_safety;
+    }
+
+    /* "Infinite" lifetimes */
+    zsklife = (collection.zsklife == 0) ? INT_MAX - 1 : collection.zsklife;
+    ksklife = (collection.ksklife == 0) ? INT_MAX - 1 : collection.ksklife;
+
+    /* Publish */
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, KSM_TYPE_ZSK,
+            KSM_STATE_PUBLISH, "PUBLISH", "READY", Ipc, 0);
+    }
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, KSM_TYPE_KSK,
+            KSM_STATE_PUBLISH, "PUBLISH", "READY", kskpub, 0);
+    }
+
+    /* Active, unless the key has a fixed retire date */
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, KSM_TYPE_ZSK,
+            KSM_STATE_ACTIVE, "ACTIVE", "RETIRE", zsklife, 1);
+    }
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, KSM_TYPE_KSK,
+            KSM_STATE_ACTIVE, "ACTIVE", "RETIRE", ksklife, 1);
+    }
+
+    /* Retire */
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, KSM_TYPE_ZSK,
+            KSM_STATE_RETIRE, "RETIRE", "DEAD", collection.zsksiglife +
+            collection.propdelay + collection.ret_safety, 0);
+    }
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, KSM_TYPE_KSK,
+            KSM_STATE_RETIRE, "RETIRE", "DEAD", collection.dsttl +
+            collection.kskpropdelay + collection.ret_safety, 0);
+    }
+
+    /* DS publish (KSKs only) */
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, KSM_TYPE_KSK,
+            KSM_STATE_DSPUBLISH, "PUBLISH", "READY", collection.kskttl +
+            collection.kskpropdelay + collection.pub_safety, 0);
+    }
+
+    /* KEY publish, whatever the key type */
+    if (status == 0) {
+        status = KsmUpdatePolicyKeyTime(policy_id, -1,
+            KSM_STATE_KEYPUBLISH, "PUBLISH", "ACTIVE", Ipc, 0);
+    }
+
+    return status;
+}
+
+
 /*+
  * KsmUpdateKey - Update Key Times
  *
@@ -591,3 +686,86 @@ int KsmUpdateKeyTime(const KSM_KEYDATA* data, const char* source,
 
     return status;
 }
+
+/*+
+ * KsmUpdatePolicyKeyTime - Update Key Time for All Zones on a Policy
+ *
+ * Description:
+ *      Performs the update of KsmUpdateKeyTime for every key of the given
+ *      type and state in the zones on the policy:
+ *
+ *          destination_time = source_time + interval
+ *
+ * Arguments:
+ *      int policy_id
+ *          ID of the policy whose zones are updated.
+ *
+ *      int keytype
+ *          Type of the keys to update, -1 for all types.
+ *
+ *      int state
+ *          State of the keys to update.
+ *
+ *      const char* source
+ *          Source field.
+ *
+ *      const char* destination
+ *          Destination field.
+ *
+ *      int interval
+ *          Interval (seconds) to update the source field with.
+ *
+ *      int not_fixed
+ *          If 1, keys marked as fixedDate are left alone.
+ *
+ * Returns:
+ *      int
+ *          0       Update successful
+ *          Other   Error.  A message will have beeen output.
+-*/
+
+int KsmUpdatePolicyKeyTime(int policy_id, int keytype, int state,
+    const char* source, const char* destination, int interval, int not_fixed)
+{
+    char            buffer[KSM_SQL_SIZE];    /* Long enough for any statement */
+    char            type[32];       /* Key type condition */
+    unsigned int    nchar;          /* Number of characters converted */
+    int             status;         /* Status return */
+
+    /* check the argument */
+    if (source == NULL || destination == NULL) {
+        return MsgLog(KSM_INVARG, "NULL argument");
+    }
+
+    type[0] = '\0';
+    if (keytype != -1) {
+        snprintf(type, sizeof(type), " and keytype = %d", keytype);
+    }
+
+#ifdef USE_MYSQL
+    nchar = snprintf(buffer, sizeof(buffer),
+        "UPDATE dnsseckeys SET %s = DATE_ADD(%s, INTERVAL %d SECOND) WHERE state = %d%s and zone_id in (select id from zones where policy_id = %d)%s",
+        destination, source, interval, state, type, policy_id,
+        not_fixed ? " and keypair_id not in (select id from keypairs where fixedDate <> 0)" : "");
+#else
+    nchar = snprintf(buffer, sizeof(buffer),
+        "UPDATE dnsseckeys SET %s = DATETIME(%s, '+%d SECONDS') WHERE state = %d%s and zone_id in (select id from zones where policy_id = %d)%s",
+        destination, source, interval, state, type, policy_id,
+        not_fixed ? " and keypair_id not in (select id from keypairs where fixedDate <> 0)" : "");
+#endif /* USE_MYSQL */
+
+    if (nchar < sizeof(buffer)) {
+
+        /* All OK, execute the statement */
+
+        status = DbExecuteSqlNoResult(DbHandle(), buffer);
+    }
+    else {
+
+        /* Unable to create update statement */
+
+        status = MsgLog(KME_BUFFEROVF, "KsmUpdatePolicyKeyTime");
+    }
+
+    return status;
+}
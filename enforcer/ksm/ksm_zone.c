@@ -46,6 +46,7 @@
 #include "ksm/ksm_internal.h"
 #include "ksm/message.h"
 #include "ksm/string_util.h"
+#include "ksm/string_util2.h"
 
 /*+
  * KsmZoneInit - Query for Zone Information
@@ -250,7 +251,8 @@ int KsmZoneIdFromName(const char* zone_name, int* zone_id)
 {
     int     where = 0;          /* WHERE clause value */
     char*   sql = NULL;         /* SQL query */
-    DB_RESULT       result;     /* Handle converted to a result object */
+    DB_STATEMENT    stmt = NULL;    /* Prepared statement */
+    DB_RESULT       result = NULL;  /* Handle converted to a result object */
     DB_ROW      row = NULL;            /* Row data */
     int     status = 0;         /* Status return */
 
@@ -262,17 +264,21 @@ int KsmZoneIdFromName(const char* zone_name, int* zone_id)
     /* Construct the query */
 
     sql = DqsSpecifyInit("zones","id, name");
-    DqsConditionString(&sql, "NAME", DQS_COMPARE_EQ, zone_name, where++);
+    DqsConditionParam(&sql, "NAME", DQS_COMPARE_EQ, where++);
     DqsOrderBy(&sql, "id");
 
-    /* Execute query and free up the query string */
-    status = DbExecuteSql(DbHandle(), sql, &result);
+    /* Prepare (or reuse) the statement and free up the query string */
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindString(stmt, 1, zone_name);
+        status = DbExecuteStatement(stmt, &result);
+    }
     
     if (status != 0)
     {
         status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
-        DbFreeResult(result);
+        DbFreeStatement(stmt);
         return status;
 	}
 
@@ -289,6 +295,7 @@ int KsmZoneIdFromName(const char* zone_name, int* zone_id)
 
     DbFreeRow(row);
     DbFreeResult(result);
+    DbFreeStatement(stmt);
     return status;
 }
 
@@ -313,7 +320,8 @@ int KsmZoneIdAndPolicyFromName(const char* zone_name, int* policy_id, int* zone_
 {
     int     where = 0;          /* WHERE clause value */
     char*   sql = NULL;         /* SQL query */
-    DB_RESULT       result;     /* Handle converted to a result object */
+    DB_STATEMENT    stmt = NULL;    /* Prepared statement */
+    DB_RESULT       result = NULL;  /* Handle converted to a result object */
     DB_ROW      row = NULL;            /* Row data */
     int     status = 0;         /* Status return */
 
@@ -325,17 +333,21 @@ int KsmZoneIdAndPolicyFromName(const char* zone_name, int* policy_id, int* zone_
     /* Construct the query */
 
     sql = DqsSpecifyInit("zones","id, name, policy_id");
-    DqsConditionString(&sql, "NAME", DQS_COMPARE_EQ, zone_name, where++);
+    DqsConditionParam(&sql, "NAME", DQS_COMPARE_EQ, where++);
     DqsOrderBy(&sql, "id");
 
-    /* Execute query and free up the query string */
-    status = DbExecuteSql(DbHandle(), sql, &result);
+    /* Prepare (or reuse) the statement and free up the query string */
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindString(stmt, 1, zone_name);
+        status = DbExecuteStatement(stmt, &result);
+    }
     
     if (status != 0)
     {
         status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
-        DbFreeResult(result);
+        DbFreeStatement(stmt);
         return status;
 	}
 
@@ -353,6 +365,7 @@ int KsmZoneIdAndPolicyFromName(const char* zone_name, int* policy_id, int* zone_
 
     DbFreeRow(row);
     DbFreeResult(result);
+    DbFreeStatement(stmt);
     return status;
 }
 
@@ -415,7 +428,8 @@ int KsmZoneNameFromId(int zone_id, char** zone_name)
 {
     int     where = 0;          /* WHERE clause value */
     char*   sql = NULL;         /* SQL query */
-    DB_RESULT       result;     /* Handle converted to a result object */
+    DB_STATEMENT    stmt = NULL;    /* Prepared statement */
+    DB_RESULT       result = NULL;  /* Handle converted to a result object */
     DB_ROW      row = NULL;            /* Row data */
     int     status = 0;         /* Status return */
 
@@ -427,17 +441,21 @@ int KsmZoneNameFromId(int zone_id, char** zone_name)
     /* Construct the query */
 
     sql = DqsSpecifyInit("zones","id, name");
-    DqsConditionInt(&sql, "id", DQS_COMPARE_EQ, zone_id, where++);
+    DqsConditionParam(&sql, "id", DQS_COMPARE_EQ, where++);
     DqsOrderBy(&sql, "id");
 
-    /* Execute query and free up the query string */
-    status = DbExecuteSql(DbHandle(), sql, &result);
+    /* Prepare (or reuse) the statement and free up the query string */
+    status = DbPrepare(DbHandle(), sql, &stmt);
     DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, zone_id);
+        status = DbExecuteStatement(stmt, &result);
+    }
     
     if (status != 0)
     {
         status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
-        DbFreeResult(result);
+        DbFreeStatement(stmt);
         return status;
 	}
 
@@ -454,5 +472,200 @@ int KsmZoneNameFromId(int zone_id, char** zone_name)
 
     DbFreeRow(row);
     DbFreeResult(result);
+    DbFreeStatement(stmt);
+    return status;
+}
+
+/*+
+ * KsmZoneGenerationBump - Mark Zones as Changed
+ *
+ * Description:
+ *      Increments the change generation of a zone, or of all zones on a
+ *      policy.  The enforcer only rewrites the signer configuration of a zone
+ *      whose generation has moved on since the configuration was last
+ *      written, so anything that changes what goes into it (key states,
+ *      policy parameters, the salt) must call this.
+ *
+ * Arguments:
+ *      int zone_id
+ *          ID of the zone, or -1 for all zones on the policy.
+ *
+ *      int policy_id
+ *          ID of the policy if zone_id is -1, or -1 for all zones.
+ *
+ * Returns:
+ *      int
+ *          Status return.  0 => success, non-zero => error, in which case a
+ *          message will have been output.
+-*/
+
+int KsmZoneGenerationBump(int zone_id, int policy_id)
+{
+    char    in[32];             /* "IN" clause */
+    char*   sql = NULL;         /* SQL statement */
+    int     status = 0;         /* Status return */
+
+    if (zone_id != -1) {
+        snprintf(in, sizeof(in), "(%d)", zone_id);
+        return KsmZoneGenerationBumpIn(in);
+    }
+
+    sql = StrStrdup("UPDATE zones SET generation = generation + 1");
+    if (policy_id != -1) {
+        snprintf(in, sizeof(in), " WHERE policy_id = %d", policy_id);
+        StrAppend(&sql, in);
+    }
+
+    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    StrFree(sql);
+
+    if (status != 0) {
+        status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
+    }
+
+    return status;
+}
+
+/*+
+ * KsmZoneGenerationBumpIn - Mark a Set of Zones as Changed
+ *
+ * Description:
+ *      As KsmZoneGenerationBump, for the zones given by an SQL "IN" clause;
+ *      this may be a list of IDs or a sub-query.
+ *
+ * Arguments:
+ *      const char* zones_in
+ *          "IN" clause giving the IDs of the zones, including the brackets.
+ *
+ * Returns:
+ *      int
+ *          Status return.  0 => success, non-zero => error, in which case a
+ *          message will have been output.
+-*/
+
+int KsmZoneGenerationBumpIn(const char* zones_in)
+{
+    char*   sql = NULL;         /* SQL statement */
+    int     status = 0;         /* Status return */
+
+    if (zones_in == NULL) {
+        return MsgLog(KSM_INVARG, "NULL zone list");
+    }
+
+    sql = StrStrdup("UPDATE zones SET generation = generation + 1 WHERE id IN ");
+    StrAppend(&sql, zones_in);
+
+    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    StrFree(sql);
+
+    if (status != 0) {
+        status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
+    }
+
+    return status;
+}
+
+/*+
+ * KsmZoneGeneration - Get the Change Generation of a Zone
+ *
+ * Arguments:
+ *          int         zone_id     id of the zone
+ *          int*        policy_id   (returned) policy of the zone
+ *          int*        generation  (returned) current change generation
+ *          int*        signconf_generation
+ *                                  (returned) generation for which the
+ *                                  signer configuration was last written
+ *
+ * Returns:
+ *      int
+ *          Status return:
+ *              0           success
+ *              -1          no record found
+ *              non-zero    some error occurred and a message has been output.
+ *
+ *          If the status is non-zero, the returned data is meaningless.
+-*/
+int KsmZoneGeneration(int zone_id, int* policy_id, int* generation, int* signconf_generation)
+{
+    char*   sql = NULL;         /* SQL query */
+    DB_STATEMENT    stmt = NULL;    /* Prepared statement */
+    DB_RESULT       result = NULL;  /* Handle converted to a result object */
+    DB_ROW      row = NULL;            /* Row data */
+    int     status = 0;         /* Status return */
+
+    /* check the arguments */
+    if (policy_id == NULL || generation == NULL || signconf_generation == NULL) {
+        return MsgLog(KSM_INVARG, "NULL argument");
+    }
+
+    /* Construct the query */
+
+    sql = DqsSpecifyInit("zones","policy_id, generation, signconf_generation");
+    DqsConditionParam(&sql, "id", DQS_COMPARE_EQ, 0);
+
+    /* Prepare (or reuse) the statement and free up the query string */
+    status = DbPrepare(DbHandle(), sql, &stmt);
+    DqsFree(sql);
+    if (status == 0) {
+        DbBindInt(stmt, 1, zone_id);
+        status = DbExecuteStatement(stmt, &result);
+    }
+
+    if (status != 0)
+    {
+        status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
+        DbFreeStatement(stmt);
+        return status;
+	}
+
+    /* Get the next row from the data */
+    status = DbFetchRow(result, &row);
+    if (status == 0) {
+        DbInt(row, 0, policy_id);
+        DbInt(row, 1, generation);
+        DbInt(row, 2, signconf_generation);
+    }
+    else if (status == -1) {}
+        /* No rows to return (but no DB error) */
+	else {
+        status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
+	}
+
+    DbFreeRow(row);
+    DbFreeResult(result);
+    DbFreeStatement(stmt);
+    return status;
+}
+
+/*+
+ * KsmZoneSetSignconfGeneration - Record that the Signconf is Up to Date
+ *
+ * Arguments:
+ *          int         zone_id     id of the zone
+ *          int         generation  change generation that the signer
+ *                                  configuration now reflects
+ *
+ * Returns:
+ *      int
+ *          Status return.  0 => success, non-zero => error, in which case a
+ *          message will have been output.
+-*/
+int KsmZoneSetSignconfGeneration(int zone_id, int generation)
+{
+    char*   sql = NULL;         /* SQL statement */
+    int     status = 0;         /* Status return */
+
+    sql = DusInit("zones");
+    DusSetInt(&sql, "signconf_generation", generation, 0);
+    DusConditionInt(&sql, "id", DQS_COMPARE_EQ, zone_id, 0);
+    DusEnd(&sql);
+
+    status = DbExecuteSqlNoResult(DbHandle(), sql);
+    DusFree(sql);
+
+    if (status != 0) {
+        status = MsgLog(KSM_SQLFAIL, DbErrmsg(DbHandle()));
+    }
+
     return status;
 }
@@ -389,6 +389,83 @@ static void TestDbRollback(void)
 	return;
 }
 
+static void TestDbNestedRollback(void)
+{
+	int			rowcount;	/* Number of rows returned */
+	char*		sql;		/* Constructed query */
+	int			status;		/* Status return */
+	int			where = 0;	/* WHERE clause count */
+	int			value;		/* Value inserted at each level */
+
+	/* One row in the outer transaction, one in each nested one */
+
+	for (value = 800; value <= 802; ++value) {
+		status = DbBeginTransaction();
+		CU_ASSERT_EQUAL(status, 0);
+		CU_ASSERT_EQUAL(DbTransactionDepth(), value - 799);
+
+		sql = DisInit("TEST_BASIC");
+		DisAppendInt(&sql, value);
+		DisAppendString(&sql, "PQR");
+		DisAppendString(&sql, NULL);
+		DisEnd(&sql);
+		status = DbExecuteSqlNoResult(DbHandle(), sql);
+		CU_ASSERT_EQUAL(status, 0);
+		DisFree(sql);
+	}
+
+	/* Roll back the innermost level only, then commit the others */
+
+	status = DbRollback();
+	CU_ASSERT_EQUAL(status, 0);
+	status = DbCommit();
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(DbTransactionDepth(), 1);
+	status = DbCommit();
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(DbTransactionDepth(), 0);
+
+	/* Check that only the rows of the outer levels are in the table */
+
+	sql = DqsCountInit("TEST_BASIC");
+	DqsConditionString(&sql, "SVALUE", DQS_COMPARE_EQ, "PQR", where++);
+	DqsEnd(&sql);
+	status = DbIntQuery(DbHandle(), &rowcount, sql);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(rowcount, 2);
+	DqsFree(sql);
+
+	where = 0;
+	sql = DqsCountInit("TEST_BASIC");
+	DqsConditionInt(&sql, "IVALUE", DQS_COMPARE_EQ, 802, where++);
+	DqsConditionString(&sql, "SVALUE", DQS_COMPARE_EQ, "PQR", where++);
+	DqsEnd(&sql);
+	status = DbIntQuery(DbHandle(), &rowcount, sql);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(rowcount, 0);
+	DqsFree(sql);
+
+	return;
+}
+
+static void TestDbCheckpoint(void)
+{
+	int			rowcount;	/* Number of rows returned */
+	int			status;		/* Status return */
+
+	/* Committed data is still there after the log is written to the file */
+
+	status = DbCheckpoint();
+	CU_ASSERT_EQUAL(status, 0);
+
+	status = DbIntQuery(DbHandle(), &rowcount,
+		"SELECT COUNT(*) FROM TEST_BASIC WHERE SVALUE = 'PQR'");
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(rowcount, 2);
+
+	return;
+}
+
 static void TestDbDateDiff(void)
 {
 	char	buffer[128];
@@ -427,6 +504,136 @@ static void TestDbDateDiff(void)
 	return;
 }
 
+/*+
+ * TestDbPrepare - Check Statement Cache
+ *
+ * Description:
+ * 		Prepares the same statement twice.  When the first has been freed, the
+ * 		second call returns it from the cache; while it is still in use, a
+ * 		separate statement is returned.
+-*/
+
+static void TestDbPrepare(void)
+{
+	DB_STATEMENT	first = NULL;	/* First statement */
+	DB_STATEMENT	second = NULL;	/* Second statement */
+	int				rowcount;		/* Number of rows returned */
+	int				status;			/* Status return */
+	const char*		sql = "SELECT COUNT(*) FROM TEST_BASIC WHERE IVALUE = ?";
+
+	status = DbPrepare(DbHandle(), sql, &first);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_PTR_NOT_NULL(first);
+
+	status = DbPrepare(DbHandle(), sql, &second);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_PTR_NOT_NULL(second);
+	CU_ASSERT_PTR_NOT_EQUAL(first, second);
+
+	/* Both can be used at the same time */
+
+	DbBindInt(first, 1, 200);
+	DbBindInt(second, 1, 999);
+	status = DbIntQueryStatement(first, &rowcount);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(rowcount, 1);
+	status = DbIntQueryStatement(second, &rowcount);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(rowcount, 0);
+	DbFreeStatement(second);
+
+	/* Once freed, the statement comes back from the cache */
+
+	DbFreeStatement(first);
+	status = DbPrepare(DbHandle(), sql, &second);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_PTR_EQUAL(first, second);
+
+	/* ... with no parameters bound */
+
+	status = DbIntQueryStatement(second, &rowcount);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(rowcount, 0);
+
+	/* A binding error is reported when the statement is executed */
+
+	status = DbBindInt(second, 2, 200);
+	CU_ASSERT_NOT_EQUAL(status, 0);
+	status = DbIntQueryStatement(second, &rowcount);
+	CU_ASSERT_NOT_EQUAL(status, 0);
+	DbFreeStatement(second);
+
+	return;
+}
+
+
+/*+
+ * TestDbExecuteStatement - Check Prepared Statement Execution
+ *
+ * Description:
+ * 		Inserts a row with a prepared statement and reads it back with
+ * 		another, checking string and NULL parameters on the way.
+-*/
+
+static void TestDbExecuteStatement(void)
+{
+	DB_STATEMENT	stmt = NULL;	/* Prepared statement */
+	DB_RESULT		result = NULL;	/* Result object */
+	DB_ROW			row = NULL;		/* Row object */
+	char*			sql;			/* Constructed query */
+	char*			string;			/* String from the row */
+	int				status;			/* Status return */
+	int				where = 0;		/* WHERE clause count */
+
+	sql = DisInit("TEST_BASIC");
+	DisAppendParam(&sql);
+	DisAppendParam(&sql);
+	DisAppendParam(&sql);
+	DisEnd(&sql);
+	status = DbPrepare(DbHandle(), sql, &stmt);
+	CU_ASSERT_EQUAL(status, 0);
+	DisFree(sql);
+
+	DbBindInt(stmt, 1, 800);
+	DbBindString(stmt, 2, "it's");
+	DbBindString(stmt, 3, NULL);
+	status = DbExecuteStatementNoResult(stmt);
+	CU_ASSERT_EQUAL(status, 0);
+	DbFreeStatement(stmt);
+
+	/* Read it back */
+
+	sql = DqsInit("TEST_BASIC");
+	DqsConditionParam(&sql, "IVALUE", DQS_COMPARE_EQ, where++);
+	DqsEnd(&sql);
+	status = DbPrepare(DbHandle(), sql, &stmt);
+	CU_ASSERT_EQUAL(status, 0);
+	DqsFree(sql);
+
+	DbBindInt(stmt, 1, 800);
+	status = DbExecuteStatement(stmt, &result);
+	CU_ASSERT_EQUAL(status, 0);
+
+	status = DbFetchRow(result, &row);
+	CU_ASSERT_EQUAL(status, 0);
+	status = DbString(row, 2, &string);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_STRING_EQUAL(string, "it's");
+	DbStringFree(string);
+	status = DbString(row, 3, &string);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_PTR_NULL(string);
+	DbFreeRow(row);
+
+	status = DbFetchRow(result, &row);
+	CU_ASSERT_EQUAL(status, -1);
+
+	DbFreeResult(result);
+	DbFreeStatement(stmt);
+
+	return;
+}
+
 /*+
  * TestDdb  - Create Test Suite
  *
@@ -454,7 +661,11 @@ int TestDb(void)
         {"TestDbLastRowId",				TestDbLastRowId},
         {"TestDbCommit",				TestDbCommit},
         {"TestDbRollback",				TestDbRollback},
+        {"TestDbNestedRollback",		TestDbNestedRollback},
+        {"TestDbCheckpoint",			TestDbCheckpoint},
         {"TestDbDateDiff",				TestDbDateDiff},
+        {"TestDbPrepare",				TestDbPrepare},
+        {"TestDbExecuteStatement",		TestDbExecuteStatement},
         {NULL,                  		NULL}
     };
 
@@ -77,6 +77,34 @@ static void TestDisCreate(void)
 }
 
 
+/*+
+ * TestDisAppendParam - Test Placeholders
+ *
+ * Description:
+ *      Constructs an INSERT statement with placeholders for a prepared
+ *      statement and checks the string so constructed.
+-*/
+
+static void TestDisAppendParam(void)
+{
+	char*	sql = NULL;
+
+	static const char* TEST =
+		"INSERT INTO TEST VALUES (NULL, 1, ?, ?)";
+
+	sql = DisInit("TEST");
+	DisAppendInt(&sql, 1);
+	DisAppendParam(&sql);
+	DisAppendParam(&sql);
+	DisEnd(&sql);
+
+	CU_ASSERT_STRING_EQUAL(sql, TEST);
+	DisFree(sql);
+
+	return;
+}
+
+
 /*+
  * TestDis  - Create Test Suite
  *
@@ -97,6 +125,7 @@ int TestDis(void)
 {
     struct test_testdef tests[] = {
         {"TestDisCreate",			TestDisCreate},
+        {"TestDisAppendParam",		TestDisAppendParam},
         {NULL,                      NULL}
     };
 
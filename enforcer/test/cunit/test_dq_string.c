@@ -167,6 +167,33 @@ static void TestDqsConditionKeyword(void)
 	return;
 }
 
+/*+
+ * TestDqsConditionParam - Test Conditional
+ *
+ * Description:
+ * 		Checks that the query can be constrained by a WHERE clause comprising
+ * 		placeholders for a prepared statement.
+-*/
+
+
+static void TestDqsConditionParam(void)
+{
+	char*	sql = NULL;
+	int		clause = 0;
+	static const char* TEST = 
+		"SELECT * FROM TEST WHERE ALPHA = ? AND BETA < ?";
+
+	sql = DqsInit("TEST");
+	DqsConditionParam(&sql, "ALPHA", DQS_COMPARE_EQ, clause++);
+	DqsConditionParam(&sql, "BETA", DQS_COMPARE_LT, clause++);
+	DqsEnd(&sql);
+
+	CU_ASSERT_STRING_EQUAL(sql, TEST);
+	DqsFree(sql);
+
+	return;
+}
+
 /*+
  * TestDqsOrderBy - Test ORDER BY Clause
  *
@@ -218,6 +245,7 @@ int TestDqs(void)
         {"TestDqsConditionInt",		TestDqsConditionInt},
         {"TestDqsConditionString",	TestDqsConditionString},
         {"TestDqsConditionKeyword",	TestDqsConditionKeyword},
+        {"TestDqsConditionParam",	TestDqsConditionParam},
         {"TestDqsOrderBy",			TestDqsOrderBy},
         {NULL,                      NULL}
     };
@@ -44,8 +44,10 @@
 
 #include "CUnit/Basic.h"
 
+#include "ksm/database.h"
 #include "ksm/ksm.h"
 #include "ksm/datetime.h"
+#include "ksm/string_util.h"
 #include "test_routines.h"
 
 int l_keytype = -1;
@@ -127,6 +129,51 @@ static void TestKsmRequestKeys(void)
 	/* TODO work out some test scenarios here and use Callback to check */
 }
 
+/*+
+ * TestKsmRequestPolicyKeys - Test Policy-Wide Request code
+ *
+ * Description:
+ *      Tests that a key due to change state is moved for all zones of a
+ *      policy at once, and that the zones are remembered until cleared.
+-*/
+
+static void TestKsmRequestPolicyKeys(void)
+{
+	int		status = 0;
+    int     zone_id = 2; /* opendnssec.se */
+    int     policy_id = 2;
+    int     newDS = 0;
+    int     count = 0;
+    DB_ID   dnsseckey_id;
+    char    sql[256];
+
+    char*   datetime = DtParseDateTimeString("now");
+
+    /* A ZSK that retired long ago (keys 3 - 15 are unallocated) */
+    status = KsmDnssecKeyCreate(zone_id, 4, KSM_TYPE_ZSK, KSM_STATE_RETIRE, "2001-01-01 01:00:00", NULL, &dnsseckey_id);
+    CU_ASSERT_EQUAL(status, 0);
+
+    status = KsmRequestPolicyKeys(policy_id, datetime);
+    CU_ASSERT_EQUAL(status, 0);
+
+    /* It is dead now, as of the time of the request */
+    snprintf(sql, sizeof(sql), "SELECT COUNT(*) FROM dnsseckeys WHERE id = %lu AND state = %d AND dead = '%s'",
+        (unsigned long) dnsseckey_id, KSM_STATE_DEAD, datetime);
+    status = DbIntQuery(DbHandle(), &count, sql);
+    CU_ASSERT_EQUAL(status, 0);
+    CU_ASSERT_EQUAL(count, 1);
+
+    /* The zone is known for its own policy only; ZSKs leave NewDS alone */
+    CU_ASSERT_EQUAL(KsmRequestPolicyDone(policy_id, zone_id, &newDS), 1);
+    CU_ASSERT_EQUAL(newDS, 0);
+    CU_ASSERT_EQUAL(KsmRequestPolicyDone(1, zone_id, NULL), 0);
+
+    KsmRequestPolicyClear();
+    CU_ASSERT_EQUAL(KsmRequestPolicyDone(policy_id, zone_id, NULL), 0);
+
+    StrFree(datetime);
+}
+
 /*
  * TestKsmRequest - Create Test Suite
  *
@@ -147,6 +194,7 @@ int TestKsmRequest(void)
 {
     struct test_testdef tests[] = {
         {"KsmRequest", TestKsmRequestKeys},
+        {"KsmRequestPolicyKeys", TestKsmRequestPolicyKeys},
         {NULL,                      NULL}
     };
 
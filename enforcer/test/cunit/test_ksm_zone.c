@@ -110,6 +110,60 @@ static void TestKsmZoneIdFromName(void)
 
 }
 
+/*+
+ * TestKsmZoneGeneration - Test
+ *
+ * Description:
+ *      Tests that the change generation of a zone moves on when it is bumped
+ *      and that the generation of the signconf can be recorded
+-*/
+
+static void TestKsmZoneGeneration(void)
+{
+	int		status;		/* Status return */
+    int     policy_id;  /* returned policy */
+    int     generation; /* returned generation */
+    int     written;    /* returned signconf generation */
+    int     generation2;    /* generation of the other zone */
+
+    /* a new zone has never had its signconf written */
+    status = KsmZoneGeneration(1, &policy_id, &generation, &written);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(policy_id, 2);
+	CU_ASSERT_NOT_EQUAL(generation, written);
+
+    status = KsmZoneGeneration(2, &policy_id, &generation2, &written);
+	CU_ASSERT_EQUAL(status, 0);
+
+    /* record it as written */
+    status = KsmZoneSetSignconfGeneration(1, generation);
+	CU_ASSERT_EQUAL(status, 0);
+    status = KsmZoneGeneration(1, &policy_id, &generation, &written);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(generation, written);
+
+    /* bumping one zone leaves the other alone */
+    status = KsmZoneGenerationBump(1, -1);
+	CU_ASSERT_EQUAL(status, 0);
+    status = KsmZoneGeneration(1, &policy_id, &generation, &written);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(generation, written + 1);
+    status = KsmZoneGeneration(2, &policy_id, &generation, &written);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(generation, generation2);
+
+    /* bumping the policy moves both on */
+    status = KsmZoneGenerationBump(-1, 2);
+	CU_ASSERT_EQUAL(status, 0);
+    status = KsmZoneGeneration(2, &policy_id, &generation, &written);
+	CU_ASSERT_EQUAL(status, 0);
+	CU_ASSERT_EQUAL(generation, generation2 + 1);
+
+    /* no such zone */
+    status = KsmZoneGeneration(100, &policy_id, &generation, &written);
+	CU_ASSERT_EQUAL(status, -1);
+}
+
 /*
  * TestKsmZone - Create Test Suite
  *
@@ -131,6 +185,7 @@ int TestKsmZone(void)
     struct test_testdef tests[] = {
         {"KsmZone", TestKsmZoneRead},
         {"KsmZoneIdFromName", TestKsmZoneIdFromName},
+        {"KsmZoneGeneration", TestKsmZoneGeneration},
         {NULL,                      NULL}
     };
 
@@ -160,7 +160,7 @@ $sth->finish;
 #
 
 my $from_version_valid = 0;
-if ($from_version == 3) {
+if ($from_version == 3 or $from_version == 4) {
     $from_version_valid = 1;
 }
 
@@ -174,7 +174,7 @@ unless ($from_version_valid) {
 #
 
 if ($to_data_source eq 'mysql') {
-    if ($from_version == 3) {
+    if ($from_version == 3 or $from_version == 4) {
         my $valid = 1;
         print 'Validating existing data', "\n";
         
@@ -405,9 +405,10 @@ unless ($from_version == $to_version) {
 # Convert the database
 #
 
-if ($from_version == 3) {
+if ($from_version == 3 or $from_version == 4) {
     #
-    # Schema version 3 does not need any data modifications so just dump it out and in
+    # Schema versions 3 and 4 do not need any data modifications so just dump
+    # it out and in; version 4 added the generation columns to zones
     #
     
     my @tables = (
@@ -439,7 +440,9 @@ if ($from_version == 3) {
         { zones => {
             delete => 'DELETE FROM zones',
             select => 'SELECT * FROM zones',
-            insert => 'INSERT INTO zones VALUES ( ?, ?, ?, ?, ?, ?, ?, ? )'
+            insert => $from_version == 3
+                ? 'INSERT INTO zones VALUES ( ?, ?, ?, ?, ?, ?, ?, ? )'
+                : 'INSERT INTO zones VALUES ( ?, ?, ?, ?, ?, ?, ?, ?, ?, ? )'
         }},
         { keypairs => {
             delete => 'DELETE FROM keypairs',
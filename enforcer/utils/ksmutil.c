@@ -1336,7 +1336,7 @@ cmd_listzone ()
     }
 
     /* try to connect to the database */
-    status = db_connect(&dbhandle, &lock_fd, 1);
+    status = db_connect(&dbhandle, NULL, 0);
     if (status != 0) {
         printf("Failed to connect to database\n");
         db_disconnect(lock_fd);
@@ -2275,7 +2275,7 @@ cmd_listrolls ()
     FILE* lock_fd = NULL;   /* This is the lock file descriptor for a SQLite DB */
 
     /* try to connect to the database */
-    status = db_connect(&dbhandle, &lock_fd, 1);
+    status = db_connect(&dbhandle, NULL, 0);
     if (status != 0) {
         printf("Failed to connect to database\n");
         db_disconnect(lock_fd);
@@ -2344,7 +2344,7 @@ cmd_listbackups ()
     FILE* lock_fd = NULL;   /* This is the lock file descriptor for a SQLite DB */
 
     /* try to connect to the database */
-    status = db_connect(&dbhandle, &lock_fd, 0);
+    status = db_connect(&dbhandle, NULL, 0);
     if (status != 0) {
         printf("Failed to connect to database\n");
         db_disconnect(lock_fd);
@@ -2391,7 +2391,7 @@ cmd_listrepo ()
     FILE* lock_fd = NULL;   /* This is the lock file descriptor for a SQLite DB */
 
     /* try to connect to the database */
-    status = db_connect(&dbhandle, &lock_fd, 0);
+    status = db_connect(&dbhandle, NULL, 0);
     if (status != 0) {
         printf("Failed to connect to database\n");
         db_disconnect(lock_fd);
@@ -2432,7 +2432,7 @@ cmd_listpolicy ()
     FILE* lock_fd = NULL;   /* This is the lock file descriptor for a SQLite DB */
 
     /* try to connect to the database */
-    status = db_connect(&dbhandle, &lock_fd, 0);
+    status = db_connect(&dbhandle, NULL, 0);
     if (status != 0) {
         printf("Failed to connect to database\n");
         db_disconnect(lock_fd);
@@ -2472,7 +2472,7 @@ cmd_listkeys ()
     FILE* lock_fd = NULL;   /* This is the lock file descriptor for a SQLite DB */
 
     /* try to connect to the database */
-    status = db_connect(&dbhandle, &lock_fd, 0);
+    status = db_connect(&dbhandle, NULL, 0);
     if (status != 0) {
         printf("Failed to connect to database\n");
         db_disconnect(lock_fd);
@@ -3269,6 +3269,7 @@ cmd_import ()
 cmd_dbbackup ()
 {
     /* Database details */
+    DB_HANDLE	dbhandle;
     FILE* lock_fd = NULL;   /* This is the lock file descriptor for a SQLite DB */
 
     /* what we will read from the file */
@@ -3323,6 +3324,23 @@ cmd_dbbackup ()
     }
     StrFree(lock_filename);
 
+    /* Write what is still in the log of the DB to the file itself */
+    status = DbConnect(&dbhandle, dbschema);
+    if (status == 0) {
+        status = DbCheckpoint();
+        DbDisconnect(dbhandle);
+    }
+    if (status != 0) {
+        printf("Failed to flush the database log\n");
+        StrFree(host);
+        StrFree(port);
+        StrFree(dbschema);
+        StrFree(user);
+        StrFree(password);
+        db_disconnect(lock_fd);
+        return(1);
+    }
+
     /* Work out what file to output */
     if (o_output == NULL) {
         StrAppend(&backup_filename, dbschema);
@@ -3983,7 +4001,8 @@ main (int argc, char *argv[])
  * Given a conf.xml location connect to the database contained within it
  *
  * A lock will be taken out on the DB if it is SQLite; so it is important to release it
- * in the calling Fn when we are done with it.
+ * in the calling Fn when we are done with it.  Commands that only read pass a NULL
+ * lock_fd: in WAL mode they neither wait for nor hold up the enforcer.
  * If backup is set to 1 then a backup will be made (of a sqlite DB file)
  *
  * Returns 0 if a connection was made.
@@ -4046,33 +4065,34 @@ db_connect(DB_HANDLE *dbhandle, FILE** lock_fd, int backup)
             StrFree(lock_filename);
         }
 
-        /* Make a backup of the sqlite DB */
-        if (backup == 1) {
-            StrAppend(&backup_filename, dbschema);
-            StrAppend(&backup_filename, ".backup");
+    }
+
+    /* Finally we can do what we came here to do, connect to the database */
+    status = DbConnect(dbhandle, dbschema, host, password, user, port);
+
+    /* Make a backup of the sqlite DB, once everything that is still in
+       its log has been written to the file */
+    if (status == 0 && DbFlavour() == SQLITE_DB && backup == 1) {
+        StrAppend(&backup_filename, dbschema);
+        StrAppend(&backup_filename, ".backup");
 
+        status = DbCheckpoint();
+        if (status == 0) {
             status = backup_file(dbschema, backup_filename);
+        }
 
-            StrFree(backup_filename);
+        StrFree(backup_filename);
 
-            if (status == 1) {
-                if (lock_fd != NULL) {
-                    fclose(*lock_fd);
-                }
-                StrFree(host);
-                StrFree(port);
-                StrFree(dbschema);
-                StrFree(user);
-                StrFree(password);
-                return(status);
+        if (status != 0) {
+            DbDisconnect(*dbhandle);
+            if (lock_fd != NULL) {
+                fclose(*lock_fd);
+                *lock_fd = NULL;
             }
+            status = 1;
         }
-
     }
 
-    /* Finally we can do what we came here to do, connect to the database */
-    status = DbConnect(dbhandle, dbschema, host, password, user, port);
-
     /* Cleanup */
     StrFree(host);
     StrFree(port);
@@ -4116,7 +4136,8 @@ int get_lite_lock(char *lock_filename, FILE* lock_fd)
 {
     struct flock fl;
     struct timeval tv;
-	int retry = 0;
+    int wait = 10;      /* ms until the next attempt; doubles up to 1s */
+    int waited = 0;     /* ms waited so far; give up after a minute */
 
     if (lock_fd == NULL) {
         printf("%s could not be opened\n", lock_filename);
@@ -4129,19 +4150,25 @@ int get_lite_lock(char *lock_filename, FILE* lock_fd)
     fl.l_pid = getpid();
 
     while (fcntl(fileno(lock_fd), F_SETLK, &fl) == -1) {
-		if (retry >= 6) {
+		if (waited >= 60000) {
 			printf("couldn't get lock on %s; %s\n", lock_filename, strerror(errno));
 			return 1;
 		}
         if (errno == EACCES || errno == EAGAIN) {
-            printf("%s already locked, sleep\n", lock_filename);
+            if (waited == 0) {
+                printf("%s already locked, waiting\n", lock_filename);
+            }
 
-            /* sleep for 10 seconds TODO make this configurable? */
-            tv.tv_sec = 10;
-            tv.tv_usec = 0;
+            /* Wait in short steps, so that we go as soon as the enforcer
+               is done with the database */
+            tv.tv_sec = wait / 1000;
+            tv.tv_usec = (wait % 1000) * 1000;
             select(0, NULL, NULL, NULL, &tv);
 
-			retry++;
+			waited += wait;
+            if (wait < 1000) {
+                wait = (wait * 2 > 1000 ? 1000 : wait * 2);
+            }
 
         } else {
             printf("couldn't get lock on %s; %s\n", lock_filename, strerror(errno));
@@ -7826,6 +7853,13 @@ int MarkDSSeen(int keypair_id, int zone_id, int policy_id, const char *datetime,
         return status;
     }
 
+    /* 2) Have the enforcer rewrite the signconf of the zone */
+    status = KsmZoneGenerationBump(zone_id, -1);
+    if (status != 0) {
+        DbRollback();
+        return status;
+    }
+
     /* 3) Commit or Rollback */
     if (status == 0) { /* It actually can't be anything else */
         /* Everything worked by the looks of it */
@@ -7939,6 +7973,13 @@ int RetireOldKey(int zone_id, int policy_id, const char *datetime)
         return status;
     }
 
+    /* Have the enforcer rewrite the signconf of the zone */
+    status = KsmZoneGenerationBump(zone_id, -1);
+    if (status != 0) {
+        DbRollback();
+        return status;
+    }
+
     /* 2) Commit or Rollback */
     if (status == 0) { /* It actually can't be anything else */
         /* Everything worked by the looks of it */
@@ -8246,6 +8287,26 @@ int ChangeKeyState(int keytype, const char *cka_id, int zone_id, int policy_id,
     status = DbExecuteSqlNoResult(DbHandle(), sql1);
     DusFree(sql1);
 
+    /* 2) Have the enforcer rewrite the signconf of the zones with the key */
+    if (status == 0) {
+        if (zone_id != -1) {
+            status = KsmZoneGenerationBump(zone_id, -1);
+        }
+        else {
+            sql = StrStrdup("(SELECT zone_id FROM dnsseckeys WHERE keypair_id IN ");
+            StrAppend(&sql, insql);
+            StrAppend(&sql, ")");
+            status = KsmZoneGenerationBumpIn(sql);
+            StrFree(sql);
+        }
+        if (status != 0) {
+            StrFree(insql);
+            StrFree(keyids);
+            DbRollback();
+            return status;
+        }
+    }
+
     StrFree(insql);
     StrFree(keyids);
     
@@ -8726,6 +8787,14 @@ int keyRoll(int zone_id, int policy_id, int key_type)
                 DbFreeRow(row);
                 return status;
             }
+
+            /* Every zone with this key needs a new signconf */
+            snprintf(sql2, KSM_SQL_SIZE, "(select zone_id from dnsseckeys where keypair_id = %d)", temp_id);
+            status = KsmZoneGenerationBumpIn(sql2);
+            if (status != 0) {
+                DbFreeRow(row);
+                return status;
+            }
            
             /* Promote any standby keys if we need to, i.e. we retired a KSK 
                and there is nothing able to take over from it */
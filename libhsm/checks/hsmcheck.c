@@ -42,7 +42,99 @@ char *progname = NULL;
 void
 usage ()
 {
-    fprintf(stderr, "usage: %s [-c config] [-gsdr]\n", progname);
+    fprintf(stderr, "usage: %s [-c config] [-gsdrk]\n", progname);
+}
+
+/* checks that a key lookup by ID counts as a hit or a miss */
+static int
+check_key_cache_lookup(hsm_ctx_t *ctx, const char *id, int expect_key,
+                       unsigned long expect_hits, unsigned long expect_misses)
+{
+    hsm_key_t *key;
+    unsigned long hits, misses;
+    unsigned long hits_before, misses_before;
+
+    hsm_key_cache_stats(&hits_before, &misses_before);
+    key = hsm_find_key_by_id(ctx, id);
+    hsm_key_cache_stats(&hits, &misses);
+    printf("lookup %s: %s, %lu hits, %lu misses\n", id,
+        key ? "found" : "not found", hits - hits_before,
+        misses - misses_before);
+    if (key) hsm_key_free(key);
+    if ((key != NULL) != expect_key || hits - hits_before != expect_hits ||
+        misses - misses_before != expect_misses) {
+        printf("Unexpected key cache result\n");
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * Checks the key cache: a generated key is found in the cache, an unknown
+ * key is not, looking up the attributes of a key does not count as a key
+ * lookup, and a removed key is no longer found.
+ */
+static int
+check_key_cache(hsm_ctx_t *ctx, const char *repository)
+{
+    hsm_key_t *key;
+    hsm_key_info_t *key_info;
+    hsm_sign_params_t *sign_params;
+    ldns_rr *dnskey_rr;
+    char *id;
+    unsigned long hits, misses;
+    unsigned long hits_before, misses_before;
+    int res = 0;
+
+    key = hsm_generate_rsa_key(ctx, repository, 1024);
+    if (!key) {
+        printf("Error creating key, bad token name?\n");
+        hsm_print_error(ctx);
+        return 1;
+    }
+    id = hsm_get_key_id(ctx, key);
+    if (!id) {
+        printf("Got no key ID\n");
+        hsm_key_free(key);
+        return 1;
+    }
+
+    /* hit */
+    res |= check_key_cache_lookup(ctx, id, 1, 1, 0);
+    /* miss */
+    res |= check_key_cache_lookup(ctx, "0123456789abcdef0123456789abcdef",
+        0, 0, 1);
+
+    /* attribute lookups are not counted */
+    hsm_key_cache_stats(&hits_before, &misses_before);
+    sign_params = hsm_sign_params_new();
+    sign_params->algorithm = LDNS_RSASHA1;
+    sign_params->owner = ldns_rdf_new_frm_str(LDNS_RDF_TYPE_DNAME,
+        "opendnssec.se.");
+    dnskey_rr = hsm_get_dnskey(ctx, key, sign_params);
+    if (dnskey_rr) ldns_rr_free(dnskey_rr);
+    hsm_sign_params_free(sign_params);
+    key_info = hsm_get_key_info(ctx, key);
+    if (key_info) hsm_key_info_free(key_info);
+    hsm_key_cache_stats(&hits, &misses);
+    if (hits != hits_before || misses != misses_before) {
+        printf("Key attribute lookups counted as key lookups\n");
+        res = 1;
+    }
+
+    /* invalidation on delete */
+    if (hsm_remove_key(ctx, key)) {
+        printf("Error removing key\n");
+        hsm_print_error(ctx);
+        res = 1;
+    } else {
+        res |= check_key_cache_lookup(ctx, id, 0, 0, 1);
+    }
+
+    free(id);
+    hsm_key_free(key);
+    printf("key cache check: %s\n", res ? "failed" : "ok");
+    return res;
 }
 
 int
@@ -64,6 +156,7 @@ main (int argc, char *argv[])
     int do_sign = 0;
     int do_delete = 0;
     int do_random = 0;
+    int do_cache = 0;
 
     int res;
     uint32_t r32;
@@ -76,7 +169,7 @@ main (int argc, char *argv[])
 
     progname = argv[0];
 
-    while ((ch = getopt(argc, argv, "hgsdrc:")) != -1) {
+    while ((ch = getopt(argc, argv, "hgsdrkc:")) != -1) {
         switch (ch) {
         case 'c':
             config = strdup(optarg);
@@ -97,6 +190,9 @@ main (int argc, char *argv[])
         case 'r':
             do_random = 1;
             break;
+        case 'k':
+            do_cache = 1;
+            break;
         default:
             usage();
             exit(1);
@@ -232,6 +328,16 @@ main (int argc, char *argv[])
         printf("random 64: %llu\n", (long long unsigned int)r64);
     }
 
+    /*
+     * Test the key cache
+     */
+    if (do_cache) {
+        printf("\nKey cache:\n");
+        if (check_key_cache(ctx, repository)) {
+            exit(1);
+        }
+    }
+
     /*
      * Destroy HSM context
      */
@@ -147,6 +147,7 @@ main (int argc, char *argv[])
     int ch;
     unsigned int n;
     double elapsed, speed;
+    unsigned long hits, misses;
 
     progname = argv[0];
 
@@ -261,6 +262,9 @@ main (int argc, char *argv[])
     printf("%d %s, %d signatures per thread, %.2f sig/s (RSA %d bits)\n",
         threads, (threads > 1 ? "threads" : "thread"), iterations,
         speed, keysize);
+    hsm_key_cache_stats(&hits, &misses);
+    printf("Key cache: %lu hits, %lu misses (%.1f%% hit rate)\n",
+        hits, misses, hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
 
     /* Delete temporary key */
     fprintf(stderr, "Deleting temporary key...\n");
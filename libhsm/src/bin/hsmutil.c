@@ -641,6 +641,13 @@ main (int argc, char *argv[])
         result = -1;
     }
 
+    if (verbose) {
+        unsigned long hits, misses;
+
+        hsm_key_cache_stats(&hits, &misses);
+        fprintf(stderr, "Key cache: %lu hits, %lu misses\n", hits, misses);
+    }
+
     (void) hsm_close();
     if (config) free(config);
 
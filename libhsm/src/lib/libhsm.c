@@ -34,7 +34,11 @@
 #include <strings.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <dlfcn.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include <libxml/tree.h>
 #include <libxml/parser.h>
@@ -783,6 +787,429 @@ hsm_find_key_session(hsm_ctx_t *ctx, const hsm_key_t *key)
     return NULL;
 }
 
+/*! Key cache
+ *
+ * Maps CKA_ID to the key handles, and to what we learned about the key,
+ * so that finding a key or building its DNSKEY again does not need any
+ * round trips to the HSM. The cache is shared by all contexts: object
+ * handles are valid in every session of the module. It is emptied when
+ * the modules are closed or opened again.
+ */
+#define HSM_KEY_CACHE_BUCKETS 4096
+
+typedef struct hsm_key_cache_entry_struct hsm_key_cache_entry_t;
+struct hsm_key_cache_entry_struct {
+    unsigned char        *id;           /*!< CKA_ID */
+    size_t               id_len;
+    const hsm_module_t   *module;
+    unsigned long        private_key;
+    unsigned long        public_key;
+    unsigned int         have_algorithm : 1;
+    unsigned int         have_keysize : 1;
+    unsigned long        algorithm;
+    unsigned long        keysize;
+    ldns_rdf             *rdata;        /*!< public key, as in DNSKEY */
+    hsm_key_cache_entry_t *id_next;     /*!< next in bucket by id */
+    hsm_key_cache_entry_t *handle_next; /*!< next in bucket by handle */
+};
+
+static hsm_key_cache_entry_t *hsm_key_cache_by_id[HSM_KEY_CACHE_BUCKETS];
+static hsm_key_cache_entry_t *hsm_key_cache_by_handle[HSM_KEY_CACHE_BUCKETS];
+/* lookups of key handles by CKA_ID, protected by the cache lock */
+static unsigned long hsm_key_cache_hits = 0;
+static unsigned long hsm_key_cache_misses = 0;
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t hsm_key_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define hsm_key_cache_lock() pthread_mutex_lock(&hsm_key_cache_mutex)
+#define hsm_key_cache_unlock() pthread_mutex_unlock(&hsm_key_cache_mutex)
+#else
+#define hsm_key_cache_lock()
+#define hsm_key_cache_unlock()
+#endif
+
+static unsigned int
+hsm_key_cache_hash_id(const unsigned char *id, size_t len)
+{
+    unsigned int hash = 2166136261U;
+    size_t i;
+    for (i = 0; i < len; i++) {
+        hash = (hash ^ id[i]) * 16777619U;
+    }
+    return hash % HSM_KEY_CACHE_BUCKETS;
+}
+
+static unsigned int
+hsm_key_cache_hash_handle(const hsm_module_t *module, unsigned long handle)
+{
+    return (unsigned int) (((uintptr_t) module / sizeof(void *)) + handle) %
+        HSM_KEY_CACHE_BUCKETS;
+}
+
+/* returns the entry of a key, the cache must be locked */
+static hsm_key_cache_entry_t *
+hsm_key_cache_find(const hsm_key_t *key)
+{
+    hsm_key_cache_entry_t *entry;
+    if (!key || !key->module || !key->private_key) return NULL;
+    entry = hsm_key_cache_by_handle[hsm_key_cache_hash_handle(key->module,
+                                                    key->private_key)];
+    while (entry) {
+        if (entry->module == key->module &&
+            entry->private_key == key->private_key) {
+            return entry;
+        }
+        entry = entry->handle_next;
+    }
+    return NULL;
+}
+
+static void
+hsm_key_cache_unlink(hsm_key_cache_entry_t *entry)
+{
+    hsm_key_cache_entry_t **prev;
+    prev = &hsm_key_cache_by_id[hsm_key_cache_hash_id(entry->id,
+                                                     entry->id_len)];
+    while (*prev && *prev != entry) prev = &(*prev)->id_next;
+    if (*prev) *prev = entry->id_next;
+    prev = &hsm_key_cache_by_handle[hsm_key_cache_hash_handle(entry->module,
+                                                     entry->private_key)];
+    while (*prev && *prev != entry) prev = &(*prev)->handle_next;
+    if (*prev) *prev = entry->handle_next;
+}
+
+static void
+hsm_key_cache_entry_free(hsm_key_cache_entry_t *entry)
+{
+    if (entry) {
+        if (entry->rdata) ldns_rdf_deep_free(entry->rdata);
+        free(entry->id);
+        free(entry);
+    }
+}
+
+/* returns 1 if the context has a session with the module */
+static int
+hsm_ctx_has_module(hsm_ctx_t *ctx, const hsm_module_t *module)
+{
+    unsigned int i;
+    for (i = 0; i < ctx->session_count; i++) {
+        if (ctx->session[i] && ctx->session[i]->module == module) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* looks up a key by CKA_ID, returns a new key or NULL if not cached */
+static hsm_key_t *
+hsm_key_cache_get(hsm_ctx_t *ctx, const unsigned char *id, size_t len)
+{
+    hsm_key_cache_entry_t *entry;
+    hsm_key_t *key = NULL;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_by_id[hsm_key_cache_hash_id(id, len)];
+    while (entry) {
+        if (entry->id_len == len && memcmp(entry->id, id, len) == 0 &&
+            hsm_ctx_has_module(ctx, entry->module)) {
+            key = hsm_key_new();
+            key->module = entry->module;
+            key->private_key = entry->private_key;
+            key->public_key = entry->public_key;
+            break;
+        }
+        entry = entry->id_next;
+    }
+    if (key) {
+        hsm_key_cache_hits++;
+    } else {
+        hsm_key_cache_misses++;
+    }
+    hsm_key_cache_unlock();
+    return key;
+}
+
+/* remembers a key and its CKA_ID */
+static void
+hsm_key_cache_put(const hsm_key_t *key, const unsigned char *id, size_t len)
+{
+    hsm_key_cache_entry_t *entry;
+    unsigned int bucket;
+
+    if (!key || !key->module || !key->private_key || !id) return;
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry) {
+        entry->public_key = key->public_key;
+        hsm_key_cache_unlock();
+        return;
+    }
+    entry = calloc(1, sizeof(hsm_key_cache_entry_t));
+    if (entry) entry->id = malloc(len ? len : 1);
+    if (!entry || !entry->id) {
+        free(entry);
+        hsm_key_cache_unlock();
+        return;
+    }
+    memcpy(entry->id, id, len);
+    entry->id_len = len;
+    entry->module = key->module;
+    entry->private_key = key->private_key;
+    entry->public_key = key->public_key;
+    bucket = hsm_key_cache_hash_id(id, len);
+    entry->id_next = hsm_key_cache_by_id[bucket];
+    hsm_key_cache_by_id[bucket] = entry;
+    bucket = hsm_key_cache_hash_handle(key->module, key->private_key);
+    entry->handle_next = hsm_key_cache_by_handle[bucket];
+    hsm_key_cache_by_handle[bucket] = entry;
+    hsm_key_cache_unlock();
+}
+
+/* returns the cached CKA_ID of a key as a new byte array, or NULL */
+static unsigned char *
+hsm_key_cache_get_id(const hsm_key_t *key, size_t *len)
+{
+    hsm_key_cache_entry_t *entry;
+    unsigned char *id = NULL;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry) {
+        id = malloc(entry->id_len ? entry->id_len : 1);
+        if (id) {
+            memcpy(id, entry->id, entry->id_len);
+            *len = entry->id_len;
+        }
+    }
+    hsm_key_cache_unlock();
+    return id;
+}
+
+/* returns 1 and sets the algorithm if it is cached */
+static int
+hsm_key_cache_get_algorithm(const hsm_key_t *key, unsigned long *algorithm)
+{
+    hsm_key_cache_entry_t *entry;
+    int found = 0;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry && entry->have_algorithm) {
+        *algorithm = entry->algorithm;
+        found = 1;
+    }
+    hsm_key_cache_unlock();
+    return found;
+}
+
+static void
+hsm_key_cache_put_algorithm(const hsm_key_t *key, unsigned long algorithm)
+{
+    hsm_key_cache_entry_t *entry;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry) {
+        entry->algorithm = algorithm;
+        entry->have_algorithm = 1;
+    }
+    hsm_key_cache_unlock();
+}
+
+/* returns the cached key size, or 0 if it is not cached */
+static unsigned long
+hsm_key_cache_get_keysize(const hsm_key_t *key)
+{
+    hsm_key_cache_entry_t *entry;
+    unsigned long keysize = 0;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry && entry->have_keysize) {
+        keysize = entry->keysize;
+    }
+    hsm_key_cache_unlock();
+    return keysize;
+}
+
+static void
+hsm_key_cache_put_keysize(const hsm_key_t *key, unsigned long keysize)
+{
+    hsm_key_cache_entry_t *entry;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry) {
+        entry->keysize = keysize;
+        entry->have_keysize = 1;
+    }
+    hsm_key_cache_unlock();
+}
+
+/* returns a copy of the cached public key rdata, or NULL */
+static ldns_rdf *
+hsm_key_cache_get_rdata(const hsm_key_t *key)
+{
+    hsm_key_cache_entry_t *entry;
+    ldns_rdf *rdata = NULL;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry && entry->rdata) {
+        rdata = ldns_rdf_clone(entry->rdata);
+    }
+    hsm_key_cache_unlock();
+    return rdata;
+}
+
+static void
+hsm_key_cache_put_rdata(const hsm_key_t *key, const ldns_rdf *rdata)
+{
+    hsm_key_cache_entry_t *entry;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry && !entry->rdata) {
+        entry->rdata = ldns_rdf_clone(rdata);
+    }
+    hsm_key_cache_unlock();
+}
+
+/*! Key inventory
+ *
+ * The number of private keys on each token, so that capacity checks do
+ * not have to enumerate the whole token every time. The count follows
+ * the keys that this process generates and removes, and is taken from
+ * the token again when it is older than HSM_KEY_INVENTORY_MAX_AGE
+ * seconds, to pick up the changes made by other processes. It is
+ * protected by the key cache lock.
+ */
+#define HSM_KEY_INVENTORY_MAX_AGE 300
+
+typedef struct {
+    const hsm_module_t *module;
+    size_t count;
+    time_t counted;
+} hsm_key_inventory_t;
+
+static hsm_key_inventory_t hsm_key_inventory[HSM_MAX_SESSIONS];
+
+/* returns the inventory of a module, the cache must be locked */
+static hsm_key_inventory_t *
+hsm_key_inventory_find(const hsm_module_t *module, int create)
+{
+    unsigned int i;
+    for (i = 0; i < HSM_MAX_SESSIONS; i++) {
+        if (hsm_key_inventory[i].module == module) {
+            return &hsm_key_inventory[i];
+        }
+    }
+    if (!create) return NULL;
+    for (i = 0; i < HSM_MAX_SESSIONS; i++) {
+        if (!hsm_key_inventory[i].module) {
+            hsm_key_inventory[i].module = module;
+            return &hsm_key_inventory[i];
+        }
+    }
+    return NULL;
+}
+
+/* returns 1 and sets count if the number of keys of the module is known
+ * and recent enough */
+static int
+hsm_key_inventory_get(const hsm_module_t *module, size_t *count)
+{
+    hsm_key_inventory_t *inventory;
+    int found = 0;
+
+    hsm_key_cache_lock();
+    inventory = hsm_key_inventory_find(module, 0);
+    if (inventory && inventory->counted &&
+        time(NULL) - inventory->counted < HSM_KEY_INVENTORY_MAX_AGE) {
+        *count = inventory->count;
+        found = 1;
+    }
+    hsm_key_cache_unlock();
+    return found;
+}
+
+/* sets the number of keys of the module, as counted on the token */
+static void
+hsm_key_inventory_set(const hsm_module_t *module, size_t count)
+{
+    hsm_key_inventory_t *inventory;
+
+    hsm_key_cache_lock();
+    inventory = hsm_key_inventory_find(module, 1);
+    if (inventory) {
+        inventory->count = count;
+        inventory->counted = time(NULL);
+    }
+    hsm_key_cache_unlock();
+}
+
+/* adds a generated (1) or removed (-1) key to the count, if known */
+static void
+hsm_key_inventory_adjust(const hsm_module_t *module, int delta)
+{
+    hsm_key_inventory_t *inventory;
+
+    hsm_key_cache_lock();
+    inventory = hsm_key_inventory_find(module, 0);
+    if (inventory && inventory->counted) {
+        if (delta < 0 && inventory->count < (size_t) -delta) {
+            inventory->count = 0;
+        } else {
+            inventory->count += delta;
+        }
+    }
+    hsm_key_cache_unlock();
+}
+
+/* forgets all keys, for when the modules are (re)opened or closed */
+static void
+hsm_key_cache_clear()
+{
+    hsm_key_cache_entry_t *entry;
+    unsigned int i;
+
+    hsm_key_cache_lock();
+    for (i = 0; i < HSM_KEY_CACHE_BUCKETS; i++) {
+        while (hsm_key_cache_by_id[i]) {
+            entry = hsm_key_cache_by_id[i];
+            hsm_key_cache_by_id[i] = entry->id_next;
+            hsm_key_cache_entry_free(entry);
+        }
+        hsm_key_cache_by_handle[i] = NULL;
+    }
+    memset(hsm_key_inventory, 0, sizeof(hsm_key_inventory));
+    hsm_key_cache_unlock();
+}
+
+void
+hsm_key_cache_forget(const hsm_key_t *key)
+{
+    hsm_key_cache_entry_t *entry;
+
+    hsm_key_cache_lock();
+    entry = hsm_key_cache_find(key);
+    if (entry) {
+        hsm_key_cache_unlink(entry);
+        hsm_key_cache_entry_free(entry);
+    }
+    hsm_key_cache_unlock();
+}
+
+void
+hsm_key_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+    hsm_key_cache_lock();
+    if (hits) *hits = hsm_key_cache_hits;
+    if (misses) *misses = hsm_key_cache_misses;
+    hsm_key_cache_unlock();
+}
+
 /* Returns the key type (algorithm) of the given key */
 static CK_KEY_TYPE
 hsm_get_key_algorithm(hsm_ctx_t *ctx, const hsm_session_t *session,
@@ -790,11 +1217,16 @@ hsm_get_key_algorithm(hsm_ctx_t *ctx, const hsm_session_t *session,
 {
     CK_RV rv;
     CK_KEY_TYPE key_type;
+    unsigned long algorithm;
 
     CK_ATTRIBUTE template[] = {
         {CKA_KEY_TYPE, &key_type, sizeof(CK_KEY_TYPE)}
     };
 
+    if (hsm_key_cache_get_algorithm(key, &algorithm)) {
+        return (CK_KEY_TYPE) algorithm;
+    }
+
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetAttributeValue(
                                       session->session,
                                       key->private_key,
@@ -817,6 +1249,7 @@ hsm_get_key_algorithm(hsm_ctx_t *ctx, const hsm_session_t *session,
         return 0;
     }
 
+    hsm_key_cache_put_algorithm(key, (unsigned long) key_type);
     return key_type;
 }
 
@@ -1069,21 +1502,31 @@ static CK_ULONG
 hsm_get_key_size(hsm_ctx_t *ctx, const hsm_session_t *session,
                  const hsm_key_t *key, const unsigned long algorithm)
 {
+    CK_ULONG keysize;
+
+    keysize = (CK_ULONG) hsm_key_cache_get_keysize(key);
+    if (keysize) return keysize;
+
     switch (algorithm) {
         case CKK_RSA:
-            return hsm_get_key_size_rsa(ctx, session, key);
+            keysize = hsm_get_key_size_rsa(ctx, session, key);
             break;
         case CKK_DSA:
-            return hsm_get_key_size_dsa(ctx, session, key);
+            keysize = hsm_get_key_size_dsa(ctx, session, key);
             break;
         case CKK_GOSTR3410:
             /* GOST public keys always have a size of 512 bits */
-            return 512;
+            keysize = 512;
+            break;
         case CKK_EC:
-            return hsm_get_key_size_ecdsa(ctx, session, key);
+            keysize = hsm_get_key_size_ecdsa(ctx, session, key);
+            break;
         default:
-            return 0;
+            keysize = 0;
+            break;
     }
+    if (keysize) hsm_key_cache_put_keysize(key, (unsigned long) keysize);
+    return keysize;
 }
 
 static CK_OBJECT_HANDLE
@@ -1255,82 +1698,284 @@ hsm_key_new_privkey_object_handle(hsm_ctx_t *ctx,
                           id,
                           len);
 
+    hsm_key_cache_put(key, id, len);
     free(id);
     return key;
 }
 
-/* helper function to find both key counts or the keys themselves
- * if the argument store is 0, results are not returned; the
- * function will only set the count and return NULL
- * Otherwise, a newly allocated key array will be returned
- * (on error, the count will also be zero and NULL returned)
+/* number of handles to ask for per C_FindObjects() call */
+#define HSM_FIND_BATCH 1024
+/* CKA_IDs up to this size are read in the same call as other attributes,
+ * libhsm itself generates 16 byte ids */
+#define HSM_ID_BUFFER_SIZE 64
+
+/* finds all objects of the given class on the token. If handles is not
+ * NULL, a newly allocated array of the object handles is returned in it,
+ * otherwise the objects are only counted. Returns 0 on success.
  */
-static hsm_key_t **
-hsm_list_keys_session_internal(hsm_ctx_t *ctx,
-                               const hsm_session_t *session,
-                               size_t *count,
-                               int store)
+static int
+hsm_find_objects_of_class(hsm_ctx_t *ctx,
+                          const hsm_session_t *session,
+                          CK_OBJECT_CLASS object_class,
+                          CK_OBJECT_HANDLE **handles,
+                          CK_ULONG *count)
 {
-    hsm_key_t **keys = NULL;
-    hsm_key_t *key;
     CK_RV rv;
-    CK_OBJECT_CLASS key_class = CKO_PRIVATE_KEY;
     CK_ATTRIBUTE template[] = {
-        { CKA_CLASS, &key_class, sizeof(key_class) },
+        { CKA_CLASS, &object_class, sizeof(object_class) },
     };
+    CK_OBJECT_HANDLE object[HSM_FIND_BATCH];
+    CK_OBJECT_HANDLE *list = NULL;
+    CK_OBJECT_HANDLE *tmp;
+    CK_ULONG object_count = 1;
     CK_ULONG total_count = 0;
-    CK_ULONG objectCount = 1;
-    /* find 100 keys at a time (and loop until there are none left) */
-    CK_ULONG max_object_count = 100;
-    CK_ULONG i, j;
-    CK_OBJECT_HANDLE object[max_object_count];
-    CK_OBJECT_HANDLE *key_handles = NULL;
+    CK_ULONG size = 0;
 
+    *count = 0;
+    if (handles) *handles = NULL;
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_FindObjectsInit(session->session,
                                                  template, 1);
     if (hsm_pkcs11_check_error(ctx, rv, "Find objects init")) {
-        *count = 0;
-        return NULL;
+        return -1;
     }
-    j = 0;
-    while (objectCount > 0) {
+    while (object_count > 0) {
         rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_FindObjects(session->session,
                                                  object,
-                                                 max_object_count,
-                                                 &objectCount);
+                                                 HSM_FIND_BATCH,
+                                                 &object_count);
         if (hsm_pkcs11_check_error(ctx, rv, "Find first object")) {
-            free(key_handles);
-            *count = 0;
+            free(list);
             rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_FindObjectsFinal(session->session);
             hsm_pkcs11_check_error(ctx, rv, "Find objects cleanup");
-            return NULL;
+            return -1;
         }
-
-        total_count += objectCount;
-        if (objectCount > 0 && store) {
-            key_handles = realloc(key_handles, total_count * sizeof(CK_OBJECT_HANDLE));
-            for (i = 0; i < objectCount; i++) {
-                key_handles[j] = object[i];
-                j++;
+        if (object_count > 0 && handles) {
+            if (total_count + object_count > size) {
+                size = (total_count + object_count) * 2;
+                tmp = realloc(list, size * sizeof(CK_OBJECT_HANDLE));
+                if (!tmp) {
+                    free(list);
+                    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_FindObjectsFinal(session->session);
+                    hsm_ctx_set_error(ctx, -1, "hsm_find_objects_of_class()",
+                        "Error allocating memory for object handles");
+                    return -1;
+                }
+                list = tmp;
             }
+            memcpy(list + total_count, object,
+                   object_count * sizeof(CK_OBJECT_HANDLE));
         }
+        total_count += object_count;
     }
 
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_FindObjectsFinal(session->session);
     if (hsm_pkcs11_check_error(ctx, rv, "Find objects final")) {
-        free(key_handles);
-        *count = 0;
+        free(list);
+        return -1;
+    }
+
+    if (handles) *handles = list;
+    *count = total_count;
+    return 0;
+}
+
+/* returns the CKA_ID of an object, like hsm_get_id_for_object(), but
+ * in a single round trip when the id fits in a small buffer. If key_type
+ * is not NULL, CKA_KEY_TYPE is read in the same call, and *have_type
+ * tells whether it was.
+ */
+static CK_BYTE *
+hsm_get_id_and_type_for_object(hsm_ctx_t *ctx,
+                               const hsm_session_t *session,
+                               CK_OBJECT_HANDLE object,
+                               size_t *len,
+                               CK_KEY_TYPE *key_type,
+                               int *have_type)
+{
+    CK_RV rv;
+    CK_BYTE buffer[HSM_ID_BUFFER_SIZE];
+    CK_BYTE *id;
+    CK_ATTRIBUTE template[] = {
+        {CKA_ID, buffer, sizeof(buffer)},
+        {CKA_KEY_TYPE, key_type, sizeof(CK_KEY_TYPE)}
+    };
+
+    if (have_type) *have_type = 0;
+    rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_GetAttributeValue(
+                                      session->session,
+                                      object,
+                                      template,
+                                      key_type ? 2 : 1);
+    if (rv != CKR_OK) {
+        /* the id is too large for the buffer, or the token did not like
+         * the template; ask for the id on its own */
+        return hsm_get_id_for_object(ctx, session, object, len);
+    }
+
+    if ((CK_LONG)template[0].ulValueLen < 1) {
+        /* No CKA_ID found, return NULL */
+        *len = 0;
+        return NULL;
+    }
+
+    id = malloc(template[0].ulValueLen);
+    if (!id) {
+        *len = 0;
+        return NULL;
+    }
+    memcpy(id, buffer, template[0].ulValueLen);
+    *len = template[0].ulValueLen;
+    if (key_type && have_type) *have_type = 1;
+    return id;
+}
+
+/* CKA_ID of an object, for matching public keys to private keys */
+typedef struct {
+    CK_BYTE          *id;
+    size_t           len;
+    CK_OBJECT_HANDLE handle;
+} hsm_object_id_t;
+
+static int
+hsm_object_id_compare(const void *a, const void *b)
+{
+    const hsm_object_id_t *x = (const hsm_object_id_t *) a;
+    const hsm_object_id_t *y = (const hsm_object_id_t *) b;
+
+    if (x->len != y->len) {
+        return x->len < y->len ? -1 : 1;
+    }
+    return memcmp(x->id, y->id, x->len);
+}
+
+/* returns the CKA_IDs of all public keys on the token, sorted, so that
+ * the public key of each private key can be found without searching the
+ * token for it. Returns NULL if there are none.
+ */
+static hsm_object_id_t *
+hsm_list_public_key_ids(hsm_ctx_t *ctx,
+                        const hsm_session_t *session,
+                        size_t *count)
+{
+    CK_OBJECT_HANDLE *handles = NULL;
+    CK_ULONG handle_count = 0;
+    CK_ULONG i;
+    hsm_object_id_t *ids;
+    size_t n = 0;
+
+    *count = 0;
+    if (hsm_find_objects_of_class(ctx, session, CKO_PUBLIC_KEY,
+                                  &handles, &handle_count) ||
+        handle_count == 0) {
+        return NULL;
+    }
+    ids = malloc(handle_count * sizeof(hsm_object_id_t));
+    if (!ids) {
+        free(handles);
+        return NULL;
+    }
+    for (i = 0; i < handle_count; i++) {
+        ids[n].id = hsm_get_id_and_type_for_object(ctx, session,
+                        handles[i], &ids[n].len, NULL, NULL);
+        if (ids[n].id) {
+            ids[n].handle = handles[i];
+            n++;
+        }
+    }
+    free(handles);
+    if (n == 0) {
+        free(ids);
+        return NULL;
+    }
+    qsort(ids, n, sizeof(hsm_object_id_t), hsm_object_id_compare);
+    *count = n;
+    return ids;
+}
+
+/* helper function to find both key counts or the keys themselves
+ * if the argument store is 0, results are not returned; the
+ * function will only set the count and return NULL
+ * Otherwise, a newly allocated key array will be returned
+ * (on error, the count will also be zero and NULL returned)
+ *
+ * Listing reads the id and key type of each private key in one call,
+ * and matches the public keys by id in bulk, so that it takes about
+ * one round trip per object instead of five per key.
+ */
+static hsm_key_t **
+hsm_list_keys_session_internal(hsm_ctx_t *ctx,
+                               const hsm_session_t *session,
+                               size_t *count,
+                               int store)
+{
+    hsm_key_t **keys = NULL;
+    hsm_key_t *key;
+    CK_OBJECT_HANDLE *key_handles = NULL;
+    CK_ULONG total_count = 0;
+    CK_ULONG i;
+    hsm_object_id_t *public_ids = NULL;
+    hsm_object_id_t *found;
+    hsm_object_id_t search;
+    size_t public_count = 0;
+    size_t j;
+    CK_KEY_TYPE key_type;
+    int have_type;
+    CK_BYTE *id;
+    size_t len;
+
+    *count = 0;
+    if (hsm_find_objects_of_class(ctx, session, CKO_PRIVATE_KEY,
+                                  store ? &key_handles : NULL,
+                                  &total_count)) {
         return NULL;
     }
+    hsm_key_inventory_set(session->module, (size_t) total_count);
 
-    if (store) {
-        keys = realloc(keys, total_count * sizeof(hsm_key_t *));
+    if (store && total_count > 0) {
+        keys = malloc(total_count * sizeof(hsm_key_t *));
+        if (!keys) {
+            free(key_handles);
+            hsm_ctx_set_error(ctx, -1, "hsm_list_keys_session_internal()",
+                "Error allocating memory for key list");
+            return NULL;
+        }
+        public_ids = hsm_list_public_key_ids(ctx, session, &public_count);
         for (i = 0; i < total_count; i++) {
-            key = hsm_key_new_privkey_object_handle(ctx, session,
-                                                    key_handles[i]);
+            keys[i] = NULL;
+            key = hsm_key_new();
+            key->module = session->module;
+            key->private_key = key_handles[i];
+
+            have_type = 0;
+            id = hsm_key_cache_get_id(key, &len);
+            if (!id) {
+                id = hsm_get_id_and_type_for_object(ctx, session,
+                         key_handles[i], &len, &key_type, &have_type);
+            }
             /* todo, if we get NULL, free all and return error? */
+            if (!id) {
+                free(key);
+                continue;
+            }
+            if (public_ids) {
+                search.id = id;
+                search.len = len;
+                found = bsearch(&search, public_ids, public_count,
+                                sizeof(hsm_object_id_t),
+                                hsm_object_id_compare);
+                if (found) key->public_key = found->handle;
+            }
+            hsm_key_cache_put(key, id, len);
+            if (have_type) {
+                hsm_key_cache_put_algorithm(key, (unsigned long) key_type);
+            }
+            free(id);
             keys[i] = key;
         }
+        for (j = 0; j < public_count; j++) {
+            free(public_ids[j].id);
+        }
+        free(public_ids);
     }
     free(key_handles);
 
@@ -1363,6 +2008,10 @@ size_t
 hsm_count_keys_session(hsm_ctx_t *ctx, const hsm_session_t *session)
 {
     size_t count = 0;
+
+    if (hsm_key_inventory_get(session->module, &count)) {
+        return count;
+    }
     (void) hsm_list_keys_session_internal(ctx, session, &count, 0);
     return count;
 }
@@ -1413,6 +2062,9 @@ hsm_find_key_by_id_bin(hsm_ctx_t *ctx,
     if (!ctx) ctx = _hsm_ctx;
     if (!id) return NULL;
 
+    key = hsm_key_cache_get(ctx, id, len);
+    if (key) return key;
+
     for (i = 0; i < ctx->session_count; i++) {
         key = hsm_find_key_by_id_session(ctx, ctx->session[i], id, len);
         if (key) return key;
@@ -1746,21 +2398,29 @@ static ldns_rdf *
 hsm_get_key_rdata(hsm_ctx_t *ctx, hsm_session_t *session,
                   const hsm_key_t *key)
 {
+    ldns_rdf *rdata;
+
+    rdata = hsm_key_cache_get_rdata(key);
+    if (rdata) return rdata;
+
     switch (hsm_get_key_algorithm(ctx, session, key)) {
         case CKK_RSA:
-            return hsm_get_key_rdata_rsa(ctx, session, key);
+            rdata = hsm_get_key_rdata_rsa(ctx, session, key);
             break;
         case CKK_DSA:
-            return hsm_get_key_rdata_dsa(ctx, session, key);
+            rdata = hsm_get_key_rdata_dsa(ctx, session, key);
             break;
         case CKK_GOSTR3410:
-            return hsm_get_key_rdata_gost(ctx, session, key);
+            rdata = hsm_get_key_rdata_gost(ctx, session, key);
             break;
         case CKK_EC:
-            return hsm_get_key_rdata_ecdsa(ctx, session, key);
+            rdata = hsm_get_key_rdata_ecdsa(ctx, session, key);
+            break;
         default:
             return 0;
     }
+    if (rdata) hsm_key_cache_put_rdata(key, rdata);
+    return rdata;
 }
 
 /* this function allocates memory for the mechanism ID and enough room
@@ -2138,6 +2798,7 @@ hsm_open(const char *config,
 
     /* create an internal context with an attached session for each
      * configured HSM. */
+    hsm_key_cache_clear();
     _hsm_ctx = hsm_ctx_new();
 
     if (config) {
@@ -2272,6 +2933,7 @@ hsm_open(const char *config,
 int
 hsm_close()
 {
+    hsm_key_cache_clear();
     hsm_ctx_close(_hsm_ctx, 1);
     return 0;
 }
@@ -2540,6 +3202,8 @@ hsm_generate_rsa_key(hsm_ctx_t *ctx,
     }
 
     new_key->private_key = privateKey;
+    hsm_key_cache_put(new_key, id, sizeof(id));
+    hsm_key_inventory_adjust(session->module, 1);
     return new_key;
 }
 
@@ -2653,6 +3317,8 @@ hsm_generate_dsa_key(hsm_ctx_t *ctx,
     new_key->module = session->module;
     new_key->public_key = publicKey;
     new_key->private_key = privateKey;
+    hsm_key_cache_put(new_key, id, sizeof(id));
+    hsm_key_inventory_adjust(session->module, 1);
 
     return new_key;
 }
@@ -2735,6 +3401,8 @@ hsm_generate_gost_key(hsm_ctx_t *ctx,
     new_key->module = session->module;
     new_key->public_key = publicKey;
     new_key->private_key = privateKey;
+    hsm_key_cache_put(new_key, id, sizeof(id));
+    hsm_key_inventory_adjust(session->module, 1);
 
     return new_key;
 }
@@ -2833,6 +3501,8 @@ hsm_generate_ecdsa_key(hsm_ctx_t *ctx,
     new_key->module = session->module;
     new_key->public_key = publicKey;
     new_key->private_key = privateKey;
+    hsm_key_cache_put(new_key, id, sizeof(id));
+    hsm_key_inventory_adjust(session->module, 1);
 
     return new_key;
 }
@@ -2848,12 +3518,14 @@ hsm_remove_key(hsm_ctx_t *ctx, hsm_key_t *key)
     session = hsm_find_key_session(ctx, key);
     if (!session) return -2;
 
+    hsm_key_cache_forget(key);
     rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_DestroyObject(session->session,
                                                key->private_key);
     if (hsm_pkcs11_check_error(ctx, rv, "Destroy private key")) {
         return -3;
     }
     key->private_key = 0;
+    hsm_key_inventory_adjust(session->module, -1);
 
     if (key->public_key) {
         rv = ((CK_FUNCTION_LIST_PTR)session->module->sym)->C_DestroyObject(session->session,
@@ -2899,7 +3571,8 @@ hsm_get_key_id(hsm_ctx_t *ctx, const hsm_key_t *key)
     session = hsm_find_key_session(ctx, key);
     if (!session) return NULL;
 
-    id = hsm_get_id_for_object(ctx, session, key->private_key, &len);
+    id = hsm_key_cache_get_id(key, &len);
+    if (!id) id = hsm_get_id_for_object(ctx, session, key->private_key, &len);
     if (!id) return NULL;
 
     /* this is plain binary data, we need to convert it to hex */
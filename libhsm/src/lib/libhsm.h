@@ -291,6 +291,29 @@ hsm_key_t *
 hsm_find_key_by_id(hsm_ctx_t *context,
                    const char *id);
 
+/*! Forget a key in the key cache
+
+Keys found by CKA_ID are cached, with their handles, algorithm, size and
+public key data, for all contexts until the HSMs are closed or opened
+again. Call this when an operation with a cached key fails, so that the
+next lookup goes to the HSM again.
+
+\param key the key to forget
+*/
+void
+hsm_key_cache_forget(const hsm_key_t *key);
+
+/*! Get key cache statistics
+
+Only the lookups of key handles by CKA_ID are counted, not those of
+the cached attributes of a key.
+
+\param hits location to store the number of key lookups served from the cache
+\param misses location to store the number of key lookups that went to the HSM
+*/
+void
+hsm_key_cache_stats(unsigned long *hits, unsigned long *misses);
+
 /*! Generate new key pair in HSM
 
 Keys generated by libhsm will have a 16-byte identifier set as CKA_ID
@@ -82,6 +82,9 @@ AC_DEFINE_UNQUOTED(ODS_SE_CLI,           ["$OPENDNSSEC_SIGNER_CLI"],         [Pa
 AC_DEFINE_UNQUOTED(ODS_SE_MAXLINE,       [1024],                             [Maximum line length that the OpenDNSSEC signer client can handle])
 AC_DEFINE_UNQUOTED(ODS_SE_MAX_BACKOFF,   [3600],                             [Number of seconds the OpenDNSSEC signer engine should backoff when a task failed])
 AC_DEFINE_UNQUOTED(ODS_SE_WORKERTHREADS, [4],                                [Default number of worker threads for the OpenDNSSEC signer engine])
+AC_DEFINE_UNQUOTED(ODS_SE_LISTENERTHREADS, [1],                              [Default number of listener threads for the OpenDNSSEC signer engine])
+AC_DEFINE_UNQUOTED(ODS_SE_XFRTHREADS,    [1],                                [Default number of zone transfer threads for the OpenDNSSEC signer engine])
+AC_DEFINE_UNQUOTED(ODS_SE_XFRPERMASTER,  [10],                               [Default maximum number of concurrent tcp zone transfers per master])
 AC_DEFINE_UNQUOTED(ODS_SE_STOP_RESPONSE, ["Engine shut down."],              [Shutdown message for the OpenDNSSEC signer client])
 AC_DEFINE_UNQUOTED(ODS_SE_FILE_MAGIC_V3, [";OpenDNSSEC-backup-v3"],          [File magic for storing backups from the OpenDNSSEC signer engine])
 AC_DEFINE_UNQUOTED(ODS_SE_FILE_MAGIC_V2, [";ODSSE2"],                        [File magic for storing backups from the OpenDNSSEC signer engine])
@@ -35,6 +35,7 @@
 #include "adapter/adapi.h"
 #include "shared/duration.h"
 #include "shared/log.h"
+#include "shared/metrics.h"
 #include "shared/status.h"
 #include "shared/util.h"
 #include "signer/zone.h"
@@ -124,6 +125,7 @@ adapi_trans_full(zone_type* zone, unsigned more_coming)
 {
     time_t start = 0;
     time_t end = 0;
+    uint64_t usec = 0;
     uint32_t num_added = 0;
     if (!zone || !zone->db) {
         return;
@@ -137,8 +139,10 @@ adapi_trans_full(zone_type* zone, unsigned more_coming)
         lock_basic_unlock(&zone->stats->stats_lock);
     }
     start = time(NULL);
+    usec = metrics_usec();
     /* nsecify(3) */
     namedb_nsecify(zone->db, &num_added);
+    metrics_phase_time(METRICS_PHASE_NSECIFY, metrics_usec() - usec);
     end = time(NULL);
     if (zone->stats) {
         lock_basic_lock(&zone->stats->stats_lock);
@@ -162,6 +166,7 @@ adapi_trans_diff(zone_type* zone, unsigned more_coming)
 {
     time_t start = 0;
     time_t end = 0;
+    uint64_t usec = 0;
     uint32_t num_added = 0;
     if (!zone || !zone->db) {
         return;
@@ -175,8 +180,10 @@ adapi_trans_diff(zone_type* zone, unsigned more_coming)
         lock_basic_unlock(&zone->stats->stats_lock);
     }
     start = time(NULL);
+    usec = metrics_usec();
     /* nsecify(3) */
     namedb_nsecify(zone->db, &num_added);
+    metrics_phase_time(METRICS_PHASE_NSECIFY, metrics_usec() - usec);
     end = time(NULL);
     if (zone->stats) {
         lock_basic_lock(&zone->stats->stats_lock);
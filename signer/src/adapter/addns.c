@@ -44,16 +44,18 @@
 #include "shared/status.h"
 #include "shared/util.h"
 #include "signer/zone.h"
+#include "wire/buffer.h"
 #include "wire/notify.h"
 #include "wire/xfrd.h"
 
 #include <ldns/ldns.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const char* adapter_str = "adapter";
-static ods_status addns_read_pkt(FILE* fd, zone_type* zone);
-static ods_status addns_read_file(FILE* fd, zone_type* zone);
+static ods_status addns_read_file(FILE* fd, xfrd_diff_type* diffs,
+    zone_type* zone);
 
 
 /**
@@ -133,49 +135,288 @@ addns_read_line:
 
 
 /**
- * Read pkt from file.
+ * Zone transfer spool reader.
+ * Reads the RRs of the transfers that were stored on disk by xfrd, either
+ * as raw DNS messages or, for debugging, as text. If xfrd kept a copy of
+ * the spooled IXFRs in memory, the RRs are taken from there instead.
+ *
+ */
+typedef struct addns_spool_struct addns_spool_type;
+struct addns_spool_struct {
+    FILE* fd;
+    zone_type* zone;
+    char line[SE_ADFILE_MAXLINE];
+    unsigned int l;
+    /* text format */
+    ldns_rdf* orig;
+    ldns_rdf* prev;
+    uint32_t ttl;
+    /* wire format */
+    uint8_t msg[MAX_PACKET_SIZE];
+    size_t msg_len;
+    size_t pos;
+    uint16_t ancount;
+    /* in memory */
+    xfrd_diff_type* diffs;
+    xfrd_diff_type* diff;
+    size_t rr_index;
+    unsigned wire : 1;
+    unsigned mem : 1;
+    unsigned rollback : 1;
+};
+
+
+/**
+ * Read the next record from the wire format spool.
  *
  */
 static ods_status
-addns_read_pkt(FILE* fd, zone_type* zone)
+addns_spool_read_msg(addns_spool_type* spool, uint16_t* type)
+{
+    uint8_t header[XFRD_SPOOL_HEADER_SIZE];
+    buffer_type buffer;
+    size_t len = 0;
+    uint16_t qdcount = 0;
+
+    len = fread(header, 1, sizeof(header), spool->fd);
+    if (len == 0 && feof(spool->fd)) {
+        return ODS_STATUS_EOF;
+    }
+    if (len != sizeof(header) ||
+        read_uint32(header) != XFRD_SPOOL_MAGIC) {
+        ods_log_error("[%s] bogus xfrd file zone %s, bad record header",
+            adapter_str, spool->zone->name);
+        return ODS_STATUS_ERR;
+    }
+    *type = read_uint16(header + 4);
+    spool->msg_len = read_uint16(header + 6);
+    spool->pos = 0;
+    spool->ancount = 0;
+    if (spool->msg_len > 0 &&
+        fread(spool->msg, spool->msg_len, 1, spool->fd) != 1) {
+        ods_log_error("[%s] bogus xfrd file zone %s, truncated record",
+            adapter_str, spool->zone->name);
+        return ODS_STATUS_ERR;
+    }
+    if (*type == XFRD_SPOOL_END) {
+        return ODS_STATUS_OK;
+    } else if (*type != XFRD_SPOOL_BEGIN && *type != XFRD_SPOOL_PACKET) {
+        ods_log_error("[%s] bogus xfrd file zone %s, unknown record type %u",
+            adapter_str, spool->zone->name, (unsigned) *type);
+        return ODS_STATUS_ERR;
+    }
+    /* skip header and question section */
+    buffer_create_from(&buffer, spool->msg, spool->msg_len);
+    if (!buffer_available(&buffer, BUFFER_PKT_HEADER_SIZE)) {
+        ods_log_error("[%s] bogus xfrd file zone %s, short message",
+            adapter_str, spool->zone->name);
+        return ODS_STATUS_ERR;
+    }
+    qdcount = buffer_pkt_qdcount(&buffer);
+    spool->ancount = buffer_pkt_ancount(&buffer);
+    buffer_skip(&buffer, BUFFER_PKT_HEADER_SIZE);
+    while (qdcount > 0) {
+        if (!buffer_skip_rr(&buffer, 1)) {
+            ods_log_error("[%s] bogus xfrd file zone %s, bad question "
+                "section", adapter_str, spool->zone->name);
+            return ODS_STATUS_ERR;
+        }
+        qdcount--;
+    }
+    spool->pos = buffer_position(&buffer);
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Start reading the next transfer from the spool.
+ *
+ */
+static ods_status
+addns_spool_begin(addns_spool_type* spool)
+{
+    ods_status result = ODS_STATUS_OK;
+    uint16_t type = 0;
+    int len = 0;
+    int c = 0;
+
+    if (spool->mem) {
+        xfrd_diff_cleanup(spool->diff);
+        spool->diff = spool->diffs;
+        if (!spool->diff) {
+            return ODS_STATUS_EOF;
+        }
+        spool->diffs = spool->diff->next;
+        spool->diff->next = NULL;
+        spool->rr_index = 0;
+        spool->rollback = 0;
+        spool->line[0] = '\0';
+        return ODS_STATUS_OK;
+    }
+    c = fgetc(spool->fd);
+    if (c == EOF) {
+        return ODS_STATUS_EOF;
+    }
+    ungetc(c, spool->fd);
+    /* the format is determined per transfer */
+    spool->wire = (c != ';');
+    spool->rollback = 0;
+    if (!spool->wire) {
+        len = adutil_readline_frm_file(spool->fd, spool->line, &spool->l, 1);
+        if (len < 0) {
+            /* -1 EOF */
+            return ODS_STATUS_EOF;
+        }
+        adutil_rtrim_line(spool->line, &len);
+        if (ods_strcmp(";;BEGINPACKET", spool->line) != 0) {
+            ods_log_error("[%s] bogus xfrd file zone %s, missing "
+                ";;BEGINPACKET (was %s)", adapter_str, spool->zone->name,
+                spool->line);
+            return ODS_STATUS_ERR;
+        }
+        return ODS_STATUS_OK;
+    }
+    spool->line[0] = '\0';
+    result = addns_spool_read_msg(spool, &type);
+    if (result == ODS_STATUS_OK && type != XFRD_SPOOL_BEGIN) {
+        ods_log_error("[%s] bogus xfrd file zone %s, missing begin record",
+            adapter_str, spool->zone->name);
+        return ODS_STATUS_ERR;
+    }
+    return result;
+}
+
+
+/**
+ * Read the next RR of the current transfer from the spool. Returns NULL at
+ * the end of the transfer, or if a new transfer begins before the current
+ * one has ended, in which case rollback is set.
+ *
+ */
+static ldns_rr*
+addns_spool_next(addns_spool_type* spool, ldns_status* status)
 {
     ldns_rr* rr = NULL;
+    uint16_t type = 0;
+    ods_status result = ODS_STATUS_OK;
+
+    if (spool->mem) {
+        *status = LDNS_STATUS_OK;
+        if (spool->rr_index >= ldns_rr_list_rr_count(spool->diff->rrs)) {
+            return NULL;
+        }
+        /* take ownership of the rr */
+        rr = ldns_rr_list_set_rr(spool->diff->rrs, NULL, spool->rr_index);
+        spool->rr_index++;
+        spool->l++;
+        return rr;
+    }
+    if (!spool->wire) {
+        rr = addns_read_rr(spool->fd, spool->line, &spool->orig,
+            &spool->prev, &spool->ttl, status, &spool->l);
+        if (!rr && ods_strcmp(";;BEGINPACKET", spool->line) == 0) {
+            /* begin packet but previous not ended, rollback */
+            spool->rollback = 1;
+        }
+        return rr;
+    }
+    while (spool->ancount == 0) {
+        result = addns_spool_read_msg(spool, &type);
+        if (result != ODS_STATUS_OK) {
+            /* unexpected EOF or bogus record */
+            *status = LDNS_STATUS_ERR;
+            return NULL;
+        }
+        if (type == XFRD_SPOOL_END) {
+            *status = LDNS_STATUS_OK;
+            return NULL;
+        } else if (type == XFRD_SPOOL_BEGIN) {
+            /* keep the message, it starts the next transfer */
+            spool->rollback = 1;
+            *status = LDNS_STATUS_OK;
+            return NULL;
+        }
+    }
+    *status = ldns_wire2rr(&rr, spool->msg, spool->msg_len, &spool->pos,
+        LDNS_SECTION_ANSWER);
+    if (*status != LDNS_STATUS_OK) {
+        ods_log_error("[%s] error parsing RR #%u in xfrd file zone %s: %s",
+            adapter_str, spool->l + 1, spool->zone->name,
+            ldns_get_errorstr_by_id(*status));
+        return NULL;
+    }
+    spool->ancount--;
+    spool->l++;
+    return rr;
+}
+
+
+/**
+ * Skip the rest of the current transfer.
+ *
+ */
+static void
+addns_spool_skip(addns_spool_type* spool)
+{
+    ldns_rr* rr = NULL;
+    ldns_status status = LDNS_STATUS_OK;
     int len = 0;
+
+    if (spool->mem) {
+        /* remaining rrs are freed with the diff */
+        spool->rr_index = ldns_rr_list_rr_count(spool->diff->rrs);
+        return;
+    }
+    if (!spool->wire) {
+        while (len >= 0) {
+            len = adutil_readline_frm_file(spool->fd, spool->line, &spool->l,
+                1);
+            if (len && ods_strcmp(";;ENDPACKET", spool->line) == 0) {
+                /* end of pkt */
+                break;
+            }
+        }
+        return;
+    }
+    while ((rr = addns_spool_next(spool, &status)) != NULL) {
+        ldns_rr_free(rr);
+    }
+    return;
+}
+
+
+/**
+ * Read pkt from file.
+ *
+ */
+static ods_status
+addns_read_pkt(addns_spool_type* spool, zone_type* zone)
+{
+    ldns_rr* rr = NULL;
     uint32_t new_serial = 0;
     uint32_t old_serial = 0;
     uint32_t tmp_serial = 0;
-    ldns_rdf* prev = NULL;
-    ldns_rdf* orig = NULL;
     ldns_rdf* dname = NULL;
-    uint32_t ttl = 0;
     size_t rr_count = 0;
     ods_status result = ODS_STATUS_OK;
     ldns_status status = LDNS_STATUS_OK;
-    char line[SE_ADFILE_MAXLINE];
     unsigned is_axfr = 0;
     unsigned del_mode = 0;
     unsigned soa_seen = 0;
     unsigned line_update_interval = 100000;
     unsigned line_update = line_update_interval;
-    unsigned l = 0;
 
-    ods_log_assert(fd);
+    ods_log_assert(spool);
     ods_log_assert(zone);
     ods_log_assert(zone->name);
 
-    len = adutil_readline_frm_file(fd, line, &l, 1);
-    if (len < 0) {
-        /* -1 EOF */
-        return ODS_STATUS_EOF;
-    }
-    adutil_rtrim_line(line, &len);
-    if (ods_strcmp(";;BEGINPACKET", line) != 0) {
-        ods_log_error("[%s] bogus xfrd file zone %s, missing ;;BEGINPACKET (was %s)",
-            adapter_str, zone->name, line);
-        return ODS_STATUS_ERR;
+    result = addns_spool_begin(spool);
+    if (result != ODS_STATUS_OK) {
+        return result;
     }
 
 begin_pkt:
+    spool->rollback = 0;
     rr_count = 0;
     is_axfr = 0;
     del_mode = 0;
@@ -187,28 +428,29 @@ begin_pkt:
             adapter_str);
         return ODS_STATUS_ERR;
     }
-    orig = ldns_rdf_clone(dname);
-    if (!orig) {
+    spool->orig = ldns_rdf_clone(dname);
+    if (!spool->orig) {
         ods_log_error("[%s] error setting default value for $ORIGIN",
             adapter_str);
         return ODS_STATUS_ERR;
     }
     /* $TTL <default ttl> */
-    ttl = adapi_get_ttl(zone);
+    spool->ttl = adapi_get_ttl(zone);
 
     /* read RRs */
-    while ((rr = addns_read_rr(fd, line, &orig, &prev, &ttl, &status, &l))
-        != NULL) {
+    while ((rr = addns_spool_next(spool, &status)) != NULL) {
         /* check status */
         if (status != LDNS_STATUS_OK) {
             ods_log_error("[%s] error reading RR at line %i (%s): %s",
-                adapter_str, l, ldns_get_errorstr_by_id(status), line);
+                adapter_str, spool->l, ldns_get_errorstr_by_id(status),
+                spool->line);
             result = ODS_STATUS_ERR;
             break;
         }
         /* debug update */
-        if (l > line_update) {
-            ods_log_debug("[%s] ...at line %i: %s", adapter_str, l, line);
+        if (spool->l > line_update) {
+            ods_log_debug("[%s] ...at line %i: %s", adapter_str, spool->l,
+                spool->line);
             line_update += line_update_interval;
         }
         /* first RR: check if SOA and correct zone & serialno */
@@ -242,13 +484,7 @@ begin_pkt:
                 ldns_rr_free(rr);
                 rr = NULL;
                 result = ODS_STATUS_UPTODATE;
-                while (len >= 0) {
-                    len = adutil_readline_frm_file(fd, line, &l, 1);
-                    if (len && ods_strcmp(";;ENDPACKET", line) == 0) {
-                        /* end of pkt */
-                        break;
-                    }
-                }
+                addns_spool_skip(spool);
                 break;
             }
             ldns_rr_free(rr);
@@ -317,41 +553,43 @@ begin_pkt:
         /* [add to/remove from] the zone */
         if (!is_axfr && del_mode) {
             ods_log_deeebug("[%s] delete RR #%i at line %i: %s",
-                adapter_str, rr_count, l, line);
+                adapter_str, rr_count, spool->l, spool->line);
             result = adapi_del_rr(zone, rr, 0);
             ldns_rr_free(rr);
             rr = NULL;
         } else {
             ods_log_deeebug("[%s] add RR #%i at line %i: %s",
-                adapter_str, rr_count, l, line);
+                adapter_str, rr_count, spool->l, spool->line);
             result = adapi_add_rr(zone, rr, 0);
         }
         if (result == ODS_STATUS_UNCHANGED) {
             ods_log_debug("[%s] skipping RR at line %i (%s): %s",
-                adapter_str, l, del_mode?"not found":"duplicate", line);
+                adapter_str, spool->l, del_mode?"not found":"duplicate",
+                spool->line);
             ldns_rr_free(rr);
             rr = NULL;
             result = ODS_STATUS_OK;
             continue;
         } else if (result != ODS_STATUS_OK) {
             ods_log_error("[%s] error %s RR at line %i: %s",
-                adapter_str, del_mode?"deleting":"adding", l, line);
+                adapter_str, del_mode?"deleting":"adding", spool->l,
+                spool->line);
             ldns_rr_free(rr);
             rr = NULL;
             break;
         }
     }
     /* and done */
-    if (orig) {
-        ldns_rdf_deep_free(orig);
-        orig = NULL;
+    if (spool->orig) {
+        ldns_rdf_deep_free(spool->orig);
+        spool->orig = NULL;
     }
-    if (prev) {
-        ldns_rdf_deep_free(prev);
-        prev = NULL;
+    if (spool->prev) {
+        ldns_rdf_deep_free(spool->prev);
+        spool->prev = NULL;
     }
     /* check again */
-    if (ods_strcmp(";;BEGINPACKET", line) == 0) {
+    if (spool->rollback) {
         ods_log_warning("[%s] xfr zone %s on disk incomplete, rollback",
             adapter_str, zone->name);
         namedb_rollback(zone->db, 1);
@@ -364,7 +602,8 @@ begin_pkt:
     /* otherwise ENDPACKET or EOF */
     if (result == ODS_STATUS_OK && status != LDNS_STATUS_OK) {
         ods_log_error("[%s] error reading RR at line %i (%s): %s",
-            adapter_str, l, ldns_get_errorstr_by_id(status), line);
+            adapter_str, spool->l, ldns_get_errorstr_by_id(status),
+            spool->line);
         result = ODS_STATUS_ERR;
     }
     /* check the number of SOAs seen */
@@ -394,20 +633,35 @@ begin_pkt:
 
 
 /**
- * Read pkt from file.
+ * Read zone transfers from file, or from memory.
  *
  */
 static ods_status
-addns_read_file(FILE* fd, zone_type* zone)
+addns_read_file(FILE* fd, xfrd_diff_type* diffs, zone_type* zone)
 {
+    addns_spool_type* spool = NULL;
     ods_status status = ODS_STATUS_OK;
 
+    spool = (addns_spool_type*) malloc(sizeof(addns_spool_type));
+    if (!spool) {
+        ods_log_error("[%s] unable to read xfrd file zone %s: malloc() "
+            "failed", adapter_str, zone->name);
+        return ODS_STATUS_MALLOC_ERR;
+    }
+    memset(spool, 0, sizeof(addns_spool_type));
+    spool->fd = fd;
+    spool->zone = zone;
+    spool->diffs = diffs;
+    spool->mem = (diffs != NULL);
     while (status == ODS_STATUS_OK) {
-        status = addns_read_pkt(fd, zone);
+        status = addns_read_pkt(spool, zone);
     }
     if (status == ODS_STATUS_EOF) {
         status = ODS_STATUS_OK;
     }
+    xfrd_diff_cleanup(spool->diff);
+    xfrd_diff_cleanup(spool->diffs);
+    free((void*) spool);
     return status;
 }
 
@@ -437,6 +691,7 @@ dnsin_create(void)
     addns->request_xfr = NULL;
     addns->allow_notify = NULL;
     addns->tsig = NULL;
+    addns->text_spool = 0;
     return addns;
 }
 
@@ -466,6 +721,8 @@ dnsout_create(void)
     addns->provide_xfr = NULL;
     addns->do_notify = NULL;
     addns->tsig = NULL;
+    addns->journal_versions = IXFR_DEFAULT_VERSIONS;
+    addns->journal_records = IXFR_DEFAULT_RECORDS;
     return addns;
 }
 
@@ -497,6 +754,7 @@ dnsin_read(dnsin_type* addns, const char* filename)
             filename, addns->tsig);
         addns->allow_notify = parse_addns_allow_notify(addns->allocator,
             filename, addns->tsig);
+        addns->text_spool = parse_addns_text_spool(filename);
         ods_fclose(fd);
         return ODS_STATUS_OK;
     }
@@ -566,6 +824,8 @@ dnsout_read(dnsout_type* addns, const char* filename)
             filename, addns->tsig);
         addns->do_notify = parse_addns_do_notify(addns->allocator, filename,
             addns->tsig);
+        addns->journal_versions = parse_addns_journal_versions(filename);
+        addns->journal_records = parse_addns_journal_records(filename);
         ods_fclose(fd);
         return ODS_STATUS_OK;
     }
@@ -648,6 +908,8 @@ addns_read(void* zone)
 {
     zone_type* z = (zone_type*) zone;
     ods_status status = ODS_STATUS_OK;
+    xfrd_diff_type* diffs = NULL;
+    time_t acquired = 0;
     char* xfrfile = NULL;
     char* file = NULL;
     FILE* fd = NULL;
@@ -676,7 +938,11 @@ addns_read(void* zone)
     xfrfile = ods_build_path(z->name, ".xfrd", 0, 1);
     file = ods_build_path(z->name, ".xfrd.tmp", 0, 1);
     if (!xfrfile || !file) {
+        lock_basic_unlock(&z->xfrd->serial_lock);
+        lock_basic_unlock(&z->xfrd->rw_lock);
         ods_log_error("[%s] unable to build paths to xfrd files", adapter_str);
+        free((void*) xfrfile);
+        free((void*) file);
         return ODS_STATUS_MALLOC_ERR;
     }
     if (rename(xfrfile, file) != 0) {
@@ -688,21 +954,33 @@ addns_read(void* zone)
         free((void*) file);
         return ODS_STATUS_RENAME_ERR;
     }
+    /* transfers committed from now on are read the next time */
+    acquired = z->xfrd->serial_disk_acquired;
     lock_basic_unlock(&z->xfrd->serial_lock);
-    /* open copy of zone transfers to read */
-    fd = ods_fopen(file, NULL, "r");
     free((void*) xfrfile);
-    if (!fd) {
-        lock_basic_unlock(&z->xfrd->rw_lock);
-        free((void*) file);
-        return ODS_STATUS_FOPEN_ERR;
+    /* apply ixfrs from memory, if xfrd kept all of them */
+    diffs = xfrd_take_diffs(z->xfrd);
+    /* xfrd spools to a new file, it does not have to wait for us */
+    lock_basic_unlock(&z->xfrd->rw_lock);
+    if (diffs) {
+        ods_log_debug("[%s] read xfr zone %s from memory", adapter_str,
+            z->name);
+    } else {
+        ods_log_debug("[%s] read xfr zone %s from spool %s", adapter_str,
+            z->name, file);
+        /* open copy of zone transfers to read */
+        fd = ods_fopen(file, NULL, "r");
+        if (!fd) {
+            free((void*) file);
+            return ODS_STATUS_FOPEN_ERR;
+        }
     }
 
-    status = addns_read_file(fd, z);
+    status = addns_read_file(fd, diffs, z);
     if (status == ODS_STATUS_OK) {
         lock_basic_lock(&z->xfrd->serial_lock);
         z->xfrd->serial_xfr = adapi_get_serial(z);
-        z->xfrd->serial_xfr_acquired = z->xfrd->serial_disk_acquired;
+        z->xfrd->serial_xfr_acquired = acquired;
         lock_basic_unlock(&z->xfrd->serial_lock);
         /* clean up copy of zone transfer */
         if (unlink((const char*) file) != 0) {
@@ -713,11 +991,30 @@ addns_read(void* zone)
     }
     free((void*) file);
     ods_fclose(fd);
-    lock_basic_unlock(&z->xfrd->rw_lock);
     return status;
 }
 
 
+/**
+ * Apply the journal retention of the DNS output adapter to the zone.
+ *
+ */
+void
+dnsout_set_retention(void* zone)
+{
+    zone_type* z = (zone_type*) zone;
+    dnsout_type* dnsout = NULL;
+    if (!z || !z->ixfr || !z->adoutbound ||
+        z->adoutbound->type != ADAPTER_DNS || !z->adoutbound->config) {
+        return;
+    }
+    dnsout = (dnsout_type*) z->adoutbound->config;
+    ixfr_set_retention(z->ixfr, dnsout->journal_versions,
+        dnsout->journal_records);
+    return;
+}
+
+
 /**
  * Write to DNS Output Adapter.
  *
@@ -731,6 +1028,8 @@ addns_write(void* zone)
     char* itmpfile = NULL;
     char* ixfrfile = NULL;
     zone_type* z = (zone_type*) zone;
+    snapshot_type* snapshot = NULL;
+    snapshot_type* old = NULL;
     int ret = 0;
     ods_status status = ODS_STATUS_OK;
     ods_log_assert(z);
@@ -766,6 +1065,9 @@ addns_write(void* zone)
             free((void*) itmpfile);
             return ODS_STATUS_FOPEN_ERR;
         }
+        lock_basic_lock(&z->ixfr->ixfr_lock);
+        dnsout_set_retention(z);
+        lock_basic_unlock(&z->ixfr->ixfr_lock);
         status = adapi_printixfr(fd, z);
         ods_fclose(fd);
         if (status != ODS_STATUS_OK) {
@@ -794,6 +1096,8 @@ addns_write(void* zone)
         free((void*) itmpfile);
         return ODS_STATUS_MALLOC_ERR;
     }
+    /* encode the signed version, readers pick it up when published */
+    snapshot = snapshot_create((void*) z);
 
     lock_basic_lock(&z->xfr_lock);
     ret = rename(atmpfile, axfrfile);
@@ -801,6 +1105,7 @@ addns_write(void* zone)
         ods_log_error("[%s] unable to rename file %s to %s: %s", adapter_str,
             atmpfile, axfrfile, strerror(errno));
         lock_basic_unlock(&z->xfr_lock);
+        snapshot_release(snapshot);
         free((void*) atmpfile);
         free((void*) axfrfile);
         free((void*) itmpfile);
@@ -808,6 +1113,9 @@ addns_write(void* zone)
     }
     free((void*) axfrfile);
     free((void*) atmpfile);
+    /* without a signed version, readers fall back to the files */
+    old = z->snapshot;
+    z->snapshot = snapshot;
 
     if (z->db->is_initialized) {
         ixfrfile = ods_build_path(z->name, ".ixfr", 0, 1);
@@ -822,15 +1130,22 @@ addns_write(void* zone)
             ods_log_error("[%s] unable to rename file %s to %s: %s",
                 adapter_str, itmpfile, ixfrfile, strerror(errno));
             lock_basic_unlock(&z->xfr_lock);
+            snapshot_release(old);
             free((void*) itmpfile);
             free((void*) ixfrfile);
             return ODS_STATUS_RENAME_ERR;
         }
         free((void*) ixfrfile);
+        lock_basic_lock(&z->ixfr->ixfr_lock);
+        ixfr_publish_index(z->ixfr);
+        lock_basic_unlock(&z->ixfr->ixfr_lock);
     }
     free((void*) itmpfile);
     lock_basic_unlock(&z->xfr_lock);
+    /* readers that still transfer the old version keep it pinned */
+    snapshot_release(old);
 
+    xfrd_report_latency(z->xfrd, z->db->outserial);
     dnsout_send_notify(zone);
     return ODS_STATUS_OK;
 }
@@ -55,6 +55,7 @@ struct dnsin_struct {
     acl_type* allow_notify;
     tsig_type* tsig;
     time_t last_modified;
+    int text_spool;
 };
 
 /**
@@ -67,6 +68,8 @@ struct dnsout_struct {
     acl_type* provide_xfr;
     acl_type* do_notify;
     tsig_type* tsig;
+    size_t journal_versions;
+    size_t journal_records;
     time_t last_modified;
 };
 
@@ -138,6 +141,14 @@ ods_status addns_read(void* zone);
  */
 ods_status addns_write(void* zone);
 
+/**
+ * Apply the journal retention of the DNS output adapter to the zone.
+ * The caller must hold the ixfr lock.
+ * \param[in] zone zone reference
+ *
+ */
+void dnsout_set_retention(void* zone);
+
 /**
  * Clean up DNS input adapter.
  * \param[in] addns DNS input adapter
@@ -97,6 +97,9 @@ engine_config(allocator_type* allocator, const char* cfgfile,
         ecfg->use_syslog = parse_conf_use_syslog(cfgfile);
         ecfg->num_worker_threads = parse_conf_worker_threads(cfgfile);
         ecfg->num_signer_threads = parse_conf_signer_threads(cfgfile);
+        ecfg->num_listener_threads = parse_conf_listener_threads(cfgfile);
+        ecfg->num_xfr_threads = parse_conf_xfr_threads(cfgfile);
+        ecfg->num_xfr_per_master = parse_conf_xfr_per_master(cfgfile);
         /* If any verbosity has been specified at cmd line we will use that */
         if (cmdline_verbosity > 0) {
         	ecfg->verbosity = cmdline_verbosity;
@@ -204,6 +207,8 @@ engine_config_print(FILE* out, engineconfig_type* config)
         }
         if (config->interfaces) {
              size_t i = 0;
+             fprintf(out, "\t\t<ListenerThreads>%i</ListenerThreads>\n",
+                 config->num_listener_threads);
              fprintf(out, "\t\t<Listener>\n");
 
              for (i=0; i < config->interfaces->count; i++) {
@@ -228,6 +233,10 @@ engine_config_print(FILE* out, engineconfig_type* config)
             config->num_worker_threads);
         fprintf(out, "\t\t<SignerThreads>%i</SignerThreads>\n",
             config->num_signer_threads);
+        fprintf(out, "\t\t<TransferThreads>%i</TransferThreads>\n",
+            config->num_xfr_threads);
+        fprintf(out, "\t\t<TransfersPerMaster>%i</TransfersPerMaster>\n",
+            config->num_xfr_per_master);
         if (config->notify_command) {
             fprintf(out, "\t\t<NotifyCommand>%s</NotifyCommand>\n",
                 config->notify_command);
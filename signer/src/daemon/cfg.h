@@ -63,6 +63,9 @@ struct engineconfig_struct {
     int use_syslog;
     int num_worker_threads;
     int num_signer_threads;
+    int num_listener_threads;
+    int num_xfr_threads;
+    int num_xfr_per_master;
     int verbosity;
 };
 
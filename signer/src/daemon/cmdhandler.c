@@ -37,6 +37,7 @@
 #include "shared/file.h"
 #include "shared/locks.h"
 #include "shared/log.h"
+#include "shared/metrics.h"
 #include "shared/status.h"
 
 #include <errno.h>
@@ -85,12 +86,17 @@ cmdhandler_handle_cmd_help(int sockfd)
         "                All signatures will be regenerated on the next "
                          "re-sign.\n"
         "queue           Show the current task queue.\n"
+        "stats [json]    Show performance metrics, in Prometheus text "
+                         "format\n"
+        "                or as JSON.\n"
     );
     ods_writen(sockfd, buf, strlen(buf));
 
     (void) snprintf(buf, ODS_SE_MAXLINE,
         "flush           Execute all scheduled tasks immediately.\n"
         "update <zone>   Update this zone signer configurations.\n"
+        "update zones <zone>[,<zone>...]\n"
+        "                Update the signer configurations of these zones.\n"
         "update [--all]  Update zone list and all signer configurations.\n"
         "start           Start the engine.\n"
         "running         Check if the engine is running.\n"
@@ -144,6 +150,46 @@ cmdhandler_handle_cmd_zones(int sockfd, cmdhandler_type* cmdc)
 }
 
 
+/**
+ * Look up a zone that can have its signer configuration updated.
+ *
+ */
+static zone_type*
+cmdhandler_lookup_zone(engine_type* engine, const char* name)
+{
+    zone_type* zone = NULL;
+    lock_basic_lock(&engine->zonelist->zl_lock);
+    zone = zonelist_lookup_zone_by_name(engine->zonelist, name,
+        LDNS_RR_CLASS_IN);
+    /* If this zone is just added, don't update (it might not have a
+     * task yet) */
+    if (zone && zone->zl_status == ZONE_ZL_ADDED) {
+        zone = NULL;
+    }
+    lock_basic_unlock(&engine->zonelist->zl_lock);
+    return zone;
+}
+
+
+/**
+ * Schedule reading the signer configuration of a zone.
+ *
+ */
+static ods_status
+cmdhandler_update_zone(engine_type* engine, zone_type* zone)
+{
+    ods_status status = ODS_STATUS_OK;
+    lock_basic_lock(&zone->zone_lock);
+    status = zone_reschedule_task(zone, engine->taskq, TASK_SIGNCONF);
+    lock_basic_unlock(&zone->zone_lock);
+    if (status != ODS_STATUS_OK) {
+        ods_log_crit("[%s] unable to reschedule task for zone %s: %s",
+            cmdh_str, zone->name, ods_status2str(status));
+    }
+    return status;
+}
+
+
 /**
  * Handle the 'update' command.
  *
@@ -197,16 +243,7 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_type* cmdc,
         return;
     } else {
         /* look up zone */
-        lock_basic_lock(&engine->zonelist->zl_lock);
-        zone = zonelist_lookup_zone_by_name(engine->zonelist, tbd,
-            LDNS_RR_CLASS_IN);
-        /* If this zone is just added, don't update (it might not have a
-         * task yet) */
-        if (zone && zone->zl_status == ZONE_ZL_ADDED) {
-            zone = NULL;
-        }
-        lock_basic_unlock(&engine->zonelist->zl_lock);
-
+        zone = cmdhandler_lookup_zone(engine, tbd);
         if (!zone) {
             (void)snprintf(buf, ODS_SE_MAXLINE, "Zone %s not found.\n",
                 tbd);
@@ -216,16 +253,11 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_type* cmdc,
             return;
         }
 
-        lock_basic_lock(&zone->zone_lock);
-        status = zone_reschedule_task(zone, engine->taskq, TASK_SIGNCONF);
-        lock_basic_unlock(&zone->zone_lock);
-
+        status = cmdhandler_update_zone(engine, zone);
         if (status != ODS_STATUS_OK) {
             (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Unable to reschedule "
                 "task for zone %s.\n", tbd);
             ods_writen(sockfd, buf, strlen(buf));
-            ods_log_crit("[%s] unable to reschedule task for zone %s: %s",
-                cmdh_str, zone->name, ods_status2str(status));
         } else {
             engine_wakeup_workers(engine);
         }
@@ -237,6 +269,70 @@ cmdhandler_handle_cmd_update(int sockfd, cmdhandler_type* cmdc,
 }
 
 
+/**
+ * Handle the 'update zones' command: update the signer configurations of
+ * a comma separated list of zones. If any of them is unknown, the zone
+ * list is read again, once.
+ *
+ */
+static void
+cmdhandler_handle_cmd_update_zones(int sockfd, cmdhandler_type* cmdc,
+    char* tbd)
+{
+    engine_type* engine = NULL;
+    char buf[ODS_SE_MAXLINE];
+    zone_type* zone = NULL;
+    char* name = NULL;
+    char* next = NULL;
+    int updated = 0;
+    int notfound = 0;
+    int failed = 0;
+    ods_log_assert(tbd);
+    ods_log_assert(cmdc);
+    ods_log_assert(cmdc->engine);
+    engine = (engine_type*) cmdc->engine;
+    ods_log_assert(engine->taskq);
+
+    for (name = tbd; name; name = next) {
+        next = strchr(name, ',');
+        if (next) {
+            *next++ = '\0';
+        }
+        ods_str_trim(name);
+        if (name[0] == '\0') {
+            continue;
+        }
+        zone = cmdhandler_lookup_zone(engine, name);
+        if (!zone) {
+            (void)snprintf(buf, ODS_SE_MAXLINE, "Zone %s not found.\n",
+                name);
+            ods_writen(sockfd, buf, strlen(buf));
+            notfound++;
+        } else if (cmdhandler_update_zone(engine, zone) != ODS_STATUS_OK) {
+            (void)snprintf(buf, ODS_SE_MAXLINE, "Error: Unable to reschedule "
+                "task for zone %s.\n", name);
+            ods_writen(sockfd, buf, strlen(buf));
+            failed++;
+        } else {
+            updated++;
+        }
+    }
+    if (updated) {
+        engine_wakeup_workers(engine);
+    }
+    ods_log_verbose("[%s] %i zones being updated, %i not found, %i failed",
+        cmdh_str, updated, notfound, failed);
+    (void)snprintf(buf, ODS_SE_MAXLINE, "%i zone configs being updated.\n",
+        updated);
+    ods_writen(sockfd, buf, strlen(buf));
+    if (notfound) {
+        /* update all */
+        cmdhandler_handle_cmd_update(sockfd, cmdc, "--all");
+    }
+    return;
+}
+
+
 /**
  * Handle the 'sign' command.
  *
@@ -401,12 +497,15 @@ cmdhandler_handle_cmd_queue(int sockfd, cmdhandler_type* cmdc)
     char buf[ODS_SE_MAXLINE];
     size_t i = 0;
     time_t now = 0;
-    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    task_type** tasks = NULL;
+    size_t count = 0;
+    size_t j = 0;
     task_type* task = NULL;
+    int klass = 0;
     ods_log_assert(cmdc);
     ods_log_assert(cmdc->engine);
     engine = (engine_type*) cmdc->engine;
-    if (!engine->taskq || !engine->taskq->tasks) {
+    if (!engine->taskq) {
         (void)snprintf(buf, ODS_SE_MAXLINE, "I have no tasks scheduled.\n");
         ods_writen(sockfd, buf, strlen(buf));
         return;
@@ -431,24 +530,58 @@ cmdhandler_handle_cmd_queue(int sockfd, cmdhandler_type* cmdc)
     }
     /* how many tasks */
     (void)snprintf(buf, ODS_SE_MAXLINE, "\nI have %i tasks scheduled.\n",
-        (int) engine->taskq->tasks->count);
+        (int) schedule_count(engine->taskq));
     ods_writen(sockfd, buf, strlen(buf));
     /* list tasks */
-    node = ldns_rbtree_first(engine->taskq->tasks);
-    while (node && node != LDNS_RBTREE_NULL) {
-        task = (task_type*) node->data;
-        for (i=0; i < ODS_SE_MAXLINE; i++) {
-            buf[i] = 0;
+    tasks = schedule_list_tasks(engine->taskq, &count);
+    for (i=0; tasks && i < count; i++) {
+        task = tasks[i];
+        for (j=0; j < ODS_SE_MAXLINE; j++) {
+            buf[j] = 0;
         }
         (void)task2str(task, (char*) &buf[0]);
         ods_writen(sockfd, buf, strlen(buf));
-        node = ldns_rbtree_next(node);
     }
+    /* how late */
+    (void)snprintf(buf, ODS_SE_MAXLINE, "\nTask lateness%s:\n",
+        schedule_overload(engine->taskq)?" (overload)":"");
+    ods_writen(sockfd, buf, strlen(buf));
+    for (klass=0; klass < SCHEDULE_NUM_CLASSES; klass++) {
+        if (schedule_lateness2str(engine->taskq, (schedule_class) klass,
+            (char*) &buf[0])) {
+            ods_writen(sockfd, buf, strlen(buf));
+        }
+    }
+    /* how long until signatures expire */
+    (void)snprintf(buf, ODS_SE_MAXLINE, "\nEarliest signature "
+        "expiration:\n");
+    ods_writen(sockfd, buf, strlen(buf));
+    for (i=0; tasks && i < count; i++) {
+        if (tasks[i]->deadline) {
+            (void)snprintf(buf, ODS_SE_MAXLINE, "zone %s in %ld seconds\n",
+                task_who2str(tasks[i]), (long) (tasks[i]->deadline - now));
+            ods_writen(sockfd, buf, strlen(buf));
+        }
+    }
+    free((void*) tasks);
     lock_basic_unlock(&engine->taskq->schedule_lock);
     return;
 }
 
 
+/**
+ * Handle the 'stats' command.
+ *
+ */
+static void
+cmdhandler_handle_cmd_stats(int sockfd, int json)
+{
+    metrics_export(sockfd, json);
+    ods_log_verbose("[%s] metrics exported", cmdh_str);
+    return;
+}
+
+
 /**
  * Handle the 'flush' command.
  *
@@ -662,6 +795,20 @@ again:
         } else if (n == 5 && strncmp(buf, "queue", n) == 0) {
             ods_log_debug("[%s] list tasks command", cmdh_str);
             cmdhandler_handle_cmd_queue(sockfd, cmdc);
+        } else if (n >= 5 && strncmp(buf, "stats", 5) == 0) {
+            ods_log_debug("[%s] stats command", cmdh_str);
+            if (buf[5] == '\0') {
+                cmdhandler_handle_cmd_stats(sockfd, 0);
+            } else if (buf[5] != ' ') {
+                cmdhandler_handle_cmd_unknown(sockfd, buf);
+            } else if (strcmp(&buf[6], "json") == 0) {
+                cmdhandler_handle_cmd_stats(sockfd, 1);
+            } else if (strcmp(&buf[6], "prometheus") == 0) {
+                cmdhandler_handle_cmd_stats(sockfd, 0);
+            } else {
+                cmdhandler_handle_cmd_error(sockfd, "stats command takes "
+                    "an optional format ('json' or 'prometheus')");
+            }
         } else if (n == 5 && strncmp(buf, "flush", n) == 0) {
             ods_log_debug("[%s] flush tasks command", cmdh_str);
             cmdhandler_handle_cmd_flush(sockfd, cmdc);
@@ -671,6 +818,8 @@ again:
                 cmdhandler_handle_cmd_update(sockfd, cmdc, "--all");
             } else if (buf[6] != ' ') {
                 cmdhandler_handle_cmd_unknown(sockfd, buf);
+            } else if (strncmp(&buf[7], "zones ", 6) == 0) {
+                cmdhandler_handle_cmd_update_zones(sockfd, cmdc, &buf[13]);
             } else {
                 cmdhandler_handle_cmd_update(sockfd, cmdc, &buf[7]);
             }
@@ -42,20 +42,64 @@
 
 static const char* dnsh_str = "dnshandler";
 
-static void dnshandler_handle_xfr(netio_type* netio,
-    netio_handler_type* handler, netio_events_type event_types);
+/**
+ * Create dns handler thread.
+ *
+ */
+static ods_status
+dnshandler_create_thread(dnshandler_type* dnsh, dnsthread_type* dnsthread,
+    size_t num)
+{
+    allocator_type* allocator = dnsh->allocator;
+    size_t count = dnsh->interfaces->count;
+    dnsthread->dnshandler = dnsh;
+    dnsthread->thread_id = 0;
+    dnsthread->num = num;
+    dnsthread->socklist = (socklist_type*) allocator_alloc(allocator,
+        sizeof(socklist_type));
+    dnsthread->netio = netio_create(allocator);
+    dnsthread->udp_batch = sock_udp_batch_create(allocator);
+    dnsthread->udp_data = (struct udp_data*) allocator_alloc(allocator,
+        count * sizeof(struct udp_data));
+    dnsthread->udp_handlers = (netio_handler_type*) allocator_alloc(
+        allocator, count * sizeof(netio_handler_type));
+    dnsthread->tcp_accept_data = (struct tcp_accept_data*) allocator_alloc(
+        allocator, count * sizeof(struct tcp_accept_data));
+    dnsthread->tcp_accept_handlers = (netio_handler_type*) allocator_alloc(
+        allocator, count * sizeof(netio_handler_type));
+    if (!dnsthread->socklist || !dnsthread->netio || !dnsthread->udp_batch ||
+        !dnsthread->udp_data || !dnsthread->udp_handlers ||
+        !dnsthread->tcp_accept_data || !dnsthread->tcp_accept_handlers) {
+        return ODS_STATUS_MALLOC_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
 
 /**
  * Create dns handler.
  *
  */
 dnshandler_type*
-dnshandler_create(allocator_type* allocator, listener_type* interfaces)
+dnshandler_create(allocator_type* allocator, listener_type* interfaces,
+    size_t num_threads)
 {
     dnshandler_type* dnsh = NULL;
+    size_t i = 0;
     if (!allocator || !interfaces || interfaces->count <= 0) {
         return NULL;
     }
+    if (num_threads < 1) {
+        num_threads = 1;
+    }
+#ifndef SO_REUSEPORT
+    if (num_threads > 1) {
+        ods_log_warning("[%s] SO_REUSEPORT not supported, using one "
+            "listener thread instead of %u", dnsh_str,
+            (unsigned) num_threads);
+        num_threads = 1;
+    }
+#endif /* SO_REUSEPORT */
     dnsh = (dnshandler_type*) allocator_alloc(allocator,
         sizeof(dnshandler_type));
     if (!dnsh) {
@@ -67,37 +111,27 @@ dnshandler_create(allocator_type* allocator, listener_type* interfaces)
     dnsh->need_to_exit = 0;
     dnsh->engine = NULL;
     dnsh->interfaces = interfaces;
-    dnsh->socklist = NULL;
-    dnsh->netio = NULL;
-    dnsh->query = NULL;
+    dnsh->num_threads = 0;
     /* setup */
-    dnsh->socklist = (socklist_type*) allocator_alloc(allocator,
-        sizeof(socklist_type));
-    if (!dnsh->socklist) {
-        ods_log_error("[%s] unable to create socklist: "
-            "allocator_alloc() failed", dnsh_str);
-        dnshandler_cleanup(dnsh);
-        return NULL;
-    }
-    dnsh->netio = netio_create(allocator);
-    if (!dnsh->netio) {
+    dnsh->threads = (dnsthread_type*) allocator_alloc(allocator,
+        num_threads * sizeof(dnsthread_type));
+    if (!dnsh->threads) {
         ods_log_error("[%s] unable to create dnshandler: "
-            "netio_create() failed", dnsh_str);
+            "allocator_alloc() failed", dnsh_str);
         dnshandler_cleanup(dnsh);
         return NULL;
     }
-    dnsh->query = query_create();
-    if (!dnsh->query) {
-        ods_log_error("[%s] unable to create dnshandler: "
-            "query_create() failed", dnsh_str);
-        dnshandler_cleanup(dnsh);
-        return NULL;
+    memset(dnsh->threads, 0, num_threads * sizeof(dnsthread_type));
+    dnsh->num_threads = num_threads;
+    for (i=0; i < num_threads; i++) {
+        if (dnshandler_create_thread(dnsh, &dnsh->threads[i], i) !=
+            ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to create dnshandler thread %u: "
+                "allocation failed", dnsh_str, (unsigned) i);
+            dnshandler_cleanup(dnsh);
+            return NULL;
+        }
     }
-    dnsh->xfrhandler.fd = -1;
-    dnsh->xfrhandler.user_data = (void*) dnsh;
-    dnsh->xfrhandler.timeout = 0;
-    dnsh->xfrhandler.event_types = NETIO_EVENT_READ;
-    dnsh->xfrhandler.event_handler = dnshandler_handle_xfr;
     return dnsh;
 }
 
@@ -110,100 +144,77 @@ ods_status
 dnshandler_listen(dnshandler_type* dnshandler)
 {
     ods_status status = ODS_STATUS_OK;
+    size_t i = 0;
     ods_log_assert(dnshandler);
-    status = sock_listen(dnshandler->socklist, dnshandler->interfaces);
-    if (status != ODS_STATUS_OK) {
-        ods_log_error("[%s] unable to start: sock_listen() "
-            "failed (%s)", dnsh_str, ods_status2str(status));
-        dnshandler->thread_id = 0;
+    for (i=0; i < dnshandler->num_threads; i++) {
+        status = sock_listen(dnshandler->threads[i].socklist,
+            dnshandler->interfaces, dnshandler->num_threads > 1);
+        if (status != ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to start: sock_listen() "
+                "failed (%s)", dnsh_str, ods_status2str(status));
+            dnshandler->threads[i].thread_id = 0;
+            return status;
+        }
     }
     return status;
 }
 
 
 /**
- * Start dns handler.
+ * Start dns handler thread.
  *
  */
 void
-dnshandler_start(dnshandler_type* dnshandler)
+dnshandler_start(dnsthread_type* dnsthread)
 {
     size_t i = 0;
-    engine_type* engine = NULL;
-    netio_handler_type* tcp_accept_handlers = NULL;
+    dnshandler_type* dnshandler = NULL;
 
+    ods_log_assert(dnsthread);
+    dnshandler = dnsthread->dnshandler;
     ods_log_assert(dnshandler);
     ods_log_assert(dnshandler->engine);
-    ods_log_debug("[%s] start", dnsh_str);
+    ods_log_debug("[%s] start thread %u", dnsh_str,
+        (unsigned) dnsthread->num);
     /* udp */
     for (i=0; i < dnshandler->interfaces->count; i++) {
-        struct udp_data* data = NULL;
-        netio_handler_type* handler = NULL;
-        data = (struct udp_data*) allocator_alloc(dnshandler->allocator,
-            sizeof(struct udp_data));
-        if (!data) {
-            ods_log_error("[%s] unable to start: allocator_alloc() "
-                "failed", dnsh_str);
-            dnshandler->thread_id = 0;
-            engine->need_to_exit = 1;
-            break;
-        }
-        data->query = dnshandler->query;
+        struct udp_data* data = &dnsthread->udp_data[i];
+        netio_handler_type* handler = &dnsthread->udp_handlers[i];
+        data->batch = dnsthread->udp_batch;
         data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
-        handler = (netio_handler_type*) allocator_alloc(
-            dnshandler->allocator, sizeof(netio_handler_type));
-        if (!handler) {
-            ods_log_error("[%s] unable to start: allocator_alloc() "
-                "failed", dnsh_str);
-            allocator_deallocate(dnshandler->allocator, (void*)data);
-            dnshandler->thread_id = 0;
-            engine->need_to_exit = 1;
-            break;
-        }
-        handler->fd = dnshandler->socklist->udp[i].s;
+        data->socket = &dnsthread->socklist->udp[i];
+        handler->fd = dnsthread->socklist->udp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
         handler->event_handler = sock_handle_udp;
+        handler->node = NULL;
         ods_log_debug("[%s] add udp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(dnsthread->netio, handler);
     }
     /* tcp */
-    tcp_accept_handlers = (netio_handler_type*) allocator_alloc(
-        dnshandler->allocator,
-        dnshandler->interfaces->count * sizeof(netio_handler_type));
     for (i=0; i < dnshandler->interfaces->count; i++) {
-        struct tcp_accept_data* data = NULL;
-        netio_handler_type* handler = NULL;
-        data = (struct tcp_accept_data*) allocator_alloc(
-            dnshandler->allocator, sizeof(struct tcp_accept_data));
-        if (!data) {
-            ods_log_error("[%s] unable to start: allocator_alloc() "
-                "failed", dnsh_str);
-            dnshandler->thread_id = 0;
-            engine->need_to_exit = 1;
-            return;
-        }
+        struct tcp_accept_data* data = &dnsthread->tcp_accept_data[i];
+        netio_handler_type* handler = &dnsthread->tcp_accept_handlers[i];
         data->engine = dnshandler->engine;
-        data->socket = &dnshandler->socklist->udp[i];
+        data->socket = &dnsthread->socklist->tcp[i];
         data->tcp_accept_handler_count = dnshandler->interfaces->count;
-        data->tcp_accept_handlers = tcp_accept_handlers;
-        handler = &tcp_accept_handlers[i];
-        handler->fd = dnshandler->socklist->tcp[i].s;
+        data->tcp_accept_handlers = dnsthread->tcp_accept_handlers;
+        handler->fd = dnsthread->socklist->tcp[i].s;
         handler->timeout = NULL;
         handler->user_data = data;
         handler->event_types = NETIO_EVENT_READ;
         handler->event_handler = sock_handle_tcp_accept;
+        handler->node = NULL;
         ods_log_debug("[%s] add tcp network handler fd %u", dnsh_str,
             (unsigned) handler->fd);
-        netio_add_handler(dnshandler->netio, handler);
+        netio_add_handler(dnsthread->netio, handler);
     }
     /* service */
     while (dnshandler->need_to_exit == 0) {
         ods_log_deeebug("[%s] netio dispatch", dnsh_str);
-        if (netio_dispatch(dnshandler->netio, NULL, NULL) == -1) {
+        if (netio_dispatch(dnsthread->netio, NULL, NULL) == -1) {
             if (errno != EINTR) {
                 ods_log_error("[%s] unable to dispatch netio: %s", dnsh_str,
                     strerror(errno));
@@ -212,15 +223,16 @@ dnshandler_start(dnshandler_type* dnshandler)
         }
     }
     /* shutdown */
-    ods_log_debug("[%s] shutdown", dnsh_str);
+    ods_log_debug("[%s] shutdown thread %u", dnsh_str,
+        (unsigned) dnsthread->num);
     for (i=0; i < dnshandler->interfaces->count; i++) {
-        if (dnshandler->socklist->udp[i].s != -1) {
-            close(dnshandler->socklist->udp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->udp[i].addr);
+        if (dnsthread->socklist->udp[i].s != -1) {
+            close(dnsthread->socklist->udp[i].s);
+            freeaddrinfo((void*)dnsthread->socklist->udp[i].addr);
         }
-        if (dnshandler->socklist->tcp[i].s != -1) {
-            close(dnshandler->socklist->tcp[i].s);
-            freeaddrinfo((void*)dnshandler->socklist->tcp[i].addr);
+        if (dnsthread->socklist->tcp[i].s != -1) {
+            close(dnsthread->socklist->tcp[i].s);
+            freeaddrinfo((void*)dnsthread->socklist->tcp[i].addr);
         }
     }
     return;
@@ -234,55 +246,14 @@ dnshandler_start(dnshandler_type* dnshandler)
 void
 dnshandler_signal(dnshandler_type* dnshandler)
 {
-    if (dnshandler && dnshandler->thread_id) {
-        ods_thread_kill(dnshandler->thread_id, SIGHUP);
-    }
-    return;
-}
-
-
-/**
- * Forward notify to zone transfer handler.
- *
- */
-void
-dnshandler_fwd_notify(dnshandler_type* dnshandler, uint8_t* pkt, size_t len)
-{
-    ssize_t nb = 0;
-    ods_log_assert(dnshandler);
-    ods_log_assert(pkt);
-    nb = send(dnshandler->xfrhandler.fd, (const void*) pkt, len, 0);
-    if (nb < 0) {
-        ods_log_error("[%s] unable to forward notify: send() failed (%s)",
-            dnsh_str, strerror(errno));
-    } else {
-        ods_log_debug("[%s] forwarded notify: %u bytes sent", dnsh_str, nb);
-    }
-    return;
-}
-
-
-/**
- * Handle forwarded dns packets.
- *
- */
-static void
-dnshandler_handle_xfr(netio_type* ATTR_UNUSED(netio),
-    netio_handler_type* handler, netio_events_type event_types)
-{
-    dnshandler_type* dnshandler = NULL;
-    uint8_t buf[MAX_PACKET_SIZE];
-    ssize_t received = 0;
-    if (!handler) {
+    size_t i = 0;
+    if (!dnshandler) {
         return;
     }
-    dnshandler = (dnshandler_type*) handler->user_data;
-    ods_log_assert(event_types & NETIO_EVENT_READ);
-    ods_log_debug("[%s] read forwarded xfr packet", dnsh_str);
-    received = read(dnshandler->xfrhandler.fd, &buf, MAX_PACKET_SIZE);
-    if (received == -1) {
-        ods_log_debug("[%s] unable to forward xfr packet: %s", dnsh_str,
-            strerror(errno));
+    for (i=0; i < dnshandler->num_threads; i++) {
+        if (dnshandler->threads[i].thread_id) {
+            ods_thread_kill(dnshandler->threads[i].thread_id, SIGHUP);
+        }
     }
     return;
 }
@@ -296,13 +267,24 @@ void
 dnshandler_cleanup(dnshandler_type* dnshandler)
 {
     allocator_type* allocator = NULL;
+    dnsthread_type* dnsthread = NULL;
+    size_t i = 0;
     if (!dnshandler) {
         return;
     }
     allocator = dnshandler->allocator;
-    netio_cleanup(dnshandler->netio);
-    query_cleanup(dnshandler->query);
-    allocator_deallocate(allocator, (void*) dnshandler->socklist);
+    for (i=0; i < dnshandler->num_threads; i++) {
+        dnsthread = &dnshandler->threads[i];
+        netio_cleanup(dnsthread->netio);
+        sock_udp_batch_cleanup(dnsthread->udp_batch, allocator);
+        allocator_deallocate(allocator, (void*) dnsthread->udp_data);
+        allocator_deallocate(allocator, (void*) dnsthread->udp_handlers);
+        allocator_deallocate(allocator, (void*) dnsthread->tcp_accept_data);
+        allocator_deallocate(allocator,
+            (void*) dnsthread->tcp_accept_handlers);
+        allocator_deallocate(allocator, (void*) dnsthread->socklist);
+    }
+    allocator_deallocate(allocator, (void*) dnshandler->threads);
     allocator_deallocate(allocator, (void*) dnshandler);
     return;
 }
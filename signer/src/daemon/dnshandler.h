@@ -49,15 +49,35 @@
 #define ODS_SE_MAX_HANDLERS 5
 
 typedef struct dnshandler_struct dnshandler_type;
+
+/**
+ * DNS handler thread.
+ * Every thread serves all listener interfaces on its own set of sockets,
+ * with its own network I/O loop and batch of udp queries. If there is
+ * more than one thread, the sockets share their ports and the kernel
+ * balances incoming queries and connections over the threads.
+ *
+ */
+typedef struct dnsthread_struct dnsthread_type;
+struct dnsthread_struct {
+    dnshandler_type* dnshandler;
+    ods_thread_type thread_id;
+    size_t num;
+    socklist_type* socklist;
+    netio_type* netio;
+    struct udp_batch* udp_batch;
+    struct udp_data* udp_data;
+    netio_handler_type* udp_handlers;
+    struct tcp_accept_data* tcp_accept_data;
+    netio_handler_type* tcp_accept_handlers;
+};
+
 struct dnshandler_struct {
     allocator_type* allocator;
-    ods_thread_type thread_id;
     void* engine;
     listener_type* interfaces;
-    socklist_type* socklist;
-    netio_type* netio;
-    query_type* query;
-    netio_handler_type xfrhandler;
+    dnsthread_type* threads;
+    size_t num_threads;
     unsigned need_to_exit;
 };
 
@@ -65,11 +85,12 @@ struct dnshandler_struct {
  * Create dns handler.
  * \param[in] allocator memory allocator
  * \param[in] interfaces list of interfaces
+ * \param[in] num_threads number of dns handler threads
  * \return dnshandler_type* created dns handler
  *
  */
 dnshandler_type* dnshandler_create(allocator_type* allocator,
-    listener_type* interfaces);
+    listener_type* interfaces, size_t num_threads);
 
 /**
  * Start dns handler listener.
@@ -80,11 +101,11 @@ dnshandler_type* dnshandler_create(allocator_type* allocator,
 ods_status dnshandler_listen(dnshandler_type* dnshandler);
 
 /**
- * Start dns handler.
- * \param[in] dnshandler_type* dns handler
+ * Start dns handler thread.
+ * \param[in] dnsthread dns handler thread
  *
  */
-void dnshandler_start(dnshandler_type* dnshandler);
+void dnshandler_start(dnsthread_type* dnsthread);
 
 /**
  * Signal dns handler.
@@ -93,16 +114,6 @@ void dnshandler_start(dnshandler_type* dnshandler);
  */
 void dnshandler_signal(dnshandler_type* dnshandler);
 
-/**
- * Forward notify to zone transfer handler.
- * \param[in] dnshandler_type* dns handler
- * \param[in] pkt notify packet
- * \param[in] len packet length
- *
- */
-void dnshandler_fwd_notify(dnshandler_type* dnshandler,
-    uint8_t* pkt, size_t len);
-
 /**
  * Cleanup dns handler.
  * \param[in] dnshandler_type* dns handler
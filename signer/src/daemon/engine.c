@@ -41,6 +41,7 @@
 #include "shared/hsm.h"
 #include "shared/locks.h"
 #include "shared/log.h"
+#include "shared/metrics.h"
 #include "shared/privdrop.h"
 #include "shared/status.h"
 #include "shared/util.h"
@@ -92,7 +93,7 @@ engine_create(void)
     engine->cmdhandler = NULL;
     engine->cmdhandler_done = 0;
     engine->dnshandler = NULL;
-    engine->xfrhandler = NULL;
+    engine->xfrhandlers = NULL;
     engine->pid = -1;
     engine->uid = -1;
     engine->gid = -1;
@@ -104,6 +105,7 @@ engine_create(void)
     lock_basic_lock(&engine->signal_lock);
     engine->signal = SIGNAL_INIT;
     lock_basic_unlock(&engine->signal_lock);
+    metrics_init();
     engine->zonelist = zonelist_create(engine->allocator);
     if (!engine->zonelist) {
         engine_cleanup(engine);
@@ -216,33 +218,42 @@ engine_stop_cmdhandler(engine_type* engine)
 static void*
 dnshandler_thread_start(void* arg)
 {
-    dnshandler_type* dnshandler = (dnshandler_type*) arg;
-    dnshandler_start(dnshandler);
+    dnsthread_type* dnsthread = (dnsthread_type*) arg;
+    dnshandler_start(dnsthread);
     return NULL;
 }
 static void
 engine_start_dnshandler(engine_type* engine)
 {
+    size_t i = 0;
     if (!engine || !engine->dnshandler) {
         return;
     }
     ods_log_debug("[%s] start dnshandler", engine_str);
     engine->dnshandler->engine = engine;
-    ods_thread_create(&engine->dnshandler->thread_id,
-        dnshandler_thread_start, engine->dnshandler);
+    for (i=0; i < engine->dnshandler->num_threads; i++) {
+        ods_thread_create(&engine->dnshandler->threads[i].thread_id,
+            dnshandler_thread_start, &engine->dnshandler->threads[i]);
+    }
     return;
 }
 static void
 engine_stop_dnshandler(engine_type* engine)
 {
-    if (!engine || !engine->dnshandler || !engine->dnshandler->thread_id) {
+    size_t i = 0;
+    if (!engine || !engine->dnshandler) {
         return;
     }
     ods_log_debug("[%s] stop dnshandler", engine_str);
     engine->dnshandler->need_to_exit = 1;
     dnshandler_signal(engine->dnshandler);
     ods_log_debug("[%s] join dnshandler", engine_str);
-    ods_thread_join(engine->dnshandler->thread_id);
+    for (i=0; i < engine->dnshandler->num_threads; i++) {
+        if (engine->dnshandler->threads[i].thread_id) {
+            ods_thread_join(engine->dnshandler->threads[i].thread_id);
+            engine->dnshandler->threads[i].thread_id = 0;
+        }
+    }
     engine->dnshandler->engine = NULL;
     return;
 }
@@ -262,39 +273,73 @@ xfrhandler_thread_start(void* arg)
 static void
 engine_start_xfrhandler(engine_type* engine)
 {
-    if (!engine || !engine->xfrhandler) {
+    size_t i = 0;
+    xfrhandler_type* xfrhandler = NULL;
+    if (!engine || !engine->xfrhandlers) {
         return;
     }
     ods_log_debug("[%s] start xfrhandler", engine_str);
-    engine->xfrhandler->engine = engine;
-    ods_thread_create(&engine->xfrhandler->thread_id,
-        xfrhandler_thread_start, engine->xfrhandler);
-    /* This might be the wrong place to mark the xfrhandler started but
-     * if its isn't done here we might try to shutdown and stop it before
-     * it has marked itself started
-     */
-    engine->xfrhandler->started = 1;
+    for (i=0; i < (size_t) engine->config->num_xfr_threads; i++) {
+        xfrhandler = engine->xfrhandlers[i];
+        xfrhandler->engine = engine;
+        ods_thread_create(&xfrhandler->thread_id,
+            xfrhandler_thread_start, xfrhandler);
+        /* This might be the wrong place to mark the xfrhandler started but
+         * if its isn't done here we might try to shutdown and stop it
+         * before it has marked itself started
+         */
+        xfrhandler->started = 1;
+    }
     return;
 }
 static void
 engine_stop_xfrhandler(engine_type* engine)
 {
-    if (!engine || !engine->xfrhandler) {
+    size_t i = 0;
+    xfrhandler_type* xfrhandler = NULL;
+    if (!engine || !engine->xfrhandlers) {
         return;
     }
     ods_log_debug("[%s] stop xfrhandler", engine_str);
-    engine->xfrhandler->need_to_exit = 1;
-    xfrhandler_signal(engine->xfrhandler);
+    for (i=0; i < (size_t) engine->config->num_xfr_threads; i++) {
+        engine->xfrhandlers[i]->need_to_exit = 1;
+        xfrhandler_signal(engine->xfrhandlers[i]);
+    }
     ods_log_debug("[%s] join xfrhandler", engine_str);
-    if (engine->xfrhandler->started) {
-    	ods_thread_join(engine->xfrhandler->thread_id);
-    	engine->xfrhandler->started = 0;
+    for (i=0; i < (size_t) engine->config->num_xfr_threads; i++) {
+        xfrhandler = engine->xfrhandlers[i];
+        if (xfrhandler->started) {
+            ods_thread_join(xfrhandler->thread_id);
+            xfrhandler->started = 0;
+        }
+        xfrhandler->engine = NULL;
     }
-    engine->xfrhandler->engine = NULL;
     return;
 }
 
 
+/**
+ * Get the zone transfer handler that serves a zone. Zones are divided
+ * over the zone transfer handlers by a hash of their name.
+ *
+ */
+static xfrhandler_type*
+engine_zone_xfrhandler(engine_type* engine, zone_type* zone)
+{
+    uint32_t hash = 5381;
+    const char* s = NULL;
+    ods_log_assert(engine);
+    ods_log_assert(engine->xfrhandlers);
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+    for (s = zone->name; *s; s++) {
+        hash = ((hash << 5) + hash) + (uint8_t) *s;
+    }
+    return engine->xfrhandlers[hash %
+        (uint32_t) engine->config->num_xfr_threads];
+}
+
+
 /**
  * Drop privileges.
  *
@@ -339,6 +384,7 @@ static void
 engine_create_workers(engine_type* engine)
 {
     size_t i = 0;
+    size_t reserved = 0;
     ods_log_assert(engine);
     ods_log_assert(engine->config);
     ods_log_assert(engine->allocator);
@@ -348,6 +394,17 @@ engine_create_workers(engine_type* engine)
         engine->workers[i] = worker_create(engine->allocator, i,
             WORKER_WORKER);
     }
+    /* keep a quarter of the workers, at least one, for small zones */
+    if (engine->config->num_worker_threads > 1) {
+        reserved = ((size_t) engine->config->num_worker_threads) / 4;
+        if (reserved < 1) {
+            reserved = 1;
+        }
+    }
+    lock_basic_lock(&engine->taskq->schedule_lock);
+    engine->taskq->large_limit =
+        ((size_t) engine->config->num_worker_threads) - reserved;
+    lock_basic_unlock(&engine->taskq->schedule_lock);
     return;
 }
 static void
@@ -415,6 +472,7 @@ engine_stop_workers(engine_type* engine)
         engine->workers[i]->need_to_exit = 1;
         worker_wakeup(engine->workers[i]);
     }
+    schedule_wakeup(engine->taskq);
     ods_log_debug("[%s] notify workers", engine_str);
     worker_notify_all(&engine->signq->q_lock, &engine->signq->q_nonfull);
     /* head count */
@@ -463,6 +521,7 @@ engine_wakeup_workers(engine_type* engine)
     for (i=0; i < (size_t) engine->config->num_worker_threads; i++) {
         worker_wakeup(engine->workers[i]);
     }
+    schedule_wakeup(engine->taskq);
     return;
 }
 
@@ -478,6 +537,7 @@ engine_setup(engine_type* engine)
     struct sigaction action;
     int result = 0;
     int sockets[2] = {0,0};
+    size_t i = 0;
 
     ods_log_debug("[%s] setup signer engine", engine_str);
     if (!engine || !engine->config) {
@@ -493,17 +553,34 @@ engine_setup(engine_type* engine)
         return ODS_STATUS_CMDHANDLER_ERR;
     }
     engine->dnshandler = dnshandler_create(engine->allocator,
-        engine->config->interfaces);
-    engine->xfrhandler = xfrhandler_create(engine->allocator);
-    if (!engine->xfrhandler) {
+        engine->config->interfaces,
+        (size_t) engine->config->num_listener_threads);
+    if (engine->config->num_xfr_threads < 1) {
+        engine->config->num_xfr_threads = 1;
+    }
+    engine->xfrhandlers = (xfrhandler_type**) allocator_alloc(
+        engine->allocator,
+        ((size_t)engine->config->num_xfr_threads) * sizeof(xfrhandler_type*));
+    if (!engine->xfrhandlers) {
         return ODS_STATUS_XFRHANDLER_ERR;
     }
-    if (engine->dnshandler) {
-        if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) == -1) {
+    memset(engine->xfrhandlers, 0,
+        ((size_t)engine->config->num_xfr_threads) * sizeof(xfrhandler_type*));
+    for (i=0; i < (size_t) engine->config->num_xfr_threads; i++) {
+        engine->xfrhandlers[i] = xfrhandler_create(engine->allocator, i,
+            (size_t) engine->config->num_xfr_per_master);
+        if (!engine->xfrhandlers[i]) {
             return ODS_STATUS_XFRHANDLER_ERR;
         }
-        engine->xfrhandler->dnshandler.fd = sockets[0];
-        engine->dnshandler->xfrhandler.fd = sockets[1];
+    }
+    if (engine->dnshandler) {
+        for (i=0; i < (size_t) engine->config->num_xfr_threads; i++) {
+            if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sockets) == -1) {
+                return ODS_STATUS_XFRHANDLER_ERR;
+            }
+            engine->xfrhandlers[i]->dnshandler.fd = sockets[0];
+            engine->xfrhandlers[i]->fwd_fd = sockets[1];
+        }
         status = dnshandler_listen(engine->dnshandler);
         if (status != ODS_STATUS_OK) {
             ods_log_error("[%s] setup: unable to listen to sockets (%s)",
@@ -730,9 +807,9 @@ static int
 dnsconfig_zone(engine_type* engine, zone_type* zone)
 {
     int numdns = 0;
+    xfrhandler_type* xfrhandler = NULL;
     ods_log_assert(engine);
-    ods_log_assert(engine->xfrhandler);
-    ods_log_assert(engine->xfrhandler->netio);
+    ods_log_assert(engine->xfrhandlers);
     ods_log_assert(zone);
     ods_log_assert(zone->adinbound);
     ods_log_assert(zone->adoutbound);
@@ -743,18 +820,17 @@ dnsconfig_zone(engine_type* engine, zone_type* zone)
         if (!zone->xfrd) {
             ods_log_debug("[%s] add transfer handler for zone %s",
                 engine_str, zone->name);
-            zone->xfrd = xfrd_create((void*) engine->xfrhandler,
-                (void*) zone);
+            xfrhandler = engine_zone_xfrhandler(engine, zone);
+            zone->xfrd = xfrd_create((void*) xfrhandler, (void*) zone);
             ods_log_assert(zone->xfrd);
-            netio_add_handler(engine->xfrhandler->netio,
-                &zone->xfrd->handler);
+            netio_add_handler(xfrhandler->netio, &zone->xfrd->handler);
         } else if (!zone->xfrd->serial_disk_acquired) {
             xfrd_set_timer_now(zone->xfrd);
         }
         numdns++;
     } else if (zone->xfrd) {
-        netio_remove_handler(engine->xfrhandler->netio,
-            &zone->xfrd->handler);
+        xfrhandler = (xfrhandler_type*) zone->xfrd->xfrhandler;
+        netio_remove_handler(xfrhandler->netio, &zone->xfrd->handler);
         xfrd_cleanup(zone->xfrd);
         zone->xfrd = NULL;
     }
@@ -763,16 +839,15 @@ dnsconfig_zone(engine_type* engine, zone_type* zone)
         if (!zone->notify) {
             ods_log_debug("[%s] add notify handler for zone %s",
                 engine_str, zone->name);
-            zone->notify = notify_create((void*) engine->xfrhandler,
-                (void*) zone);
+            xfrhandler = engine_zone_xfrhandler(engine, zone);
+            zone->notify = notify_create((void*) xfrhandler, (void*) zone);
             ods_log_assert(zone->notify);
-            netio_add_handler(engine->xfrhandler->netio,
-                &zone->notify->handler);
+            netio_add_handler(xfrhandler->netio, &zone->notify->handler);
         }
         numdns++;
     } else if (zone->notify) {
-        netio_remove_handler(engine->xfrhandler->netio,
-            &zone->notify->handler);
+        xfrhandler = (xfrhandler_type*) zone->notify->xfrhandler;
+        netio_remove_handler(xfrhandler->netio, &zone->notify->handler);
         notify_cleanup(zone->notify);
         zone->notify = NULL;
     }
@@ -795,6 +870,7 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
     unsigned wake_up = 0;
     int warnings = 0;
     time_t now = 0;
+    size_t i = 0;
 
     if (!engine || !engine->zonelist || !engine->zonelist->zones) {
         return;
@@ -816,13 +892,20 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
                 lock_basic_lock(&engine->taskq->schedule_lock);
                 task = unschedule_task(engine->taskq,
                     (task_type*) zone->task);
+                zone->task = NULL;
                 lock_basic_unlock(&engine->taskq->schedule_lock);
             }
             task_cleanup(task);
             task = NULL;
             lock_basic_unlock(&zone->zone_lock);
-            netio_remove_handler(engine->xfrhandler->netio,
-                &zone->xfrd->handler);
+            if (zone->xfrd) {
+                netio_remove_handler(((xfrhandler_type*)
+                    zone->xfrd->xfrhandler)->netio, &zone->xfrd->handler);
+            }
+            if (zone->notify) {
+                netio_remove_handler(((xfrhandler_type*)
+                    zone->notify->xfrhandler)->netio, &zone->notify->handler);
+            }
             zone_cleanup(zone);
             zone = NULL;
             continue;
@@ -862,11 +945,11 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
         if (zone->zl_status == ZONE_ZL_ADDED) {
             ods_log_assert(task);
             lock_basic_lock(&zone->zone_lock);
-            zone->task = task;
-            lock_basic_unlock(&zone->zone_lock);
             lock_basic_lock(&engine->taskq->schedule_lock);
+            zone->task = task;
             status = schedule_task(engine->taskq, task, 0);
             lock_basic_unlock(&engine->taskq->schedule_lock);
+            lock_basic_unlock(&zone->zone_lock);
         } else if (zl_changed == ODS_STATUS_OK) {
             /* always try to update signconf */
             lock_basic_lock(&zone->zone_lock);
@@ -884,8 +967,10 @@ engine_update_zones(engine_type* engine, ods_status zl_changed)
     }
     lock_basic_unlock(&engine->zonelist->zl_lock);
     if (engine->dnshandler) {
-        dnshandler_fwd_notify(engine->dnshandler,
-            (uint8_t*) ODS_SE_NOTIFY_CMD, strlen(ODS_SE_NOTIFY_CMD));
+        for (i=0; i < (size_t) engine->config->num_xfr_threads; i++) {
+            xfrhandler_fwd_notify(engine->xfrhandlers[i],
+                (uint8_t*) ODS_SE_NOTIFY_CMD, strlen(ODS_SE_NOTIFY_CMD));
+        }
     } else if (warnings) {
         ods_log_warning("[%s] no dnshandler/listener configured, but zones "
          "are configured with dns adapters: notify and zone transfer "
@@ -1060,6 +1145,7 @@ engine_start(const char* cfgfile, int cmdline_verbosity, int daemonize,
 
     /* shutdown */
     ods_log_info("[%s] signer shutdown", engine_str);
+    metrics_log();
     if (close_hsm) {
         ods_log_verbose("[%s] close hsm", engine_str);
         hsm_close();
@@ -1124,9 +1210,15 @@ engine_cleanup(engine_type* engine)
     fifoq_cleanup(engine->signq);
     cmdhandler_cleanup(engine->cmdhandler);
     dnshandler_cleanup(engine->dnshandler);
-    xfrhandler_cleanup(engine->xfrhandler);
+    if (engine->xfrhandlers && engine->config) {
+        for (i=0; i < (size_t) engine->config->num_xfr_threads; i++) {
+            xfrhandler_cleanup(engine->xfrhandlers[i]);
+        }
+        allocator_deallocate(allocator, (void*) engine->xfrhandlers);
+    }
     engine_config_cleanup(engine->config);
     allocator_deallocate(allocator, (void*) engine);
+    metrics_cleanup();
     lock_basic_destroy(&signal_lock);
     lock_basic_off(&signal_cond);
     allocator_cleanup(allocator);
@@ -64,7 +64,7 @@ struct engine_struct {
     fifoq_type* signq;
     cmdhandler_type* cmdhandler;
     dnshandler_type* dnshandler;
-    xfrhandler_type* xfrhandler;
+    xfrhandler_type** xfrhandlers;
     edns_data_type edns;
     int cmdhandler_done;
 
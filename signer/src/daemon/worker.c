@@ -38,6 +38,7 @@
 #include "shared/hsm.h"
 #include "shared/locks.h"
 #include "shared/log.h"
+#include "shared/metrics.h"
 #include "shared/status.h"
 #include "signer/tools.h"
 #include "signer/zone.h"
@@ -93,6 +94,7 @@ worker_create(allocator_type* allocator, int num, worker_id type)
     worker->need_to_exit = 0;
     worker->type = type;
     worker->clock_in = 0;
+    worker->phase_start = 0;
     worker->jobs_appointed = 0;
     worker->jobs_completed = 0;
     worker->jobs_failed = 0;
@@ -103,6 +105,39 @@ worker_create(allocator_type* allocator, int num, worker_id type)
 }
 
 
+/**
+ * Record how long the worker spent in its current phase.
+ *
+ */
+static void
+worker_phase_done(worker_type* worker)
+{
+    uint64_t usec = 0;
+    if (!worker->phase_start) {
+        return;
+    }
+    usec = metrics_usec() - worker->phase_start;
+    worker->phase_start = 0;
+    switch (worker->working_with) {
+        case TASK_SIGNCONF:
+            metrics_phase_time(METRICS_PHASE_CONFIGURE, usec);
+            break;
+        case TASK_READ:
+            metrics_phase_time(METRICS_PHASE_READ, usec);
+            break;
+        case TASK_SIGN:
+            metrics_phase_time(METRICS_PHASE_SIGN, usec);
+            break;
+        case TASK_WRITE:
+            metrics_phase_time(METRICS_PHASE_WRITE, usec);
+            break;
+        default:
+            break;
+    }
+    return;
+}
+
+
 /**
  * Worker working with...
  *
@@ -111,6 +146,8 @@ static void
 worker_working_with(worker_type* worker, task_id with, task_id next,
     const char* str, const char* name, task_id* what, time_t* when)
 {
+    worker_phase_done(worker);
+    worker->phase_start = metrics_usec();
     worker->working_with = with;
     ods_log_verbose("[%s[%i]] %s zone %s", worker2str(worker->type),
        worker->thread_num, str, name);
@@ -217,11 +254,29 @@ worker_queue_domain(worker_type* worker, fifoq_type* q, domain_type* domain)
 
 
 /**
- * Queue zone for signing.
+ * Forget where signing the zone stopped, the next sign starts over.
  *
  */
 static void
-worker_queue_zone(worker_type* worker, fifoq_type* q, zone_type* zone)
+worker_sign_restart(zone_type* zone)
+{
+    if (zone->sign_next) {
+        ldns_rdf_deep_free(zone->sign_next);
+        zone->sign_next = NULL;
+    }
+    return;
+}
+
+
+/**
+ * Queue zone for signing, starting at the domain where the previous chunk
+ * stopped. Stops after the domain that makes the chunk full.
+ * \return int 1 if there is more to sign, 0 if the zone is done
+ *
+ */
+static int
+worker_queue_zone(worker_type* worker, fifoq_type* q, zone_type* zone,
+    size_t chunk)
 {
     ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     domain_type* domain = NULL;
@@ -230,17 +285,50 @@ worker_queue_zone(worker_type* worker, fifoq_type* q, zone_type* zone)
     ods_log_assert(zone);
     worker_clear_jobs(worker);
     if (!zone->db || !zone->db->domains) {
-        return;
+        worker_sign_restart(zone);
+        return 0;
+    }
+    if (zone->sign_next) {
+        node = ldns_rbtree_search(zone->db->domains, zone->sign_next);
+        worker_sign_restart(zone);
+        if (!node || node == LDNS_RBTREE_NULL) {
+            /* should not happen, zone changes restart signing */
+            ods_log_warning("[%s[%i]] unable to resume signing zone %s: "
+                "domain not found, start over", worker2str(worker->type),
+                worker->thread_num, zone->name);
+            node = LDNS_RBTREE_NULL;
+        }
     }
-    if (zone->db->domains->root != LDNS_RBTREE_NULL) {
+    if (node == LDNS_RBTREE_NULL &&
+        zone->db->domains->root != LDNS_RBTREE_NULL) {
         node = ldns_rbtree_first(zone->db->domains);
     }
     while (node && node != LDNS_RBTREE_NULL) {
         domain = (domain_type*) node->data;
+        if (chunk && worker->jobs_appointed >= chunk) {
+            zone->sign_next = ldns_rdf_clone(domain->dname);
+            return zone->sign_next != NULL;
+        }
         worker_queue_domain(worker, q, domain);
         node = ldns_rbtree_next(node);
     }
-    return;
+    return 0;
+}
+
+
+/**
+ * Check if other zones are waiting for a worker.
+ *
+ */
+static int
+worker_others_waiting(worker_type* worker)
+{
+    engine_type* engine = (engine_type*) worker->engine;
+    int waiting = 0;
+    lock_basic_lock(&engine->taskq->schedule_lock);
+    waiting = schedule_has_due_task(engine->taskq);
+    lock_basic_unlock(&engine->taskq->schedule_lock);
+    return waiting;
 }
 
 
@@ -296,10 +384,13 @@ worker_perform_task(worker_type* worker)
     task_id what = TASK_NONE;
     time_t when = 0;
     time_t never = (3600*24*365);
+    time_t cap = 0;
     ods_status status = ODS_STATUS_OK;
     int backup = 0;
+    int more = 0;
     time_t start = 0;
     time_t end = 0;
+    uint64_t usec = 0;
 
     if (!worker || !worker->task || !worker->task->zone || !worker->engine) {
         return;
@@ -361,6 +452,8 @@ worker_perform_task(worker_type* worker)
                     task_who2str(task));
                 status = ODS_STATUS_OK;
             }
+            /* sign the zone as read from the start */
+            worker_sign_restart(zone);
             if (status == ODS_STATUS_OK) {
                 if (task->interrupt > TASK_SIGNCONF) {
                     task->interrupt = TASK_NONE;
@@ -378,64 +471,107 @@ worker_perform_task(worker_type* worker)
             worker_working_with(worker, TASK_SIGN, TASK_WRITE,
                 "sign", task_who2str(task), &what, &when);
             task->what = TASK_SIGN;
-            status = zone_update_serial(zone);
-            if (status == ODS_STATUS_OK) {
-                if (task->interrupt > TASK_SIGNCONF) {
-                    task->interrupt = TASK_NONE;
-                    task->halted = TASK_NONE;
+            if (!zone->sign_next) {
+                /* first chunk, new serial and new statistics */
+                status = zone_update_serial(zone);
+                if (status == ODS_STATUS_OK) {
+                    if (task->interrupt > TASK_SIGNCONF) {
+                        task->interrupt = TASK_NONE;
+                        task->halted = TASK_NONE;
+                    }
+                } else {
+                    ods_log_error("[%s[%i]] unable to sign zone %s: "
+                        "failed to increment serial",
+                        worker2str(worker->type), worker->thread_num,
+                        task_who2str(task));
+                    if (task->halted == TASK_NONE) {
+                        goto task_perform_fail;
+                    }
+                    goto task_perform_continue;
+                }
+                task->cost = 0;
+                if (zone->stats) {
+                    lock_basic_lock(&zone->stats->stats_lock);
+                    if (!zone->stats->start_time) {
+                        zone->stats->start_time = time(NULL);
+                    }
+                    zone->stats->sig_count = 0;
+                    zone->stats->sig_soa_count = 0;
+                    zone->stats->sig_reuse = 0;
+                    zone->stats->sig_expiration = 0;
+                    zone->stats->sig_time = 0;
+                    lock_basic_unlock(&zone->stats->stats_lock);
                 }
             } else {
-                ods_log_error("[%s[%i]] unable to sign zone %s: "
-                    "failed to increment serial",
+                ods_log_verbose("[%s[%i]] resume signing zone %s",
                     worker2str(worker->type), worker->thread_num,
                     task_who2str(task));
-                if (task->halted == TASK_NONE) {
-                    goto task_perform_fail;
-                }
-                goto task_perform_continue;
             }
-
-            /* start timer */
-            start = time(NULL);
-            if (zone->stats) {
-                lock_basic_lock(&zone->stats->stats_lock);
-                if (!zone->stats->start_time) {
-                    zone->stats->start_time = start;
-                }
-                zone->stats->sig_count = 0;
-                zone->stats->sig_soa_count = 0;
-                zone->stats->sig_reuse = 0;
-                zone->stats->sig_time = 0;
-                lock_basic_unlock(&zone->stats->stats_lock);
+            /* under overload, only refresh signatures that need it */
+            lock_basic_lock(&engine->taskq->schedule_lock);
+            zone->shed_refresh = schedule_overload(engine->taskq);
+            lock_basic_unlock(&engine->taskq->schedule_lock);
+            if (zone->shed_refresh) {
+                ods_log_verbose("[%s[%i]] overload, postpone refreshing "
+                    "signatures of zone %s", worker2str(worker->type),
+                    worker->thread_num, task_who2str(task));
             }
             /* check the HSM connection before queuing sign operations */
             lhsm_check_connection((void*)engine);
-            /* queue menial, hard signing work */
-            worker_queue_zone(worker, engine->signq, zone);
-            ods_log_deeebug("[%s[%i]] wait until drudgers are finished "
-                "signing zone %s", worker2str(worker->type), worker->thread_num,
-                task_who2str(task));
-            /* sleep until work is done */
-            worker_sleep_unless(worker, 0);
-            /* stop timer */
-            end = time(NULL);
-            status = worker_check_jobs(worker, task);
-            worker_clear_jobs(worker);
-            if (status == ODS_STATUS_OK && zone->stats) {
-                lock_basic_lock(&zone->stats->stats_lock);
-                zone->stats->sig_time = (end-start);
-                lock_basic_unlock(&zone->stats->stats_lock);
-            }
+            do {
+                /* start timer */
+                start = time(NULL);
+                /* queue menial, hard signing work */
+                more = worker_queue_zone(worker, engine->signq, zone,
+                    WORKER_SIGN_CHUNK);
+                ods_log_deeebug("[%s[%i]] wait until drudgers are finished "
+                    "signing zone %s", worker2str(worker->type),
+                    worker->thread_num, task_who2str(task));
+                /* sleep until work is done */
+                worker_sleep_unless(worker, 0);
+                /* stop timer */
+                end = time(NULL);
+                status = worker_check_jobs(worker, task);
+                task->cost += worker->jobs_appointed;
+                worker_clear_jobs(worker);
+                if (status == ODS_STATUS_OK && zone->stats) {
+                    lock_basic_lock(&zone->stats->stats_lock);
+                    zone->stats->sig_time += (end-start);
+                    lock_basic_unlock(&zone->stats->stats_lock);
+                }
+                /* give other zones a turn, continue when it is ours */
+            } while (status == ODS_STATUS_OK && more &&
+                !worker_others_waiting(worker));
             if (status != ODS_STATUS_OK) {
+                worker_sign_restart(zone);
                 if (task->halted == TASK_NONE) {
                     goto task_perform_fail;
                 }
                 goto task_perform_continue;
-            } else {
-                if (task->interrupt > TASK_SIGNCONF) {
-                    task->interrupt = TASK_NONE;
-                    task->halted = TASK_NONE;
+            }
+            if (more) {
+                ods_log_verbose("[%s[%i]] yield signing zone %s, %u RRsets "
+                    "signed so far", worker2str(worker->type),
+                    worker->thread_num, task_who2str(task),
+                    (unsigned) task->cost);
+                task->large = 1;
+                what = TASK_SIGN;
+                when = time_now();
+                break;
+            }
+            if (task->interrupt > TASK_SIGNCONF) {
+                task->interrupt = TASK_NONE;
+                task->halted = TASK_NONE;
+            }
+            /* estimate the work and the deadline for next time */
+            task->large = (task->cost > WORKER_SIGN_CHUNK);
+            if (zone->stats) {
+                lock_basic_lock(&zone->stats->stats_lock);
+                if (zone->stats->sig_time >= WORKER_LARGE_SIGN_TIME) {
+                    task->large = 1;
                 }
+                task->deadline = (time_t) zone->stats->sig_expiration;
+                lock_basic_unlock(&zone->stats->stats_lock);
             }
             /* break; */
         case TASK_WRITE:
@@ -515,7 +651,10 @@ worker_perform_task(worker_type* worker)
     }
     /* backup the last successful run */
     if (backup) {
+        worker_phase_done(worker);
+        usec = metrics_usec();
         status = zone_backup2(zone);
+        metrics_phase_time(METRICS_PHASE_BACKUP, metrics_usec() - usec);
         if (status != ODS_STATUS_OK) {
             ods_log_warning("[%s[%i]] unable to backup zone %s: %s",
             worker2str(worker->type), worker->thread_num,
@@ -544,6 +683,19 @@ task_perform_fail:
     if (task->backoff > ODS_SE_MAX_BACKOFF) {
         task->backoff = ODS_SE_MAX_BACKOFF;
     }
+    if (task->deadline) {
+        /* retry a few times before the signatures expire */
+        cap = (task->deadline - time_now()) / 4;
+        if (cap < 60) {
+            cap = 60;
+        }
+        if (task->backoff > cap) {
+            ods_log_warning("[%s[%i]] signatures of zone %s expire in %ld "
+                "seconds", worker2str(worker->type), worker->thread_num,
+                task_who2str(task), (long) (task->deadline - time_now()));
+            task->backoff = cap;
+        }
+    }
     ods_log_info("[%s[%i]] backoff task %s for zone %s with %u seconds",
         worker2str(worker->type), worker->thread_num,
         task_what2str(task->what), task_who2str(task), task->backoff);
@@ -596,11 +748,18 @@ worker_work(worker_type* worker)
                 worker2str(worker->type), worker->thread_num, zone->name);
             worker->clock_in = time(NULL);
             worker_perform_task(worker);
-            zone->task = worker->task;
+            worker_phase_done(worker);
             ods_log_debug("[%s[%i]] finished working on zone %s",
                 worker2str(worker->type), worker->thread_num, zone->name);
 
             lock_basic_lock(&engine->taskq->schedule_lock);
+            schedule_finish_task(engine->taskq, worker->task);
+            if (worker->task->pending != TASK_NONE) {
+                /* handed off while we were working, e.g. by xfrd */
+                task_interrupt(worker->task, worker->task->pending);
+                worker->task->pending = TASK_NONE;
+            }
+            zone->task = worker->task;
             worker->task = NULL;
             worker->working_with = TASK_NONE;
             status = schedule_task(engine->taskq, zone->task, 1);
@@ -611,7 +770,6 @@ worker_work(worker_type* worker)
             }
             lock_basic_unlock(&engine->taskq->schedule_lock);
             lock_basic_unlock(&zone->zone_lock);
-            timeout = 1;
             /** Do we need to tell the engine that we require a reload? */
             lock_basic_lock(&engine->signal_lock);
             if (engine->need_to_reload) {
@@ -622,18 +780,17 @@ worker_work(worker_type* worker)
         } else {
             ods_log_debug("[%s[%i]] nothing to do", worker2str(worker->type),
                 worker->thread_num);
-            worker->task = schedule_get_first_task(engine->taskq);
-            lock_basic_unlock(&engine->taskq->schedule_lock);
-            if (worker->task && !engine->taskq->loading) {
-                timeout = (worker->task->when - now);
-            } else {
-                timeout *= 2;
-            }
-            if (timeout > ODS_SE_MAX_BACKOFF) {
-                timeout = ODS_SE_MAX_BACKOFF;
+            /**
+             * Sleep until the first task is due. Scheduling a task that
+             * is due sooner wakes us up, so without tasks there is no
+             * alarm clock at all.
+             */
+            timeout = schedule_timeout(engine->taskq, now);
+            if (!worker->need_to_exit) {
+                lock_basic_sleep(&engine->taskq->schedule_cond,
+                    &engine->taskq->schedule_lock, timeout);
             }
-            worker->task = NULL;
-            worker_sleep(worker, timeout);
+            lock_basic_unlock(&engine->taskq->schedule_lock);
         }
     }
     return;
@@ -654,6 +811,7 @@ worker_drudge(worker_type* worker)
     ods_status status = ODS_STATUS_OK;
     worker_type* superior = NULL;
     hsm_ctx_t* ctx = NULL;
+    uint64_t busy = 0;
 
     ods_log_assert(worker);
     ods_log_assert(worker->engine);
@@ -710,7 +868,9 @@ worker_drudge(worker_type* worker)
                 ods_log_assert(zone->apex);
                 ods_log_assert(zone->signconf);
                 worker->clock_in = time(NULL);
+                busy = metrics_usec();
                 status = rrset_sign(ctx, rrset, superior->clock_in);
+                metrics_drudger_busy(metrics_usec() - busy);
                 lock_basic_lock(&superior->worker_lock);
                 if (status == ODS_STATUS_OK) {
                     superior->jobs_completed++;
@@ -40,6 +40,11 @@
 
 #include <time.h>
 
+/* RRsets queued for signing before other zones get a turn */
+#define WORKER_SIGN_CHUNK 10000
+/* zones that take longer to sign are large, like zones of more chunks */
+#define WORKER_LARGE_SIGN_TIME 60
+
 enum worker_enum {
     WORKER_NONE = 0,
     WORKER_WORKER = 1,
@@ -57,6 +62,7 @@ struct worker_struct {
     task_id working_with;
     worker_id type;
     time_t clock_in;
+    uint64_t phase_start;
     size_t jobs_appointed;
     size_t jobs_completed;
     size_t jobs_failed;
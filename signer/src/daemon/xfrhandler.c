@@ -51,7 +51,8 @@ static void xfrhandler_handle_dns(netio_type* netio,
  *
  */
 xfrhandler_type*
-xfrhandler_create(allocator_type* allocator)
+xfrhandler_create(allocator_type* allocator, size_t num,
+    size_t max_per_master)
 {
     xfrhandler_type* xfrh = NULL;
     if (!allocator) {
@@ -65,7 +66,9 @@ xfrhandler_create(allocator_type* allocator)
         return NULL;
     }
     xfrh->allocator = allocator;
+    lock_basic_init(&xfrh->tcp_lock);
     xfrh->engine = NULL;
+    xfrh->num = num;
     xfrh->packet = NULL;
     xfrh->netio = NULL;
     xfrh->tcp_set = NULL;
@@ -81,6 +84,7 @@ xfrhandler_create(allocator_type* allocator)
     xfrh->notify_waiting_first = NULL;
     xfrh->notify_waiting_last = NULL;
     xfrh->notify_udp_num = 0;
+    xfrh->notify_queue = NULL;
     /* setup */
     xfrh->netio = netio_create(allocator);
     if (!xfrh->netio) {
@@ -96,6 +100,13 @@ xfrhandler_create(allocator_type* allocator)
         xfrhandler_cleanup(xfrh);
         return NULL;
     }
+    xfrh->notify_queue = notify_queue_create(allocator, (void*) xfrh);
+    if (!xfrh->notify_queue) {
+        ods_log_error("[%s] unable to create xfrhandler: "
+            "notify_queue_create() failed", xfrh_str);
+        xfrhandler_cleanup(xfrh);
+        return NULL;
+    }
     xfrh->tcp_set = tcp_set_create(allocator);
     if (!xfrh->tcp_set) {
         ods_log_error("[%s] unable to create xfrhandler: "
@@ -103,11 +114,16 @@ xfrhandler_create(allocator_type* allocator)
         xfrhandler_cleanup(xfrh);
         return NULL;
     }
+    if (max_per_master > 0 && max_per_master < TCPSET_MAX) {
+        xfrh->tcp_set->max_per_master = max_per_master;
+    }
+    xfrh->fwd_fd = -1;
     xfrh->dnshandler.fd = -1;
     xfrh->dnshandler.user_data = (void*) xfrh;
     xfrh->dnshandler.timeout = 0;
     xfrh->dnshandler.event_types = NETIO_EVENT_READ;
     xfrh->dnshandler.event_handler = xfrhandler_handle_dns;
+    xfrh->dnshandler.node = NULL;
     return xfrh;
 }
 
@@ -121,7 +137,8 @@ xfrhandler_start(xfrhandler_type* xfrhandler)
 {
     ods_log_assert(xfrhandler);
     ods_log_assert(xfrhandler->engine);
-    ods_log_debug("[%s] start", xfrh_str);
+    ods_log_debug("[%s] start thread %u", xfrh_str,
+        (unsigned) xfrhandler->num);
     /* setup */
     xfrhandler->start_time = time_now();
     /* handlers */
@@ -137,6 +154,8 @@ xfrhandler_start(xfrhandler_type* xfrhandler)
                     strerror(errno));
             }
         }
+        /* send the notifies of this round in one batch */
+        notify_queue_flush(xfrhandler->notify_queue);
     }
     /* shutdown */
     ods_log_debug("[%s] shutdown", xfrh_str);
@@ -182,6 +201,30 @@ xfrhandler_signal(xfrhandler_type* xfrhandler)
 }
 
 
+/**
+ * Forward notify to zone transfer handler.
+ *
+ */
+void
+xfrhandler_fwd_notify(xfrhandler_type* xfrhandler, uint8_t* pkt, size_t len)
+{
+    ssize_t nb = 0;
+    ods_log_assert(xfrhandler);
+    ods_log_assert(pkt);
+    if (xfrhandler->fwd_fd == -1) {
+        return;
+    }
+    nb = send(xfrhandler->fwd_fd, (const void*) pkt, len, 0);
+    if (nb < 0) {
+        ods_log_error("[%s] unable to forward notify: send() failed (%s)",
+            xfrh_str, strerror(errno));
+    } else {
+        ods_log_debug("[%s] forwarded notify: %u bytes sent", xfrh_str, nb);
+    }
+    return;
+}
+
+
 /**
  * Handle forwarded dns packets.
  *
@@ -222,7 +265,9 @@ xfrhandler_cleanup(xfrhandler_type* xfrhandler)
     allocator = xfrhandler->allocator;
     netio_cleanup(xfrhandler->netio);
     buffer_cleanup(xfrhandler->packet, allocator);
+    notify_queue_cleanup(xfrhandler->notify_queue);
     tcp_set_cleanup(xfrhandler->tcp_set, allocator);
+    lock_basic_destroy(&xfrhandler->tcp_lock);
     allocator_deallocate(allocator, (void*) xfrhandler);
     return;
 }
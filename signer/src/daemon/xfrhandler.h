@@ -53,12 +53,14 @@ struct xfrhandler_struct {
     /* Engine reference */
     ods_thread_type thread_id;
     void* engine;
+    size_t num;
     /* Start time */
     time_t start_time;
     time_t current_time;
     /* Network support */
     netio_type* netio;
     tcp_set_type* tcp_set;
+    lock_basic_type tcp_lock; /* zone dispatch vs. zone removal */
     buffer_type* packet;
     xfrd_type* udp_waiting_first;
     xfrd_type* udp_waiting_last;
@@ -66,7 +68,9 @@ struct xfrhandler_struct {
     notify_type* notify_waiting_first;
     notify_type* notify_waiting_last;
     int notify_udp_num;
+    notify_queue_type* notify_queue;
     netio_handler_type dnshandler;
+    int fwd_fd; /* other end of the dnshandler socket pair */
     unsigned got_time : 1;
     unsigned need_to_exit : 1;
     unsigned started : 1;
@@ -75,10 +79,13 @@ struct xfrhandler_struct {
 /**
  * Create zone transfer handler.
  * \param[in] allocator memory allocator
+ * \param[in] num zone transfer handler number
+ * \param[in] max_per_master maximum number of tcp connections per master
  * \return xfrhandler_type* created zoned transfer handler
  *
  */
-xfrhandler_type* xfrhandler_create(allocator_type* allocator);
+xfrhandler_type* xfrhandler_create(allocator_type* allocator, size_t num,
+    size_t max_per_master);
 
 /**
  * Start zone transfer handler.
@@ -102,6 +109,17 @@ time_t xfrhandler_time(xfrhandler_type* xfrhandler);
  */
 void xfrhandler_signal(xfrhandler_type* xfrhandler);
 
+/**
+ * Forward notify to zone transfer handler, so that it wakes up and
+ * picks up the changed zone transfer and notify timers.
+ * \param[in] xfrhandler_type* zone transfer handler
+ * \param[in] pkt notify packet
+ * \param[in] len packet length
+ *
+ */
+void xfrhandler_fwd_notify(xfrhandler_type* xfrhandler, uint8_t* pkt,
+    size_t len);
+
 /**
  * Cleanup zone transfer handler.
  * \param[in] xfrhandler_type* zone transfer handler
@@ -0,0 +1,448 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * DNS handler load generator.
+ *
+ * Sends SOA queries over UDP and concurrent AXFR requests over TCP to a
+ * running signer, and reports the SOA query rate and the zone transfer
+ * throughput. Run it against signers with a different number of
+ * <ListenerThreads> to see how query and transfer serving scale.
+ *
+ */
+
+#include "config.h"
+#include "shared/allocator.h"
+#include "shared/locks.h"
+#include "shared/log.h"
+#include "wire/buffer.h"
+
+#include <errno.h>
+#include <ldns/ldns.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define DNSLOAD_POLL_MS 100
+
+extern char *optarg;
+extern int optind;
+char *progname = NULL;
+
+static volatile int dnsload_stop = 0;
+
+/**
+ * Load generator settings.
+ *
+ */
+typedef struct dnsload_conf_struct dnsload_conf_type;
+struct dnsload_conf_struct {
+    struct addrinfo* udp_addr;
+    struct addrinfo* tcp_addr;
+    ldns_rdf* zone;
+    unsigned int window;
+};
+
+/**
+ * Load generator thread.
+ *
+ */
+typedef struct dnsload_struct dnsload_type;
+struct dnsload_struct {
+    dnsload_conf_type* conf;
+    ods_thread_type thread_id;
+    allocator_type* allocator;
+    buffer_type* buffer;
+    size_t sent;
+    size_t received;
+    size_t transfers;
+    size_t failed;
+    size_t messages;
+    size_t rrs;
+    size_t bytes;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: %s [-s server] [-p port] [-q udp threads] [-w window] "
+        "[-a axfr connections] [-t seconds] zone\n", progname);
+}
+
+
+static double
+dnsload_now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+
+/**
+ * Send SOA queries over UDP, keeping a window of queries outstanding.
+ *
+ */
+static void*
+dnsload_udp(void* arg)
+{
+    dnsload_type* load = (dnsload_type*) arg;
+    dnsload_conf_type* conf = load->conf;
+    uint8_t pkt[MAX_PACKET_SIZE];
+    struct pollfd pfd;
+    unsigned int outstanding = 0;
+    ssize_t nb = 0;
+    int s = -1;
+
+    s = socket(conf->udp_addr->ai_family, SOCK_DGRAM, 0);
+    if (s == -1 || connect(s, conf->udp_addr->ai_addr,
+        conf->udp_addr->ai_addrlen) != 0) {
+        fprintf(stderr, "%s: udp socket failed: %s\n", progname,
+            strerror(errno));
+        if (s != -1) {
+            close(s);
+        }
+        load->failed++;
+        return NULL;
+    }
+    buffer_pkt_query(load->buffer, conf->zone, LDNS_RR_TYPE_SOA,
+        LDNS_RR_CLASS_IN);
+    buffer_flip(load->buffer);
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    while (!dnsload_stop) {
+        while (outstanding < conf->window) {
+            buffer_pkt_set_random_id(load->buffer);
+            if (send(s, buffer_begin(load->buffer),
+                buffer_remaining(load->buffer), 0) == -1) {
+                break;
+            }
+            load->sent++;
+            outstanding++;
+        }
+        if (poll(&pfd, 1, DNSLOAD_POLL_MS) <= 0) {
+            /* assume the outstanding queries are lost */
+            outstanding = 0;
+            continue;
+        }
+        while ((nb = recv(s, pkt, sizeof(pkt), MSG_DONTWAIT)) > 0) {
+            load->received++;
+            load->bytes += nb;
+            if (outstanding > 0) {
+                outstanding--;
+            }
+        }
+    }
+    close(s);
+    return NULL;
+}
+
+
+/**
+ * Read exactly len bytes from a tcp connection.
+ *
+ */
+static int
+dnsload_read(int s, uint8_t* data, size_t len)
+{
+    ssize_t nb = 0;
+    size_t done = 0;
+    while (done < len) {
+        nb = read(s, data + done, len - done);
+        if (nb <= 0) {
+            if (nb == -1 && errno == EINTR) {
+                continue;
+            }
+            return 0;
+        }
+        done += nb;
+    }
+    return 1;
+}
+
+
+/**
+ * Count the SOA RRs in the answer section of a transfer message.
+ *
+ */
+static int
+dnsload_axfr_soas(buffer_type* buffer, size_t* rrs)
+{
+    uint16_t ancount = 0;
+    uint16_t i = 0;
+    int soas = 0;
+    if (buffer_limit(buffer) < BUFFER_PKT_HEADER_SIZE ||
+        buffer_pkt_rcode(buffer) != LDNS_RCODE_NOERROR) {
+        return -1;
+    }
+    ancount = buffer_pkt_ancount(buffer);
+    buffer_set_position(buffer, BUFFER_PKT_HEADER_SIZE);
+    for (i=0; i < buffer_pkt_qdcount(buffer); i++) {
+        if (!buffer_skip_rr(buffer, 1)) {
+            return -1;
+        }
+    }
+    for (i=0; i < ancount; i++) {
+        if (!buffer_skip_dname(buffer) || !buffer_available(buffer, 10)) {
+            return -1;
+        }
+        if (buffer_read_u16(buffer) == LDNS_RR_TYPE_SOA) {
+            soas++;
+        }
+        buffer_skip(buffer, 6);
+        if (!buffer_available(buffer, 2)) {
+            return -1;
+        }
+        buffer_skip(buffer, buffer_read_u16(buffer));
+        if (buffer_position(buffer) > buffer_limit(buffer)) {
+            return -1;
+        }
+    }
+    *rrs += ancount;
+    return soas;
+}
+
+
+/**
+ * Transfer the zone over and over again, one connection per transfer.
+ *
+ */
+static void*
+dnsload_axfr(void* arg)
+{
+    dnsload_type* load = (dnsload_type*) arg;
+    dnsload_conf_type* conf = load->conf;
+    uint8_t query[MAX_PACKET_SIZE];
+    uint8_t lenbuf[2];
+    uint16_t qlen = 0;
+    uint16_t len = 0;
+    int soas = 0;
+    int n = 0;
+    int s = -1;
+
+    buffer_pkt_axfr(load->buffer, conf->zone, LDNS_RR_CLASS_IN);
+    buffer_flip(load->buffer);
+    qlen = (uint16_t) buffer_remaining(load->buffer);
+    write_uint16(query, qlen);
+    memcpy(query + 2, buffer_begin(load->buffer), qlen);
+    while (!dnsload_stop) {
+        s = socket(conf->tcp_addr->ai_family, SOCK_STREAM, 0);
+        if (s == -1 || connect(s, conf->tcp_addr->ai_addr,
+            conf->tcp_addr->ai_addrlen) != 0 ||
+            write(s, query, qlen + 2) != (ssize_t) (qlen + 2)) {
+            goto failed;
+        }
+        soas = 0;
+        while (soas < 2 && !dnsload_stop) {
+            if (!dnsload_read(s, lenbuf, 2)) {
+                goto failed;
+            }
+            len = read_uint16(lenbuf);
+            buffer_clear(load->buffer);
+            if (len > buffer_capacity(load->buffer) ||
+                !dnsload_read(s, buffer_begin(load->buffer), len)) {
+                goto failed;
+            }
+            buffer_set_limit(load->buffer, len);
+            n = dnsload_axfr_soas(load->buffer, &load->rrs);
+            if (n < 0) {
+                goto failed;
+            }
+            soas += n;
+            load->messages++;
+            load->bytes += len + 2;
+        }
+        if (soas >= 2) {
+            load->transfers++;
+        }
+        close(s);
+        continue;
+failed:
+        if (!dnsload_stop) {
+            load->failed++;
+            /* do not spin on a refused connection */
+            usleep(DNSLOAD_POLL_MS * 1000);
+        }
+        if (s != -1) {
+            close(s);
+        }
+    }
+    return NULL;
+}
+
+
+static struct addrinfo*
+dnsload_addr(const char* server, const char* port, int socktype)
+{
+    struct addrinfo hints;
+    struct addrinfo* addr = NULL;
+    int r = 0;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = socktype;
+    r = getaddrinfo(server, port, &hints, &addr);
+    if (r != 0) {
+        fprintf(stderr, "%s: unable to resolve %s port %s: %s\n", progname,
+            server, port, gai_strerror(r));
+        return NULL;
+    }
+    return addr;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    int ch = 0;
+    const char* server = "127.0.0.1";
+    const char* port = "53";
+    unsigned int udp_threads = 4;
+    unsigned int axfr_threads = 2;
+    unsigned int seconds = 10;
+    unsigned int i = 0;
+    dnsload_conf_type conf;
+    dnsload_type* loads = NULL;
+    dnsload_type total;
+    allocator_type* allocator = NULL;
+    double start = 0.0;
+    double elapsed = 0.0;
+
+    progname = argv[0];
+    memset(&conf, 0, sizeof(conf));
+    conf.window = 16;
+    while ((ch = getopt(argc, argv, "a:p:q:s:t:w:h")) != -1) {
+        switch (ch) {
+        case 'a':
+            axfr_threads = atoi(optarg);
+            break;
+        case 'p':
+            port = optarg;
+            break;
+        case 'q':
+            udp_threads = atoi(optarg);
+            break;
+        case 's':
+            server = optarg;
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'w':
+            conf.window = atoi(optarg);
+            break;
+        case 'h':
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 1 || seconds == 0 || conf.window == 0 ||
+        udp_threads + axfr_threads == 0) {
+        usage();
+        exit(1);
+    }
+    ods_log_init(NULL, 0, 0);
+    conf.zone = ldns_dname_new_frm_str(argv[0]);
+    conf.udp_addr = dnsload_addr(server, port, SOCK_DGRAM);
+    conf.tcp_addr = dnsload_addr(server, port, SOCK_STREAM);
+    if (!conf.zone || !conf.udp_addr || !conf.tcp_addr) {
+        exit(1);
+    }
+    allocator = allocator_create(malloc, free);
+    loads = (dnsload_type*) calloc(udp_threads + axfr_threads,
+        sizeof(dnsload_type));
+    if (!allocator || !loads) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        exit(1);
+    }
+    fprintf(stdout, "Loading %s port %s for %u seconds: %u udp threads "
+        "(window %u), %u axfr connections, zone %s\n", server, port,
+        seconds, udp_threads, conf.window, axfr_threads, argv[0]);
+    start = dnsload_now();
+    for (i=0; i < udp_threads + axfr_threads; i++) {
+        loads[i].conf = &conf;
+        loads[i].allocator = allocator;
+        loads[i].buffer = buffer_create(allocator, PACKET_BUFFER_SIZE);
+        if (!loads[i].buffer) {
+            fprintf(stderr, "%s: out of memory\n", progname);
+            exit(1);
+        }
+        ods_thread_create(&loads[i].thread_id,
+            i < udp_threads ? dnsload_udp : dnsload_axfr, &loads[i]);
+    }
+    sleep(seconds);
+    dnsload_stop = 1;
+    memset(&total, 0, sizeof(total));
+    for (i=0; i < udp_threads + axfr_threads; i++) {
+        ods_thread_join(loads[i].thread_id);
+        if (i == udp_threads && udp_threads > 0) {
+            elapsed = dnsload_now() - start;
+            fprintf(stdout, "soa:  %lu sent %lu received %.0f qps "
+                "%lu errors\n", (unsigned long) total.sent,
+                (unsigned long) total.received,
+                total.received / elapsed, (unsigned long) total.failed);
+            memset(&total, 0, sizeof(total));
+        }
+        total.sent += loads[i].sent;
+        total.received += loads[i].received;
+        total.transfers += loads[i].transfers;
+        total.failed += loads[i].failed;
+        total.messages += loads[i].messages;
+        total.rrs += loads[i].rrs;
+        total.bytes += loads[i].bytes;
+        buffer_cleanup(loads[i].buffer, allocator);
+    }
+    elapsed = dnsload_now() - start;
+    if (axfr_threads == 0) {
+        fprintf(stdout, "soa:  %lu sent %lu received %.0f qps "
+            "%lu errors\n", (unsigned long) total.sent,
+            (unsigned long) total.received, total.received / elapsed,
+            (unsigned long) total.failed);
+    } else {
+        fprintf(stdout, "axfr: %lu transfers %.1f/s %lu messages "
+            "%.0f rrs/s %.2f MB/s %lu errors\n",
+            (unsigned long) total.transfers, total.transfers / elapsed,
+            (unsigned long) total.messages, total.rrs / elapsed,
+            total.bytes / elapsed / (1024*1024),
+            (unsigned long) total.failed);
+    }
+    free(loads);
+    allocator_cleanup(allocator);
+    freeaddrinfo(conf.udp_addr);
+    freeaddrinfo(conf.tcp_addr);
+    ldns_rdf_deep_free(conf.zone);
+    return 0;
+}
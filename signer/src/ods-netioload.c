@@ -0,0 +1,309 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Network I/O load test.
+ *
+ * Simulates the zone transfer handler of a signer with many zones: every
+ * zone has a handler with a refresh timer, and a number of handlers wait
+ * for data on a pipe, like the sockets of zone transfers in progress.
+ * Reports how late the timers fire and how much CPU time the dispatch
+ * takes.
+ *
+ */
+
+#include "config.h"
+#include "shared/allocator.h"
+#include "shared/log.h"
+#include "wire/netio.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char *optarg;
+extern int optind;
+char *progname = NULL;
+
+/**
+ * Load test state.
+ *
+ */
+typedef struct netioload_struct netioload_type;
+struct netioload_struct {
+    long refresh; /* refresh interval in milliseconds */
+    int* pipes; /* write ends */
+    size_t pipe_count;
+    size_t timers;
+    size_t reads;
+    double lateness;
+    double max_lateness;
+};
+
+/**
+ * Simulated zone.
+ *
+ */
+typedef struct netioload_zone_struct netioload_zone_type;
+struct netioload_zone_struct {
+    netioload_type* load;
+    netio_handler_type handler;
+    struct timespec timeout;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: %s [-s] [-n zones] [-p pipes] [-r refresh] [-t seconds]\n"
+        "\t-s\tuse the select backend\n"
+        "\t-n\tnumber of zones with a refresh timer (default 20000)\n"
+        "\t-p\tnumber of handlers waiting for data (default 64)\n"
+        "\t-r\trefresh interval in milliseconds (default 1000)\n"
+        "\t-t\tduration of the test in seconds (default 10)\n", progname);
+}
+
+
+/**
+ * Set timer to a random moment within the refresh interval.
+ *
+ */
+static void
+netioload_set_timer(netio_type* netio, netioload_zone_type* zone)
+{
+    struct timespec delta;
+    long msec = random() % (zone->load->refresh + 1);
+    delta.tv_sec = msec / 1000;
+    delta.tv_nsec = (msec % 1000) * 1000000L;
+    zone->timeout = *netio_current_time(netio);
+    timespec_add(&zone->timeout, &delta);
+    zone->handler.timeout = &zone->timeout;
+}
+
+
+/**
+ * Refresh timer expired.
+ *
+ */
+static void
+netioload_handle_zone(netio_type* netio, netio_handler_type* handler,
+    netio_events_type event_types)
+{
+    netioload_zone_type* zone = (netioload_zone_type*) handler->user_data;
+    netioload_type* load = zone->load;
+    const struct timespec* now = netio_current_time(netio);
+    double late = (now->tv_sec - zone->timeout.tv_sec) +
+        (now->tv_nsec - zone->timeout.tv_nsec) / 1000000000.0;
+    char c = 0;
+
+    if (!(event_types & NETIO_EVENT_TIMEOUT)) {
+        return;
+    }
+    load->timers++;
+    load->lateness += late;
+    if (late > load->max_lateness) {
+        load->max_lateness = late;
+    }
+    /* some refreshes lead to a transfer */
+    if (load->pipe_count && (load->timers % 16) == 0) {
+        if (write(load->pipes[random() % load->pipe_count], &c, 1) == -1) {
+            fprintf(stderr, "%s: write failed: %s\n", progname,
+                strerror(errno));
+        }
+    }
+    netioload_set_timer(netio, zone);
+}
+
+
+/**
+ * Data available.
+ *
+ */
+static void
+netioload_handle_pipe(netio_type* ATTR_UNUSED(netio),
+    netio_handler_type* handler, netio_events_type event_types)
+{
+    netioload_type* load = (netioload_type*) handler->user_data;
+    char buf[64];
+    if (event_types & NETIO_EVENT_READ) {
+        if (read(handler->fd, buf, sizeof(buf)) > 0) {
+            load->reads++;
+        }
+    }
+}
+
+
+static double
+netioload_cputime(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+        (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    int ch = 0;
+    int use_select = 0;
+    size_t i = 0;
+    size_t zones = 20000;
+    size_t dispatches = 0;
+    int seconds = 10;
+    time_t end = 0;
+    double cpu = 0.0;
+    int fds[2];
+    allocator_type* allocator = NULL;
+    netio_type* netio = NULL;
+    netioload_type load;
+    netioload_zone_type* zone = NULL;
+    netio_handler_type* pipe_handler = NULL;
+
+    progname = argv[0];
+    memset(&load, 0, sizeof(load));
+    load.refresh = 1000;
+    load.pipe_count = 64;
+    while ((ch = getopt(argc, argv, "n:p:r:st:h")) != -1) {
+        switch (ch) {
+        case 'n':
+            zones = (size_t) atol(optarg);
+            break;
+        case 'p':
+            load.pipe_count = (size_t) atol(optarg);
+            break;
+        case 'r':
+            load.refresh = atol(optarg);
+            break;
+        case 's':
+            use_select = 1;
+            break;
+        case 't':
+            seconds = atoi(optarg);
+            break;
+        case 'h':
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 0 || load.refresh <= 0 || seconds <= 0) {
+        usage();
+        exit(1);
+    }
+    ods_log_init(NULL, 0, 0);
+
+    allocator = allocator_create(malloc, free);
+    netio = allocator ? netio_create(allocator) : NULL;
+    zone = (netioload_zone_type*) calloc(zones ? zones : 1,
+        sizeof(netioload_zone_type));
+    load.pipes = (int*) calloc(load.pipe_count + 1, sizeof(int));
+    pipe_handler = (netio_handler_type*) calloc(load.pipe_count + 1,
+        sizeof(netio_handler_type));
+    if (!netio || !zone || !load.pipes || !pipe_handler) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        exit(1);
+    }
+    if (use_select) {
+        netio->backend = NETIO_BACKEND_SELECT;
+    }
+    srandom(1);
+    for (i = 0; i < zones; i++) {
+        zone[i].load = &load;
+        zone[i].handler.fd = -1;
+        zone[i].handler.user_data = &zone[i];
+        zone[i].handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+        zone[i].handler.event_handler = netioload_handle_zone;
+        zone[i].handler.node = NULL;
+        netioload_set_timer(netio, &zone[i]);
+        netio_add_handler(netio, &zone[i].handler);
+    }
+    for (i = 0; i < load.pipe_count; i++) {
+        if (pipe(fds) == -1) {
+            fprintf(stderr, "%s: pipe failed: %s\n", progname,
+                strerror(errno));
+            exit(1);
+        }
+        load.pipes[i] = fds[1];
+        pipe_handler[i].fd = fds[0];
+        pipe_handler[i].timeout = NULL;
+        pipe_handler[i].user_data = &load;
+        pipe_handler[i].event_types = NETIO_EVENT_READ;
+        pipe_handler[i].event_handler = netioload_handle_pipe;
+        pipe_handler[i].node = NULL;
+        netio_add_handler(netio, &pipe_handler[i]);
+    }
+
+    fprintf(stdout, "%s backend, %lu zones, %lu pipes, refresh %ld ms, "
+        "%d seconds\n", netio->backend == NETIO_BACKEND_EPOLL ? "epoll" :
+        "select", (unsigned long) zones, (unsigned long) load.pipe_count,
+        load.refresh, seconds);
+    cpu = netioload_cputime();
+    end = time(NULL) + seconds;
+    while (time(NULL) < end) {
+        if (netio_dispatch(netio, NULL, NULL) == -1 && errno != EINTR) {
+            fprintf(stderr, "%s: dispatch failed: %s\n", progname,
+                strerror(errno));
+            break;
+        }
+        dispatches++;
+    }
+    cpu = netioload_cputime() - cpu;
+
+    fprintf(stdout, "%lu timers, %lu reads, %lu dispatches\n",
+        (unsigned long) load.timers, (unsigned long) load.reads,
+        (unsigned long) dispatches);
+    fprintf(stdout, "lateness avg %.3f ms, max %.3f ms\n",
+        load.timers ? load.lateness / load.timers * 1000.0 : 0.0,
+        load.max_lateness * 1000.0);
+    fprintf(stdout, "cpu %.2f s, %.2f us per timer\n", cpu,
+        load.timers ? cpu / load.timers * 1000000.0 : 0.0);
+
+    for (i = 0; i < zones; i++) {
+        netio_remove_handler(netio, &zone[i].handler);
+    }
+    for (i = 0; i < load.pipe_count; i++) {
+        netio_remove_handler(netio, &pipe_handler[i]);
+        close(pipe_handler[i].fd);
+        close(load.pipes[i]);
+    }
+    netio_cleanup(netio);
+    allocator_cleanup(allocator);
+    free(zone);
+    free(load.pipes);
+    free(pipe_handler);
+    return 0;
+}
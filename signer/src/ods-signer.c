@@ -354,7 +354,7 @@ main(int argc, char* argv[])
         exit(1);
     }
 
-    if (argc > 3) {
+    if (argc > 4) {
         fprintf(stderr,"error, too many arguments\n");
         exit(1);
     }
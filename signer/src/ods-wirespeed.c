@@ -0,0 +1,232 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Zone transfer encoding benchmark.
+ *
+ * Encodes a zone file into AXFR messages the way the signer engine does,
+ * once without and once with name compression, and reports the number of
+ * bytes on the wire and the encode rate.
+ *
+ */
+
+#include "config.h"
+#include "shared/allocator.h"
+#include "shared/log.h"
+#include "wire/buffer.h"
+#include "wire/compress.h"
+
+#include <ldns/ldns.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+extern char *optarg;
+extern int optind;
+char *progname = NULL;
+
+/**
+ * Encoding results.
+ *
+ */
+typedef struct wirespeed_struct wirespeed_type;
+struct wirespeed_struct {
+    size_t messages;
+    size_t rrs;
+    size_t bytes;
+    double elapsed;
+};
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+        "usage: %s [-i iterations] [-o origin] zonefile\n", progname);
+}
+
+
+/**
+ * Encode all RRs of the zone into AXFR messages.
+ *
+ */
+static int
+wirespeed_encode(buffer_type* buffer, compress_type* table, ldns_rdf* apex,
+    ldns_rr_list* rrs, unsigned int iterations, wirespeed_type* result)
+{
+    struct timeval start, end;
+    unsigned int iter = 0;
+    size_t i = 0;
+    uint16_t count = 0;
+
+    memset(result, 0, sizeof(wirespeed_type));
+    gettimeofday(&start, NULL);
+    for (iter = 0; iter < iterations; iter++) {
+        i = 0;
+        while (i < ldns_rr_list_rr_count(rrs)) {
+            buffer_pkt_axfr(buffer, apex, LDNS_RR_CLASS_IN);
+            buffer_set_limit(buffer, MAX_COMPRESSION_OFFSET);
+            compress_clear(table);
+            compress_add_dname(table, buffer, BUFFER_PKT_HEADER_SIZE);
+            count = 0;
+            while (i < ldns_rr_list_rr_count(rrs) &&
+                compress_write_rr(table, buffer, ldns_rr_list_rr(rrs, i))) {
+                count++;
+                i++;
+            }
+            if (count == 0) {
+                fprintf(stderr, "%s: rr does not fit in empty message\n",
+                    progname);
+                return 1;
+            }
+            buffer_pkt_set_ancount(buffer, count);
+            result->messages++;
+            result->rrs += count;
+            result->bytes += buffer_position(buffer);
+        }
+    }
+    gettimeofday(&end, NULL);
+    result->elapsed = (end.tv_sec - start.tv_sec) +
+        (end.tv_usec - start.tv_usec) / 1000000.0;
+    return 0;
+}
+
+
+static void
+wirespeed_print(const char* mode, wirespeed_type* result,
+    unsigned int iterations)
+{
+    fprintf(stdout, "%-12s %8lu messages %12lu bytes %10.0f rrs/s "
+        "%8.2f MB/s\n", mode,
+        (unsigned long) (result->messages / iterations),
+        (unsigned long) (result->bytes / iterations),
+        result->elapsed > 0 ? result->rrs / result->elapsed : 0.0,
+        result->elapsed > 0 ?
+        result->bytes / result->elapsed / (1024*1024) : 0.0);
+}
+
+
+int
+main(int argc, char *argv[])
+{
+    int ch = 0;
+    int result = 0;
+    unsigned int iterations = 10;
+    char* origin = NULL;
+    FILE* fd = NULL;
+    ldns_status status = LDNS_STATUS_OK;
+    ldns_zone* zone = NULL;
+    ldns_rdf* apex = NULL;
+    ldns_rr_list* rrs = NULL;
+    allocator_type* allocator = NULL;
+    buffer_type* buffer = NULL;
+    compress_type* table = NULL;
+    wirespeed_type plain, compressed;
+
+    progname = argv[0];
+    while ((ch = getopt(argc, argv, "i:o:h")) != -1) {
+        switch (ch) {
+        case 'i':
+            iterations = atoi(optarg);
+            break;
+        case 'o':
+            origin = strdup(optarg);
+            break;
+        case 'h':
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    argc -= optind;
+    argv += optind;
+    if (argc != 1 || iterations == 0) {
+        usage();
+        exit(1);
+    }
+    ods_log_init(NULL, 0, 0);
+
+    fd = fopen(argv[0], "r");
+    if (!fd) {
+        fprintf(stderr, "%s: unable to open %s\n", progname, argv[0]);
+        exit(1);
+    }
+    if (origin) {
+        apex = ldns_dname_new_frm_str(origin);
+        free((void*)origin);
+    }
+    status = ldns_zone_new_frm_fp(&zone, fd, apex, 3600, LDNS_RR_CLASS_IN);
+    fclose(fd);
+    if (status != LDNS_STATUS_OK) {
+        fprintf(stderr, "%s: unable to read zone %s: %s\n", progname,
+            argv[0], ldns_get_errorstr_by_id(status));
+        exit(1);
+    }
+    if (!ldns_zone_soa(zone)) {
+        fprintf(stderr, "%s: zone %s has no soa\n", progname, argv[0]);
+        exit(1);
+    }
+    if (!apex) {
+        apex = ldns_rdf_clone(ldns_rr_owner(ldns_zone_soa(zone)));
+    }
+    /* soa first, as in a zone transfer */
+    rrs = ldns_rr_list_new();
+    ldns_rr_list_push_rr(rrs, ldns_zone_soa(zone));
+    ldns_rr_list_cat(rrs, ldns_zone_rrs(zone));
+
+    allocator = allocator_create(malloc, free);
+    buffer = buffer_create(allocator, PACKET_BUFFER_SIZE);
+    table = compress_create(allocator);
+    if (!buffer || !table) {
+        fprintf(stderr, "%s: out of memory\n", progname);
+        exit(1);
+    }
+
+    fprintf(stdout, "Encoding %lu rrs, %u iterations\n",
+        (unsigned long) ldns_rr_list_rr_count(rrs), iterations);
+    result = wirespeed_encode(buffer, NULL, apex, rrs, iterations, &plain);
+    if (!result) {
+        result = wirespeed_encode(buffer, table, apex, rrs, iterations,
+            &compressed);
+    }
+    if (!result) {
+        wirespeed_print("plain", &plain, iterations);
+        wirespeed_print("compressed", &compressed, iterations);
+        fprintf(stdout, "Compression ratio: %.2f\n", plain.bytes ?
+            (double) compressed.bytes / plain.bytes : 0.0);
+    }
+
+    compress_cleanup(table);
+    buffer_cleanup(buffer, allocator);
+    allocator_cleanup(allocator);
+    ldns_rr_list_free(rrs);
+    ldns_zone_deep_free(zone);
+    ldns_rdf_deep_free(apex);
+    return result;
+}
@@ -32,7 +32,9 @@
  */
 
 #include "parser/addnsparser.h"
+#include "parser/confparser.h"
 #include "shared/log.h"
+#include "signer/ixfr.h"
 
 #include <libxml/xpath.h>
 #include <libxml/xmlreader.h>
@@ -377,6 +379,69 @@ parse_addns_do_notify(allocator_type* allocator, const char* filename,
 }
 
 
+/**
+ * Parse <Journal/> value.
+ *
+ */
+static size_t
+parse_addns_journal(const char* filename, const char* expr, size_t def)
+{
+    size_t value = def;
+    const char* str = parse_conf_string(filename, expr, 0);
+    if (str) {
+        if (strlen(str) > 0) {
+            value = (size_t) atoi(str);
+        }
+        free((void*)str);
+    }
+    return value;
+}
+
+
+/**
+ * Parse <Journal><Versions/></Journal>.
+ *
+ */
+size_t
+parse_addns_journal_versions(const char* filename)
+{
+    return parse_addns_journal(filename,
+        "//Adapter/DNS/Outbound/Journal/Versions",
+        IXFR_DEFAULT_VERSIONS);
+}
+
+
+/**
+ * Parse <Journal><Records/></Journal>.
+ *
+ */
+size_t
+parse_addns_journal_records(const char* filename)
+{
+    return parse_addns_journal(filename,
+        "//Adapter/DNS/Outbound/Journal/Records",
+        IXFR_DEFAULT_RECORDS);
+}
+
+
+/**
+ * Parse <Inbound><TextSpool/></Inbound>.
+ *
+ */
+int
+parse_addns_text_spool(const char* filename)
+{
+    const char* str = parse_conf_string(filename,
+        "//Adapter/DNS/Inbound/TextSpool",
+        0);
+    if (str) {
+        free((void*)str);
+        return 1;
+    }
+    return 0;
+}
+
+
 /**
  * Parse <TSIG/>.
  *
@@ -84,6 +84,30 @@ acl_type* parse_addns_provide_xfr(allocator_type* allocator,
 acl_type* parse_addns_do_notify(allocator_type* allocator,
     const char* filename, tsig_type* tsig);
 
+/**
+ * Parse <Journal><Versions/></Journal>.
+ * \param[in] filename filename
+ * \return size_t number of versions to keep in the ixfr journal
+ *
+ */
+size_t parse_addns_journal_versions(const char* filename);
+
+/**
+ * Parse <Journal><Records/></Journal>.
+ * \param[in] filename filename
+ * \return size_t number of records to keep in the ixfr journal
+ *
+ */
+size_t parse_addns_journal_records(const char* filename);
+
+/**
+ * Parse <Inbound><TextSpool/></Inbound>.
+ * \param[in] filename filename
+ * \return int 1 if received transfers are spooled as text, 0 otherwise
+ *
+ */
+int parse_addns_text_spool(const char* filename);
+
 /**
  * Parse <TSIG/>.
  * \param[in] allocator memory allocator
@@ -522,3 +522,54 @@ parse_conf_signer_threads(const char* cfgfile)
     /* no SignerThreads value configured, look at WorkerThreads */
     return parse_conf_worker_threads(cfgfile);
 }
+
+
+int
+parse_conf_listener_threads(const char* cfgfile)
+{
+    int numlt = ODS_SE_LISTENERTHREADS;
+    const char* str = parse_conf_string(cfgfile,
+        "//Configuration/Signer/ListenerThreads",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numlt = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numlt;
+}
+
+
+int
+parse_conf_xfr_threads(const char* cfgfile)
+{
+    int numxt = ODS_SE_XFRTHREADS;
+    const char* str = parse_conf_string(cfgfile,
+        "//Configuration/Signer/TransferThreads",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numxt = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numxt;
+}
+
+
+int
+parse_conf_xfr_per_master(const char* cfgfile)
+{
+    int numxpm = ODS_SE_XFRPERMASTER;
+    const char* str = parse_conf_string(cfgfile,
+        "//Configuration/Signer/TransfersPerMaster",
+        0);
+    if (str) {
+        if (strlen(str) > 0) {
+            numxpm = atoi(str);
+        }
+        free((void*)str);
+    }
+    return numxpm;
+}
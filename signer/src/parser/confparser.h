@@ -115,5 +115,8 @@ int parse_conf_verbosity(const char* cfgfile);
 /** Signer specific */
 int parse_conf_worker_threads(const char* cfgfile);
 int parse_conf_signer_threads(const char* cfgfile);
+int parse_conf_listener_threads(const char* cfgfile);
+int parse_conf_xfr_threads(const char* cfgfile);
+int parse_conf_xfr_per_master(const char* cfgfile);
 
 #endif /* PARSE_CONFPARSER_H */
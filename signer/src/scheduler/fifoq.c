@@ -34,6 +34,7 @@
 #include "config.h"
 #include "scheduler/fifoq.h"
 #include "shared/log.h"
+#include "shared/metrics.h"
 
 #include <ldns/ldns.h>
 
@@ -77,6 +78,7 @@ fifoq_wipe(fifoq_type* q)
     for (i=0; i < FIFOQ_MAX_COUNT; i++) {
         q->blob[i] = NULL;
         q->owner[i] = NULL;
+        q->pushed[i] = 0;
     }
     q->count = 0;
     return;
@@ -91,17 +93,21 @@ void*
 fifoq_pop(fifoq_type* q, worker_type** worker)
 {
     void* pop = NULL;
+    uint64_t pushed = 0;
     size_t i = 0;
     if (!q || q->count <= 0) {
         return NULL;
     }
     pop = q->blob[0];
     *worker = q->owner[0];
+    pushed = q->pushed[0];
     for (i = 0; i < q->count-1; i++) {
         q->blob[i] = q->blob[i+1];
         q->owner[i] = q->owner[i+1];
+        q->pushed[i] = q->pushed[i+1];
     }
     q->count -= 1;
+    metrics_signq_pop(q->count, metrics_usec() - pushed);
     if (q->count <= (size_t) FIFOQ_MAX_COUNT * 0.1) {
         /**
          * Notify waiting workers that they can start queuing again
@@ -139,7 +145,9 @@ fifoq_push(fifoq_type* q, void* item, worker_type* worker, int* tries)
     }
     q->blob[q->count] = item;
     q->owner[q->count] = worker;
+    q->pushed[q->count] = metrics_usec();
     q->count += 1;
+    metrics_signq_push(q->count);
     if (q->count == 1) {
         ods_log_deeebug("[%s] threshold %u reached, notify drudgers",
             fifoq_str, q->count);
@@ -63,6 +63,7 @@ struct fifoq_struct {
     allocator_type* allocator;
     void* blob[FIFOQ_MAX_COUNT];
     worker_type* owner[FIFOQ_MAX_COUNT];
+    uint64_t pushed[FIFOQ_MAX_COUNT];
     size_t count;
     lock_basic_type q_lock;
     cond_basic_type q_threshold;
@@ -37,10 +37,22 @@
 #include "shared/duration.h"
 #include "shared/log.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <ldns/ldns.h>
 
 static const char* schedule_str = "scheduler";
 
+/* upper bounds of the lateness buckets, the last bucket is unbounded */
+static const time_t schedule_lateness_bounds[SCHEDULE_LATENESS_BUCKETS-1] =
+    { 0, 1, 5, 30, 60, 300, 3600 };
+static const char* schedule_lateness_labels[SCHEDULE_LATENESS_BUCKETS] =
+    { "0s", "1s", "5s", "30s", "1m", "5m", "1h", ">1h" };
+
+#define SCHEDULE_QUEUED_HEAP 1
+#define SCHEDULE_QUEUED_RUNQ 2
+
 
 /**
  * Create new schedule.
@@ -60,62 +72,306 @@ schedule_create(allocator_type* allocator)
             "failed", schedule_str);
         return NULL;
     }
+    memset(schedule, 0, sizeof(schedule_type));
     schedule->allocator = allocator;
-    schedule->loading = 0;
-    schedule->flushcount = 0;
-    schedule->tasks = ldns_rbtree_create(task_compare);
-    if (!schedule->tasks) {
-        ods_log_error("[%s] unable to create schedule: ldns_rbtree_create() "
-            "failed", schedule_str);
-        allocator_deallocate(allocator, (void*) schedule);
-        return NULL;
-    }
     lock_basic_init(&schedule->schedule_lock);
+    lock_basic_set(&schedule->schedule_cond);
     return schedule;
 }
 
 
 /**
- * Flush schedule.
+ * Priority class of task.
  *
  */
-void
-schedule_flush(schedule_type* schedule, task_id override)
+static schedule_class
+schedule_task_class(task_type* task)
+{
+    if (task->interrupt != TASK_NONE || task->what == TASK_SIGNCONF ||
+        task->what == TASK_READ) {
+        return SCHEDULE_CLASS_INTERRUPT;
+    }
+    return SCHEDULE_CLASS_ROUTINE;
+}
+
+
+/**
+ * Swap two timers in the heap.
+ *
+ */
+static void
+schedule_heap_swap(schedule_type* schedule, size_t i, size_t j)
+{
+    task_type* task = schedule->heap[i];
+    schedule->heap[i] = schedule->heap[j];
+    schedule->heap[j] = task;
+    schedule->heap[i]->heap_index = i;
+    schedule->heap[j]->heap_index = j;
+    return;
+}
+
+
+/**
+ * Restore the heap property of a timer.
+ *
+ */
+static void
+schedule_heap_fix(schedule_type* schedule, size_t i)
+{
+    size_t parent = 0;
+    size_t child = 0;
+    /* sift up */
+    while (i > 0) {
+        parent = (i - 1) / 2;
+        if (task_compare(schedule->heap[i], schedule->heap[parent]) >= 0) {
+            break;
+        }
+        schedule_heap_swap(schedule, i, parent);
+        i = parent;
+    }
+    /* sift down */
+    while ((child = 2 * i + 1) < schedule->heap_count) {
+        if (child + 1 < schedule->heap_count &&
+            task_compare(schedule->heap[child+1], schedule->heap[child]) < 0) {
+            child++;
+        }
+        if (task_compare(schedule->heap[child], schedule->heap[i]) >= 0) {
+            break;
+        }
+        schedule_heap_swap(schedule, i, child);
+        i = child;
+    }
+    return;
+}
+
+
+/**
+ * Add timer to the heap.
+ *
+ */
+static ods_status
+schedule_heap_insert(schedule_type* schedule, task_type* task)
+{
+    task_type** heap = NULL;
+    size_t capacity = 0;
+    if (schedule->heap_count >= schedule->heap_capacity) {
+        capacity = schedule->heap_capacity ? schedule->heap_capacity * 2 : 64;
+        heap = (task_type**) realloc(schedule->heap,
+            capacity * sizeof(task_type*));
+        if (!heap) {
+            return ODS_STATUS_MALLOC_ERR;
+        }
+        schedule->heap = heap;
+        schedule->heap_capacity = capacity;
+    }
+    task->heap_index = schedule->heap_count;
+    task->scheduled = SCHEDULE_QUEUED_HEAP;
+    schedule->heap[schedule->heap_count++] = task;
+    schedule_heap_fix(schedule, task->heap_index);
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Remove timer from the heap.
+ *
+ */
+static void
+schedule_heap_remove(schedule_type* schedule, task_type* task)
+{
+    size_t i = task->heap_index;
+    ods_log_assert(i < schedule->heap_count);
+    ods_log_assert(schedule->heap[i] == task);
+    schedule->heap_count--;
+    if (i != schedule->heap_count) {
+        schedule->heap[i] = schedule->heap[schedule->heap_count];
+        schedule->heap[i]->heap_index = i;
+        schedule_heap_fix(schedule, i);
+    }
+    task->scheduled = 0;
+    return;
+}
+
+
+/**
+ * Append task to the run queue of its priority class.
+ *
+ */
+static void
+schedule_runq_append(schedule_type* schedule, task_type* task)
+{
+    schedule_class klass = schedule_task_class(task);
+    task->klass = (int) klass;
+    task->runq_next = NULL;
+    task->runq_prev = schedule->runq_last[klass];
+    if (schedule->runq_last[klass]) {
+        schedule->runq_last[klass]->runq_next = task;
+    } else {
+        schedule->runq_first[klass] = task;
+    }
+    schedule->runq_last[klass] = task;
+    schedule->runq_count[klass]++;
+    task->scheduled = SCHEDULE_QUEUED_RUNQ;
+    return;
+}
+
+
+/**
+ * Remove task from its run queue.
+ *
+ */
+static void
+schedule_runq_remove(schedule_type* schedule, task_type* task)
+{
+    int klass = task->klass;
+    if (task->runq_prev) {
+        task->runq_prev->runq_next = task->runq_next;
+    } else {
+        schedule->runq_first[klass] = task->runq_next;
+    }
+    if (task->runq_next) {
+        task->runq_next->runq_prev = task->runq_prev;
+    } else {
+        schedule->runq_last[klass] = task->runq_prev;
+    }
+    task->runq_prev = NULL;
+    task->runq_next = NULL;
+    schedule->runq_count[klass]--;
+    task->scheduled = 0;
+    return;
+}
+
+
+/**
+ * Move the timers that are due to the run queues.
+ *
+ */
+static void
+schedule_expire_timers(schedule_type* schedule, time_t now)
 {
-    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
     task_type* task = NULL;
+    while (schedule->heap_count > 0 && schedule->heap[0]->when <= now) {
+        task = schedule->heap[0];
+        schedule_heap_remove(schedule, task);
+        schedule_runq_append(schedule, task);
+    }
+    return;
+}
 
-    ods_log_debug("[%s] flush all tasks", schedule_str);
-    if (!schedule || !schedule->tasks) {
-        return;
+
+/**
+ * First task in the run queues.
+ *
+ */
+static task_type*
+schedule_runq_first(schedule_type* schedule)
+{
+    int klass = 0;
+    for (klass = 0; klass < SCHEDULE_NUM_CLASSES; klass++) {
+        if (schedule->runq_first[klass]) {
+            return schedule->runq_first[klass];
+        }
     }
-    node = ldns_rbtree_first(schedule->tasks);
-    while (node && node != LDNS_RBTREE_NULL) {
-        task = (task_type*) node->data;
-        task->flush = 1;
-        schedule->flushcount++;
-        if (override != TASK_NONE) {
-            task->what = override;
+    return NULL;
+}
+
+
+/**
+ * First task in the run queues that may be worked on. Tasks of large
+ * zones wait while the workers that are not reserved for small zones
+ * are all busy with large zones.
+ *
+ */
+static task_type*
+schedule_runq_eligible(schedule_type* schedule)
+{
+    task_type* task = NULL;
+    task_type* first = NULL;
+    int klass = 0;
+    int large_ok = (!schedule->large_limit ||
+        schedule->large_running < schedule->large_limit);
+    for (klass = 0; klass < SCHEDULE_NUM_CLASSES; klass++) {
+        for (task = schedule->runq_first[klass]; task;
+            task = task->runq_next) {
+            if (!large_ok && task->large) {
+                continue;
+            }
+            if (!schedule->overload || klass != SCHEDULE_CLASS_ROUTINE) {
+                return task;
+            }
+            /* overload: the zone whose signatures expire first */
+            if (!first || (task->deadline && (!first->deadline ||
+                task->deadline < first->deadline))) {
+                first = task;
+            }
         }
-        node = ldns_rbtree_next(node);
+        if (first) {
+            return first;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+ * Enter or leave overload mode, depending on how late the oldest due
+ * routine task is.
+ *
+ */
+static void
+schedule_check_overload(schedule_type* schedule, time_t now)
+{
+    task_type* oldest = schedule->runq_first[SCHEDULE_CLASS_ROUTINE];
+    int overload = (oldest && !oldest->flush &&
+        now - oldest->when > SCHEDULE_OVERLOAD_LATENESS);
+    if (overload && !schedule->overload) {
+        ods_log_warning("[%s] overload: tasks are %u seconds late, sign "
+            "zones by earliest signature expiration", schedule_str,
+            (unsigned) (now - oldest->when));
+    } else if (!overload && schedule->overload) {
+        ods_log_info("[%s] overload is over", schedule_str);
     }
+    schedule->overload = overload;
     return;
 }
 
 
 /**
- * Convert task to a tree node.
+ * Flush schedule.
  *
  */
-static ldns_rbnode_t*
-task2node(task_type* task)
+void
+schedule_flush(schedule_type* schedule, task_id override)
 {
-    ldns_rbnode_t* node = (ldns_rbnode_t*) malloc(sizeof(ldns_rbnode_t));
-    if (node) {
-        node->key = task;
-        node->data = task;
+    task_type** tasks = NULL;
+    size_t count = 0;
+    size_t i = 0;
+
+    ods_log_debug("[%s] flush all tasks", schedule_str);
+    if (!schedule) {
+        return;
+    }
+    tasks = schedule_list_tasks(schedule, &count);
+    if (!tasks && count) {
+        ods_log_error("[%s] unable to flush tasks: malloc() failed",
+            schedule_str);
+        return;
+    }
+    for (i = 0; i < count; i++) {
+        (void) unschedule_task(schedule, tasks[i]);
+    }
+    for (i = 0; i < count; i++) {
+        tasks[i]->flush = 1;
+        if (override != TASK_NONE) {
+            tasks[i]->what = override;
+        }
+        schedule_runq_append(schedule, tasks[i]);
     }
-    return node;
+    free((void*) tasks);
+    if (count) {
+        lock_basic_broadcast(&schedule->schedule_cond);
+    }
+    return;
 }
 
 
@@ -126,17 +382,13 @@ task2node(task_type* task)
 task_type*
 schedule_lookup_task(schedule_type* schedule, task_type* task)
 {
-    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
-    task_type* lookup = NULL;
     if (!schedule || !task) {
         return NULL;
     }
-    ods_log_assert(schedule->tasks);
-    node = ldns_rbtree_search(schedule->tasks, task);
-    if (node && node != LDNS_RBTREE_NULL) {
-        lookup = (task_type*) node->data;
+    if (task->scheduled) {
+        return task;
     }
-    return lookup;
+    return NULL;
 }
 
 
@@ -147,9 +399,8 @@ schedule_lookup_task(schedule_type* schedule, task_type* task)
 ods_status
 schedule_task(schedule_type* schedule, task_type* task, int log)
 {
-    ldns_rbnode_t* new_node = NULL;
-    ldns_rbnode_t* ins_node = NULL;
-    if (!task || !schedule || !schedule->tasks) {
+    ods_status status = ODS_STATUS_OK;
+    if (!task || !schedule) {
         return ODS_STATUS_ASSERT_ERR;
     }
     ods_log_debug("[%s] schedule task %s for zone %s", schedule_str,
@@ -160,23 +411,21 @@ schedule_task(schedule_type* schedule, task_type* task, int log)
             task_who2str(task));
         return ODS_STATUS_ERR;
     }
-    new_node = task2node(task);
-    if (!new_node) {
-        ods_log_error("[%s] unable to schedule task %s for zone %s: "
-            " task2node() failed", schedule_str, task_what2str(task->what),
-            task_who2str(task));
-        return ODS_STATUS_MALLOC_ERR;
-    }
-    ins_node = ldns_rbtree_insert(schedule->tasks, new_node);
-    if (!ins_node) {
-        ods_log_error("[%s] unable to schedule task %s for zone %s: "
-            " insert failed", schedule_str, task_what2str(task->what),
-            task_who2str(task));
-        free((void*)new_node);
-        return ODS_STATUS_ERR;
-    }
     if (task->flush) {
-        schedule->flushcount++;
+        schedule_runq_append(schedule, task);
+        lock_basic_alarm(&schedule->schedule_cond);
+    } else {
+        status = schedule_heap_insert(schedule, task);
+        if (status != ODS_STATUS_OK) {
+            ods_log_error("[%s] unable to schedule task %s for zone %s: "
+                " realloc() failed", schedule_str, task_what2str(task->what),
+                task_who2str(task));
+            return status;
+        }
+        if (task->heap_index == 0) {
+            /* first timer changed, a waiting worker sets a new alarm */
+            lock_basic_alarm(&schedule->schedule_cond);
+        }
     }
     if (log) {
         task_log(task);
@@ -192,28 +441,23 @@ schedule_task(schedule_type* schedule, task_type* task, int log)
 task_type*
 unschedule_task(schedule_type* schedule, task_type* task)
 {
-    ldns_rbnode_t* del_node = LDNS_RBTREE_NULL;
-    task_type* del_task = NULL;
-    if (!task || !schedule || !schedule->tasks) {
+    if (!task || !schedule) {
         return NULL;
     }
     ods_log_debug("[%s] unschedule task %s for zone %s",
         schedule_str, task_what2str(task->what), task_who2str(task));
-    del_node = ldns_rbtree_delete(schedule->tasks, (const void*) task);
-    if (del_node) {
-        del_task = (task_type*) del_node->data;
-        free((void*)del_node);
+    if (task->scheduled == SCHEDULE_QUEUED_HEAP) {
+        schedule_heap_remove(schedule, task);
+    } else if (task->scheduled == SCHEDULE_QUEUED_RUNQ) {
+        schedule_runq_remove(schedule, task);
     } else {
         ods_log_warning("[%s] unable to unschedule task %s for zone %s: not "
             "scheduled", schedule_str, task_what2str(task->what),
             task_who2str(task));
         return NULL;
     }
-    if (del_task->flush) {
-        del_task->flush = 0;
-        schedule->flushcount--;
-    }
-    return del_task;
+    task->flush = 0;
+    return task;
 }
 
 
@@ -226,7 +470,7 @@ reschedule_task(schedule_type* schedule, task_type* task, task_id what,
     time_t when)
 {
     task_type* del_task = NULL;
-    if (!task || !schedule || !schedule->tasks) {
+    if (!task || !schedule) {
         return ODS_STATUS_ASSERT_ERR;
     }
     del_task = unschedule_task(schedule, task);
@@ -246,36 +490,44 @@ reschedule_task(schedule_type* schedule, task_type* task, task_id what,
 task_type*
 schedule_get_first_task(schedule_type* schedule)
 {
-    ldns_rbnode_t* first_node = LDNS_RBTREE_NULL;
-    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
-    task_type* pop = NULL;
-    if (!schedule || !schedule->tasks) {
+    task_type* first = NULL;
+    if (!schedule) {
         return NULL;
     }
-    first_node = ldns_rbtree_first(schedule->tasks);
-    if (!first_node) {
-        return NULL;
+    first = schedule_runq_first(schedule);
+    if (!first && schedule->heap_count > 0) {
+        first = schedule->heap[0];
     }
-    if (schedule->flushcount > 0) {
-        /* find remaining to be flushed tasks */
-        node = first_node;
-        while (node && node != LDNS_RBTREE_NULL) {
-            pop = (task_type*) node->data;
-            if (pop->flush) {
-                return pop;
-            }
-            node = ldns_rbtree_next(node);
+    return first;
+}
+
+
+/**
+ * Account the lateness of a task.
+ *
+ */
+static void
+schedule_account_lateness(schedule_type* schedule, task_type* task,
+    time_t now)
+{
+    schedule_lateness_type* lateness = &schedule->lateness[task->klass];
+    time_t late = now - task->when;
+    size_t i = 0;
+    if (late < 0) {
+        late = 0;
+    }
+    for (i = 0; i < SCHEDULE_LATENESS_BUCKETS-1; i++) {
+        if (late <= schedule_lateness_bounds[i]) {
+            break;
         }
-        /* no more to be flushed tasks found */
-        ods_log_warning("[%s] unable to get first scheduled task: could not "
-            "find flush-task, while there should be %i flush-tasks left",
-            schedule_str, schedule->flushcount);
-        ods_log_info("[%s] reset flush count to 0", schedule_str);
-        schedule->flushcount = 0;
-    }
-    /* no more tasks to be flushed, return first task in schedule */
-    pop = (task_type*) first_node->data;
-    return pop;
+    }
+    lateness->buckets[i]++;
+    lateness->count++;
+    lateness->total += late;
+    if (late > lateness->max) {
+        lateness->max = late;
+    }
+    return;
 }
 
 
@@ -288,65 +540,271 @@ schedule_pop_task(schedule_type* schedule)
 {
     task_type* pop = NULL;
     time_t now = 0;
-    if (!schedule || !schedule->tasks) {
+    if (!schedule) {
         return NULL;
     }
     now = time_now();
-    pop = schedule_get_first_task(schedule);
-    if (pop && (pop->flush || pop->when <= now)) {
-        if (pop->flush) {
-            ods_log_debug("[%s] flush task for zone %s", schedule_str,
-                task_who2str(pop));
-        } else {
-            ods_log_debug("[%s] pop task for zone %s", schedule_str,
-                task_who2str(pop));
-        }
-        return unschedule_task(schedule, pop);
+    schedule_expire_timers(schedule, now);
+    schedule_check_overload(schedule, now);
+    pop = schedule_runq_eligible(schedule);
+    if (!pop) {
+        return NULL;
     }
-    return NULL;
+    if (pop->flush) {
+        ods_log_debug("[%s] flush task for zone %s", schedule_str,
+            task_who2str(pop));
+    } else {
+        ods_log_debug("[%s] pop task for zone %s", schedule_str,
+            task_who2str(pop));
+        /* flushed tasks are not late, they are early */
+        schedule_account_lateness(schedule, pop, now);
+    }
+    (void) unschedule_task(schedule, pop);
+    if (pop->large) {
+        pop->running_large = 1;
+        schedule->large_running++;
+    }
+    if (schedule_runq_eligible(schedule)) {
+        /* more work to do, pass it on */
+        lock_basic_alarm(&schedule->schedule_cond);
+    }
+    return pop;
 }
 
 
 /**
- * Print schedule.
+ * Done working on a popped task.
  *
  */
 void
-schedule_print(FILE* out, schedule_type* schedule)
+schedule_finish_task(schedule_type* schedule, task_type* task)
+{
+    if (!schedule || !task) {
+        return;
+    }
+    if (task->running_large) {
+        task->running_large = 0;
+        schedule->large_running--;
+        if (schedule_runq_first(schedule)) {
+            /* a large zone may have been waiting for this */
+            lock_basic_alarm(&schedule->schedule_cond);
+        }
+    }
+    return;
+}
+
+
+/**
+ * Check if there are tasks waiting to be worked on.
+ *
+ */
+int
+schedule_has_due_task(schedule_type* schedule)
+{
+    if (!schedule) {
+        return 0;
+    }
+    schedule_expire_timers(schedule, time_now());
+    return schedule_runq_first(schedule) != NULL;
+}
+
+
+/**
+ * Check if the schedule is in overload mode.
+ *
+ */
+int
+schedule_overload(schedule_type* schedule)
+{
+    if (!schedule) {
+        return 0;
+    }
+    return schedule->overload;
+}
+
+
+/**
+ * Time until the first timer expires.
+ *
+ */
+time_t
+schedule_timeout(schedule_type* schedule, time_t now)
+{
+    time_t timeout = 0;
+    if (!schedule || schedule->heap_count == 0) {
+        return 0;
+    }
+    timeout = schedule->heap[0]->when - now;
+    if (timeout < 1) {
+        timeout = 1;
+    }
+    return timeout;
+}
+
+
+/**
+ * Number of scheduled tasks.
+ *
+ */
+size_t
+schedule_count(schedule_type* schedule)
+{
+    size_t count = 0;
+    int klass = 0;
+    if (!schedule) {
+        return 0;
+    }
+    count = schedule->heap_count;
+    for (klass = 0; klass < SCHEDULE_NUM_CLASSES; klass++) {
+        count += schedule->runq_count[klass];
+    }
+    return count;
+}
+
+
+/**
+ * Compare timers for sorting.
+ *
+ */
+static int
+schedule_sort_compare(const void* a, const void* b)
 {
-    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    return task_compare(*(task_type* const*) a, *(task_type* const*) b);
+}
+
+
+/**
+ * List scheduled tasks.
+ *
+ */
+task_type**
+schedule_list_tasks(schedule_type* schedule, size_t* count)
+{
+    task_type** tasks = NULL;
     task_type* task = NULL;
+    size_t n = 0;
+    int klass = 0;
+    if (!schedule || !count) {
+        return NULL;
+    }
+    *count = schedule_count(schedule);
+    if (*count == 0) {
+        return NULL;
+    }
+    tasks = (task_type**) malloc(*count * sizeof(task_type*));
+    if (!tasks) {
+        return NULL;
+    }
+    /* due tasks first, by priority class */
+    for (klass = 0; klass < SCHEDULE_NUM_CLASSES; klass++) {
+        for (task = schedule->runq_first[klass]; task;
+            task = task->runq_next) {
+            tasks[n++] = task;
+        }
+    }
+    /* then the timers, in time order */
+    if (schedule->heap_count > 0) {
+        memcpy(&tasks[n], schedule->heap,
+            schedule->heap_count * sizeof(task_type*));
+        qsort(&tasks[n], schedule->heap_count, sizeof(task_type*),
+            schedule_sort_compare);
+    }
+    return tasks;
+}
+
 
-    if (!out || !schedule || !schedule->tasks) {
+/**
+ * Wake up the workers that are waiting for a task to become due.
+ *
+ */
+void
+schedule_wakeup(schedule_type* schedule)
+{
+    if (!schedule) {
         return;
     }
-    node = ldns_rbtree_first(schedule->tasks);
-    while (node && node != LDNS_RBTREE_NULL) {
-        task = (task_type*) node->data;
-        task_print(out, task);
-        node = ldns_rbtree_next(node);
-    }
-    fprintf(out, "\n");
+    lock_basic_lock(&schedule->schedule_lock);
+    lock_basic_broadcast(&schedule->schedule_cond);
+    lock_basic_unlock(&schedule->schedule_lock);
     return;
 }
 
 
 /**
- * Internal task cleanup function.
+ * String-format of priority class.
  *
  */
-static void
-task_delfunc(ldns_rbnode_t* elem)
+const char*
+schedule_class2str(schedule_class klass)
 {
-    task_type* task;
+    switch (klass) {
+        case SCHEDULE_CLASS_INTERRUPT:
+            return "interrupt";
+            break;
+        case SCHEDULE_CLASS_ROUTINE:
+            return "routine";
+            break;
+        default:
+            break;
+    }
+    return "???";
+}
 
-    if (elem && elem != LDNS_RBTREE_NULL) {
-        task = (task_type*) elem->data;
-        task_delfunc(elem->left);
-        task_delfunc(elem->right);
-        task_cleanup(task);
-        free((void*)elem);
+
+/**
+ * Convert task lateness of a priority class to string.
+ *
+ */
+char*
+schedule_lateness2str(schedule_type* schedule, schedule_class klass,
+    char* buf)
+{
+    schedule_lateness_type* lateness = NULL;
+    size_t len = 0;
+    size_t i = 0;
+    if (!schedule || !buf || klass >= SCHEDULE_NUM_CLASSES) {
+        return NULL;
+    }
+    lateness = &schedule->lateness[klass];
+    len = snprintf(buf, ODS_SE_MAXLINE, "%s tasks: %lu started, lateness "
+        "avg %lus max %lus [", schedule_class2str(klass),
+        (unsigned long) lateness->count,
+        (unsigned long) (lateness->count ?
+            lateness->total / lateness->count : 0),
+        (unsigned long) lateness->max);
+    for (i = 0; i < SCHEDULE_LATENESS_BUCKETS && len < ODS_SE_MAXLINE;
+        i++) {
+        len += snprintf(buf + len, ODS_SE_MAXLINE - len, "%s<=%s %lu",
+            i?", ":"", schedule_lateness_labels[i],
+            (unsigned long) lateness->buckets[i]);
+    }
+    if (len < ODS_SE_MAXLINE) {
+        (void)snprintf(buf + len, ODS_SE_MAXLINE - len, "]\n");
     }
+    return buf;
+}
+
+
+/**
+ * Print schedule.
+ *
+ */
+void
+schedule_print(FILE* out, schedule_type* schedule)
+{
+    task_type** tasks = NULL;
+    size_t count = 0;
+    size_t i = 0;
+
+    if (!out || !schedule) {
+        return;
+    }
+    tasks = schedule_list_tasks(schedule, &count);
+    for (i = 0; tasks && i < count; i++) {
+        task_print(out, tasks[i]);
+    }
+    free((void*) tasks);
+    fprintf(out, "\n");
     return;
 }
 
@@ -360,19 +818,23 @@ schedule_cleanup(schedule_type* schedule)
 {
     allocator_type* allocator;
     lock_basic_type schedule_lock;
+    cond_basic_type schedule_cond;
+    task_type* task = NULL;
 
     if (!schedule) {
         return;
     }
     ods_log_debug("[%s] cleanup schedule", schedule_str);
-    if (schedule->tasks) {
-        task_delfunc(schedule->tasks->root);
-        ldns_rbtree_free(schedule->tasks);
-        schedule->tasks = NULL;
+    while ((task = schedule_get_first_task(schedule)) != NULL) {
+        (void) unschedule_task(schedule, task);
+        task_cleanup(task);
     }
+    free((void*) schedule->heap);
     allocator = schedule->allocator;
     schedule_lock = schedule->schedule_lock;
+    schedule_cond = schedule->schedule_cond;
     allocator_deallocate(allocator, (void*) schedule);
     lock_basic_destroy(&schedule_lock);
+    lock_basic_off(&schedule_cond);
     return;
 }
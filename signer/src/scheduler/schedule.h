@@ -53,16 +53,59 @@
 #include <ldns/ldns.h>
 
 
+/* priority classes, a due task of a lower class goes first */
+enum schedule_class_enum {
+    SCHEDULE_CLASS_INTERRUPT = 0, /* configure, read, interrupted tasks */
+    SCHEDULE_CLASS_ROUTINE, /* resign, write */
+    SCHEDULE_NUM_CLASSES
+};
+typedef enum schedule_class_enum schedule_class;
+
+#define SCHEDULE_LATENESS_BUCKETS 8
+/* routine tasks this late put the schedule in overload mode */
+#define SCHEDULE_OVERLOAD_LATENESS 300
+
+/**
+ * Task lateness, the time between the scheduled time and the time the
+ * task was handed to a worker.
+ *
+ */
+typedef struct schedule_lateness_struct schedule_lateness_type;
+struct schedule_lateness_struct {
+    size_t count;
+    time_t total;
+    time_t max;
+    size_t buckets[SCHEDULE_LATENESS_BUCKETS];
+};
+
 /**
  * Task schedule.
+ * Tasks that are not due yet are kept in a min-heap on scheduled time.
+ * Tasks that are due, or flushed, are moved to the run queue of their
+ * priority class.
+ *
  */
 typedef struct schedule_struct schedule_type;
 struct schedule_struct {
     allocator_type* allocator;
-    ldns_rbtree_t* tasks;
-    int flushcount;
-    int loading; /* to determine backoff */
+    /* timers */
+    task_type** heap;
+    size_t heap_count;
+    size_t heap_capacity;
+    /* run queues */
+    task_type* runq_first[SCHEDULE_NUM_CLASSES];
+    task_type* runq_last[SCHEDULE_NUM_CLASSES];
+    size_t runq_count[SCHEDULE_NUM_CLASSES];
+    /* tasks of large zones being worked on, and how many may be */
+    size_t large_running;
+    size_t large_limit;
+    /* overload mode, routine tasks go by earliest signature expiration */
+    int overload;
+    /* statistics */
+    schedule_lateness_type lateness[SCHEDULE_NUM_CLASSES];
     lock_basic_type schedule_lock;
+    /* signalled when a task becomes due sooner, schedule locked */
+    cond_basic_type schedule_cond;
 };
 
 /**
@@ -129,6 +172,40 @@ ods_status reschedule_task(schedule_type* schedule, task_type* task,
  */
 task_type* schedule_pop_task(schedule_type* schedule);
 
+/**
+ * Done working on a popped task, before it is scheduled again.
+ * \param[in] schedule schedule
+ * \param[in] task task
+ *
+ */
+void schedule_finish_task(schedule_type* schedule, task_type* task);
+
+/**
+ * Check if there are tasks waiting to be worked on.
+ * \param[in] schedule schedule
+ * \return int 1 if tasks are due, 0 otherwise
+ *
+ */
+int schedule_has_due_task(schedule_type* schedule);
+
+/**
+ * Check if the schedule is in overload mode. Work that is not needed to
+ * keep signatures from expiring may be shed.
+ * \param[in] schedule schedule
+ * \return int 1 if in overload mode, 0 otherwise
+ *
+ */
+int schedule_overload(schedule_type* schedule);
+
+/**
+ * Time until the first timer expires.
+ * \param[in] schedule schedule
+ * \param[in] now current time
+ * \return time_t seconds until the first timer, 0 if there are no timers
+ *
+ */
+time_t schedule_timeout(schedule_type* schedule, time_t now);
+
 /**
  * Get the first scheduled task.
  * \param[in] schedule schedule
@@ -137,6 +214,49 @@ task_type* schedule_pop_task(schedule_type* schedule);
  */
 task_type* schedule_get_first_task(schedule_type* schedule);
 
+/**
+ * Number of scheduled tasks.
+ * \param[in] schedule schedule
+ * \return size_t number of tasks
+ *
+ */
+size_t schedule_count(schedule_type* schedule);
+
+/**
+ * List scheduled tasks, in the order they will be performed.
+ * \param[in] schedule schedule
+ * \param[out] count number of tasks
+ * \return task_type** tasks, to be freed by the caller
+ *
+ */
+task_type** schedule_list_tasks(schedule_type* schedule, size_t* count);
+
+/**
+ * Wake up the workers that are waiting for a task to become due.
+ * \param[in] schedule schedule
+ *
+ */
+void schedule_wakeup(schedule_type* schedule);
+
+/**
+ * String-format of priority class.
+ * \param[in] klass priority class
+ * \return const char* string-format of priority class
+ *
+ */
+const char* schedule_class2str(schedule_class klass);
+
+/**
+ * Convert task lateness of a priority class to string.
+ * \param[in] schedule schedule
+ * \param[in] klass priority class
+ * \param[out] buf buffer of ODS_SE_MAXLINE to store the string in
+ * \return char* string-format of task lateness
+ *
+ */
+char* schedule_lateness2str(schedule_type* schedule, schedule_class klass,
+    char* buf);
+
 /**
  * Print schedule.
  * \param[in] out file descriptor
@@ -72,15 +72,47 @@ task_create(task_id what, time_t when, void* zone)
     task->what = what;
     task->interrupt = TASK_NONE;
     task->halted = TASK_NONE;
+    task->pending = TASK_NONE;
     task->when = when;
     task->halted_when = 0;
     task->backoff = 0;
     task->flush = 0;
     task->zone = zone;
+    task->cost = 0;
+    task->large = 0;
+    task->deadline = 0;
+    task->scheduled = 0;
+    task->running_large = 0;
+    task->klass = 0;
+    task->heap_index = 0;
+    task->runq_prev = NULL;
+    task->runq_next = NULL;
     return task;
 }
 
 
+/**
+ * Interrupt task.
+ *
+ */
+void
+task_interrupt(task_type* task, task_id what)
+{
+    ods_log_assert(task);
+    if (task->what != what) {
+        task->halted = task->what;
+        task->halted_when = task->when;
+        task->interrupt = what;
+    }
+    /** Only reschedule if what to do is lower than what was scheduled. */
+    if (task->what > what) {
+        task->what = what;
+    }
+    task->when = time_now();
+    return;
+}
+
+
 /**
  * Backup task.
  *
@@ -129,7 +161,7 @@ task_compare(const void* a, const void* b)
     }
     /* order task on time, what to do, dname */
     if (x->when != y->when) {
-        return (int) x->when - y->when;
+        return x->when < y->when ? -1 : 1;
     }
     if (x->what != y->what) {
         return (int) x->what - y->what;
@@ -58,11 +58,24 @@ struct task_struct {
     task_id what;
     task_id interrupt;
     task_id halted;
+    task_id pending; /* requested while being worked on, schedule locked */
     time_t when;
     time_t halted_when;
     time_t backoff;
     int flush;
     void* zone;
+    /* estimated work, RRsets queued when the zone was last signed */
+    size_t cost;
+    int large;
+    /* earliest signature expiration of the zone, 0 if not signed yet */
+    time_t deadline;
+    /* schedule bookkeeping, schedule locked */
+    int scheduled;
+    int running_large;
+    int klass;
+    size_t heap_index;
+    task_type* runq_prev;
+    task_type* runq_next;
 };
 
 /**
@@ -75,6 +88,14 @@ struct task_struct {
  */
 task_type* task_create(task_id what, time_t when, void* zone);
 
+/**
+ * Interrupt task: do what first, then continue with the task at hand.
+ * \param[in] task task
+ * \param[in] what task identifier
+ *
+ */
+void task_interrupt(task_type* task, task_id what);
+
 /**
  * Backup task.
  * \param[in] fd file descriptor
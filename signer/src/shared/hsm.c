@@ -34,6 +34,7 @@
 #include "daemon/engine.h"
 #include "shared/hsm.h"
 #include "shared/log.h"
+#include "shared/metrics.h"
 
 static const char* hsm_str = "hsm";
 
@@ -95,6 +96,8 @@ lhsm_clear_key_cache(key_type* key)
         key->dnskey = NULL;
     }
     if (key->hsmkey) {
+        /* the HSM may have lost the key, look it up there again */
+        hsm_key_cache_forget(key->hsmkey);
         hsm_key_free(key->hsmkey);
         key->hsmkey = NULL;
     }
@@ -224,6 +227,7 @@ lhsm_sign(hsm_ctx_t* ctx, ldns_rr_list* rrset, key_type* key_id,
     ldns_rr* result = NULL;
     hsm_sign_params_t* params = NULL;
     int retries = 0;
+    uint64_t start = 0;
 
     if (!owner || !key_id || !rrset || !inception || !expiration) {
         ods_log_error("[%s] unable to sign: missing required elements",
@@ -264,7 +268,9 @@ lhsm_sign_start:
     ods_log_deeebug("[%s] sign RRset[%i] with key %s tag %u", hsm_str,
         ldns_rr_get_type(ldns_rr_list_rr(rrset, 0)),
         key_id->locator?key_id->locator:"(null)", params->keytag);
+    start = metrics_usec();
     result = hsm_sign_rrset(ctx, rrset, key_id->hsmkey, params);
+    metrics_hsm_sign(key_id->locator, metrics_usec() - start);
     hsm_sign_params_free(params);
     if (!result) {
         error = hsm_get_error(ctx);
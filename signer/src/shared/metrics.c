@@ -0,0 +1,764 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Signer metrics.
+ *
+ */
+
+#include "config.h"
+#include "shared/file.h"
+#include "shared/locks.h"
+#include "shared/log.h"
+#include "shared/metrics.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <time.h>
+
+static const char* metrics_str = "metrics";
+
+#define METRICS_LOCATOR_SIZE 128
+
+/**
+ * Histogram with power of two buckets.
+ *
+ */
+typedef struct metrics_histogram_struct metrics_histogram_type;
+struct metrics_histogram_struct {
+    uint64_t buckets[METRICS_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+};
+
+/**
+ * Signing latency per key.
+ *
+ */
+typedef struct metrics_key_struct metrics_key_type;
+struct metrics_key_struct {
+    char locator[METRICS_LOCATOR_SIZE];
+    metrics_histogram_type sign;
+};
+
+/**
+ * Metrics.
+ *
+ */
+typedef struct metrics_struct metrics_type;
+struct metrics_struct {
+    metrics_histogram_type phase[METRICS_NUM_PHASES];
+    metrics_key_type keys[METRICS_MAX_KEYS];
+    size_t keys_count;
+    metrics_histogram_type keys_other;
+    metrics_histogram_type signq_depth;
+    metrics_histogram_type signq_wait;
+    size_t signq_current;
+    uint64_t signq_stamp;
+    uint64_t drudger_busy;
+    uint64_t counters[METRICS_NUM_COUNTERS];
+};
+
+/**
+ * Metrics of one thread. Only the owning thread writes to it, the lock
+ * is taken by an export as well, so it is hardly ever contended.
+ *
+ */
+typedef struct metrics_shard_struct metrics_shard_type;
+struct metrics_shard_struct {
+    metrics_shard_type* next;
+    lock_basic_type lock;
+    metrics_type m;
+};
+
+static uint64_t metrics_start = 0;
+/* protects the list of shards, taken once per thread and by an export */
+static lock_basic_type metrics_lock;
+static metrics_shard_type* metrics_shards = NULL;
+#if defined(HAVE_PTHREAD)
+static pthread_key_t metrics_key;
+#else
+static metrics_shard_type* metrics_shard_single = NULL;
+#endif
+static int metrics_initialized = 0;
+
+static const char* metrics_phase_str[METRICS_NUM_PHASES] = {
+    "configure", "read", "nsecify", "sign", "write", "backup"
+};
+static const char* metrics_counter_str[METRICS_NUM_COUNTERS] = {
+    "xfr_in_messages", "xfr_in_done", "xfr_in_failed",
+    "xfr_out_axfr", "xfr_out_ixfr",
+    "notify_in", "notify_out", "notify_out_acked"
+};
+
+
+/**
+ * Initialize metrics.
+ *
+ */
+void
+metrics_init(void)
+{
+    if (metrics_initialized) {
+        return;
+    }
+    metrics_start = metrics_usec();
+    metrics_shards = NULL;
+    lock_basic_init(&metrics_lock);
+#if defined(HAVE_PTHREAD)
+    if (pthread_key_create(&metrics_key, NULL) != 0) {
+        ods_log_error("[%s] unable to initialize metrics: "
+            "pthread_key_create() failed", metrics_str);
+        lock_basic_destroy(&metrics_lock);
+        return;
+    }
+#else
+    metrics_shard_single = NULL;
+#endif
+    metrics_initialized = 1;
+    return;
+}
+
+
+/**
+ * Get the metrics of the calling thread, create them on first use.
+ *
+ */
+static metrics_shard_type*
+metrics_shard(void)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (!metrics_initialized) {
+        return NULL;
+    }
+#if defined(HAVE_PTHREAD)
+    shard = (metrics_shard_type*) pthread_getspecific(metrics_key);
+#else
+    shard = metrics_shard_single;
+#endif
+    if (shard) {
+        return shard;
+    }
+    shard = (metrics_shard_type*) calloc(1, sizeof(metrics_shard_type));
+    if (!shard) {
+        return NULL;
+    }
+    lock_basic_init(&shard->lock);
+#if defined(HAVE_PTHREAD)
+    if (pthread_setspecific(metrics_key, shard) != 0) {
+        lock_basic_destroy(&shard->lock);
+        free((void*) shard);
+        return NULL;
+    }
+#else
+    metrics_shard_single = shard;
+#endif
+    lock_basic_lock(&metrics_lock);
+    shard->next = metrics_shards;
+    metrics_shards = shard;
+    lock_basic_unlock(&metrics_lock);
+    return shard;
+}
+
+
+/**
+ * Monotonic clock in microseconds.
+ *
+ */
+uint64_t
+metrics_usec(void)
+{
+    struct timeval tv;
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (uint64_t) ts.tv_sec * 1000000 +
+            (uint64_t) ts.tv_nsec / 1000;
+    }
+#endif
+    if (gettimeofday(&tv, NULL) != 0) {
+        return 0;
+    }
+    return (uint64_t) tv.tv_sec * 1000000 + (uint64_t) tv.tv_usec;
+}
+
+
+/**
+ * Add value to histogram.
+ *
+ */
+static void
+metrics_observe(metrics_histogram_type* h, uint64_t value)
+{
+    size_t i = 0;
+    while (i < METRICS_BUCKETS - 1 && value > ((uint64_t) 1 << i)) {
+        i++;
+    }
+    h->buckets[i]++;
+    h->count++;
+    h->sum += value;
+    if (value > h->max) {
+        h->max = value;
+    }
+    return;
+}
+
+
+/**
+ * Add histogram to histogram.
+ *
+ */
+static void
+metrics_merge_histogram(metrics_histogram_type* to,
+    metrics_histogram_type* from)
+{
+    size_t i = 0;
+    for (i = 0; i < METRICS_BUCKETS; i++) {
+        to->buckets[i] += from->buckets[i];
+    }
+    to->count += from->count;
+    to->sum += from->sum;
+    if (from->max > to->max) {
+        to->max = from->max;
+    }
+    return;
+}
+
+
+/**
+ * Look up the signing histogram of a key, add the key if there is room.
+ *
+ */
+static metrics_histogram_type*
+metrics_key_histogram(metrics_type* m, const char* locator)
+{
+    size_t i = 0;
+    for (i = 0; i < m->keys_count; i++) {
+        if (strncmp(m->keys[i].locator, locator,
+            METRICS_LOCATOR_SIZE - 1) == 0) {
+            return &m->keys[i].sign;
+        }
+    }
+    if (m->keys_count < METRICS_MAX_KEYS) {
+        i = m->keys_count++;
+        (void) strncpy(m->keys[i].locator, locator,
+            METRICS_LOCATOR_SIZE - 1);
+        m->keys[i].locator[METRICS_LOCATOR_SIZE - 1] = '\0';
+        return &m->keys[i].sign;
+    }
+    return &m->keys_other;
+}
+
+
+/**
+ * Add the metrics of a thread to the total.
+ *
+ */
+static void
+metrics_merge(metrics_type* to, metrics_type* from)
+{
+    size_t i = 0;
+    for (i = 0; i < METRICS_NUM_PHASES; i++) {
+        metrics_merge_histogram(&to->phase[i], &from->phase[i]);
+    }
+    for (i = 0; i < from->keys_count; i++) {
+        metrics_merge_histogram(metrics_key_histogram(to,
+            from->keys[i].locator), &from->keys[i].sign);
+    }
+    metrics_merge_histogram(&to->keys_other, &from->keys_other);
+    metrics_merge_histogram(&to->signq_depth, &from->signq_depth);
+    metrics_merge_histogram(&to->signq_wait, &from->signq_wait);
+    /* the queue depth last seen by any thread */
+    if (from->signq_stamp > to->signq_stamp) {
+        to->signq_stamp = from->signq_stamp;
+        to->signq_current = from->signq_current;
+    }
+    to->drudger_busy += from->drudger_busy;
+    for (i = 0; i < METRICS_NUM_COUNTERS; i++) {
+        to->counters[i] += from->counters[i];
+    }
+    return;
+}
+
+
+/**
+ * Sum the metrics of all threads.
+ *
+ */
+static void
+metrics_snapshot(metrics_type* m)
+{
+    metrics_shard_type* shard = NULL;
+
+    memset(m, 0, sizeof(metrics_type));
+    lock_basic_lock(&metrics_lock);
+    for (shard = metrics_shards; shard; shard = shard->next) {
+        lock_basic_lock(&shard->lock);
+        metrics_merge(m, &shard->m);
+        lock_basic_unlock(&shard->lock);
+    }
+    lock_basic_unlock(&metrics_lock);
+    return;
+}
+
+
+/**
+ * Record the duration of a worker phase.
+ *
+ */
+void
+metrics_phase_time(metrics_phase phase, uint64_t usec)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (phase >= METRICS_NUM_PHASES || !(shard = metrics_shard())) {
+        return;
+    }
+    lock_basic_lock(&shard->lock);
+    metrics_observe(&shard->m.phase[phase], usec);
+    lock_basic_unlock(&shard->lock);
+    return;
+}
+
+
+/**
+ * Record the latency of a signing operation with a key.
+ *
+ */
+void
+metrics_hsm_sign(const char* locator, uint64_t usec)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (!(shard = metrics_shard())) {
+        return;
+    }
+    if (!locator) {
+        locator = "(null)";
+    }
+    lock_basic_lock(&shard->lock);
+    metrics_observe(metrics_key_histogram(&shard->m, locator), usec);
+    lock_basic_unlock(&shard->lock);
+    return;
+}
+
+
+/**
+ * Record the depth of the signing queue after a push.
+ *
+ */
+void
+metrics_signq_push(size_t depth)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (!(shard = metrics_shard())) {
+        return;
+    }
+    lock_basic_lock(&shard->lock);
+    metrics_observe(&shard->m.signq_depth, (uint64_t) depth);
+    shard->m.signq_current = depth;
+    shard->m.signq_stamp = metrics_usec();
+    lock_basic_unlock(&shard->lock);
+    return;
+}
+
+
+/**
+ * Record the time an item waited in the signing queue.
+ *
+ */
+void
+metrics_signq_pop(size_t depth, uint64_t usec)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (!(shard = metrics_shard())) {
+        return;
+    }
+    lock_basic_lock(&shard->lock);
+    metrics_observe(&shard->m.signq_wait, usec);
+    shard->m.signq_current = depth;
+    shard->m.signq_stamp = metrics_usec();
+    lock_basic_unlock(&shard->lock);
+    return;
+}
+
+
+/**
+ * Record time a drudger spent signing.
+ *
+ */
+void
+metrics_drudger_busy(uint64_t usec)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (!(shard = metrics_shard())) {
+        return;
+    }
+    lock_basic_lock(&shard->lock);
+    shard->m.drudger_busy += usec;
+    lock_basic_unlock(&shard->lock);
+    return;
+}
+
+
+/**
+ * Increment event counter.
+ *
+ */
+void
+metrics_count(metrics_counter counter)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (counter >= METRICS_NUM_COUNTERS || !(shard = metrics_shard())) {
+        return;
+    }
+    lock_basic_lock(&shard->lock);
+    shard->m.counters[counter]++;
+    lock_basic_unlock(&shard->lock);
+    return;
+}
+
+
+/**
+ * Write formatted output to file descriptor.
+ *
+ */
+static void
+metrics_printf(int fd, const char* format, ...)
+{
+    char buf[ODS_SE_MAXLINE];
+    va_list args;
+    int len = 0;
+
+    va_start(args, format);
+    len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0) {
+        return;
+    }
+    if ((size_t) len >= sizeof(buf)) {
+        len = sizeof(buf) - 1;
+    }
+    ods_writen(fd, buf, (size_t) len);
+    return;
+}
+
+
+/**
+ * Write histogram in Prometheus text format. Values are divided by scale,
+ * so that microseconds are exported as seconds.
+ *
+ */
+static void
+metrics_export_prom_histogram(int fd, const char* name, const char* label,
+    metrics_histogram_type* h, double scale)
+{
+    size_t i = 0;
+    uint64_t cumulative = 0;
+    const char* sep = label[0]?",":"";
+
+    for (i = 0; i < METRICS_BUCKETS - 1; i++) {
+        cumulative += h->buckets[i];
+        metrics_printf(fd, "%s_bucket{%s%sle=\"%.6g\"} %llu\n", name,
+            label, sep, (double) ((uint64_t) 1 << i) / scale,
+            (unsigned long long) cumulative);
+    }
+    metrics_printf(fd, "%s_bucket{%s%sle=\"+Inf\"} %llu\n", name, label,
+        sep, (unsigned long long) h->count);
+    if (label[0]) {
+        metrics_printf(fd, "%s_sum{%s} %.6f\n", name, label,
+            (double) h->sum / scale);
+        metrics_printf(fd, "%s_count{%s} %llu\n", name, label,
+            (unsigned long long) h->count);
+    } else {
+        metrics_printf(fd, "%s_sum %.6f\n", name, (double) h->sum / scale);
+        metrics_printf(fd, "%s_count %llu\n", name,
+            (unsigned long long) h->count);
+    }
+    return;
+}
+
+
+/**
+ * Write metrics in Prometheus text format.
+ *
+ */
+static void
+metrics_export_prom(int fd, metrics_type* m, uint64_t now)
+{
+    char label[METRICS_LOCATOR_SIZE + 16];
+    size_t i = 0;
+
+    metrics_printf(fd, "# TYPE ods_signer_uptime_seconds gauge\n"
+        "ods_signer_uptime_seconds %.6f\n", (double) (now - metrics_start) / 1e6);
+    metrics_printf(fd, "# TYPE ods_signer_phase_duration_seconds "
+        "histogram\n");
+    for (i = 0; i < METRICS_NUM_PHASES; i++) {
+        (void) snprintf(label, sizeof(label), "phase=\"%s\"",
+            metrics_phase_str[i]);
+        metrics_export_prom_histogram(fd,
+            "ods_signer_phase_duration_seconds", label, &m->phase[i], 1e6);
+    }
+    metrics_printf(fd, "# TYPE ods_signer_hsm_sign_duration_seconds "
+        "histogram\n");
+    for (i = 0; i < m->keys_count; i++) {
+        (void) snprintf(label, sizeof(label), "key=\"%s\"",
+            m->keys[i].locator);
+        metrics_export_prom_histogram(fd,
+            "ods_signer_hsm_sign_duration_seconds", label,
+            &m->keys[i].sign, 1e6);
+    }
+    if (m->keys_other.count) {
+        metrics_export_prom_histogram(fd,
+            "ods_signer_hsm_sign_duration_seconds", "key=\"other\"",
+            &m->keys_other, 1e6);
+    }
+    metrics_printf(fd, "# TYPE ods_signer_signq_depth gauge\n"
+        "ods_signer_signq_depth %lu\n", (unsigned long) m->signq_current);
+    metrics_printf(fd, "# TYPE ods_signer_signq_push_depth histogram\n");
+    metrics_export_prom_histogram(fd, "ods_signer_signq_push_depth", "",
+        &m->signq_depth, 1.0);
+    metrics_printf(fd, "# TYPE ods_signer_signq_wait_seconds histogram\n");
+    metrics_export_prom_histogram(fd, "ods_signer_signq_wait_seconds", "",
+        &m->signq_wait, 1e6);
+    metrics_printf(fd, "# TYPE ods_signer_drudger_busy_seconds_total "
+        "counter\nods_signer_drudger_busy_seconds_total %.6f\n",
+        (double) m->drudger_busy / 1e6);
+    for (i = 0; i < METRICS_NUM_COUNTERS; i++) {
+        metrics_printf(fd, "# TYPE ods_signer_%s_total counter\n"
+            "ods_signer_%s_total %llu\n", metrics_counter_str[i],
+            metrics_counter_str[i], (unsigned long long) m->counters[i]);
+    }
+    return;
+}
+
+
+/**
+ * Write histogram as JSON object. Only non-empty buckets are listed,
+ * keyed by their upper bound.
+ *
+ */
+static void
+metrics_export_json_histogram(int fd, metrics_histogram_type* h)
+{
+    size_t i = 0;
+    int first = 1;
+
+    metrics_printf(fd, "{\"count\": %llu, \"sum\": %llu, \"max\": %llu, "
+        "\"buckets\": {", (unsigned long long) h->count,
+        (unsigned long long) h->sum, (unsigned long long) h->max);
+    for (i = 0; i < METRICS_BUCKETS; i++) {
+        if (!h->buckets[i]) {
+            continue;
+        }
+        if (i < METRICS_BUCKETS - 1) {
+            metrics_printf(fd, "%s\"%llu\": %llu", first?"":", ",
+                (unsigned long long) ((uint64_t) 1 << i),
+                (unsigned long long) h->buckets[i]);
+        } else {
+            metrics_printf(fd, "%s\"+Inf\": %llu", first?"":", ",
+                (unsigned long long) h->buckets[i]);
+        }
+        first = 0;
+    }
+    metrics_printf(fd, "}}");
+    return;
+}
+
+
+/**
+ * Write metrics as JSON. Durations are in microseconds.
+ *
+ */
+static void
+metrics_export_json(int fd, metrics_type* m, uint64_t now)
+{
+    size_t i = 0;
+
+    metrics_printf(fd, "{\n  \"uptime_us\": %llu,\n  \"phase_us\": {",
+        (unsigned long long) (now - metrics_start));
+    for (i = 0; i < METRICS_NUM_PHASES; i++) {
+        metrics_printf(fd, "%s\n    \"%s\": ", i?",":"",
+            metrics_phase_str[i]);
+        metrics_export_json_histogram(fd, &m->phase[i]);
+    }
+    metrics_printf(fd, "\n  },\n  \"hsm_sign_us\": {");
+    for (i = 0; i < m->keys_count; i++) {
+        metrics_printf(fd, "%s\n    \"%s\": ", i?",":"",
+            m->keys[i].locator);
+        metrics_export_json_histogram(fd, &m->keys[i].sign);
+    }
+    if (m->keys_other.count) {
+        metrics_printf(fd, "%s\n    \"other\": ", m->keys_count?",":"");
+        metrics_export_json_histogram(fd, &m->keys_other);
+    }
+    metrics_printf(fd, "\n  },\n  \"signq_depth\": %lu,\n"
+        "  \"signq_push_depth\": ", (unsigned long) m->signq_current);
+    metrics_export_json_histogram(fd, &m->signq_depth);
+    metrics_printf(fd, ",\n  \"signq_wait_us\": ");
+    metrics_export_json_histogram(fd, &m->signq_wait);
+    metrics_printf(fd, ",\n  \"drudger_busy_us\": %llu,\n  \"counters\": {",
+        (unsigned long long) m->drudger_busy);
+    for (i = 0; i < METRICS_NUM_COUNTERS; i++) {
+        metrics_printf(fd, "%s\n    \"%s\": %llu", i?",":"",
+            metrics_counter_str[i], (unsigned long long) m->counters[i]);
+    }
+    metrics_printf(fd, "\n  }\n}\n");
+    return;
+}
+
+
+/**
+ * Write metrics to file descriptor.
+ *
+ */
+void
+metrics_export(int fd, int json)
+{
+    metrics_type* copy = NULL;
+    uint64_t now = 0;
+
+    if (!metrics_initialized) {
+        return;
+    }
+    /* sum up a snapshot, so that a slow reader does not hold up signing */
+    copy = (metrics_type*) malloc(sizeof(metrics_type));
+    if (!copy) {
+        ods_log_error("[%s] unable to export metrics: malloc() failed",
+            metrics_str);
+        return;
+    }
+    metrics_snapshot(copy);
+    now = metrics_usec();
+    if (json) {
+        metrics_export_json(fd, copy, now);
+    } else {
+        metrics_export_prom(fd, copy, now);
+    }
+    free((void*) copy);
+    return;
+}
+
+
+/**
+ * Log a summary of the metrics.
+ *
+ */
+void
+metrics_log(void)
+{
+    metrics_type* copy = NULL;
+    metrics_histogram_type* h = NULL;
+    uint64_t sign_count = 0;
+    uint64_t sign_sum = 0;
+    uint64_t sign_max = 0;
+    struct rusage usage;
+    size_t i = 0;
+
+    if (!metrics_initialized) {
+        return;
+    }
+    copy = (metrics_type*) malloc(sizeof(metrics_type));
+    if (!copy) {
+        ods_log_error("[%s] unable to log metrics: malloc() failed",
+            metrics_str);
+        return;
+    }
+    metrics_snapshot(copy);
+    for (i = 0; i < METRICS_NUM_PHASES; i++) {
+        h = &copy->phase[i];
+        ods_log_info("[%s] phase %s count=%llu total=%llu(usec) "
+            "max=%llu(usec)", metrics_str, metrics_phase_str[i],
+            (unsigned long long) h->count, (unsigned long long) h->sum,
+            (unsigned long long) h->max);
+    }
+    for (i = 0; i <= copy->keys_count; i++) {
+        h = (i < copy->keys_count)?&copy->keys[i].sign:&copy->keys_other;
+        sign_count += h->count;
+        sign_sum += h->sum;
+        if (h->max > sign_max) {
+            sign_max = h->max;
+        }
+    }
+    ods_log_info("[%s] hsm sign count=%llu total=%llu(usec) max=%llu(usec)",
+        metrics_str, (unsigned long long) sign_count,
+        (unsigned long long) sign_sum, (unsigned long long) sign_max);
+    ods_log_info("[%s] signq wait count=%llu total=%llu(usec) "
+        "max=%llu(usec) drudgers busy=%llu(usec)", metrics_str,
+        (unsigned long long) copy->signq_wait.count,
+        (unsigned long long) copy->signq_wait.sum,
+        (unsigned long long) copy->signq_wait.max,
+        (unsigned long long) copy->drudger_busy);
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        ods_log_info("[%s] peak rss=%ld(kB) user=%ld(msec) sys=%ld(msec)",
+            metrics_str, (long) usage.ru_maxrss,
+            (long) usage.ru_utime.tv_sec * 1000 +
+            (long) usage.ru_utime.tv_usec / 1000,
+            (long) usage.ru_stime.tv_sec * 1000 +
+            (long) usage.ru_stime.tv_usec / 1000);
+    }
+    free((void*) copy);
+    return;
+}
+
+
+/**
+ * Clean up metrics.
+ *
+ */
+void
+metrics_cleanup(void)
+{
+    metrics_shard_type* shard = NULL;
+
+    if (!metrics_initialized) {
+        return;
+    }
+    metrics_initialized = 0;
+    while ((shard = metrics_shards) != NULL) {
+        metrics_shards = shard->next;
+        lock_basic_destroy(&shard->lock);
+        free((void*) shard);
+    }
+#if defined(HAVE_PTHREAD)
+    (void) pthread_key_delete(metrics_key);
+#else
+    metrics_shard_single = NULL;
+#endif
+    lock_basic_destroy(&metrics_lock);
+    return;
+}
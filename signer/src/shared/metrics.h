@@ -0,0 +1,157 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Signer metrics.
+ *
+ */
+
+#ifndef SHARED_METRICS_H
+#define SHARED_METRICS_H
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define METRICS_BUCKETS 34 /* le 2^0 .. 2^32, and +Inf */
+#define METRICS_MAX_KEYS 64 /* keys tracked by locator */
+
+/**
+ * Worker phases, as performed by worker_perform_task. Adding NSEC(3)
+ * records is part of the read phase, or of the sign phase for zones that
+ * came in by transfer; backup follows the write phase.
+ *
+ */
+enum metrics_phase_enum {
+    METRICS_PHASE_CONFIGURE = 0,
+    METRICS_PHASE_READ,
+    METRICS_PHASE_NSECIFY,
+    METRICS_PHASE_SIGN,
+    METRICS_PHASE_WRITE,
+    METRICS_PHASE_BACKUP,
+    METRICS_NUM_PHASES
+};
+typedef enum metrics_phase_enum metrics_phase;
+
+/**
+ * Event counters.
+ *
+ */
+enum metrics_counter_enum {
+    METRICS_XFR_IN_MESSAGES = 0,
+    METRICS_XFR_IN_DONE,
+    METRICS_XFR_IN_FAILED,
+    METRICS_XFR_OUT_AXFR,
+    METRICS_XFR_OUT_IXFR,
+    METRICS_NOTIFY_IN,
+    METRICS_NOTIFY_OUT,
+    METRICS_NOTIFY_OUT_ACKED,
+    METRICS_NUM_COUNTERS
+};
+typedef enum metrics_counter_enum metrics_counter;
+
+/**
+ * Initialize metrics. Call once, before the workers are started.
+ *
+ */
+void metrics_init(void);
+
+/**
+ * Monotonic clock in microseconds.
+ * \return uint64_t microseconds
+ *
+ */
+uint64_t metrics_usec(void);
+
+/**
+ * Record the duration of a worker phase.
+ * \param[in] phase worker phase
+ * \param[in] usec duration in microseconds
+ *
+ */
+void metrics_phase_time(metrics_phase phase, uint64_t usec);
+
+/**
+ * Record the latency of a signing operation with a key.
+ * \param[in] locator key locator
+ * \param[in] usec duration in microseconds
+ *
+ */
+void metrics_hsm_sign(const char* locator, uint64_t usec);
+
+/**
+ * Record the depth of the signing queue after a push.
+ * \param[in] depth number of items in queue
+ *
+ */
+void metrics_signq_push(size_t depth);
+
+/**
+ * Record the time an item waited in the signing queue.
+ * \param[in] depth number of items left in queue
+ * \param[in] usec wait time in microseconds
+ *
+ */
+void metrics_signq_pop(size_t depth, uint64_t usec);
+
+/**
+ * Record time a drudger spent signing.
+ * \param[in] usec duration in microseconds
+ *
+ */
+void metrics_drudger_busy(uint64_t usec);
+
+/**
+ * Increment event counter.
+ * \param[in] counter counter
+ *
+ */
+void metrics_count(metrics_counter counter);
+
+/**
+ * Write metrics to file descriptor.
+ * \param[in] fd file descriptor
+ * \param[in] json 1 for JSON, 0 for Prometheus text format
+ *
+ */
+void metrics_export(int fd, int json);
+
+/**
+ * Log a summary of the metrics, including the peak resident set size.
+ *
+ */
+void metrics_log(void);
+
+/**
+ * Clean up metrics.
+ *
+ */
+void metrics_cleanup(void);
+
+#endif /* SHARED_METRICS_H */
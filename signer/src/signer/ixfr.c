@@ -32,11 +32,16 @@
  */
 
 #include "config.h"
+#include "adapter/addns.h"
+#include "adapter/adutil.h"
 #include "shared/util.h"
 #include "signer/ixfr.h"
 #include "signer/rrset.h"
 #include "signer/zone.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 static const char* ixfr_str = "journal";
 
 
@@ -115,9 +120,28 @@ ixfr_create(void* zone)
             "allocator_alloc() failed", ixfr_str, z->name);
         return NULL;
     }
-    for (i=0; i < IXFR_MAX_PARTS; i++) {
+    xfr->part = (part_type**) allocator_alloc(z->allocator,
+        IXFR_DEFAULT_VERSIONS * sizeof(part_type*));
+    xfr->index = (ixfr_index_type*) allocator_alloc(z->allocator,
+        IXFR_DEFAULT_VERSIONS * sizeof(ixfr_index_type));
+    xfr->pending = (ixfr_index_type*) allocator_alloc(z->allocator,
+        IXFR_DEFAULT_VERSIONS * sizeof(ixfr_index_type));
+    if (!xfr->part || !xfr->index || !xfr->pending) {
+        ods_log_error("[%s] unable to create ixfr for zone %s: "
+            "allocator_alloc() failed", ixfr_str, z->name);
+        allocator_deallocate(z->allocator, (void*) xfr->part);
+        allocator_deallocate(z->allocator, (void*) xfr->index);
+        allocator_deallocate(z->allocator, (void*) xfr->pending);
+        allocator_deallocate(z->allocator, (void*) xfr);
+        return NULL;
+    }
+    for (i=0; i < IXFR_DEFAULT_VERSIONS; i++) {
         xfr->part[i] = NULL;
     }
+    xfr->max_parts = IXFR_DEFAULT_VERSIONS;
+    xfr->max_rrs = IXFR_DEFAULT_RECORDS;
+    xfr->index_count = 0;
+    xfr->pending_count = 0;
     xfr->zone = zone;
     lock_basic_init(&xfr->ixfr_lock);
     return xfr;
@@ -257,18 +281,353 @@ void
 ixfr_print(FILE* fd, ixfr_type* ixfr)
 {
     int i = 0;
+    long offset = 0;
     if (!ixfr || !fd) {
         return;
     }
     ods_log_debug("[%s] print ixfr", ixfr_str);
-    for (i = IXFR_MAX_PARTS - 1; i >= 0; i--) {
+    ixfr->pending_count = 0;
+    for (i = (int) ixfr->max_parts - 1; i >= 0; i--) {
         ods_log_deeebug("[%s] print ixfr part #%d", ixfr_str, i);
+        if (ixfr->part[i] && ixfr->part[i]->soamin) {
+            offset = ftell(fd);
+            if (offset >= 0) {
+                ixfr->pending[ixfr->pending_count].serial =
+                    ldns_rdf2native_int32(ldns_rr_rdf(ixfr->part[i]->soamin,
+                    SE_SOA_RDATA_SERIAL));
+                ixfr->pending[ixfr->pending_count].offset = offset;
+                ixfr->pending_count++;
+            }
+        }
         part_print(fd, ixfr, i);
     }
     return;
 }
 
 
+/**
+ * Publish the pending serial index.
+ *
+ */
+void
+ixfr_publish_index(ixfr_type* ixfr)
+{
+    ixfr_index_type* index = NULL;
+    if (!ixfr) {
+        return;
+    }
+    index = ixfr->index;
+    ixfr->index = ixfr->pending;
+    ixfr->index_count = ixfr->pending_count;
+    ixfr->pending = index;
+    ixfr->pending_count = 0;
+    return;
+}
+
+
+/**
+ * Look up where the diff from serial starts in the journal file.
+ *
+ */
+long
+ixfr_lookup_serial(ixfr_type* ixfr, uint32_t serial)
+{
+    size_t i = 0;
+    if (!ixfr) {
+        return -1;
+    }
+    for (i = 0; i < ixfr->index_count; i++) {
+        if (ixfr->index[i].serial == serial) {
+            return ixfr->index[i].offset;
+        }
+    }
+    return -1;
+}
+
+
+/**
+ * Compare RRs, including their TTL, so that a TTL change is kept as a
+ * deletion and an addition.
+ *
+ */
+static int
+ixfr_rr_compare(const void* a, const void* b)
+{
+    ldns_rr* x = (ldns_rr*) a;
+    ldns_rr* y = (ldns_rr*) b;
+    int c = ldns_rr_compare(x, y);
+    if (c != 0) {
+        return c;
+    }
+    if (ldns_rr_ttl(x) < ldns_rr_ttl(y)) {
+        return -1;
+    } else if (ldns_rr_ttl(x) > ldns_rr_ttl(y)) {
+        return 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Condense RR into a diff. If the RR is pending in the opposite list, the
+ * two cancel each other out. Otherwise, the RR is added to its own list.
+ *
+ */
+static ods_status
+ixfr_condense_rr(ldns_rbtree_t* cancel, ldns_rbtree_t* keep, ldns_rr* rr)
+{
+    ldns_rbnode_t* node = ldns_rbtree_delete(cancel, rr);
+    if (node) {
+        ldns_rr_free((ldns_rr*) node->data);
+        free((void*) node);
+        ldns_rr_free(rr);
+        return ODS_STATUS_OK;
+    }
+    if (ldns_rbtree_search(keep, rr)) {
+        /* duplicate */
+        ldns_rr_free(rr);
+        return ODS_STATUS_OK;
+    }
+    node = (ldns_rbnode_t*) malloc(sizeof(ldns_rbnode_t));
+    if (!node) {
+        ldns_rr_free(rr);
+        return ODS_STATUS_MALLOC_ERR;
+    }
+    node->key = rr;
+    node->data = rr;
+    if (!ldns_rbtree_insert(keep, node)) {
+        ldns_rr_free(rr);
+        free((void*) node);
+        return ODS_STATUS_ERR;
+    }
+    return ODS_STATUS_OK;
+}
+
+
+/**
+ * Move the RRs in the tree to the list, freeing the tree nodes.
+ *
+ */
+static void
+ixfr_condense_move(ldns_rbnode_t* elem, ldns_rr_list* rrs)
+{
+    if (elem && elem != LDNS_RBTREE_NULL) {
+        ixfr_condense_move(elem->left, rrs);
+        if (rrs && ldns_rr_list_push_rr(rrs, (ldns_rr*) elem->data)) {
+            elem->data = NULL;
+        }
+        ixfr_condense_move(elem->right, rrs);
+        if (elem->data) {
+            ldns_rr_free((ldns_rr*) elem->data);
+        }
+        free((void*) elem);
+    }
+    return;
+}
+
+
+/**
+ * Read the journal file and condense the diffs from serial onwards.
+ *
+ */
+ods_status
+ixfr_condense(FILE* fd, uint32_t serial, ldns_rr* soa, ldns_rr_list** rrs)
+{
+    ods_status result = ODS_STATUS_OK;
+    ldns_status status = LDNS_STATUS_OK;
+    ldns_rbtree_t* del = NULL;
+    ldns_rbtree_t* add = NULL;
+    ldns_rr_list* list = NULL;
+    ldns_rr* rr = NULL;
+    ldns_rr* soa_from = NULL;
+    ldns_rdf* orig = NULL;
+    ldns_rdf* prev = NULL;
+    char line[SE_ADFILE_MAXLINE];
+    unsigned int l = 0;
+    unsigned del_mode = 0;
+    uint32_t ttl = 0;
+    uint32_t last_serial = 0;
+
+    if (!fd || !soa || !rrs) {
+        return ODS_STATUS_ASSERT_ERR;
+    }
+    *rrs = NULL;
+    del = ldns_rbtree_create(ixfr_rr_compare);
+    add = ldns_rbtree_create(ixfr_rr_compare);
+    if (!del || !add) {
+        result = ODS_STATUS_MALLOC_ERR;
+        goto condense_done;
+    }
+    while ((rr = addns_read_rr(fd, line, &orig, &prev, &ttl, &status, &l))
+        != NULL) {
+        if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
+            del_mode = !del_mode;
+            last_serial = ldns_rdf2native_int32(ldns_rr_rdf(rr,
+                SE_SOA_RDATA_SERIAL));
+            if (!soa_from && del_mode && last_serial == serial) {
+                soa_from = rr;
+            } else {
+                /* intermediate versions are condensed away */
+                ldns_rr_free(rr);
+            }
+            continue;
+        }
+        if (!soa_from) {
+            ldns_rr_free(rr);
+            continue;
+        }
+        if (del_mode) {
+            result = ixfr_condense_rr(add, del, rr);
+        } else {
+            result = ixfr_condense_rr(del, add, rr);
+        }
+        if (result != ODS_STATUS_OK) {
+            goto condense_done;
+        }
+    }
+    /* addns_read_rr() signals end of file with LDNS_STATUS_ERR */
+    if (status != LDNS_STATUS_OK && status != LDNS_STATUS_ERR) {
+        ods_log_error("[%s] unable to condense ixfr: error reading rr at "
+            "line %u (%s)", ixfr_str, l, ldns_get_errorstr_by_id(status));
+        result = ODS_STATUS_PARSE_ERR;
+        goto condense_done;
+    }
+    if (!soa_from) {
+        ods_log_debug("[%s] unable to condense ixfr: serial %u not in "
+            "journal", ixfr_str, serial);
+        result = ODS_STATUS_UNCHANGED;
+        goto condense_done;
+    }
+    /* the journal file ends with the current SOA */
+    if (last_serial != ldns_rdf2native_int32(
+        ldns_rr_rdf(soa, SE_SOA_RDATA_SERIAL))) {
+        ods_log_error("[%s] unable to condense ixfr: journal does not end "
+            "with serial %u", ixfr_str, ldns_rdf2native_int32(
+            ldns_rr_rdf(soa, SE_SOA_RDATA_SERIAL)));
+        result = ODS_STATUS_ERR;
+        goto condense_done;
+    }
+    /* RFC 1995: -SOA(from), deletions, +SOA(to), additions */
+    list = ldns_rr_list_new();
+    if (!list) {
+        result = ODS_STATUS_MALLOC_ERR;
+        goto condense_done;
+    }
+    ldns_rr_list_push_rr(list, soa_from);
+    soa_from = NULL;
+    ixfr_condense_move(del->root, list);
+    del->root = LDNS_RBTREE_NULL;
+    ldns_rr_list_push_rr(list, ldns_rr_clone(soa));
+    ixfr_condense_move(add->root, list);
+    add->root = LDNS_RBTREE_NULL;
+    *rrs = list;
+
+condense_done:
+    if (soa_from) {
+        ldns_rr_free(soa_from);
+    }
+    if (del) {
+        ixfr_condense_move(del->root, NULL);
+        ldns_rbtree_free(del);
+    }
+    if (add) {
+        ixfr_condense_move(add->root, NULL);
+        ldns_rbtree_free(add);
+    }
+    if (orig) {
+        ldns_rdf_deep_free(orig);
+    }
+    if (prev) {
+        ldns_rdf_deep_free(prev);
+    }
+    return result;
+}
+
+
+/**
+ * Number of RRs in part of the ixfr journal.
+ *
+ */
+static size_t
+part_count(part_type* part)
+{
+    if (!part) {
+        return 0;
+    }
+    return ldns_rr_list_rr_count(part->min) +
+        ldns_rr_list_rr_count(part->plus);
+}
+
+
+/**
+ * Set the retention of the ixfr journal.
+ *
+ */
+void
+ixfr_set_retention(ixfr_type* ixfr, size_t versions, size_t rrs)
+{
+    size_t i = 0;
+    zone_type* zone = NULL;
+    part_type** part = NULL;
+    ixfr_index_type* index = NULL;
+    ixfr_index_type* pending = NULL;
+    if (!ixfr) {
+        return;
+    }
+    zone = (zone_type*) ixfr->zone;
+    ods_log_assert(zone);
+    ods_log_assert(zone->allocator);
+    if (versions < 1) {
+        versions = 1;
+    }
+    ixfr->max_rrs = rrs;
+    if (versions == ixfr->max_parts) {
+        return;
+    }
+    ods_log_debug("[%s] zone %s keeps %u versions in ixfr journal",
+        ixfr_str, zone->name, (unsigned) versions);
+    part = (part_type**) allocator_alloc(zone->allocator,
+        versions * sizeof(part_type*));
+    index = (ixfr_index_type*) allocator_alloc(zone->allocator,
+        versions * sizeof(ixfr_index_type));
+    pending = (ixfr_index_type*) allocator_alloc(zone->allocator,
+        versions * sizeof(ixfr_index_type));
+    if (!part || !index || !pending) {
+        ods_log_error("[%s] unable to set ixfr retention for zone %s: "
+            "allocator_alloc() failed", ixfr_str, zone->name);
+        allocator_deallocate(zone->allocator, (void*) part);
+        allocator_deallocate(zone->allocator, (void*) index);
+        allocator_deallocate(zone->allocator, (void*) pending);
+        return;
+    }
+    /* keep the newest versions */
+    for (i = 0; i < versions; i++) {
+        part[i] = i < ixfr->max_parts ? ixfr->part[i] : NULL;
+    }
+    for (i = versions; i < ixfr->max_parts; i++) {
+        part_cleanup(zone->allocator, ixfr->part[i]);
+    }
+    /* the index is written oldest first */
+    if (ixfr->index_count > versions) {
+        memcpy(index, ixfr->index + (ixfr->index_count - versions),
+            versions * sizeof(ixfr_index_type));
+        ixfr->index_count = versions;
+    } else {
+        memcpy(index, ixfr->index,
+            ixfr->index_count * sizeof(ixfr_index_type));
+    }
+    allocator_deallocate(zone->allocator, (void*) ixfr->part);
+    allocator_deallocate(zone->allocator, (void*) ixfr->index);
+    allocator_deallocate(zone->allocator, (void*) ixfr->pending);
+    ixfr->part = part;
+    ixfr->index = index;
+    ixfr->pending = pending;
+    ixfr->pending_count = 0;
+    ixfr->max_parts = versions;
+    return;
+}
+
+
 /**
  * Purge the ixfr journal.
  *
@@ -277,6 +636,7 @@ void
 ixfr_purge(ixfr_type* ixfr)
 {
     int i = 0;
+    size_t count = 0;
     zone_type* zone = NULL;
     if (!ixfr) {
         return;
@@ -285,8 +645,8 @@ ixfr_purge(ixfr_type* ixfr)
     ods_log_assert(zone);
     ods_log_assert(zone->allocator);
     ods_log_debug("[%s] purge ixfr for zone %s", ixfr_str, zone->name);
-    for (i = IXFR_MAX_PARTS - 1; i >= 0; i--) {
-        if (i == (IXFR_MAX_PARTS - 1)) {
+    for (i = (int) ixfr->max_parts - 1; i >= 0; i--) {
+        if (i == ((int) ixfr->max_parts - 1)) {
             part_cleanup(zone->allocator, ixfr->part[i]);
             ixfr->part[i] = NULL;
         } else {
@@ -294,6 +654,19 @@ ixfr_purge(ixfr_type* ixfr)
             ixfr->part[i] = NULL;
         }
     }
+    /* keep the journal within its size bound, but keep the newest diff */
+    if (ixfr->max_rrs > 0) {
+        for (i = 1; i < (int) ixfr->max_parts; i++) {
+            count += part_count(ixfr->part[i]);
+            if (i > 1 && count > ixfr->max_rrs) {
+                ods_log_debug("[%s] drop ixfr part #%d for zone %s: journal "
+                    "exceeds %u records", ixfr_str, i, zone->name,
+                    (unsigned) ixfr->max_rrs);
+                part_cleanup(zone->allocator, ixfr->part[i]);
+                ixfr->part[i] = NULL;
+            }
+        }
+    }
     ixfr->part[0] = part_create(zone->allocator);
     if (!ixfr->part[0]) {
         ods_fatal_exit("[%s] fatal unable to purge ixfr for zone %s: "
@@ -318,9 +691,12 @@ ixfr_cleanup(ixfr_type* ixfr)
     }
     z = (zone_type*) ixfr->zone;
     ixfr_lock = ixfr->ixfr_lock;
-    for (i = IXFR_MAX_PARTS - 1; i >= 0; i--) {
+    for (i = (int) ixfr->max_parts - 1; i >= 0; i--) {
         part_cleanup(z->allocator, ixfr->part[i]);
     }
+    allocator_deallocate(z->allocator, (void*) ixfr->part);
+    allocator_deallocate(z->allocator, (void*) ixfr->index);
+    allocator_deallocate(z->allocator, (void*) ixfr->pending);
     allocator_deallocate(z->allocator, (void*) ixfr);
     lock_basic_destroy(&ixfr_lock);
     return;
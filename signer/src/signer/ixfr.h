@@ -36,10 +36,13 @@
 
 #include "config.h"
 #include "shared/locks.h"
+#include "shared/status.h"
 
 #include <ldns/ldns.h>
+#include <stdio.h>
 
-#define IXFR_MAX_PARTS 3
+#define IXFR_DEFAULT_VERSIONS 3 /* number of versions kept in the journal */
+#define IXFR_DEFAULT_RECORDS 0 /* records kept in the journal, 0 is no limit */
 
 /**
  * Part of IXFR Journal.
@@ -53,6 +56,17 @@ struct part_struct {
     ldns_rr_list* plus;
 };
 
+/**
+ * Serial index entry of the IXFR Journal.
+ * Offset in the journal file where the diff from serial starts.
+ *
+ */
+typedef struct ixfr_index_struct ixfr_index_type;
+struct ixfr_index_struct {
+    uint32_t serial;
+    long offset;
+};
+
 /**
  * IXFR Journal.
  *
@@ -60,7 +74,15 @@ struct part_struct {
 typedef struct ixfr_struct ixfr_type;
 struct ixfr_struct {
     void* zone;
-    part_type* part[IXFR_MAX_PARTS];
+    part_type** part;
+    size_t max_parts;
+    size_t max_rrs;
+    /* serial index of the published journal file */
+    ixfr_index_type* index;
+    size_t index_count;
+    /* serial index of the journal file being written */
+    ixfr_index_type* pending;
+    size_t pending_count;
     lock_basic_type ixfr_lock;
 };
 
@@ -88,14 +110,55 @@ void ixfr_add_rr(ixfr_type* ixfr, ldns_rr* rr);
  */
 void ixfr_del_rr(ixfr_type* ixfr, ldns_rr* rr);
 
+/**
+ * Set the retention of the ixfr journal.
+ * \param[in] ixfr journal
+ * \param[in] versions number of versions to keep
+ * \param[in] rrs number of records to keep, 0 means no limit
+ *
+ */
+void ixfr_set_retention(ixfr_type* ixfr, size_t versions, size_t rrs);
+
 /**
  * Print the ixfr journal.
+ * The offset of each version is remembered in the pending serial index.
  * \param[in] fd file descriptor
  * \param[in] ixfr journal
  *
  */
 void ixfr_print(FILE* fd, ixfr_type* ixfr);
 
+/**
+ * Publish the pending serial index, once the journal file that was
+ * printed last has replaced the previous journal file.
+ * \param[in] ixfr journal
+ *
+ */
+void ixfr_publish_index(ixfr_type* ixfr);
+
+/**
+ * Look up where the diff from serial starts in the journal file.
+ * \param[in] ixfr journal
+ * \param[in] serial serial
+ * \return long offset in the journal file, -1 if not indexed
+ *
+ */
+long ixfr_lookup_serial(ixfr_type* ixfr, uint32_t serial);
+
+/**
+ * Read the journal file from the current position and condense all diffs
+ * from serial onwards into one diff. RRs that are added and later deleted
+ * again (or vice versa) cancel each other out.
+ * \param[in] fd journal file, positioned before the diff from serial
+ * \param[in] serial serial to start from
+ * \param[in] soa current SOA RR, the version the diffs must lead to
+ * \param[out] rrs condensed diff: -SOA, deletions, +SOA, additions
+ * \return ods_status status
+ *
+ */
+ods_status ixfr_condense(FILE* fd, uint32_t serial, ldns_rr* soa,
+    ldns_rr_list** rrs);
+
 /**
  * Purge the ixfr journal.
  * \param[in] ixfr journal
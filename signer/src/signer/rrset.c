@@ -483,6 +483,17 @@ rrset_recycle(rrset_type* rrset, time_t signtime, ldns_rr_type dstatus,
     if (zone->signconf && zone->signconf->sig_refresh_interval) {
         refresh = (uint32_t) (signtime +
             duration2time(zone->signconf->sig_refresh_interval));
+        /**
+         * Under overload, only refresh signatures that would expire
+         * before the next two resigns. The others are refreshed later.
+         */
+        if (zone->shed_refresh && zone->signconf->sig_resign_interval &&
+            duration2time(zone->signconf->sig_resign_interval) &&
+            (uint32_t) (signtime + 2 *
+            duration2time(zone->signconf->sig_resign_interval)) < refresh) {
+            refresh = (uint32_t) (signtime + 2 *
+                duration2time(zone->signconf->sig_resign_interval));
+        }
     }
     /* Check every signature if it matches the recycling logic. */
     for (i=0; i < rrset->rrsig_count; i++) {
@@ -662,6 +673,7 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
     const char* locator = NULL;
     time_t inception = 0;
     time_t expiration = 0;
+    time_t expire_min = 0;
     size_t i = 0;
     domain_type* domain = NULL;
     ldns_rr_type dstatus = LDNS_RR_TYPE_FIRST;
@@ -770,12 +782,23 @@ rrset_sign(hsm_ctx_t* ctx, rrset_type* rrset, time_t signtime)
     }
     /* RRset signing completed */
     ldns_rr_list_free(rr_list);
+    for (i=0; i < rrset->rrsig_count; i++) {
+        expiration = (time_t) ldns_rdf2native_int32(
+            ldns_rr_rrsig_expiration(rrset->rrsigs[i].rr));
+        if (!expire_min || expiration < expire_min) {
+            expire_min = expiration;
+        }
+    }
     lock_basic_lock(&zone->stats->stats_lock);
     if (rrset->rrtype == LDNS_RR_TYPE_SOA) {
         zone->stats->sig_soa_count += newsigs;
     }
     zone->stats->sig_count += newsigs;
     zone->stats->sig_reuse += reusedsigs;
+    if (expire_min && (!zone->stats->sig_expiration ||
+        (uint32_t) expire_min < zone->stats->sig_expiration)) {
+        zone->stats->sig_expiration = (uint32_t) expire_min;
+    }
     lock_basic_unlock(&zone->stats->stats_lock);
     return ODS_STATUS_OK;
 }
@@ -0,0 +1,370 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Published signed version of a zone.
+ *
+ */
+
+#include "config.h"
+#include "shared/log.h"
+#include "shared/util.h"
+#include "signer/denial.h"
+#include "signer/domain.h"
+#include "signer/snapshot.h"
+#include "signer/zone.h"
+#include "wire/buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+static const char* snapshot_str = "snapshot";
+
+/**
+ * Zone transfer encoder.
+ *
+ */
+typedef struct snapshot_encoder_struct snapshot_encoder_type;
+struct snapshot_encoder_struct {
+    snapshot_type* snapshot;
+    buffer_type* buffer;
+    compress_type* table;
+    ldns_rdf* apex;
+    ldns_rr_class klass;
+    size_t start; /* start of the answer section in the buffer */
+    uint16_t ancount;
+    size_t image_capacity;
+    size_t msg_capacity;
+};
+
+
+/**
+ * Start a new message.
+ *
+ */
+static void
+snapshot_encoder_start(snapshot_encoder_type* enc)
+{
+    if (enc->snapshot->msg_count == 0) {
+        /* the first message carries the question */
+        buffer_pkt_axfr(enc->buffer, enc->apex, enc->klass);
+    } else {
+        buffer_clear(enc->buffer);
+        buffer_skip(enc->buffer, BUFFER_PKT_HEADER_SIZE);
+    }
+    buffer_set_limit(enc->buffer, SNAPSHOT_MAX_MESSAGE_LEN);
+    compress_clear(enc->table);
+    if (enc->snapshot->msg_count == 0) {
+        compress_add_dname(enc->table, enc->buffer, BUFFER_PKT_HEADER_SIZE);
+    }
+    enc->start = buffer_position(enc->buffer);
+    enc->ancount = 0;
+    return;
+}
+
+
+/**
+ * Append the current message to the image.
+ *
+ */
+static int
+snapshot_encoder_flush(snapshot_encoder_type* enc)
+{
+    snapshot_type* snapshot = enc->snapshot;
+    size_t len = buffer_position(enc->buffer) - enc->start;
+    void* p = NULL;
+    if (snapshot->image_size + len > enc->image_capacity) {
+        size_t capacity = enc->image_capacity ? enc->image_capacity * 2 :
+            SNAPSHOT_MAX_MESSAGE_LEN;
+        while (capacity < snapshot->image_size + len) {
+            capacity *= 2;
+        }
+        p = realloc(snapshot->image, capacity);
+        if (!p) {
+            return 0;
+        }
+        snapshot->image = (uint8_t*) p;
+        enc->image_capacity = capacity;
+    }
+    if (snapshot->msg_count >= enc->msg_capacity) {
+        size_t capacity = enc->msg_capacity ? enc->msg_capacity * 2 : 16;
+        p = realloc(snapshot->msgs, capacity * sizeof(snapshot_msg_type));
+        if (!p) {
+            return 0;
+        }
+        snapshot->msgs = (snapshot_msg_type*) p;
+        enc->msg_capacity = capacity;
+    }
+    if (snapshot->msg_count == 0) {
+        snapshot->question_size = enc->start - BUFFER_PKT_HEADER_SIZE;
+    }
+    memcpy(snapshot->image + snapshot->image_size,
+        buffer_at(enc->buffer, enc->start), len);
+    snapshot->msgs[snapshot->msg_count].offset = snapshot->image_size;
+    snapshot->msgs[snapshot->msg_count].len = (uint16_t) len;
+    snapshot->msgs[snapshot->msg_count].ancount = enc->ancount;
+    snapshot->msg_count++;
+    snapshot->image_size += len;
+    if (len > snapshot->max_len) {
+        snapshot->max_len = (uint16_t) len;
+    }
+    return 1;
+}
+
+
+/**
+ * Add RR to the zone transfer image.
+ *
+ */
+static int
+snapshot_encoder_add_rr(snapshot_encoder_type* enc, ldns_rr* rr)
+{
+    if (compress_write_rr(enc->table, enc->buffer, rr)) {
+        enc->ancount++;
+        return 1;
+    }
+    if (enc->ancount == 0) {
+        log_rr(rr, "rr does not fit in axfr message", LOG_ERR);
+        return 0;
+    }
+    if (!snapshot_encoder_flush(enc)) {
+        return 0;
+    }
+    snapshot_encoder_start(enc);
+    if (!compress_write_rr(enc->table, enc->buffer, rr)) {
+        log_rr(rr, "rr does not fit in axfr message", LOG_ERR);
+        return 0;
+    }
+    enc->ancount++;
+    return 1;
+}
+
+
+/**
+ * Add RRset to the zone transfer image, in the order of rrset_print().
+ *
+ */
+static int
+snapshot_encoder_add_rrset(snapshot_encoder_type* enc, rrset_type* rrset,
+    int skip_rrsigs, domain_type* domain)
+{
+    size_t i = 0;
+    for (i=0; i < rrset->rr_count; i++) {
+        if (rrset->rrs[i].exists) {
+            if (!snapshot_encoder_add_rr(enc, rrset->rrs[i].rr)) {
+                return 0;
+            }
+            if (domain && domain->is_apex) {
+                ldns_rr_list_push_rr(enc->snapshot->apex,
+                    ldns_rr_clone(rrset->rrs[i].rr));
+            }
+            if (rrset->rrtype == LDNS_RR_TYPE_CNAME ||
+                rrset->rrtype == LDNS_RR_TYPE_DNAME) {
+                /* singleton types */
+                break;
+            }
+        }
+    }
+    if (skip_rrsigs) {
+        return 1;
+    }
+    for (i=0; i < rrset->rrsig_count; i++) {
+        if (!snapshot_encoder_add_rr(enc, rrset->rrsigs[i].rr)) {
+            return 0;
+        }
+        if (domain && domain->is_apex) {
+            ldns_rr_list_push_rr(enc->snapshot->apex,
+                ldns_rr_clone(rrset->rrsigs[i].rr));
+        }
+    }
+    return 1;
+}
+
+
+/**
+ * Add domain to the zone transfer image, in the order of domain_print().
+ *
+ */
+static int
+snapshot_encoder_add_domain(snapshot_encoder_type* enc, domain_type* domain)
+{
+    rrset_type* rrset = NULL;
+    if (domain->rrsets) {
+        rrset = domain_lookup_rrset(domain, LDNS_RR_TYPE_CNAME);
+        if (rrset) {
+            if (!snapshot_encoder_add_rrset(enc, rrset, 0, domain)) {
+                return 0;
+            }
+        } else {
+            if (domain->is_apex) {
+                rrset = domain_lookup_rrset(domain, LDNS_RR_TYPE_SOA);
+                if (rrset &&
+                    !snapshot_encoder_add_rrset(enc, rrset, 0, domain)) {
+                    return 0;
+                }
+            }
+            for (rrset = domain->rrsets; rrset; rrset = rrset->next) {
+                if (rrset->rrtype != LDNS_RR_TYPE_SOA &&
+                    !snapshot_encoder_add_rrset(enc, rrset, 0, domain)) {
+                    return 0;
+                }
+            }
+        }
+    }
+    if (domain->denial && ((denial_type*) domain->denial)->rrset) {
+        return snapshot_encoder_add_rrset(enc,
+            ((denial_type*) domain->denial)->rrset, 0, NULL);
+    }
+    return 1;
+}
+
+
+/**
+ * Create the signed version of a zone.
+ *
+ */
+snapshot_type*
+snapshot_create(void* zone)
+{
+    zone_type* z = (zone_type*) zone;
+    snapshot_type* snapshot = NULL;
+    snapshot_encoder_type enc;
+    allocator_type* allocator = NULL;
+    ldns_rbnode_t* node = LDNS_RBTREE_NULL;
+    rrset_type* soa = NULL;
+    int ok = 1;
+
+    if (!z || !z->db || !z->db->domains) {
+        return NULL;
+    }
+    soa = zone_lookup_rrset(z, z->apex, LDNS_RR_TYPE_SOA);
+    if (!soa || !soa->rr_count) {
+        ods_log_error("[%s] unable to create signed version of zone %s: "
+            "no soa", snapshot_str, z->name);
+        return NULL;
+    }
+    snapshot = (snapshot_type*) malloc(sizeof(snapshot_type));
+    if (!snapshot) {
+        ods_log_error("[%s] unable to create signed version of zone %s: "
+            "malloc() failed", snapshot_str, z->name);
+        return NULL;
+    }
+    memset(snapshot, 0, sizeof(snapshot_type));
+    snapshot->serial = z->db->outserial;
+    snapshot->expire = ldns_rdf2native_int32(ldns_rr_rdf(soa->rrs[0].rr,
+        SE_SOA_RDATA_EXPIRE));
+    snapshot->refcount = 1;
+    snapshot->apex = ldns_rr_list_new();
+    lock_basic_init(&snapshot->snapshot_lock);
+
+    memset(&enc, 0, sizeof(snapshot_encoder_type));
+    allocator = allocator_create(malloc, free);
+    enc.snapshot = snapshot;
+    enc.apex = z->apex;
+    enc.klass = z->klass;
+    enc.buffer = allocator ? buffer_create(allocator, PACKET_BUFFER_SIZE) :
+        NULL;
+    enc.table = allocator ? compress_create(allocator) : NULL;
+    if (!snapshot->apex || !enc.buffer || !enc.table) {
+        ods_log_error("[%s] unable to create signed version of zone %s: "
+            "allocation failed", snapshot_str, z->name);
+        ok = 0;
+    }
+    if (ok) {
+        snapshot_encoder_start(&enc);
+        node = ldns_rbtree_first(z->db->domains);
+    }
+    while (ok && node && node != LDNS_RBTREE_NULL) {
+        ok = snapshot_encoder_add_domain(&enc, (domain_type*) node->data);
+        node = ldns_rbtree_next(node);
+    }
+    /* the transfer ends with the soa */
+    if (ok) {
+        ok = snapshot_encoder_add_rrset(&enc, soa, 1, NULL);
+    }
+    if (ok) {
+        ok = snapshot_encoder_flush(&enc);
+    }
+    compress_cleanup(enc.table);
+    buffer_cleanup(enc.buffer, allocator);
+    allocator_cleanup(allocator);
+    if (!ok) {
+        ods_log_error("[%s] unable to create signed version of zone %s",
+            snapshot_str, z->name);
+        snapshot_release(snapshot);
+        return NULL;
+    }
+    ods_log_debug("[%s] zone %s serial %u: %lu bytes in %lu messages",
+        snapshot_str, z->name, snapshot->serial,
+        (unsigned long) snapshot->image_size,
+        (unsigned long) snapshot->msg_count);
+    return snapshot;
+}
+
+
+/**
+ * Pin signed version.
+ *
+ */
+snapshot_type*
+snapshot_pin(snapshot_type* snapshot)
+{
+    if (!snapshot) {
+        return NULL;
+    }
+    lock_basic_lock(&snapshot->snapshot_lock);
+    snapshot->refcount++;
+    lock_basic_unlock(&snapshot->snapshot_lock);
+    return snapshot;
+}
+
+
+/**
+ * Release signed version.
+ *
+ */
+void
+snapshot_release(snapshot_type* snapshot)
+{
+    size_t refcount = 0;
+    if (!snapshot) {
+        return;
+    }
+    lock_basic_lock(&snapshot->snapshot_lock);
+    refcount = --snapshot->refcount;
+    lock_basic_unlock(&snapshot->snapshot_lock);
+    if (refcount > 0) {
+        return;
+    }
+    lock_basic_destroy(&snapshot->snapshot_lock);
+    ldns_rr_list_deep_free(snapshot->apex);
+    free((void*) snapshot->image);
+    free((void*) snapshot->msgs);
+    free((void*) snapshot);
+    return;
+}
@@ -0,0 +1,111 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Published signed version of a zone.
+ *
+ */
+
+#ifndef SIGNER_SNAPSHOT_H
+#define SIGNER_SNAPSHOT_H
+
+#include "config.h"
+#include "shared/locks.h"
+#include "wire/compress.h"
+
+#include <ldns/ldns.h>
+#include <stdint.h>
+
+/* room left in every message for the EDNS and TSIG records */
+#define SNAPSHOT_RESERVED_SPACE 1024
+#define SNAPSHOT_MAX_MESSAGE_LEN (MAX_COMPRESSION_OFFSET - \
+    SNAPSHOT_RESERVED_SPACE)
+
+/**
+ * Message of the pre-encoded zone transfer.
+ *
+ */
+typedef struct snapshot_msg_struct snapshot_msg_type;
+struct snapshot_msg_struct {
+    size_t offset; /* start of the answer section in the image */
+    uint16_t len; /* length of the answer section */
+    uint16_t ancount;
+};
+
+/**
+ * Published signed version of a zone.
+ * Made by the worker that writes the zone to the output adapter, and
+ * read-only from then on. Readers pin the version for as long as they
+ * need it, so that the next version can be published without waiting
+ * for them.
+ *
+ */
+typedef struct snapshot_struct snapshot_type;
+struct snapshot_struct {
+    uint32_t serial;
+    uint32_t expire;
+    /* apex RRs and their signatures, for queries to the apex */
+    ldns_rr_list* apex;
+    /* zone transfer image, answer sections of AXFR messages. The answer
+     * section of the first message starts after the question, in the
+     * other messages right after the header. */
+    uint8_t* image;
+    size_t image_size;
+    size_t question_size;
+    snapshot_msg_type* msgs;
+    size_t msg_count;
+    uint16_t max_len;
+    /* readers */
+    size_t refcount;
+    lock_basic_type snapshot_lock;
+};
+
+/**
+ * Create the signed version of a zone. The caller must hold the zone lock.
+ * \param[in] zone zone
+ * \return snapshot_type* signed version, with one reference for the caller
+ *
+ */
+snapshot_type* snapshot_create(void* zone);
+
+/**
+ * Pin signed version.
+ * \param[in] snapshot signed version
+ * \return snapshot_type* the same signed version
+ *
+ */
+snapshot_type* snapshot_pin(snapshot_type* snapshot);
+
+/**
+ * Release signed version. The last release cleans it up.
+ * \param[in] snapshot signed version
+ *
+ */
+void snapshot_release(snapshot_type* snapshot);
+
+#endif /* SIGNER_SNAPSHOT_H */
@@ -31,6 +31,7 @@
  *
  */
 
+#include "shared/duration.h"
 #include "shared/log.h"
 #include "signer/stats.h"
 
@@ -64,6 +65,7 @@ stats_clear(stats_type* stats)
     stats->sig_count = 0;
     stats->sig_soa_count = 0;
     stats->sig_reuse = 0;
+    stats->sig_expiration = 0;
     stats->sig_time = 0;
     stats->start_time = 0;
     stats->end_time = 0;
@@ -78,6 +80,7 @@ void
 stats_log(stats_type* stats, const char* name, ldns_rr_type nsec_type)
 {
     uint32_t avsign = 0;
+    long expire_in = 0;
 
     if (!stats) {
         return;
@@ -86,14 +89,18 @@ stats_log(stats_type* stats, const char* name, ldns_rr_type nsec_type)
     if (stats->sig_time) {
         avsign = (uint32_t) (stats->sig_count/stats->sig_time);
     }
+    if (stats->sig_expiration) {
+        expire_in = (long) stats->sig_expiration - (long) time_now();
+    }
     ods_log_info("[STATS] %s RR[count=%u time=%u(sec)] "
         "NSEC%s[count=%u time=%u(sec)] "
-        "RRSIG[new=%u reused=%u time=%u(sec) avg=%u(sig/sec)] "
+        "RRSIG[new=%u reused=%u time=%u(sec) avg=%u(sig/sec) "
+        "expire=%ld(sec)] "
         "TOTAL[time=%u(sec)] ",
         name?name:"(null)", stats->sort_count, stats->sort_time,
         nsec_type==LDNS_RR_TYPE_NSEC3?"3":"", stats->nsec_count,
         stats->nsec_time, stats->sig_count, stats->sig_reuse,
-        stats->sig_time, avsign,
+        stats->sig_time, avsign, expire_in,
         (uint32_t) (stats->end_time - stats->start_time));
     return;
 }
@@ -62,6 +62,7 @@ struct stats_struct {
     uint32_t    sig_count;
     uint32_t    sig_soa_count;
     uint32_t    sig_reuse;
+    uint32_t    sig_expiration; /* earliest signature expiration */
     time_t      sig_time;
     time_t      audit_time;
     time_t      start_time;
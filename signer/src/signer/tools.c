@@ -253,9 +253,9 @@ tools_output(zone_type* zone, engine_type* engine)
                 break;
         }
     }
-    if (engine->dnshandler) {
-        dnshandler_fwd_notify(engine->dnshandler, (uint8_t*) ODS_SE_NOTIFY_CMD,
-            strlen(ODS_SE_NOTIFY_CMD));
+    if (engine->dnshandler && zone->notify) {
+        xfrhandler_fwd_notify((xfrhandler_type*) zone->notify->xfrhandler,
+            (uint8_t*) ODS_SE_NOTIFY_CMD, strlen(ODS_SE_NOTIFY_CMD));
     }
     /* log stats */
     if (zone->stats) {
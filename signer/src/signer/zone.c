@@ -102,6 +102,9 @@ zone_create(char* name, ldns_rr_class klass)
     zone->task = NULL;
     zone->xfrd = NULL;
     zone->notify = NULL;
+    zone->snapshot = NULL;
+    zone->sign_next = NULL;
+    zone->shed_refresh = 0;
     zone->db = namedb_create((void*)zone);
     if (!zone->db) {
         ods_log_error("[%s] unable to create zone %s: namedb_create() "
@@ -199,16 +202,7 @@ zone_reschedule_task(zone_type* zone, schedule_type* taskq, task_id what)
      lock_basic_lock(&taskq->schedule_lock);
      task = unschedule_task(taskq, (task_type*) zone->task);
      if (task != NULL) {
-         if (task->what != what) {
-             task->halted = task->what;
-             task->halted_when = task->when;
-             task->interrupt = what;
-         }
-         /** Only reschedule if what to do is lower than what was scheduled. */
-         if (task->what > what) {
-             task->what = what;
-         }
-         task->when = time_now();
+         task_interrupt(task, what);
          status = schedule_task(taskq, task, 0);
      } else {
          /* task not queued, being worked on? */
@@ -219,12 +213,70 @@ zone_reschedule_task(zone_type* zone, schedule_type* taskq, task_id what)
          task->interrupt = what;
          /* task->halted(_when) set by worker */
      }
-     lock_basic_unlock(&taskq->schedule_lock);
      zone->task = task;
+     lock_basic_unlock(&taskq->schedule_lock);
      return status;
 }
 
 
+/**
+ * Reschedule task for zone, without waiting for the zone lock.
+ *
+ */
+ods_status
+zone_reschedule_task_nowait(zone_type* zone, schedule_type* taskq,
+    task_id what)
+{
+    task_type* task = NULL;
+    ods_status status = ODS_STATUS_OK;
+
+    ods_log_assert(taskq);
+    ods_log_assert(zone);
+    ods_log_assert(zone->name);
+    lock_basic_lock(&taskq->schedule_lock);
+    if (!zone->task) {
+        /* no task yet, the first task reads the zone */
+        lock_basic_unlock(&taskq->schedule_lock);
+        return ODS_STATUS_OK;
+    }
+    task = unschedule_task(taskq, (task_type*) zone->task);
+    if (task != NULL) {
+        ods_log_debug("[%s] reschedule task for zone %s", zone_str,
+            zone->name);
+        task_interrupt(task, what);
+        status = schedule_task(taskq, task, 0);
+    } else {
+        /* being worked on, the worker reschedules when it is done */
+        ods_log_debug("[%s] hand off task %s for zone %s to worker",
+            zone_str, task_what2str(what), zone->name);
+        task = (task_type*) zone->task;
+        if (task->pending == TASK_NONE || task->pending > what) {
+            task->pending = what;
+        }
+    }
+    lock_basic_unlock(&taskq->schedule_lock);
+    return status;
+}
+
+
+/**
+ * Pin the published signed version of the zone.
+ *
+ */
+snapshot_type*
+zone_pin_snapshot(zone_type* zone)
+{
+    snapshot_type* snapshot = NULL;
+    if (!zone) {
+        return NULL;
+    }
+    lock_basic_lock(&zone->xfr_lock);
+    snapshot = snapshot_pin(zone->snapshot);
+    lock_basic_unlock(&zone->xfr_lock);
+    return snapshot;
+}
+
+
 /**
  * Publish the keys as indicated by the signer configuration.
  *
@@ -708,6 +760,8 @@ zone_cleanup(zone_type* zone)
     ixfr_cleanup(zone->ixfr);
     xfrd_cleanup(zone->xfrd);
     notify_cleanup(zone->notify);
+    snapshot_release(zone->snapshot);
+    ldns_rdf_deep_free(zone->sign_next);
     signconf_cleanup(zone->signconf);
     stats_cleanup(zone->stats);
     allocator_deallocate(allocator, (void*) zone->notify_command);
@@ -923,6 +977,9 @@ zone_recover2(zone_type* zone)
             fd = ods_fopen(filename, NULL, "r");
         }
         if (fd) {
+            lock_basic_lock(&zone->ixfr->ixfr_lock);
+            dnsout_set_retention((void*) zone);
+            lock_basic_unlock(&zone->ixfr->ixfr_lock);
             status = backup_read_ixfr(fd, zone);
             if (status != ODS_STATUS_OK) {
                 ods_log_warning("[%s] corrupted journal file zone %s, "
@@ -43,6 +43,7 @@
 #include "signer/ixfr.h"
 #include "signer/namedb.h"
 #include "signer/signconf.h"
+#include "signer/snapshot.h"
 #include "signer/stats.h"
 #include "wire/buffer.h"
 #include "wire/notify.h"
@@ -90,8 +91,11 @@ struct zone_struct {
     /* zone transfers */
     xfrd_type* xfrd;
     notify_type* notify;
+    snapshot_type* snapshot; /* published signed version, xfr_lock */
     /* worker variables */
     void* task; /* next assigned task */
+    ldns_rdf* sign_next; /* resume signing at this domain, zone locked */
+    int shed_refresh; /* overload, refresh fewer signatures, zone locked */
     /* statistics */
     stats_type* stats;
     lock_basic_type zone_lock;
@@ -130,6 +134,28 @@ ods_status zone_load_signconf(zone_type* zone, signconf_type** new_signconf);
 ods_status zone_reschedule_task(zone_type* zone, schedule_type* taskq,
     task_id what);
 
+/**
+ * Reschedule task for zone, without taking the zone lock. If the task is
+ * being worked on, the request is handed off to the worker, that
+ * reschedules the task when it puts it back on the queue.
+ * \param[in] zone zone
+ * \param[in] taskq task queue
+ * \param[in] what new task identifier
+ * \return ods_status status
+ *
+ */
+ods_status zone_reschedule_task_nowait(zone_type* zone, schedule_type* taskq,
+    task_id what);
+
+/**
+ * Pin the published signed version of the zone.
+ * \param[in] zone zone
+ * \return snapshot_type* signed version, NULL if none is published yet.
+ *         Release with snapshot_release().
+ *
+ */
+snapshot_type* zone_pin_snapshot(zone_type* zone);
+
 /**
  * Publish the keys as indicated by the signer configuration.
  * \param[in] zone zone
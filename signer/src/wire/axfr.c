@@ -47,6 +47,91 @@
 const char* axfr_str = "axfr";
 
 
+/**
+ * Check if the pre-encoded messages of the signed version fit in the
+ * response.
+ *
+ */
+static int
+axfr_snapshot_fits(query_type* q)
+{
+    snapshot_type* snapshot = q->snapshot;
+    size_t pos = buffer_position(q->buffer);
+    if (!snapshot->msg_count ||
+        pos != BUFFER_PKT_HEADER_SIZE + snapshot->question_size) {
+        /* question differs from the one the image was encoded with */
+        return 0;
+    }
+    if (pos + snapshot->msgs[0].len + q->reserved_space > q->maxlen ||
+        BUFFER_PKT_HEADER_SIZE + snapshot->max_len + q->reserved_space >
+        q->maxlen) {
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * Do AXFR from the signed version.
+ * The answer sections are copied from the pre-encoded image, one message
+ * per packet.
+ *
+ */
+static query_state
+axfr_snapshot(query_type* q)
+{
+    snapshot_msg_type* msg = NULL;
+    time_t expire = 0;
+    ods_log_assert(q->snapshot);
+    if (q->axfr_msg == 0) {
+        /* start AXFR, zone not expired? */
+        if (q->zone->xfrd) {
+            expire = q->zone->xfrd->serial_xfr_acquired;
+            expire += q->snapshot->expire;
+            if (expire < time_now()) {
+                ods_log_warning("[%s] zone %s expired, not transferring zone",
+                    axfr_str, q->zone->name);
+                snapshot_release(q->snapshot);
+                q->snapshot = NULL;
+                buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+                return QUERY_PROCESSED;
+            }
+        }
+        if (q->tsig_rr->status == TSIG_OK) {
+            q->tsig_sign_it = 1; /* sign first packet in stream */
+        }
+        ods_log_debug("[%s] axfr zone %s serial %u from signed version",
+            axfr_str, q->zone->name, q->snapshot->serial);
+    } else {
+        /* subsequent AXFR packets */
+        ods_log_debug("[%s] subsequent axfr packet zone %s", axfr_str,
+            q->zone->name);
+        q->edns_rr->status = EDNS_NOT_PRESENT;
+        buffer_set_limit(q->buffer, BUFFER_PKT_HEADER_SIZE);
+        buffer_pkt_set_qdcount(q->buffer, 0);
+        query_prepare(q);
+    }
+    msg = &q->snapshot->msgs[q->axfr_msg];
+    buffer_write(q->buffer, q->snapshot->image + msg->offset, msg->len);
+    buffer_pkt_set_ancount(q->buffer, msg->ancount);
+    buffer_pkt_set_nscount(q->buffer, 0);
+    buffer_pkt_set_arcount(q->buffer, 0);
+    q->axfr_msg++;
+    if (q->axfr_msg >= q->snapshot->msg_count) {
+        ods_log_debug("[%s] axfr zone %s is done", axfr_str, q->zone->name);
+        q->tsig_sign_it = 1; /* sign last packet */
+        q->axfr_is_done = 1;
+        snapshot_release(q->snapshot);
+        q->snapshot = NULL;
+    } else if (q->tsig_rr->status == TSIG_OK &&
+        q->tsig_rr->update_since_last_prepare >= AXFR_TSIG_SIGN_EVERY_NTH) {
+        /* check if it needs TSIG signatures */
+        q->tsig_sign_it = 1;
+    }
+    return QUERY_AXFR;
+}
+
+
 /**
  * Do AXFR.
  *
@@ -88,8 +173,19 @@ axfr(query_type* q, engine_type* engine)
         q->tsig_sign_it = 0;
     }
     ods_log_assert(q->tsig_rr);
+    if (q->axfr_fd == NULL && q->snapshot == NULL && q->tcp) {
+        /* serve the published signed version, if there is one */
+        q->snapshot = zone_pin_snapshot(q->zone);
+        if (q->snapshot && !axfr_snapshot_fits(q)) {
+            snapshot_release(q->snapshot);
+            q->snapshot = NULL;
+        }
+    }
+    if (q->snapshot) {
+        return axfr_snapshot(q);
+    }
     if (q->axfr_fd == NULL) {
-        /* start AXFR */
+        /* start AXFR, from file */
         xfrfile = ods_build_path(q->zone->name, ".axfr", 0, 1);
         if (xfrfile) {
             q->axfr_fd = ods_fopen(xfrfile, NULL, "r");
@@ -105,8 +201,6 @@ axfr(query_type* q, engine_type* engine)
         if (q->tsig_rr->status == TSIG_OK) {
             q->tsig_sign_it = 1; /* sign first packet in stream */
         }
-        /* compression? */
-
         /* add SOA RR */
         fpos = ftell(q->axfr_fd);
         if (fpos < 0) {
@@ -282,7 +376,9 @@ udp_overflow:
 
 
 /**
- * Do IXFR (equal to AXFR for now).
+ * Do IXFR.
+ * The diffs in the journal from the requested serial onwards are condensed
+ * into a single diff to the current serial.
  *
  */
 query_state
@@ -296,13 +392,12 @@ ixfr(query_type* q, engine_type* engine)
     uint32_t ttl = 0;
     time_t expire = 0;
     ldns_status status = LDNS_STATUS_OK;
+    ods_status result = ODS_STATUS_OK;
     char line[SE_ADFILE_MAXLINE];
     unsigned l = 0;
-    long fpos = 0;
+    long fpos = -1;
     size_t bufpos = 0;
     uint32_t new_serial = 0;
-    unsigned del_mode = 0;
-    unsigned soa_found = 0;
     ods_log_assert(engine);
     ods_log_assert(q);
     ods_log_assert(q->buffer);
@@ -322,12 +417,19 @@ ixfr(query_type* q, engine_type* engine)
         q->tsig_sign_it = 0;
     }
     ods_log_assert(q->tsig_rr);
-    if (q->axfr_fd == NULL) {
+    if (q->ixfr_rrs == NULL) {
         /* start IXFR */
         xfrfile = ods_build_path(q->zone->name, ".ixfr", 0, 1);
+        lock_basic_lock(&q->zone->xfr_lock);
         if (xfrfile) {
             q->axfr_fd = ods_fopen(xfrfile, NULL, "r");
         }
+        if (q->axfr_fd && q->zone->ixfr) {
+            lock_basic_lock(&q->zone->ixfr->ixfr_lock);
+            fpos = ixfr_lookup_serial(q->zone->ixfr, q->serial);
+            lock_basic_unlock(&q->zone->ixfr->ixfr_lock);
+        }
+        lock_basic_unlock(&q->zone->xfr_lock);
         if (!q->axfr_fd) {
             ods_log_error("[%s] unable to open ixfr file %s for zone %s",
                 axfr_str, xfrfile, q->zone->name);
@@ -341,26 +443,23 @@ ixfr(query_type* q, engine_type* engine)
         if (q->tsig_rr->status == TSIG_OK) {
             q->tsig_sign_it = 1; /* sign first packet in stream */
         }
-        /* compression? */
-
         /* add SOA RR */
-        fpos = ftell(q->axfr_fd);
-        if (fpos < 0) {
-            ods_log_error("[%s] unable to read ixfr for zone %s: ftell() "
-                "failed (%s)", axfr_str, q->zone->name, strerror(errno));
-            ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-                q->zone->name);
-            ods_fclose(q->axfr_fd);
-            q->axfr_fd = NULL;
-            buffer_set_position(q->buffer, q->startpos);
-            return axfr(q, engine);
-        }
         rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl, &status,
             &l);
+        if (orig) {
+            ldns_rdf_deep_free(orig);
+            orig = NULL;
+        }
+        if (prev) {
+            ldns_rdf_deep_free(prev);
+            prev = NULL;
+        }
         if (!rr) {
             /* no SOA no transfer */
             ods_log_error("[%s] bad ixfr zone %s, corrupted file",
                 axfr_str, q->zone->name);
+            ods_fclose(q->axfr_fd);
+            q->axfr_fd = NULL;
             buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
             return QUERY_PROCESSED;
         }
@@ -369,6 +468,8 @@ ixfr(query_type* q, engine_type* engine)
             ods_log_error("[%s] bad ixfr zone %s, first rr is not soa",
                 axfr_str, q->zone->name);
             ldns_rr_free(rr);
+            ods_fclose(q->axfr_fd);
+            q->axfr_fd = NULL;
             buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
             return QUERY_PROCESSED;
         }
@@ -396,20 +497,56 @@ ixfr(query_type* q, engine_type* engine)
                 q->zone->name);
             buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
             total_added++;
-            ldns_rr_free(rr);
-            rr = NULL;
             bufpos = buffer_position(q->buffer);
         } else {
             ods_log_error("[%s] soa does not fit in ixfr zone %s",
                 axfr_str, q->zone->name);
             ldns_rr_free(rr);
-            rr = NULL;
+            ods_fclose(q->axfr_fd);
+            q->axfr_fd = NULL;
             buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
             return QUERY_PROCESSED;
         }
+        if (q->serial == new_serial) {
+            /* up to date, only the SOA (RFC 1995, section 2) */
+            ldns_rr_free(rr);
+            ods_fclose(q->axfr_fd);
+            q->axfr_fd = NULL;
+            goto ixfr_done;
+        }
         if (util_serial_gt(q->serial, new_serial)) {
+            ldns_rr_free(rr);
+            goto axfr_fallback;
+        }
+        /* jump to the requested serial, if the journal index knows it */
+        if (fpos >= 0 && fseek(q->axfr_fd, fpos, SEEK_SET) != 0) {
+            ods_log_error("[%s] unable to seek ixfr for zone %s: fseek() "
+                "failed (%s)", axfr_str, q->zone->name, strerror(errno));
+            ldns_rr_free(rr);
+            goto axfr_fallback;
+        }
+        result = ixfr_condense(q->axfr_fd, q->serial, rr, &q->ixfr_rrs);
+        ods_fclose(q->axfr_fd);
+        q->axfr_fd = NULL;
+        if (result != ODS_STATUS_OK) {
+            if (result != ODS_STATUS_UNCHANGED) {
+                ods_log_error("[%s] unable to condense ixfr for zone %s "
+                    "from serial %u (%s)", axfr_str, q->zone->name,
+                    q->serial, ods_status2str(result));
+            }
+            ldns_rr_free(rr);
             goto axfr_fallback;
         }
+        /* the stream ends with the current SOA */
+        if (!ldns_rr_list_push_rr(q->ixfr_rrs, rr)) {
+            ldns_rr_free(rr);
+            goto axfr_fallback;
+        }
+        rr = NULL;
+        q->ixfr_pos = 0;
+        ods_log_debug("[%s] condensed ixfr zone %s from serial %u to %u: "
+            "%u rrs", axfr_str, q->zone->name, q->serial, new_serial,
+            (unsigned) ldns_rr_list_rr_count(q->ixfr_rrs));
     } else if (q->tcp) {
         /* subsequent IXFR packets */
         ods_log_debug("[%s] subsequent ixfr packet zone %s", axfr_str,
@@ -420,82 +557,28 @@ ixfr(query_type* q, engine_type* engine)
     }
 
     /* add as many records as fit */
-    fpos = ftell(q->axfr_fd);
-    if (fpos < 0) {
-        ods_log_error("[%s] unable to read ixfr for zone %s: ftell() failed "
-            "(%s)", axfr_str, q->zone->name, strerror(errno));
-        ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-            q->zone->name);
-        ods_fclose(q->axfr_fd);
-        q->axfr_fd = NULL;
-        buffer_set_position(q->buffer, q->startpos);
-        return axfr(q, engine);
-    }
-    while ((rr = addns_read_rr(q->axfr_fd, line, &orig, &prev, &ttl,
-        &status, &l)) != NULL) {
-        ods_log_deeebug("[%s] read rr at line %d", axfr_str, l);
-        if (status != LDNS_STATUS_OK) {
-            ldns_rr_free(rr);
-            rr = NULL;
-            ods_log_error("[%s] error reading rr at line %i (%s): %s",
-                axfr_str, l, ldns_get_errorstr_by_id(status), line);
-            goto axfr_fallback;
-        }
-        if (ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA) {
-            del_mode = !del_mode;
-        }
-        if (!soa_found) {
-            if (del_mode && ldns_rr_get_type(rr) == LDNS_RR_TYPE_SOA &&
-                q->serial == ldns_rdf2native_int32(
-                ldns_rr_rdf(rr, SE_SOA_RDATA_SERIAL))) {
-                soa_found = 1;
-            } else {
-                ods_log_deeebug("[%s] soa not found for rr at line %d",
-                    axfr_str, l);
-                continue;
-            }
-        }
-        /* does it fit? */
+    while (q->ixfr_pos < ldns_rr_list_rr_count(q->ixfr_rrs)) {
+        rr = ldns_rr_list_rr(q->ixfr_rrs, q->ixfr_pos);
         if (query_add_rr(q, rr)) {
-            ods_log_deeebug("[%s] add rr at line %d", axfr_str, l);
-            ldns_rr_free(rr);
-            rr = NULL;
-            fpos = ftell(q->axfr_fd);
-            if (fpos < 0) {
-                ods_log_error("[%s] unable to read ixfr for zone %s: ftell() "
-                    "failed (%s)", axfr_str, q->zone->name, strerror(errno));
-                ods_log_info("[%s] axfr fallback zone %s", axfr_str,
-                    q->zone->name);
-                ods_fclose(q->axfr_fd);
-                q->axfr_fd = NULL;
-                buffer_set_position(q->buffer, q->startpos);
-                return axfr(q, engine);
-            }
             buffer_pkt_set_ancount(q->buffer, buffer_pkt_ancount(q->buffer)+1);
             total_added++;
+            q->ixfr_pos++;
+        } else if (!q->tcp) {
+            goto axfr_fallback;
+        } else if (total_added == 0) {
+            ods_log_error("[%s] rr does not fit in ixfr zone %s",
+                axfr_str, q->zone->name);
+            buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
+            return QUERY_PROCESSED;
         } else {
-            ods_log_deeebug("[%s] rr at line %d does not fit", axfr_str, l);
-            ldns_rr_free(rr);
-            rr = NULL;
-            if (fseek(q->axfr_fd, fpos, SEEK_SET) != 0) {
-                ods_log_error("[%s] unable to reset file position in ixfr "
-                    "file: fseek() failed (%s)", axfr_str, strerror(errno));
-                buffer_pkt_set_rcode(q->buffer, LDNS_RCODE_SERVFAIL);
-                return QUERY_PROCESSED;
-            } else if (q->tcp) {
-                goto return_ixfr;
-            } else {
-                goto axfr_fallback;
-            }
+            goto return_ixfr;
         }
     }
-    if (!soa_found) {
-        goto axfr_fallback;
-    }
+
+ixfr_done:
     ods_log_debug("[%s] ixfr zone %s is done", axfr_str, q->zone->name);
     q->tsig_sign_it = 1; /* sign last packet */
     q->axfr_is_done = 1;
-    ods_fclose(q->axfr_fd);
 
 return_ixfr:
     ods_log_debug("[%s] return part ixfr zone %s", axfr_str, q->zone->name);
@@ -512,12 +595,12 @@ return_ixfr:
     return QUERY_IXFR;
 
 axfr_fallback:
+    if (q->axfr_fd) {
+        ods_fclose(q->axfr_fd);
+        q->axfr_fd = NULL;
+    }
     if (q->tcp) {
         ods_log_info("[%s] axfr fallback zone %s", axfr_str, q->zone->name);
-        if (q->axfr_fd) {
-            ods_fclose(q->axfr_fd);
-            q->axfr_fd = NULL;
-        }
         buffer_set_position(q->buffer, q->startpos);
         return axfr(q, engine);
     }
@@ -40,8 +40,6 @@
 
 #include <ldns/ldns.h>
 
-/* NSD values */
-#define MAX_COMPRESSION_OFFSET 16383 /* Compression pointers are 14 bit. */
 #define AXFR_MAX_MESSAGE_LEN MAX_COMPRESSION_OFFSET
 
 /**
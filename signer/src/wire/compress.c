@@ -0,0 +1,420 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Name compression.
+ *
+ */
+
+#include "config.h"
+#include "shared/log.h"
+#include "wire/buffer.h"
+#include "wire/compress.h"
+
+#include <string.h>
+
+static const char* compress_str = "compress";
+
+
+/**
+ * Create compression table.
+ *
+ */
+compress_type*
+compress_create(allocator_type* allocator)
+{
+    compress_type* table = NULL;
+    if (!allocator) {
+        return NULL;
+    }
+    table = (compress_type*) allocator_alloc(allocator,
+        sizeof(compress_type));
+    if (!table) {
+        ods_log_error("[%s] unable to create compression table: "
+            "allocator_alloc() failed", compress_str);
+        return NULL;
+    }
+    table->allocator = allocator;
+    compress_clear(table);
+    return table;
+}
+
+
+/**
+ * Clear compression table.
+ *
+ */
+void
+compress_clear(compress_type* table)
+{
+    if (!table) {
+        return;
+    }
+    memset(table->buckets, 0xff, sizeof(table->buckets));
+    table->count = 0;
+    return;
+}
+
+
+/**
+ * Forget all suffixes at or beyond a message offset.
+ *
+ */
+void
+compress_rollback(compress_type* table, size_t mark)
+{
+    compress_entry_type* entry = NULL;
+    if (!table) {
+        return;
+    }
+    while (table->count > 0) {
+        entry = &table->entries[table->count - 1];
+        if (entry->offset < mark) {
+            break;
+        }
+        /* entries are pushed at the head of their bucket */
+        ods_log_assert(table->buckets[entry->hash % COMPRESS_HASH_SIZE] ==
+            table->count - 1);
+        table->buckets[entry->hash % COMPRESS_HASH_SIZE] = entry->next;
+        table->count--;
+    }
+    return;
+}
+
+
+/**
+ * Split uncompressed name into labels and compute the hash of every
+ * suffix. Returns the number of labels, not counting the root label.
+ *
+ */
+static size_t
+compress_labels(const uint8_t* dname, size_t size, size_t* labels,
+    uint32_t* hashes)
+{
+    size_t count = 0;
+    size_t pos = 0;
+    size_t i = 0;
+    uint32_t hash = 5381;
+    while (pos < size && dname[pos] != 0) {
+        if ((dname[pos] & 0xc0) != 0 || count >= COMPRESS_MAX_LABELS) {
+            return 0;
+        }
+        labels[count++] = pos;
+        pos += dname[pos] + 1;
+    }
+    if (pos >= size) {
+        return 0;
+    }
+    /* hash suffixes from the root up */
+    i = count;
+    pos = size - 1;
+    while (i > 0) {
+        i--;
+        while (pos > labels[i]) {
+            pos--;
+            hash = ((hash << 5) + hash) ^ dname[pos];
+        }
+        hashes[i] = hash;
+    }
+    return count;
+}
+
+
+/**
+ * Check if the name at the message offset equals the uncompressed suffix.
+ *
+ */
+static int
+compress_match(buffer_type* buffer, size_t offset, const uint8_t* suffix,
+    size_t size)
+{
+    size_t i = 0;
+    size_t hops = 0;
+    uint8_t len = 0;
+    while (offset < buffer_position(buffer)) {
+        len = *buffer_at(buffer, offset);
+        if ((len & 0xc0) == 0xc0) {
+            if (++hops > COMPRESS_MAX_LABELS) {
+                return 0;
+            }
+            offset = ((len & 0x3f) << 8) | *buffer_at(buffer, offset + 1);
+            continue;
+        }
+        if (i >= size || len != suffix[i]) {
+            return 0;
+        }
+        if (len == 0) {
+            return (i + 1 == size);
+        }
+        if (offset + len >= buffer_position(buffer) ||
+            memcmp(buffer_at(buffer, offset + 1), suffix + i + 1, len) != 0) {
+            return 0;
+        }
+        i += len + 1;
+        offset += len + 1;
+    }
+    return 0;
+}
+
+
+/**
+ * Look up suffix in compression table.
+ *
+ */
+static uint16_t
+compress_lookup(compress_type* table, buffer_type* buffer,
+    const uint8_t* suffix, size_t size, uint32_t hash)
+{
+    uint16_t index = table->buckets[hash % COMPRESS_HASH_SIZE];
+    while (index != COMPRESS_NONE) {
+        if (table->entries[index].hash == hash &&
+            compress_match(buffer, table->entries[index].offset, suffix,
+            size)) {
+            return table->entries[index].offset;
+        }
+        index = table->entries[index].next;
+    }
+    return COMPRESS_NONE;
+}
+
+
+/**
+ * Insert suffix into compression table.
+ *
+ */
+static void
+compress_insert(compress_type* table, size_t offset, uint32_t hash)
+{
+    compress_entry_type* entry = NULL;
+    if (offset > MAX_COMPRESSION_OFFSET ||
+        table->count >= COMPRESS_MAX_ENTRIES) {
+        return;
+    }
+    entry = &table->entries[table->count];
+    entry->hash = hash;
+    entry->offset = (uint16_t) offset;
+    entry->next = table->buckets[hash % COMPRESS_HASH_SIZE];
+    table->buckets[hash % COMPRESS_HASH_SIZE] = table->count;
+    table->count++;
+    return;
+}
+
+
+/**
+ * Remember the suffixes of an uncompressed name in the buffer.
+ *
+ */
+void
+compress_add_dname(compress_type* table, buffer_type* buffer, size_t offset)
+{
+    size_t labels[COMPRESS_MAX_LABELS];
+    uint32_t hashes[COMPRESS_MAX_LABELS];
+    size_t size = 0;
+    size_t count = 0;
+    size_t i = 0;
+    uint8_t len = 0;
+    if (!table || !buffer) {
+        return;
+    }
+    /* find the end of the name, do not follow pointers */
+    while (offset + size < buffer_limit(buffer)) {
+        len = *buffer_at(buffer, offset + size);
+        if ((len & 0xc0) != 0) {
+            return;
+        }
+        size += len + 1;
+        if (len == 0) {
+            break;
+        }
+    }
+    if (size == 0 || size > MAXDOMAINLEN ||
+        offset + size > buffer_limit(buffer)) {
+        return;
+    }
+    count = compress_labels(buffer_at(buffer, offset), size, labels, hashes);
+    for (i = 0; i < count; i++) {
+        compress_insert(table, offset + labels[i], hashes[i]);
+    }
+    return;
+}
+
+
+/**
+ * Write domain name to buffer, using compression if possible.
+ *
+ */
+int
+compress_write_dname(compress_type* table, buffer_type* buffer,
+    ldns_rdf* dname)
+{
+    size_t labels[COMPRESS_MAX_LABELS];
+    uint32_t hashes[COMPRESS_MAX_LABELS];
+    const uint8_t* data = NULL;
+    size_t size = 0;
+    size_t count = 0;
+    size_t start = 0;
+    size_t i = 0;
+    size_t j = 0;
+    uint16_t pointer = COMPRESS_NONE;
+    ods_log_assert(buffer);
+    ods_log_assert(dname);
+    data = ldns_rdf_data(dname);
+    size = ldns_rdf_size(dname);
+    if (table) {
+        count = compress_labels(data, size, labels, hashes);
+    }
+    for (i = 0; i < count; i++) {
+        pointer = compress_lookup(table, buffer, data + labels[i],
+            size - labels[i], hashes[i]);
+        if (pointer != COMPRESS_NONE) {
+            break;
+        }
+    }
+    start = buffer_position(buffer);
+    if (pointer != COMPRESS_NONE) {
+        if (!buffer_available(buffer, labels[i] + sizeof(uint16_t))) {
+            return 0;
+        }
+        buffer_write(buffer, data, labels[i]);
+        buffer_write_u16(buffer, 0xc000 | pointer);
+    } else {
+        if (!buffer_available(buffer, size)) {
+            return 0;
+        }
+        buffer_write(buffer, data, size);
+    }
+    /* remember the suffixes that were written out in full */
+    for (j = 0; j < i; j++) {
+        compress_insert(table, start + labels[j], hashes[j]);
+    }
+    return 1;
+}
+
+
+/**
+ * Check if domain names in the rdata of this RR type may be compressed.
+ *
+ */
+static int
+compress_rdata_allowed(ldns_rr_type type)
+{
+    switch (type) {
+        case LDNS_RR_TYPE_NS:
+        case LDNS_RR_TYPE_MD:
+        case LDNS_RR_TYPE_MF:
+        case LDNS_RR_TYPE_CNAME:
+        case LDNS_RR_TYPE_SOA:
+        case LDNS_RR_TYPE_MB:
+        case LDNS_RR_TYPE_MG:
+        case LDNS_RR_TYPE_MR:
+        case LDNS_RR_TYPE_PTR:
+        case LDNS_RR_TYPE_MINFO:
+        case LDNS_RR_TYPE_MX:
+            return 1;
+        default:
+            break;
+    }
+    return 0;
+}
+
+
+/**
+ * Write RR to buffer.
+ *
+ */
+int
+compress_write_rr(compress_type* table, buffer_type* buffer, ldns_rr* rr)
+{
+    size_t i = 0;
+    size_t tc_mark = 0;
+    size_t rdlength_pos = 0;
+    uint16_t rdlength = 0;
+    ldns_rdf* rdf = NULL;
+    int compress_rdata = 0;
+    ods_log_assert(buffer);
+    ods_log_assert(rr);
+    /* set truncation mark, in case rr does not fit */
+    tc_mark = buffer_position(buffer);
+    /* the buffer may have been rewound since the last write */
+    compress_rollback(table, tc_mark);
+    /* owner type class ttl */
+    if (!compress_write_dname(table, buffer, ldns_rr_owner(rr))) {
+        goto compress_tc;
+    }
+    if (!buffer_available(buffer, sizeof(uint16_t) + sizeof(uint16_t) +
+        sizeof(uint32_t) + sizeof(rdlength))) {
+        goto compress_tc;
+    }
+    buffer_write_u16(buffer, (uint16_t) ldns_rr_get_type(rr));
+    buffer_write_u16(buffer, (uint16_t) ldns_rr_get_class(rr));
+    buffer_write_u32(buffer, (uint32_t) ldns_rr_ttl(rr));
+    /* skip rdlength */
+    rdlength_pos = buffer_position(buffer);
+    buffer_skip(buffer, sizeof(rdlength));
+    /* write rdata */
+    compress_rdata = compress_rdata_allowed(ldns_rr_get_type(rr));
+    for (i=0; i < ldns_rr_rd_count(rr); i++) {
+        rdf = ldns_rr_rdf(rr, i);
+        if (compress_rdata && ldns_rdf_get_type(rdf) == LDNS_RDF_TYPE_DNAME) {
+            if (!compress_write_dname(table, buffer, rdf)) {
+                goto compress_tc;
+            }
+            continue;
+        }
+        if (!buffer_available(buffer, ldns_rdf_size(rdf))) {
+            goto compress_tc;
+        }
+        buffer_write_rdf(buffer, rdf);
+    }
+    /* write rdlength */
+    rdlength = buffer_position(buffer) - rdlength_pos - sizeof(rdlength);
+    buffer_write_u16_at(buffer, rdlength_pos, rdlength);
+    return 1;
+
+compress_tc:
+    buffer_set_position(buffer, tc_mark);
+    compress_rollback(table, tc_mark);
+    return 0;
+}
+
+
+/**
+ * Clean up compression table.
+ *
+ */
+void
+compress_cleanup(compress_type* table)
+{
+    allocator_type* allocator = NULL;
+    if (!table) {
+        return;
+    }
+    allocator = table->allocator;
+    allocator_deallocate(allocator, (void*) table);
+    return;
+}
@@ -0,0 +1,143 @@
+/*
+ * $Id$
+ *
+ * Copyright (c) 2011 NLNet Labs. All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY
+ * DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE
+ * GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER
+ * IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN
+ * IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+/**
+ * Name compression.
+ *
+ */
+
+#ifndef WIRE_COMPRESS_H
+#define WIRE_COMPRESS_H
+
+#include "config.h"
+#include "shared/allocator.h"
+#include "wire/buffer.h"
+
+#include <ldns/ldns.h>
+#include <stdint.h>
+
+/* NSD values */
+#define MAX_COMPRESSION_OFFSET 16383 /* Compression pointers are 14 bit. */
+
+#define COMPRESS_HASH_SIZE 1024 /* number of hash buckets */
+#define COMPRESS_MAX_ENTRIES 4096 /* suffixes remembered per message */
+#define COMPRESS_NONE 0xffff
+#define COMPRESS_MAX_LABELS 128
+
+/**
+ * Compression table entry.
+ * A suffix of an owner or rdata name that has been written to the
+ * message at the given offset.
+ *
+ */
+typedef struct compress_entry_struct compress_entry_type;
+struct compress_entry_struct {
+    uint32_t hash;
+    uint16_t offset;
+    uint16_t next;
+};
+
+/**
+ * Compression table.
+ * Maps name suffixes to their offset in the message that is being
+ * encoded. Entries are stored in order of increasing offset, so that
+ * the table can be rolled back cheaply when an RR does not fit.
+ *
+ */
+typedef struct compress_struct compress_type;
+struct compress_struct {
+    allocator_type* allocator;
+    uint16_t buckets[COMPRESS_HASH_SIZE];
+    compress_entry_type entries[COMPRESS_MAX_ENTRIES];
+    uint16_t count;
+};
+
+/**
+ * Create compression table.
+ * \param[in] allocator memory allocator
+ * \return compress_type* compression table
+ *
+ */
+compress_type* compress_create(allocator_type* allocator);
+
+/**
+ * Clear compression table, for use with a new message.
+ * \param[in] table compression table
+ *
+ */
+void compress_clear(compress_type* table);
+
+/**
+ * Forget all suffixes at or beyond a message offset.
+ * \param[in] table compression table
+ * \param[in] mark message offset
+ *
+ */
+void compress_rollback(compress_type* table, size_t mark);
+
+/**
+ * Remember the suffixes of an uncompressed name that is already in the
+ * buffer, like the query name in the question section.
+ * \param[in] table compression table
+ * \param[in] buffer packet buffer
+ * \param[in] offset offset of the name in the buffer
+ *
+ */
+void compress_add_dname(compress_type* table, buffer_type* buffer,
+    size_t offset);
+
+/**
+ * Write domain name to buffer, using compression if possible.
+ * \param[in] table compression table, NULL means no compression
+ * \param[in] buffer packet buffer
+ * \param[in] dname domain name
+ * \return int 1 if name fits, 0 otherwise
+ *
+ */
+int compress_write_dname(compress_type* table, buffer_type* buffer,
+    ldns_rdf* dname);
+
+/**
+ * Write RR to buffer, compressing the owner name and the domain names in
+ * the rdata of well-known RR types (RFC 3597, section 4).
+ * \param[in] table compression table, NULL means no compression
+ * \param[in] buffer packet buffer
+ * \param[in] rr RR
+ * \return int 1 if RR fits, 0 otherwise
+ *
+ */
+int compress_write_rr(compress_type* table, buffer_type* buffer, ldns_rr* rr);
+
+/**
+ * Clean up compression table.
+ * \param[in] table compression table
+ *
+ */
+void compress_cleanup(compress_type* table);
+
+#endif /* WIRE_COMPRESS_H */
@@ -18,6 +18,10 @@
 #include "shared/log.h"
 #include "wire/netio.h"
 
+#ifdef NETIO_USE_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
 
 #ifndef HAVE_PSELECT
 int pselect(int n, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
@@ -29,6 +33,9 @@ int pselect(int n, fd_set* readfds, fd_set* writefds, fd_set* exceptfds,
 /* One second is 1e9 nanoseconds.  */
 #define NANOSECONDS_PER_SECOND   1000000000L
 
+/* Handler is not in the timeout heap.  */
+#define NETIO_HEAP_NONE ((size_t) -1)
+
 static const char* netio_str = "netio";
 
 
@@ -45,13 +52,53 @@ netio_create(allocator_type* allocator)
         return NULL;
     }
     netio = (netio_type*) allocator_alloc(allocator, sizeof(netio_type));
+    if (!netio) {
+        return NULL;
+    }
     netio->allocator = allocator;
     netio->handlers = NULL;
     netio->deallocated = NULL;
     netio->dispatch_next = NULL;
+    netio->have_current_time = 0;
+    netio->backend = NETIO_BACKEND_SELECT;
+    netio->epfd = -1;
+    netio->fdmap = NULL;
+    netio->fdmap_size = 0;
+    netio->heap = NULL;
+    netio->heap_count = 0;
+    netio->heap_size = 0;
+    netio->dirty = NULL;
+    lock_basic_init(&netio->dirty_lock);
+#ifdef NETIO_USE_EPOLL
+    netio->epfd = epoll_create(NETIO_EPOLL_EVENTS);
+    if (netio->epfd == -1) {
+        ods_log_warning("[%s] unable to use epoll, falling back to select: "
+            "epoll_create() failed (%s)", netio_str, strerror(errno));
+    } else {
+        netio->backend = NETIO_BACKEND_EPOLL;
+    }
+#endif
     return netio;
 }
 
+
+/*
+ * Queue handler for registration with the backend.
+ *
+ */
+static void
+netio_mark_dirty(netio_type* netio, netio_handler_list_type* l)
+{
+    lock_basic_lock(&netio->dirty_lock);
+    if (!l->dirty) {
+        l->dirty = 1;
+        l->dirty_next = netio->dirty;
+        netio->dirty = l;
+    }
+    lock_basic_unlock(&netio->dirty_lock);
+    return;
+}
+
 /*
  * Add a new handler to netio.
  *
@@ -63,17 +110,37 @@ netio_add_handler(netio_type* netio, netio_handler_type* handler)
     if (!netio || !handler) {
         return;
     }
-    if (netio->deallocated) {
-        l = netio->deallocated;
+    lock_basic_lock(&netio->dirty_lock);
+    l = netio->deallocated;
+    if (l) {
         netio->deallocated = l->next;
-    } else {
+    }
+    lock_basic_unlock(&netio->dirty_lock);
+    if (!l) {
         ods_log_assert(netio->allocator);
         l = (netio_handler_list_type*) allocator_alloc(netio->allocator,
             sizeof(netio_handler_list_type));
+        if (!l) {
+            ods_log_error("[%s] unable to add handler: allocator_alloc() "
+                "failed", netio_str);
+            return;
+        }
     }
     l->next = netio->handlers;
     l->handler = handler;
+    l->reg_fd = -1;
+    l->reg_events = NETIO_EVENT_NONE;
+    l->reg_timeout.tv_sec = 0;
+    l->reg_timeout.tv_nsec = 0;
+    l->heap_index = NETIO_HEAP_NONE;
+    l->dirty_next = NULL;
+    l->dirty = 0;
+    l->removed = 0;
+    handler->node = l;
     netio->handlers = l;
+    if (netio->backend == NETIO_BACKEND_EPOLL) {
+        netio_mark_dirty(netio, l);
+    }
     ods_log_debug("[%s] handler added", netio_str);
     return;
 }
@@ -92,20 +159,46 @@ netio_remove_handler(netio_type* netio, netio_handler_type* handler)
     for (lptr = &netio->handlers; *lptr; lptr = &(*lptr)->next) {
         if ((*lptr)->handler == handler) {
             netio_handler_list_type* next = (*lptr)->next;
-            if ((*lptr) == netio->dispatch_next)
+            netio_handler_list_type* l = *lptr;
+            if (l == netio->dispatch_next) {
                 netio->dispatch_next = next;
-                (*lptr)->handler = NULL;
-                (*lptr)->next = netio->deallocated;
-                netio->deallocated = *lptr;
-                *lptr = next;
-                break;
-           }
+            }
+            l->handler = NULL;
+            *lptr = next;
+            if (netio->backend == NETIO_BACKEND_EPOLL) {
+                /* unregistered and recycled by the next dispatch */
+                l->removed = 1;
+                netio_mark_dirty(netio, l);
+            } else {
+                l->next = netio->deallocated;
+                netio->deallocated = l;
+            }
+            break;
+        }
     }
+    handler->node = NULL;
     ods_log_debug("[%s] handler removed", netio_str);
     return;
 }
 
 
+/*
+ * Announce that the handler has changed.
+ *
+ */
+void
+netio_update_handler(netio_type* netio, netio_handler_type* handler)
+{
+    if (!netio || !handler || !handler->node) {
+        return;
+    }
+    if (netio->backend == NETIO_BACKEND_EPOLL) {
+        netio_mark_dirty(netio, handler->node);
+    }
+    return;
+}
+
+
 /*
  * Convert timeval to timespec.
  *
@@ -198,11 +291,452 @@ netio_current_time(netio_type* netio)
 
 
 /*
- * Check for events and dispatch them to the handlers.
+ * Compare the registered timeouts of two handlers in the heap.
  *
  */
-int
-netio_dispatch(netio_type* netio, const struct timespec* timeout,
+static int
+netio_heap_less(netio_type* netio, size_t i, size_t j)
+{
+    return timespec_compare(&netio->heap[i]->reg_timeout,
+        &netio->heap[j]->reg_timeout) < 0;
+}
+
+
+/*
+ * Swap two handlers in the heap.
+ *
+ */
+static void
+netio_heap_swap(netio_type* netio, size_t i, size_t j)
+{
+    netio_handler_list_type* l = netio->heap[i];
+    netio->heap[i] = netio->heap[j];
+    netio->heap[j] = l;
+    netio->heap[i]->heap_index = i;
+    netio->heap[j]->heap_index = j;
+    return;
+}
+
+
+/*
+ * Restore the heap property for the handler at index i.
+ *
+ */
+static void
+netio_heap_fix(netio_type* netio, size_t i)
+{
+    size_t child = 0;
+    while (i > 0 && netio_heap_less(netio, i, (i - 1) / 2)) {
+        netio_heap_swap(netio, i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+    while ((child = 2 * i + 1) < netio->heap_count) {
+        if (child + 1 < netio->heap_count &&
+            netio_heap_less(netio, child + 1, child)) {
+            child++;
+        }
+        if (!netio_heap_less(netio, child, i)) {
+            break;
+        }
+        netio_heap_swap(netio, i, child);
+        i = child;
+    }
+    return;
+}
+
+
+/*
+ * Insert handler in the heap.
+ *
+ */
+static int
+netio_heap_insert(netio_type* netio, netio_handler_list_type* l)
+{
+    netio_handler_list_type** heap = NULL;
+    size_t size = 0;
+    if (netio->heap_count == netio->heap_size) {
+        size = netio->heap_size ? netio->heap_size * 2 : 64;
+        heap = (netio_handler_list_type**) allocator_alloc(netio->allocator,
+            size * sizeof(netio_handler_list_type*));
+        if (!heap) {
+            ods_log_error("[%s] unable to add timeout: allocator_alloc() "
+                "failed", netio_str);
+            return 0;
+        }
+        if (netio->heap_count) {
+            memcpy(heap, netio->heap,
+                netio->heap_count * sizeof(netio_handler_list_type*));
+        }
+        allocator_deallocate(netio->allocator, (void*) netio->heap);
+        netio->heap = heap;
+        netio->heap_size = size;
+    }
+    l->heap_index = netio->heap_count;
+    netio->heap[netio->heap_count++] = l;
+    netio_heap_fix(netio, l->heap_index);
+    return 1;
+}
+
+
+/*
+ * Remove handler from the heap.
+ *
+ */
+static void
+netio_heap_remove(netio_type* netio, netio_handler_list_type* l)
+{
+    size_t i = l->heap_index;
+    if (i == NETIO_HEAP_NONE) {
+        return;
+    }
+    ods_log_assert(i < netio->heap_count && netio->heap[i] == l);
+    netio->heap_count--;
+    if (i != netio->heap_count) {
+        netio_heap_swap(netio, i, netio->heap_count);
+        netio_heap_fix(netio, i);
+    }
+    l->heap_index = NETIO_HEAP_NONE;
+    return;
+}
+
+
+#ifdef NETIO_USE_EPOLL
+/*
+ * Remember which handler owns a file descriptor.
+ *
+ */
+static int
+netio_fdmap_set(netio_type* netio, int fd, netio_handler_list_type* l)
+{
+    netio_handler_list_type** fdmap = NULL;
+    size_t size = 0;
+    if ((size_t) fd >= netio->fdmap_size) {
+        size = netio->fdmap_size ? netio->fdmap_size : 256;
+        while (size <= (size_t) fd) {
+            size *= 2;
+        }
+        fdmap = (netio_handler_list_type**) allocator_alloc(
+            netio->allocator, size * sizeof(netio_handler_list_type*));
+        if (!fdmap) {
+            ods_log_error("[%s] unable to register fd %d: allocator_alloc() "
+                "failed", netio_str, fd);
+            return 0;
+        }
+        memset(fdmap, 0, size * sizeof(netio_handler_list_type*));
+        if (netio->fdmap_size) {
+            memcpy(fdmap, netio->fdmap,
+                netio->fdmap_size * sizeof(netio_handler_list_type*));
+        }
+        allocator_deallocate(netio->allocator, (void*) netio->fdmap);
+        netio->fdmap = fdmap;
+        netio->fdmap_size = size;
+    }
+    netio->fdmap[fd] = l;
+    return 1;
+}
+
+
+/*
+ * Convert netio events to epoll events.
+ *
+ */
+static uint32_t
+netio_epoll_events(netio_events_type event_types)
+{
+    uint32_t events = 0;
+    if (event_types & NETIO_EVENT_READ) {
+        events |= EPOLLIN;
+    }
+    if (event_types & NETIO_EVENT_WRITE) {
+        events |= EPOLLOUT;
+    }
+    if (event_types & NETIO_EVENT_EXCEPT) {
+        events |= EPOLLPRI;
+    }
+    return events;
+}
+
+
+/*
+ * Register the file descriptor of the handler with epoll.
+ *
+ */
+static void
+netio_epoll_sync_fd(netio_type* netio, netio_handler_list_type* l)
+{
+    struct epoll_event ev;
+    netio_handler_type* handler = l->handler;
+    int fd = -1;
+    netio_events_type events = NETIO_EVENT_NONE;
+    if (handler && !l->removed && handler->fd >= 0) {
+        fd = handler->fd;
+        events = handler->event_types &
+            (NETIO_EVENT_READ|NETIO_EVENT_WRITE|NETIO_EVENT_EXCEPT);
+        if (events == NETIO_EVENT_NONE) {
+            fd = -1;
+        }
+    }
+    if (fd == l->reg_fd && events == l->reg_events) {
+        return;
+    }
+    if (l->reg_fd != -1 && l->reg_fd != fd) {
+        /**
+         * The fd may already be closed, or even reused by another
+         * handler, so only unregister it if this handler still owns it.
+         */
+        if ((size_t) l->reg_fd < netio->fdmap_size &&
+            netio->fdmap[l->reg_fd] == l) {
+            (void) epoll_ctl(netio->epfd, EPOLL_CTL_DEL, l->reg_fd, &ev);
+            netio->fdmap[l->reg_fd] = NULL;
+        }
+        l->reg_fd = -1;
+        l->reg_events = NETIO_EVENT_NONE;
+    }
+    if (fd == -1) {
+        return;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = netio_epoll_events(events);
+    ev.data.ptr = (void*) l;
+    if (epoll_ctl(netio->epfd, l->reg_fd == fd ? EPOLL_CTL_MOD :
+        EPOLL_CTL_ADD, fd, &ev) == -1) {
+        /* closed and reopened behind our back, or taken over */
+        if (errno == ENOENT) {
+            (void) epoll_ctl(netio->epfd, EPOLL_CTL_ADD, fd, &ev);
+        } else if (errno == EEXIST) {
+            (void) epoll_ctl(netio->epfd, EPOLL_CTL_MOD, fd, &ev);
+        } else {
+            ods_log_error("[%s] unable to register fd %d: epoll_ctl() "
+                "failed (%s)", netio_str, fd, strerror(errno));
+            return;
+        }
+    }
+    if ((size_t) fd < netio->fdmap_size && netio->fdmap[fd] &&
+        netio->fdmap[fd] != l) {
+        /* previous owner closed this fd */
+        netio->fdmap[fd]->reg_fd = -1;
+        netio->fdmap[fd]->reg_events = NETIO_EVENT_NONE;
+    }
+    if (!netio_fdmap_set(netio, fd, l)) {
+        (void) epoll_ctl(netio->epfd, EPOLL_CTL_DEL, fd, &ev);
+        return;
+    }
+    l->reg_fd = fd;
+    l->reg_events = events;
+    return;
+}
+#endif /* NETIO_USE_EPOLL */
+
+
+/*
+ * Register the timeout of the handler with the heap.
+ *
+ */
+static void
+netio_sync_timeout(netio_type* netio, netio_handler_list_type* l)
+{
+    netio_handler_type* handler = l->handler;
+    if (!handler || l->removed || !handler->timeout ||
+        !(handler->event_types & NETIO_EVENT_TIMEOUT)) {
+        netio_heap_remove(netio, l);
+        return;
+    }
+    if (l->heap_index != NETIO_HEAP_NONE &&
+        timespec_compare(&l->reg_timeout, handler->timeout) == 0) {
+        return;
+    }
+    l->reg_timeout.tv_sec = handler->timeout->tv_sec;
+    l->reg_timeout.tv_nsec = handler->timeout->tv_nsec;
+    if (l->heap_index != NETIO_HEAP_NONE) {
+        netio_heap_fix(netio, l->heap_index);
+    } else {
+        (void) netio_heap_insert(netio, l);
+    }
+    return;
+}
+
+
+/*
+ * Bring the backend up to date with the handler.
+ *
+ */
+static void
+netio_sync_handler(netio_type* netio, netio_handler_list_type* l)
+{
+#ifdef NETIO_USE_EPOLL
+    netio_epoll_sync_fd(netio, l);
+#endif
+    netio_sync_timeout(netio, l);
+    return;
+}
+
+
+/*
+ * Register all handlers that changed since the last dispatch, and
+ * recycle the ones that were removed.
+ *
+ */
+static void
+netio_sync_dirty(netio_type* netio)
+{
+    netio_handler_list_type* l = NULL;
+    netio_handler_list_type* next = NULL;
+    lock_basic_lock(&netio->dirty_lock);
+    l = netio->dirty;
+    netio->dirty = NULL;
+    while (l) {
+        next = l->dirty_next;
+        l->dirty_next = NULL;
+        l->dirty = 0;
+        netio_sync_handler(netio, l);
+        if (l->removed) {
+            l->removed = 0;
+            l->next = netio->deallocated;
+            netio->deallocated = l;
+        }
+        l = next;
+    }
+    lock_basic_unlock(&netio->dirty_lock);
+    return;
+}
+
+
+/*
+ * Dispatch the timeout event to all handlers whose timeout expired.
+ *
+ */
+static void
+netio_dispatch_timeouts(netio_type* netio)
+{
+    netio_handler_list_type* l = NULL;
+    netio_handler_type* handler = NULL;
+    size_t count = netio->heap_count;
+    /* handlers that set a new, already expired timeout wait a round */
+    while (count-- > 0 && netio->heap_count > 0 &&
+        timespec_compare(&netio->heap[0]->reg_timeout,
+        netio_current_time(netio)) <= 0) {
+        l = netio->heap[0];
+        netio_heap_remove(netio, l);
+        handler = l->handler;
+        if (!handler || l->removed) {
+            continue;
+        }
+        if (handler->event_types & NETIO_EVENT_TIMEOUT) {
+            handler->event_handler(netio, handler, NETIO_EVENT_TIMEOUT);
+        }
+        if (!l->removed) {
+            netio_sync_handler(netio, l);
+        }
+    }
+    return;
+}
+
+
+#ifdef NETIO_USE_EPOLL
+/*
+ * Check for events with epoll(7) and dispatch them to the handlers.
+ *
+ */
+static int
+netio_dispatch_epoll(netio_type* netio, const struct timespec* timeout,
+    const sigset_t* sigmask)
+{
+    struct epoll_event events[NETIO_EPOLL_EVENTS];
+    struct timespec minimum_timeout;
+    int have_timeout = 0;
+    int msec = -1;
+    int rc = 0;
+    int i = 0;
+    int result = 0;
+
+    netio_sync_dirty(netio);
+    if (timeout) {
+        have_timeout = 1;
+        memcpy(&minimum_timeout, timeout, sizeof(struct timespec));
+    }
+    if (netio->heap_count > 0) {
+        struct timespec relative;
+        relative.tv_sec = netio->heap[0]->reg_timeout.tv_sec;
+        relative.tv_nsec = netio->heap[0]->reg_timeout.tv_nsec;
+        timespec_subtract(&relative, netio_current_time(netio));
+        if (relative.tv_sec < 0) {
+            /**
+             * On negative timeout for a handler, immediately
+             * dispatch the timeout events without checking for other
+             * events.
+             */
+            netio_dispatch_timeouts(netio);
+            return result;
+        }
+        if (!have_timeout ||
+            timespec_compare(&relative, &minimum_timeout) < 0) {
+            have_timeout = 1;
+            minimum_timeout.tv_sec = relative.tv_sec;
+            minimum_timeout.tv_nsec = relative.tv_nsec;
+        }
+    }
+    if (have_timeout) {
+        /* round up, so that the timeout has expired when we wake up */
+        msec = minimum_timeout.tv_sec * 1000 +
+            (minimum_timeout.tv_nsec + 999999L) / 1000000L;
+        if (minimum_timeout.tv_sec > 2000000) {
+            msec = 2000000000;
+        }
+    }
+    /* Check for events. */
+    rc = epoll_pwait(netio->epfd, events, NETIO_EPOLL_EVENTS, msec, sigmask);
+    if (rc == -1) {
+        if (errno == EINVAL || errno == EBADF || errno == EFAULT) {
+            ods_fatal_exit("[%s] fatal error epoll_pwait: %s", netio_str,
+                strerror(errno));
+        }
+        return -1;
+    }
+    /* Clear the cached current_time, we may have blocked for some time. */
+    netio->have_current_time = 0;
+    for (i = 0; i < rc; i++) {
+        netio_handler_list_type* l =
+            (netio_handler_list_type*) events[i].data.ptr;
+        netio_handler_type* handler = l->handler;
+        netio_events_type event_types = NETIO_EVENT_NONE;
+        if (!handler || l->removed || handler->fd != l->reg_fd) {
+            /* removed or changed by an earlier callback */
+            continue;
+        }
+        if (events[i].events & (EPOLLIN|EPOLLHUP|EPOLLERR)) {
+            event_types |= NETIO_EVENT_READ;
+        }
+        if (events[i].events & (EPOLLOUT|EPOLLHUP|EPOLLERR)) {
+            event_types |= NETIO_EVENT_WRITE;
+        }
+        if (events[i].events & EPOLLPRI) {
+            event_types |= NETIO_EVENT_EXCEPT;
+        }
+        if (event_types & handler->event_types) {
+            handler->event_handler(netio, handler,
+                event_types & handler->event_types);
+            ++result;
+            if (!l->removed) {
+                netio_sync_handler(netio, l);
+            }
+        }
+    }
+    if (rc == 0) {
+        ods_log_debug("[%s] no events before the minimum timeout "
+            "expired", netio_str);
+    }
+    netio_dispatch_timeouts(netio);
+    return result;
+}
+#endif /* NETIO_USE_EPOLL */
+
+
+/*
+ * Check for events with pselect(2) and dispatch them to the handlers.
+ *
+ */
+static int
+netio_dispatch_select(netio_type* netio, const struct timespec* timeout,
     const sigset_t* sigmask)
 {
     fd_set readfds, writefds, exceptfds;
@@ -214,11 +748,6 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
     int rc = 0;
     int result = 0;
 
-    if (!netio || !netio->handlers) {
-        return 0;
-    }
-    /* Clear the cached current time */
-    netio->have_current_time = 0;
     /* Initialize the minimum timeout with the timeout parameter */
     if (timeout) {
         have_timeout = 1;
@@ -346,6 +875,28 @@ netio_dispatch(netio_type* netio, const struct timespec* timeout,
 }
 
 
+/*
+ * Check for events and dispatch them to the handlers.
+ *
+ */
+int
+netio_dispatch(netio_type* netio, const struct timespec* timeout,
+    const sigset_t* sigmask)
+{
+    if (!netio || (!netio->handlers && !netio->dirty)) {
+        return 0;
+    }
+    /* Clear the cached current time */
+    netio->have_current_time = 0;
+#ifdef NETIO_USE_EPOLL
+    if (netio->backend == NETIO_BACKEND_EPOLL) {
+        return netio_dispatch_epoll(netio, timeout, sigmask);
+    }
+#endif
+    return netio_dispatch_select(netio, timeout, sigmask);
+}
+
+
 /**
  * Clean up netio instance
  *
@@ -354,12 +905,37 @@ void
 netio_cleanup(netio_type* netio)
 {
     allocator_type* allocator = NULL;
+    netio_handler_list_type* l = NULL;
     if (!netio) {
         return;
     }
     allocator = netio->allocator;
-    allocator_deallocate(allocator, (void*)netio->handlers);
-    allocator_deallocate(allocator, (void*)netio->deallocated);
+#ifdef NETIO_USE_EPOLL
+    if (netio->epfd != -1) {
+        close(netio->epfd);
+    }
+#endif
+    while (netio->handlers) {
+        l = netio->handlers;
+        netio->handlers = l->next;
+        allocator_deallocate(allocator, (void*)l);
+    }
+    while (netio->deallocated) {
+        l = netio->deallocated;
+        netio->deallocated = l->next;
+        allocator_deallocate(allocator, (void*)l);
+    }
+    /* removed handlers that were not yet recycled */
+    while (netio->dirty) {
+        l = netio->dirty;
+        netio->dirty = l->dirty_next;
+        if (l->removed) {
+            allocator_deallocate(allocator, (void*)l);
+        }
+    }
+    allocator_deallocate(allocator, (void*)netio->fdmap);
+    allocator_deallocate(allocator, (void*)netio->heap);
+    lock_basic_destroy(&netio->dirty_lock);
     allocator_deallocate(allocator, (void*)netio);
     return;
 }
@@ -37,6 +37,13 @@
  * events and dispatch them to the handlers.  An additional timeout
  * can be specified as well as the signal mask to install while
  * blocked in pselect(2).
+ *
+ * On systems with epoll(7), the handlers are registered with the kernel
+ * and the timeouts are kept in a heap, so that a dispatch does not have
+ * to visit every handler.  Changes that an event callback makes to its
+ * own handler are picked up when the callback returns.  Any other change
+ * to the file descriptor, timeout or event types of a handler must be
+ * announced with netio_update_handler.
  */
 
 /**
@@ -55,6 +62,13 @@
 
 #include "config.h"
 #include "shared/allocator.h"
+#include "shared/locks.h"
+
+#if defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_PWAIT)
+#define NETIO_USE_EPOLL 1
+#endif
+
+#define NETIO_EPOLL_EVENTS 64 /* events collected per epoll_pwait(2) */
 
 #ifndef PF_INET
 #define PF_INET AF_INET
@@ -88,13 +102,32 @@ typedef struct netio_handler_list_struct netio_handler_list_type;
 typedef void (*netio_event_handler_type)(netio_type *netio,
     netio_handler_type* handler, netio_events_type event_types);
 
+/**
+ * Network I/O backends.
+ *
+ */
+enum netio_backend_enum {
+	NETIO_BACKEND_SELECT = 0,
+	NETIO_BACKEND_EPOLL
+};
+typedef enum netio_backend_enum netio_backend_type;
+
 /**
  * Network I/O event handler list.
+ * Also holds the state of the handler as registered with the backend.
  *
  */
 struct netio_handler_list_struct {
     netio_handler_list_type* next;
     netio_handler_type* handler;
+    /* registered state, only used by the epoll backend */
+    int reg_fd;
+    netio_events_type reg_events;
+    struct timespec reg_timeout;
+    size_t heap_index;
+    netio_handler_list_type* dirty_next;
+    unsigned dirty : 1;
+    unsigned removed : 1;
 };
 
 /**
@@ -131,6 +164,11 @@ struct netio_handler_struct {
      * The event handler SHOULD NOT block.
      */
     netio_event_handler_type event_handler;
+    /*
+     * Registration with the netio instance.  Maintained by netio,
+     * should be NULL while the handler is not added.
+     */
+    netio_handler_list_type* node;
 };
 
 /**
@@ -157,6 +195,22 @@ struct netio_struct {
      * To make sure that deletes respect the state of the iterator.
      */
     netio_handler_list_type* dispatch_next;
+    /*
+     * Backend.  Defaults to epoll where available and can be changed
+     * to NETIO_BACKEND_SELECT before any handler is added.
+     */
+    netio_backend_type backend;
+    int epfd;
+    /* Handlers by file descriptor, as registered with epoll */
+    netio_handler_list_type** fdmap;
+    size_t fdmap_size;
+    /* Timeouts, a binary min-heap */
+    netio_handler_list_type** heap;
+    size_t heap_count;
+    size_t heap_size;
+    /* Handlers that need to be registered again */
+    netio_handler_list_type* dirty;
+    lock_basic_type dirty_lock;
 };
 
 /*
@@ -183,6 +237,15 @@ void netio_add_handler(netio_type* netio, netio_handler_type* handler);
  */
 void netio_remove_handler(netio_type* netio, netio_handler_type* handler);
 
+/*
+ * Announce that the file descriptor, timeout or event types of the
+ * handler have changed.  Safe to call from other threads.
+ * \param[in] netio netio instance
+ * \param[in] handler handler
+ *
+ */
+void netio_update_handler(netio_type* netio, netio_handler_type* handler);
+
 /*
  * Retrieve the current time (using gettimeofday(2)).
  * \param[in] netio netio instance
@@ -34,17 +34,22 @@
 #include "config.h"
 #include "adapter/addns.h"
 #include "daemon/xfrhandler.h"
+#include "shared/metrics.h"
 #include "signer/domain.h"
 #include "signer/zone.h"
 #include "wire/notify.h"
+#include "wire/sock.h"
 #include "wire/xfrd.h"
 
+#include <fcntl.h>
 #include <sys/socket.h>
 
 static const char* notify_str = "notify";
 
 static void notify_handle_zone(netio_type* netio,
     netio_handler_type* handler, netio_events_type event_types);
+static void notify_queue_handle(netio_type* netio,
+    netio_handler_type* handler, netio_events_type event_types);
 
 
 /**
@@ -60,6 +65,21 @@ notify_time(notify_type* notify)
 }
 
 
+/**
+ * Announce handler changes to netio.
+ *
+ */
+static void
+notify_update_handler(notify_type* notify)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    if (xfrhandler) {
+        netio_update_handler(xfrhandler->netio, &notify->handler);
+    }
+    return;
+}
+
+
 /**
  * Set timer.
  *
@@ -83,6 +103,7 @@ notify_set_timer(notify_type* notify, time_t t)
     notify->handler.timeout = &notify->timeout;
     notify->timeout.tv_sec = t;
     notify->timeout.tv_nsec = 0;
+    notify_update_handler(notify);
     return;
 }
 
@@ -125,19 +146,72 @@ notify_create(void* xfrhandler, void* zone)
     }
     notify->retry = 0;
     notify->query_id = 0;
+    notify->slot = -1;
     notify->is_waiting = 0;
     notify->handler.fd = -1;
     notify->timeout.tv_sec = 0;
     notify->timeout.tv_nsec = 0;
     notify->handler.timeout = NULL;
     notify->handler.user_data = notify;
-    notify->handler.event_types =
-        NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    notify->handler.event_types = NETIO_EVENT_TIMEOUT;
     notify->handler.event_handler = notify_handle_zone;
+    notify->handler.node = NULL;
     return notify;
 }
 
 
+/**
+ * Obtain a slot in the notify queue.
+ *
+ */
+static notify_slot_type*
+notify_slot_obtain(notify_type* notify)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    notify_queue_type* queue = xfrhandler->notify_queue;
+    if (notify->slot == -1) {
+        if (queue->count >= NOTIFY_MAX_UDP) {
+            return NULL;
+        }
+        notify->slot = (int) queue->count;
+        queue->slots[queue->count].notify = notify;
+        queue->slots[queue->count].queued = 0;
+        queue->count++;
+    }
+    return &queue->slots[notify->slot];
+}
+
+
+/**
+ * Release the slot in the notify queue.
+ *
+ */
+static void
+notify_slot_release(notify_type* notify)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    notify_queue_type* queue = NULL;
+    notify_slot_type tmp;
+    size_t last = 0;
+    if (notify->slot == -1 || !xfrhandler || !xfrhandler->notify_queue) {
+        return;
+    }
+    queue = xfrhandler->notify_queue;
+    last = queue->count - 1;
+    ods_log_assert(queue->slots[notify->slot].notify == notify);
+    /* swap with the last slot, keeping the buffers */
+    tmp = queue->slots[notify->slot];
+    queue->slots[notify->slot] = queue->slots[last];
+    queue->slots[last] = tmp;
+    queue->slots[notify->slot].notify->slot = notify->slot;
+    queue->slots[last].notify = NULL;
+    queue->slots[last].queued = 0;
+    queue->count--;
+    notify->slot = -1;
+    return;
+}
+
+
 /**
  * Setup notify.
  *
@@ -183,10 +257,8 @@ notify_disable(notify_type* notify)
     ods_log_assert(zone->name);
     notify->secondary = NULL;
     notify->handler.timeout = NULL;
-    if (notify->handler.fd != -1) {
-        close(notify->handler.fd);
-        notify->handler.fd = -1;
-    }
+    notify_slot_release(notify);
+    notify_update_handler(notify);
     if (xfrhandler->notify_udp_num == NOTIFY_MAX_UDP) {
         while (xfrhandler->notify_waiting_first) {
             notify_type* wn = xfrhandler->notify_waiting_first;
@@ -234,122 +306,48 @@ notify_next(notify_type* notify)
 }
 
 
-/**
- * Read packet from udp.
- *
- */
-static int
-notify_udp_read_packet(notify_type* notify)
-{
-    xfrhandler_type* xfrhandler = NULL;
-    ssize_t received = 0;
-    ods_log_assert(notify);
-    xfrhandler = (xfrhandler_type*) notify->xfrhandler;
-    ods_log_assert(xfrhandler);
-    buffer_clear(xfrhandler->packet);
-    received = recvfrom(notify->handler.fd, buffer_begin(xfrhandler->packet),
-        buffer_remaining(xfrhandler->packet), 0, NULL, NULL);
-    if (received == -1) {
-        ods_log_error("[%s] unable to read packet: recvfrom() failed fd %d "
-            "(%s)", notify_str, notify->handler.fd, strerror(errno));
-        return 0;
-    }
-    buffer_set_limit(xfrhandler->packet, received);
-    return 1;
-}
-
-
 /**
  * Handle notify reply.
  *
  */
 static int
-notify_handle_reply(notify_type* notify)
+notify_handle_reply(notify_type* notify, buffer_type* packet)
 {
-    xfrhandler_type* xfrhandler = NULL;
     zone_type* zone = NULL;
     ods_log_assert(notify);
     ods_log_assert(notify->secondary);
     ods_log_assert(notify->secondary->address);
-    xfrhandler = (xfrhandler_type*) notify->xfrhandler;
+    ods_log_assert(packet);
     zone = (zone_type*) notify->zone;
-    ods_log_assert(xfrhandler);
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    if ((buffer_pkt_opcode(xfrhandler->packet) != LDNS_PACKET_NOTIFY) ||
-        (buffer_pkt_qr(xfrhandler->packet) == 0)) {
+    if ((buffer_pkt_opcode(packet) != LDNS_PACKET_NOTIFY) ||
+        (buffer_pkt_qr(packet) == 0)) {
         ods_log_error("[%s] zone %s received bad notify reply opcode/qr",
             notify_str, zone->name);
         return 0;
     }
-    if (buffer_pkt_id(xfrhandler->packet) != notify->query_id) {
+    if (buffer_pkt_id(packet) != notify->query_id) {
         ods_log_error("[%s] zone %s received bad notify reply id",
             notify_str, zone->name);
         return 0;
     }
     /* could check tsig */
-    if (buffer_pkt_rcode(xfrhandler->packet) != LDNS_RCODE_NOERROR) {
+    if (buffer_pkt_rcode(packet) != LDNS_RCODE_NOERROR) {
         ods_log_error("[%s] zone %s received bad notify rcode %d",
-            notify_str, zone->name, buffer_pkt_rcode(xfrhandler->packet));
-        if (buffer_pkt_rcode(xfrhandler->packet) != LDNS_RCODE_NOTIMPL) {
+            notify_str, zone->name, buffer_pkt_rcode(packet));
+        if (buffer_pkt_rcode(packet) != LDNS_RCODE_NOTIMPL) {
             return 1;
         }
         return 0;
     }
     ods_log_debug("[%s] zone %s secondary %s notify reply ok", notify_str,
         zone->name, notify->secondary->address);
+    metrics_count(METRICS_NOTIFY_OUT_ACKED);
     return 1;
 }
 
 
-/**
- * Send notify over udp.
- *
- */
-static int
-notify_send_udp(notify_type* notify, buffer_type* buffer)
-{
-    struct sockaddr_storage to;
-    socklen_t to_len = 0;
-    int fd = -1;
-    int family = PF_INET;
-    ssize_t nb = 0;
-    ods_log_assert(buffer);
-    ods_log_assert(notify);
-    ods_log_assert(notify->secondary);
-    ods_log_assert(notify->secondary->address);
-    /* this will set the remote port to acl->port or TCP_PORT */
-    to_len = xfrd_acl_sockaddr_to(notify->secondary, &to);
-    /* get the address family of the remote host */
-    if (notify->secondary->family == AF_INET6) {
-        family = PF_INET6;
-    }
-    /* create socket */
-    fd = socket(family, SOCK_DGRAM, IPPROTO_UDP);
-    if (fd == -1) {
-        ods_log_error("[%s] unable to send data over udp to %s: "
-            "socket() failed (%s)", notify_str, notify->secondary->address,
-            strerror(errno));
-        return -1;
-    }
-    /* bind it? */
-
-    /* send it (udp) */
-    ods_log_deeebug("[%s] send %d bytes over udp to %s", notify_str,
-        buffer_remaining(buffer), notify->secondary->address);
-    nb = sendto(fd, buffer_current(buffer), buffer_remaining(buffer), 0,
-        (struct sockaddr*)&to, to_len);
-    if (nb == -1) {
-        ods_log_error("[%s] unable to send data over udp to %s: "
-            "sendto() failed (%s)", notify_str, notify->secondary->address,
-            strerror(errno));
-        close(fd);
-        return -1;
-    }
-    return fd;
-}
-
-
 /**
  * Sign notify.
  *
@@ -400,6 +398,8 @@ notify_send(notify_type* notify)
 {
     xfrhandler_type* xfrhandler = NULL;
     zone_type* zone = NULL;
+    notify_slot_type* slot = NULL;
+    buffer_type* packet = NULL;
     ods_log_assert(notify);
     ods_log_assert(notify->secondary);
     ods_log_assert(notify->secondary->address);
@@ -408,33 +408,60 @@ notify_send(notify_type* notify)
     ods_log_assert(xfrhandler);
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    if (notify->handler.fd != -1) {
-        close(notify->handler.fd);
-    }
-    notify->handler.fd = -1;
     notify->timeout.tv_sec = notify_time(notify) + NOTIFY_RETRY_TIMEOUT;
-    buffer_pkt_notify(xfrhandler->packet, zone->apex, LDNS_RR_CLASS_IN);
-    notify->query_id = buffer_pkt_id(xfrhandler->packet);
-    buffer_pkt_set_aa(xfrhandler->packet);
+    notify_update_handler(notify);
+    slot = notify_slot_obtain(notify);
+    if (!slot) {
+        ods_log_error("[%s] unable to send notify retry %u for zone %s to "
+            "%s: notify queue full", notify_str, notify->retry,
+            zone->name, notify->secondary->address);
+        return;
+    }
+    packet = slot->buffer;
+    buffer_pkt_notify(packet, zone->apex, LDNS_RR_CLASS_IN);
+    notify->query_id = buffer_pkt_id(packet);
+    buffer_pkt_set_aa(packet);
     /* add current SOA to answer section */
     if (notify->soa) {
-        if (buffer_write_rr(xfrhandler->packet, notify->soa)) {
-            buffer_pkt_set_ancount(xfrhandler->packet, 1);
+        if (buffer_write_rr(packet, notify->soa)) {
+            buffer_pkt_set_ancount(packet, 1);
         }
     }
     if (notify->secondary->tsig) {
-        notify_tsig_sign(notify, xfrhandler->packet);
+        notify_tsig_sign(notify, packet);
     }
-    buffer_flip(xfrhandler->packet);
-    notify->handler.fd = notify_send_udp(notify, xfrhandler->packet);
-    if (notify->handler.fd == -1) {
-        ods_log_error("[%s] unable to send notify retry %u for zone %s to "
-            "%s: notify_send_udp() failed", notify_str, notify->retry,
-            zone->name, notify->secondary->address);
-        return;
+    buffer_flip(packet);
+    /* this will set the remote port to acl->port or TCP_PORT */
+    slot->to_len = xfrd_acl_sockaddr_to(notify->secondary, &slot->to);
+    slot->queued = 1;
+    xfrhandler->notify_queue->queued = 1;
+    metrics_count(METRICS_NOTIFY_OUT);
+    ods_log_verbose("[%s] notify retry %u for zone %s queued for %s",
+        notify_str, notify->retry, zone->name, notify->secondary->address);
+    return;
+}
+
+
+/**
+ * Send notify again, or move on to the next secondary.
+ *
+ */
+static void
+notify_retry(notify_type* notify)
+{
+    zone_type* zone = (zone_type*) notify->zone;
+    /* see if notify is still enabled */
+    if (notify->secondary) {
+        ods_log_assert(notify->secondary->address);
+        notify->retry++;
+        if (notify->retry > NOTIFY_MAX_RETRY) {
+            ods_log_verbose("[%s] notify max retry for zone %s, %s unreachable",
+                notify_str, zone->name, notify->secondary->address);
+            notify_next(notify);
+        } else {
+            notify_send(notify);
+        }
     }
-    ods_log_verbose("[%s] notify retry %u for zone %s sent to %s", notify_str,
-        notify->retry, zone->name, notify->secondary->address);
     return;
 }
 
@@ -468,31 +495,11 @@ notify_handle_zone(netio_type* ATTR_UNUSED(netio),
         ods_log_assert(notify->handler.fd == -1);
         return;
     }
-    if (event_types & NETIO_EVENT_READ) {
-        ods_log_debug("[%s] read notify ok for zone %s", notify_str,
-            zone->name);
-        ods_log_assert(notify->handler.fd != -1);
-        if (notify_udp_read_packet(notify)) {
-            if (notify_handle_reply(notify)) {
-                notify_next(notify);
-            }
-        }
-    } else if(event_types & NETIO_EVENT_TIMEOUT) {
+    if (event_types & NETIO_EVENT_TIMEOUT) {
         ods_log_debug("[%s] notify timeout for zone %s", notify_str,
             zone->name);
         /* timeout, try again */
-    }
-    /* see if notify is still enabled */
-    if (notify->secondary) {
-        ods_log_assert(notify->secondary->address);
-        notify->retry++;
-        if (notify->retry > NOTIFY_MAX_RETRY) {
-            ods_log_verbose("[%s] notify max retry for zone %s, %s unreachable",
-                notify_str, zone->name, notify->secondary->address);
-            notify_next(notify);
-        } else {
-            notify_send(notify);
-        }
+        notify_retry(notify);
     }
     return;
 }
@@ -567,12 +574,340 @@ notify_enable(notify_type* notify, ldns_rr* soa)
     }
     xfrhandler->notify_waiting_last = notify;
     notify->handler.timeout = NULL;
+    notify_update_handler(notify);
     ods_log_debug("[%s] zone %s notify on waiting list", notify_str,
         zone->name);
     return;
 }
 
 
+/**
+ * Create notify queue.
+ *
+ */
+notify_queue_type*
+notify_queue_create(allocator_type* allocator, void* xfrhandler)
+{
+    notify_queue_type* queue = NULL;
+    size_t i = 0;
+    if (!allocator || !xfrhandler) {
+        return NULL;
+    }
+    queue = (notify_queue_type*) allocator_alloc(allocator,
+        sizeof(notify_queue_type));
+    if (!queue) {
+        ods_log_error("[%s] unable to create notify queue: "
+            "allocator_alloc() failed", notify_str);
+        return NULL;
+    }
+    memset(queue, 0, sizeof(notify_queue_type));
+    queue->allocator = allocator;
+    queue->xfrhandler = xfrhandler;
+    for (i=0; i < NOTIFY_MAX_UDP; i++) {
+        queue->slots[i].buffer = buffer_create(allocator, PACKET_BUFFER_SIZE);
+        if (!queue->slots[i].buffer) {
+            ods_log_error("[%s] unable to create notify queue: "
+                "buffer_create() failed", notify_str);
+            notify_queue_cleanup(queue);
+            return NULL;
+        }
+    }
+    for (i=0; i < NOTIFY_RECV_BATCH; i++) {
+        queue->recv[i] = buffer_create(allocator, PACKET_BUFFER_SIZE);
+        if (!queue->recv[i]) {
+            ods_log_error("[%s] unable to create notify queue: "
+                "buffer_create() failed", notify_str);
+            notify_queue_cleanup(queue);
+            return NULL;
+        }
+    }
+    for (i=0; i < 2; i++) {
+        queue->handler[i].fd = -1;
+        queue->handler[i].timeout = NULL;
+        queue->handler[i].user_data = queue;
+        queue->handler[i].event_types = NETIO_EVENT_READ;
+        queue->handler[i].event_handler = notify_queue_handle;
+        queue->handler[i].node = NULL;
+    }
+    return queue;
+}
+
+
+/**
+ * Get the notify socket for an address family, open it if needed.
+ *
+ */
+static int
+notify_queue_socket(notify_queue_type* queue, int ipv6)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) queue->xfrhandler;
+    netio_handler_type* handler = &queue->handler[ipv6?1:0];
+    int fd = -1;
+    if (handler->fd != -1) {
+        return handler->fd;
+    }
+    fd = socket(ipv6?PF_INET6:PF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd == -1) {
+        ods_log_error("[%s] unable to open udp/%s socket: socket() failed "
+            "(%s)", notify_str, ipv6?"ipv6":"ipv4", strerror(errno));
+        return -1;
+    }
+    if (fcntl(fd, F_SETFL, O_NONBLOCK) == -1) {
+        ods_log_error("[%s] unable to set udp/%s socket to non-blocking: "
+            "fcntl() failed (%s)", notify_str, ipv6?"ipv6":"ipv4",
+            strerror(errno));
+        close(fd);
+        return -1;
+    }
+    handler->fd = fd;
+    netio_add_handler(xfrhandler->netio, handler);
+    return fd;
+}
+
+
+/**
+ * Send all queued notifies.
+ *
+ */
+void
+notify_queue_flush(notify_queue_type* queue)
+{
+#ifdef SOCK_USE_MMSG
+    struct mmsghdr msgs[NOTIFY_MAX_UDP];
+    struct iovec iovs[NOTIFY_MAX_UDP];
+    int sent = 0;
+#else
+    ssize_t nb = 0;
+#endif
+    notify_slot_type* slot = NULL;
+    int count = 0;
+    int ipv6 = 0;
+    int fd = -1;
+    int i = 0;
+
+    if (!queue || !queue->queued) {
+        return;
+    }
+    queue->queued = 0;
+    for (ipv6 = 0; ipv6 < 2; ipv6++) {
+        fd = -1;
+        count = 0;
+        for (i=0; i < (int) queue->count; i++) {
+            slot = &queue->slots[i];
+            if (!slot->queued || (slot->to.ss_family == AF_INET6) != ipv6) {
+                continue;
+            }
+            slot->queued = 0;
+            if (fd == -1) {
+                fd = notify_queue_socket(queue, ipv6);
+                if (fd == -1) {
+                    /* notifies will be retried when they time out */
+                    continue;
+                }
+            }
+#ifdef SOCK_USE_MMSG
+            memset(&msgs[count], 0, sizeof(struct mmsghdr));
+            iovs[count].iov_base = buffer_begin(slot->buffer);
+            iovs[count].iov_len = buffer_remaining(slot->buffer);
+            msgs[count].msg_hdr.msg_name = &slot->to;
+            msgs[count].msg_hdr.msg_namelen = slot->to_len;
+            msgs[count].msg_hdr.msg_iov = &iovs[count];
+            msgs[count].msg_hdr.msg_iovlen = 1;
+#else
+            ods_log_deeebug("[%s] send %d bytes over udp to %s", notify_str,
+                buffer_remaining(slot->buffer),
+                slot->notify->secondary->address);
+            nb = sendto(fd, buffer_begin(slot->buffer),
+                buffer_remaining(slot->buffer), 0,
+                (struct sockaddr*) &slot->to, slot->to_len);
+            if (nb == -1) {
+                ods_log_error("[%s] unable to send data over udp to %s: "
+                    "sendto() failed (%s)", notify_str,
+                    slot->notify->secondary->address, strerror(errno));
+            }
+#endif
+            count++;
+        }
+#ifdef SOCK_USE_MMSG
+        i = 0;
+        while (i < count) {
+            ods_log_deeebug("[%s] send %d notifies over udp/%s", notify_str,
+                count - i, ipv6?"ipv6":"ipv4");
+            sent = sendmmsg(fd, &msgs[i], count - i, 0);
+            if (sent == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                /* skip the notify that could not be sent */
+                ods_log_error("[%s] unable to send data over udp: "
+                    "sendmmsg() failed (%s)", notify_str, strerror(errno));
+                sent = 1;
+            }
+            i += sent;
+        }
+#endif
+    }
+    return;
+}
+
+
+/**
+ * Compare the source of a reply with the secondary address.
+ *
+ */
+static int
+notify_queue_addr_match(struct sockaddr_storage* to,
+    struct sockaddr_storage* from)
+{
+    if (to->ss_family != from->ss_family) {
+        return 0;
+    }
+    if (to->ss_family == AF_INET) {
+        struct sockaddr_in* a = (struct sockaddr_in*) to;
+        struct sockaddr_in* b = (struct sockaddr_in*) from;
+        return a->sin_port == b->sin_port &&
+            a->sin_addr.s_addr == b->sin_addr.s_addr;
+    } else if (to->ss_family == AF_INET6) {
+        struct sockaddr_in6* a = (struct sockaddr_in6*) to;
+        struct sockaddr_in6* b = (struct sockaddr_in6*) from;
+        return a->sin6_port == b->sin6_port &&
+            memcmp(&a->sin6_addr, &b->sin6_addr,
+                sizeof(struct in6_addr)) == 0;
+    }
+    return 0;
+}
+
+
+/**
+ * Pass a reply to the notify it belongs to.
+ *
+ */
+static void
+notify_queue_reply(notify_queue_type* queue, buffer_type* packet,
+    struct sockaddr_storage* from)
+{
+    notify_type* notify = NULL;
+    size_t i = 0;
+    if (buffer_limit(packet) < BUFFER_PKT_HEADER_SIZE) {
+        ods_log_debug("[%s] dropped short notify reply", notify_str);
+        return;
+    }
+    for (i=0; i < queue->count; i++) {
+        notify = queue->slots[i].notify;
+        if (notify->secondary && !notify->is_waiting &&
+            notify->query_id == buffer_pkt_id(packet) &&
+            notify_queue_addr_match(&queue->slots[i].to, from)) {
+            break;
+        }
+    }
+    if (i == queue->count) {
+        ods_log_debug("[%s] dropped unexpected notify reply id=%u",
+            notify_str, buffer_pkt_id(packet));
+        return;
+    }
+    ods_log_debug("[%s] read notify ok for zone %s", notify_str,
+        ((zone_type*) notify->zone)->name);
+    if (notify_handle_reply(notify, packet)) {
+        notify_next(notify);
+    }
+    notify_retry(notify);
+    return;
+}
+
+
+/**
+ * Handle notify replies.
+ *
+ */
+static void
+notify_queue_handle(netio_type* ATTR_UNUSED(netio),
+    netio_handler_type* handler, netio_events_type event_types)
+{
+    notify_queue_type* queue = NULL;
+#ifdef SOCK_USE_MMSG
+    struct mmsghdr msgs[NOTIFY_RECV_BATCH];
+    struct iovec iovs[NOTIFY_RECV_BATCH];
+    int i = 0;
+#else
+    socklen_t fromlen = 0;
+#endif
+    int received = 0;
+    if (!handler || !(event_types & NETIO_EVENT_READ)) {
+        return;
+    }
+    queue = (notify_queue_type*) handler->user_data;
+#ifdef SOCK_USE_MMSG
+    memset(msgs, 0, sizeof(msgs));
+    for (i=0; i < NOTIFY_RECV_BATCH; i++) {
+        buffer_clear(queue->recv[i]);
+        iovs[i].iov_base = buffer_begin(queue->recv[i]);
+        iovs[i].iov_len = buffer_remaining(queue->recv[i]);
+        msgs[i].msg_hdr.msg_name = &queue->from[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    received = recvmmsg(handler->fd, msgs, NOTIFY_RECV_BATCH, 0, NULL);
+    if (received == -1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            ods_log_error("[%s] unable to read packet: recvmmsg() failed "
+                "fd %d (%s)", notify_str, handler->fd, strerror(errno));
+        }
+        return;
+    }
+    for (i=0; i < received; i++) {
+        buffer_set_limit(queue->recv[i], msgs[i].msg_len);
+        notify_queue_reply(queue, queue->recv[i], &queue->from[i]);
+    }
+#else
+    buffer_clear(queue->recv[0]);
+    fromlen = sizeof(struct sockaddr_storage);
+    received = recvfrom(handler->fd, buffer_begin(queue->recv[0]),
+        buffer_remaining(queue->recv[0]), 0,
+        (struct sockaddr*) &queue->from[0], &fromlen);
+    if (received == -1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            ods_log_error("[%s] unable to read packet: recvfrom() failed "
+                "fd %d (%s)", notify_str, handler->fd, strerror(errno));
+        }
+        return;
+    }
+    buffer_set_limit(queue->recv[0], received);
+    notify_queue_reply(queue, queue->recv[0], &queue->from[0]);
+#endif
+    /* the replies may have caused new notifies */
+    notify_queue_flush(queue);
+    return;
+}
+
+
+/**
+ * Clean up notify queue.
+ *
+ */
+void
+notify_queue_cleanup(notify_queue_type* queue)
+{
+    size_t i = 0;
+    if (!queue) {
+        return;
+    }
+    for (i=0; i < 2; i++) {
+        if (queue->handler[i].fd != -1) {
+            close(queue->handler[i].fd);
+        }
+    }
+    for (i=0; i < NOTIFY_MAX_UDP; i++) {
+        buffer_cleanup(queue->slots[i].buffer, queue->allocator);
+    }
+    for (i=0; i < NOTIFY_RECV_BATCH; i++) {
+        buffer_cleanup(queue->recv[i], queue->allocator);
+    }
+    allocator_deallocate(queue->allocator, (void*) queue);
+    return;
+}
+
+
 /**
  * Cleanup notify structure.
  *
@@ -585,10 +920,7 @@ notify_cleanup(notify_type* notify)
         return;
     }
     allocator = notify->allocator;
-    if (notify->handler.fd != -1) {
-        close(notify->handler.fd);
-        notify->handler.fd = -1;
-    }
+    notify_slot_release(notify);
     if (notify->soa) {
         ldns_rr_free(notify->soa);
     }
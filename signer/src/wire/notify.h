@@ -42,10 +42,12 @@
 #include "wire/tsig.h"
 
 #include <ldns/ldns.h>
+#include <sys/socket.h>
 
 #define NOTIFY_MAX_UDP 50
 #define NOTIFY_MAX_RETRY 5
 #define NOTIFY_RETRY_TIMEOUT 15
+#define NOTIFY_RECV_BATCH 16
 
 /**
  * Notify.
@@ -64,9 +66,44 @@ struct notify_struct {
     struct timespec timeout;
     uint16_t query_id;
     uint8_t retry;
+    int slot;
     unsigned is_waiting : 1;
 };
 
+/**
+ * Notify queue slot.
+ *
+ */
+typedef struct notify_slot_struct notify_slot_type;
+struct notify_slot_struct {
+    notify_type* notify;
+    buffer_type* buffer;
+    struct sockaddr_storage to;
+    socklen_t to_len;
+    unsigned queued : 1;
+};
+
+/**
+ * Notify queue.
+ * Every enabled notify owns a slot with a preallocated packet buffer.
+ * Notifies are written into their slot and sent in batches, over one
+ * socket per address family, when the queue is flushed. Replies are read
+ * in batches as well and matched to their notify by query id and
+ * secondary address.
+ *
+ */
+typedef struct notify_queue_struct notify_queue_type;
+struct notify_queue_struct {
+    allocator_type* allocator;
+    void* xfrhandler;
+    notify_slot_type slots[NOTIFY_MAX_UDP];
+    size_t count;
+    unsigned queued;
+    buffer_type* recv[NOTIFY_RECV_BATCH];
+    struct sockaddr_storage from[NOTIFY_RECV_BATCH];
+    netio_handler_type handler[2];
+};
+
 /**
  * Create notify structure.
  * \param[in] xfrhandler zone transfer handler
@@ -91,6 +128,30 @@ void notify_enable(notify_type* notify, ldns_rr* soa);
  */
 void notify_send(notify_type* notify);
 
+/**
+ * Create notify queue.
+ * \param[in] allocator memory allocator
+ * \param[in] xfrhandler zone transfer handler
+ * \return notify_queue_type* notify queue
+ *
+ */
+notify_queue_type* notify_queue_create(allocator_type* allocator,
+    void* xfrhandler);
+
+/**
+ * Send all queued notifies.
+ * \param[in] queue notify queue
+ *
+ */
+void notify_queue_flush(notify_queue_type* queue);
+
+/**
+ * Clean up notify queue.
+ * \param[in] queue notify queue
+ *
+ */
+void notify_queue_cleanup(notify_queue_type* queue);
+
 /**
  * Cleanup notify structure.
  * \param[in] notify notify structure.
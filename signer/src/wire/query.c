@@ -34,6 +34,7 @@
 #include "config.h"
 #include "daemon/dnshandler.h"
 #include "daemon/engine.h"
+#include "shared/metrics.h"
 #include "shared/util.h"
 #include "wire/axfr.h"
 #include "wire/query.h"
@@ -62,6 +63,10 @@ query_create(void)
     q->allocator = allocator;
     q->buffer = NULL;
     q->tsig_rr = NULL;
+    q->edns_rr = NULL;
+    q->compress = NULL;
+    q->ixfr_rrs = NULL;
+    q->snapshot = NULL;
     q->buffer = buffer_create(allocator, PACKET_BUFFER_SIZE);
     if (!q->buffer) {
         query_cleanup(q);
@@ -77,6 +82,11 @@ query_create(void)
         query_cleanup(q);
         return NULL;
     }
+    q->compress = compress_create(allocator);
+    if (!q->compress) {
+        query_cleanup(q);
+        return NULL;
+    }
     query_reset(q, UDP_MAX_MESSAGE_LEN, 0);
     return q;
 }
@@ -105,8 +115,17 @@ query_reset(query_type* q, size_t maxlen, int is_tcp)
     /* qname, qtype, qclass */
     q->zone = NULL;
     /* domain, opcode, cname count, delegation, compression, temp */
+    compress_clear(q->compress);
     q->axfr_is_done = 0;
     q->axfr_fd = NULL;
+    snapshot_release(q->snapshot);
+    q->snapshot = NULL;
+    q->axfr_msg = 0;
+    if (q->ixfr_rrs) {
+        ldns_rr_list_deep_free(q->ixfr_rrs);
+        q->ixfr_rrs = NULL;
+    }
+    q->ixfr_pos = 0;
     q->serial = 0;
     q->startpos = 0;
     return;
@@ -356,10 +375,11 @@ query_process_notify(query_type* q, ldns_rr_type qtype, void* engine)
     }
     /* forward notify to xfrd */
     xfrd_set_timer_now(q->zone->xfrd);
-    dnshandler_fwd_notify(e->dnshandler, buffer_begin(q->buffer),
-        buffer_remaining(q->buffer));
+    xfrhandler_fwd_notify((xfrhandler_type*) q->zone->xfrd->xfrhandler,
+        buffer_begin(q->buffer), buffer_remaining(q->buffer));
 
 send_notify_ok:
+    metrics_count(METRICS_NOTIFY_IN);
     /* send notify ok */
     buffer_pkt_set_qr(q->buffer);
     buffer_pkt_set_aa(q->buffer);
@@ -441,20 +461,14 @@ response_add_rrset(response_type* r, rrset_type* rrset,
 static int
 response_encode_rr(query_type* q, ldns_rr* rr, ldns_pkt_section section)
 {
-    uint8_t *data = NULL;
-    size_t size = 0;
-    ldns_status status = LDNS_STATUS_OK;
     ods_log_assert(q);
     ods_log_assert(rr);
     ods_log_assert(section);
-    status = ldns_rr2wire(&data, rr, section, &size);
-    if (status != LDNS_STATUS_OK) {
-        ods_log_error("[%s] unable to send good response: ldns_rr2wire() "
-            "failed (%s)", query_str, ldns_get_errorstr_by_id(status));
+    if (!compress_write_rr(q->compress, q->buffer, rr)) {
+        ods_log_error("[%s] unable to send good response: rr does not fit",
+            query_str);
         return 0;
     }
-    buffer_write(q->buffer, (const void*) data, size);
-    LDNS_FREE(data);
     return 1;
 }
 
@@ -516,6 +530,66 @@ response_encode(query_type* q, response_type* r)
 }
 
 
+/**
+ * Encode apex RRs of a type, and their signatures, from the signed version.
+ *
+ */
+static uint16_t
+response_encode_apex(query_type* q, ldns_rr_list* apex, ldns_rr_type rrtype,
+    ldns_pkt_section section)
+{
+    size_t i = 0;
+    uint16_t added = 0;
+    ldns_rr* rr = NULL;
+    ods_log_assert(q);
+    ods_log_assert(apex);
+    for (i = 0; i < ldns_rr_list_rr_count(apex); i++) {
+        rr = ldns_rr_list_rr(apex, i);
+        if (ldns_rr_get_type(rr) == rrtype) {
+            added += response_encode_rr(q, rr, section);
+        } else if (q->edns_rr && q->edns_rr->dnssec_ok &&
+            ldns_rr_get_type(rr) == LDNS_RR_TYPE_RRSIG &&
+            ldns_rdf2rr_type(ldns_rr_rrsig_typecovered(rr)) == rrtype) {
+            added += response_encode_rr(q, rr, section);
+        }
+    }
+    return added;
+}
+
+
+/**
+ * Query response from the signed version, without taking the zone lock.
+ *
+ */
+static query_state
+query_response_snapshot(query_type* q, snapshot_type* snapshot,
+    ldns_rr_type qtype)
+{
+    uint16_t ancount = 0;
+    uint16_t nscount = 0;
+    ods_log_assert(q);
+    ods_log_assert(snapshot);
+    ancount = response_encode_apex(q, snapshot->apex, qtype,
+        LDNS_SECTION_ANSWER);
+    if (ancount) {
+        /* NS RRset goes into Authority Section */
+        nscount = response_encode_apex(q, snapshot->apex, LDNS_RR_TYPE_NS,
+            LDNS_SECTION_AUTHORITY);
+    } else if (qtype != LDNS_RR_TYPE_SOA) {
+        nscount = response_encode_apex(q, snapshot->apex, LDNS_RR_TYPE_SOA,
+            LDNS_SECTION_AUTHORITY);
+    } else {
+        return query_servfail(q);
+    }
+    buffer_pkt_set_ancount(q->buffer, ancount);
+    buffer_pkt_set_nscount(q->buffer, nscount);
+    buffer_pkt_set_arcount(q->buffer, 0);
+    buffer_pkt_set_qr(q->buffer);
+    buffer_pkt_set_aa(q->buffer);
+    return QUERY_PROCESSED;
+}
+
+
 /**
  * Query response.
  *
@@ -524,10 +598,19 @@ static query_state
 query_response(query_type* q, ldns_rr_type qtype)
 {
     rrset_type* rrset = NULL;
+    snapshot_type* snapshot = NULL;
+    query_state state = QUERY_PROCESSED;
     response_type r;
     if (!q || !q->zone) {
         return QUERY_DISCARDED;
     }
+    /* answer from the published signed version if there is one */
+    snapshot = zone_pin_snapshot(q->zone);
+    if (snapshot) {
+        state = query_response_snapshot(q, snapshot, qtype);
+        snapshot_release(snapshot);
+        return state;
+    }
     r.rrset_count = 0;
     lock_basic_lock(&q->zone->zone_lock);
     rrset = zone_lookup_rrset(q->zone, q->zone->apex, qtype);
@@ -559,7 +642,6 @@ query_response(query_type* q, ldns_rr_type qtype)
     lock_basic_unlock(&q->zone->zone_lock);
 
     response_encode(q, &r);
-    /* compression */
     return QUERY_PROCESSED;
 }
 
@@ -583,6 +665,11 @@ query_prepare(query_type* q)
     buffer_clear(q->buffer);
     buffer_set_position(q->buffer, limit);
     buffer_set_limit(q->buffer, buffer_capacity(q->buffer));
+    /* new message: names can only point into the question section */
+    compress_clear(q->compress);
+    if (buffer_pkt_qdcount(q->buffer) > 0) {
+        compress_add_dname(q->compress, q->buffer, BUFFER_PKT_HEADER_SIZE);
+    }
     q->reserved_space = edns_rr_reserved_space(q->edns_rr);
     q->reserved_space += tsig_rr_reserved_space(q->tsig_rr);
     return;
@@ -635,6 +722,7 @@ query_process_query(query_type* q, ldns_rr_type qtype, engine_type* engine)
         ods_log_assert(q->zone->name);
         ods_log_debug("[%s] incoming ixfr request serial=%u for zone %s",
             query_str, q->serial, q->zone->name);
+        metrics_count(METRICS_XFR_OUT_IXFR);
         return ixfr(q, engine);
     }
 
@@ -644,6 +732,7 @@ query_process_query(query_type* q, ldns_rr_type qtype, engine_type* engine)
         ods_log_assert(q->zone->name);
         ods_log_debug("[%s] incoming axfr request for zone %s",
             query_str, q->zone->name);
+        metrics_count(METRICS_XFR_OUT_AXFR);
         return axfr(q, engine);
     }
     /* (soa) query */
@@ -985,10 +1074,7 @@ query_add_optional(query_type* q, void* engine)
 int
 query_add_rr(query_type* q, ldns_rr* rr)
 {
-    size_t i = 0;
     size_t tc_mark = 0;
-    size_t rdlength_pos = 0;
-    uint16_t rdlength = 0;
 
     ods_log_assert(q);
     ods_log_assert(q->buffer);
@@ -996,39 +1082,14 @@ query_add_rr(query_type* q, ldns_rr* rr)
 
     /* set truncation mark, in case rr does not fit */
     tc_mark = buffer_position(q->buffer);
-    /* owner type class ttl */
-    if (!buffer_available(q->buffer, ldns_rdf_size(ldns_rr_owner(rr)))) {
-        goto query_add_rr_tc;
-    }
-    buffer_write_rdf(q->buffer, ldns_rr_owner(rr));
-    if (!buffer_available(q->buffer, sizeof(uint16_t) + sizeof(uint16_t) +
-        sizeof(uint32_t) + sizeof(rdlength))) {
-        goto query_add_rr_tc;
-    }
-    buffer_write_u16(q->buffer, (uint16_t) ldns_rr_get_type(rr));
-    buffer_write_u16(q->buffer, (uint16_t) ldns_rr_get_class(rr));
-    buffer_write_u32(q->buffer, (uint32_t) ldns_rr_ttl(rr));
-    /* skip rdlength */
-    rdlength_pos = buffer_position(q->buffer);
-    buffer_skip(q->buffer, sizeof(rdlength));
-    /* write rdata */
-    for (i=0; i < ldns_rr_rd_count(rr); i++) {
-        if (!buffer_available(q->buffer, ldns_rdf_size(ldns_rr_rdf(rr, i)))) {
-            goto query_add_rr_tc;
-        }
-        buffer_write_rdf(q->buffer, ldns_rr_rdf(rr, i));
-    }
-
-    if (!query_overflow(q)) {
-        /* write rdlength */
-        rdlength = buffer_position(q->buffer) - rdlength_pos - sizeof(rdlength);
-        buffer_write_u16_at(q->buffer, rdlength_pos, rdlength);
-        /* position updated by buffer_write() */
+    /* owner, type, class, ttl, rdlength and rdata, names compressed */
+    if (compress_write_rr(q->compress, q->buffer, rr) && !query_overflow(q)) {
+        /* position updated by compress_write_rr() */
         return 1;
     }
 
-query_add_rr_tc:
     buffer_set_position(q->buffer, tc_mark);
+    compress_rollback(q->compress, tc_mark);
     ods_log_assert(!query_overflow(q));
     return 0;
 
@@ -1049,6 +1110,11 @@ query_cleanup(query_type* q)
     allocator = q->allocator;
     buffer_cleanup(q->buffer, allocator);
     tsig_rr_cleanup(q->tsig_rr);
+    compress_cleanup(q->compress);
+    if (q->ixfr_rrs) {
+        ldns_rr_list_deep_free(q->ixfr_rrs);
+    }
+    snapshot_release(q->snapshot);
     allocator_deallocate(allocator, (void*)q);
     allocator_cleanup(allocator);
     return;
@@ -38,6 +38,7 @@
 #include "shared/allocator.h"
 #include "signer/zone.h"
 #include "wire/buffer.h"
+#include "wire/compress.h"
 #include "wire/edns.h"
 #include "wire/tsig.h"
 
@@ -80,9 +81,13 @@ struct query_struct {
     /* Zone */
     zone_type* zone;
     /* Compression */
-
+    compress_type* compress;
     /* AXFR IXFR */
     FILE* axfr_fd;
+    snapshot_type* snapshot;
+    size_t axfr_msg;
+    ldns_rr_list* ixfr_rrs;
+    size_t ixfr_pos;
     uint32_t serial;
     size_t startpos;
     /* Bits */
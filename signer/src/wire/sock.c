@@ -128,6 +128,35 @@ sock_tcp_reuseaddr(sock_type* sock, const char* node, const char* port,
 }
 
 
+/**
+ * Set socket to share its port with the sockets of other threads.
+ *
+ */
+static ods_status
+sock_reuseport(sock_type* sock, const char* node, const char* port,
+    const char* stype)
+{
+#ifdef SO_REUSEPORT
+    int on = 1;
+    ods_log_assert(sock);
+    ods_log_assert(port);
+    ods_log_assert(stype);
+    if (setsockopt(sock->s, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        ods_log_error("[%s] unable to set %s socket '%s:%s' to "
+            "reuse-port: setsockopt() failed (%s)", sock_str, stype,
+            node?node:"localhost", port, strerror(errno));
+        return ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT;
+    }
+    return ODS_STATUS_OK;
+#else
+    ods_log_error("[%s] unable to set %s socket '%s:%s' to reuse-port: "
+        "SO_REUSEPORT not supported", sock_str, stype, node?node:"localhost",
+        port);
+    return ODS_STATUS_SOCK_SETSOCKOPT_REUSEPORT;
+#endif /* SO_REUSEPORT */
+}
+
+
 /**
  * Listen on tcp socket.
  *
@@ -155,7 +184,7 @@ sock_tcp_listen(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_udp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, unsigned reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -177,6 +206,12 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
         }
         return ODS_STATUS_SOCK_SOCKET_UDP;
     }
+    if (reuseport) {
+        status = sock_reuseport(sock, node, port, "udp");
+        if (status != ODS_STATUS_OK) {
+            return status;
+        }
+    }
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
         status = sock_fcntl_and_bind(sock, node, port, "udp", "ipv4");
@@ -199,7 +234,7 @@ sock_server_udp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 sock_server_tcp(sock_type* sock, const char* node, const char* port,
-    unsigned* ip6_support)
+    unsigned* ip6_support, unsigned reuseport)
 {
     int on = 0;
     ods_status status = ODS_STATUS_OK;
@@ -221,6 +256,12 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
         }
         return ODS_STATUS_SOCK_SOCKET_TCP;
     }
+    if (reuseport) {
+        status = sock_reuseport(sock, node, port, "tcp");
+        if (status != ODS_STATUS_OK) {
+            return status;
+        }
+    }
     /* ipv4 */
     if (sock->addr->ai_family == AF_INET) {
         sock_tcp_reuseaddr(sock, node, port, on, "ipv4");
@@ -251,7 +292,8 @@ sock_server_tcp(sock_type* sock, const char* node, const char* port,
  */
 static ods_status
 socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
-    const char* node, const char* port, unsigned* ip6_support)
+    const char* node, const char* port, unsigned* ip6_support,
+    unsigned reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     int r = 0;
@@ -277,9 +319,11 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
     }
     /* socket */
     if (socktype == SOCK_DGRAM) {
-        status = sock_server_udp(sock, node, port, ip6_support);
+        status = sock_server_udp(sock, node, port, ip6_support,
+            reuseport);
     } else if (socktype == SOCK_STREAM) {
-        status = sock_server_tcp(sock, node, port, ip6_support);
+        status = sock_server_tcp(sock, node, port, ip6_support,
+            reuseport);
     }
     ods_log_debug("[%s] socket listening to %s:%s", sock_str,
         node?node:"localhost", port);
@@ -292,7 +336,8 @@ socket_listen(sock_type* sock, struct addrinfo hints, int socktype,
  *
  */
 ods_status
-sock_listen(socklist_type* sockets, listener_type* listener)
+sock_listen(socklist_type* sockets, listener_type* listener,
+    unsigned reuseport)
 {
     ods_status status = ODS_STATUS_OK;
     struct addrinfo hints[MAX_INTERFACES];
@@ -329,7 +374,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* udp */
         status = socket_listen(&sockets->udp[i], hints[i], SOCK_DGRAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -341,7 +386,7 @@ sock_listen(socklist_type* sockets, listener_type* listener)
         }
         /* tcp */
         status = socket_listen(&sockets->tcp[i], hints[i], SOCK_STREAM,
-            node, port, &ip6_support);
+            node, port, &ip6_support, reuseport);
         if (status != ODS_STATUS_OK) {
             if (!ip6_support) {
                 ods_log_warning("[%s] fallback to udp/ipv4, no udp/ipv6: "
@@ -358,6 +403,47 @@ sock_listen(socklist_type* sockets, listener_type* listener)
 }
 
 
+/**
+ * Create batch of udp queries.
+ *
+ */
+struct udp_batch*
+sock_udp_batch_create(allocator_type* allocator)
+{
+    struct udp_batch* batch = NULL;
+    size_t i = 0;
+    ods_log_assert(allocator);
+    batch = (struct udp_batch*) allocator_alloc(allocator,
+        sizeof(struct udp_batch));
+    if (!batch) {
+        ods_log_error("[%s] unable to create udp batch: allocator_alloc() "
+            "failed", sock_str);
+        return NULL;
+    }
+    memset(batch, 0, sizeof(struct udp_batch));
+    for (i=0; i < UDP_BATCH_SIZE; i++) {
+        batch->queries[i] = query_create();
+        if (!batch->queries[i]) {
+            ods_log_error("[%s] unable to create udp batch: query_create() "
+                "failed", sock_str);
+            sock_udp_batch_cleanup(batch, allocator);
+            return NULL;
+        }
+        query_reset(batch->queries[i], UDP_MAX_MESSAGE_LEN, 0);
+#ifdef SOCK_USE_MMSG
+        batch->iovs[i].iov_base = buffer_begin(batch->queries[i]->buffer);
+        batch->iovs[i].iov_len = buffer_remaining(batch->queries[i]->buffer);
+        batch->msgs[i].msg_hdr.msg_name = &batch->queries[i]->addr;
+        batch->msgs[i].msg_hdr.msg_namelen = batch->queries[i]->addrlen;
+        batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+        batch->msgs[i].msg_hdr.msg_iovlen = 1;
+#endif
+    }
+    return batch;
+}
+
+
+#ifndef SOCK_USE_MMSG
 /**
  * Send data over udp.
  *
@@ -382,6 +468,81 @@ send_udp(struct udp_data* data, query_type* q)
     }
     return;
 }
+#endif /* !SOCK_USE_MMSG */
+
+
+#ifdef SOCK_USE_MMSG
+/**
+ * Read a batch of udp queries and send the answers in one go.
+ *
+ */
+static void
+sock_handle_udp_batch(int fd, struct udp_data* data)
+{
+    struct udp_batch* batch = data->batch;
+    query_type* q = NULL;
+    query_state qstate = QUERY_PROCESSED;
+    int received = 0;
+    int count = 0;
+    int sent = 0;
+    int i = 0;
+
+    received = recvmmsg(fd, batch->msgs, UDP_BATCH_SIZE, 0, NULL);
+    if (received < 1) {
+        if (errno != EAGAIN && errno != EINTR) {
+            ods_log_error("[%s] recvmmsg() failed: %s", sock_str,
+                strerror(errno));
+        }
+        return;
+    }
+    ods_log_debug("[%s] %d incoming udp messages", sock_str, received);
+    for (i=0; i < received; i++) {
+        q = batch->queries[i];
+        q->addrlen = batch->msgs[i].msg_hdr.msg_namelen;
+        buffer_skip(q->buffer, batch->msgs[i].msg_len);
+        buffer_flip(q->buffer);
+        qstate = query_process(q, data->engine);
+        if (qstate == QUERY_DISCARDED) {
+            continue;
+        }
+        ods_log_debug("[%s] query processed qstate=%d", sock_str, qstate);
+        query_add_optional(q, data->engine);
+        buffer_flip(q->buffer);
+        /* answers are packed at the front, behind the processed queries */
+        batch->iovs[count].iov_base = buffer_begin(q->buffer);
+        batch->iovs[count].iov_len = buffer_remaining(q->buffer);
+        batch->msgs[count].msg_hdr.msg_name = &q->addr;
+        batch->msgs[count].msg_hdr.msg_namelen = q->addrlen;
+        count++;
+    }
+    i = 0;
+    while (i < count) {
+        ods_log_deeebug("[%s] sending %d answers over udp", sock_str,
+            count - i);
+        sent = sendmmsg(fd, &batch->msgs[i], count - i, 0);
+        if (sent == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* skip the answer that could not be sent */
+            ods_log_error("[%s] unable to send data over udp: sendmmsg() "
+                "failed (%s)", sock_str, strerror(errno));
+            sent = 1;
+        }
+        i += sent;
+    }
+    /* make the used queries ready for the next batch */
+    for (i=0; i < received; i++) {
+        q = batch->queries[i];
+        query_reset(q, UDP_MAX_MESSAGE_LEN, 0);
+        batch->iovs[i].iov_base = buffer_begin(q->buffer);
+        batch->iovs[i].iov_len = buffer_remaining(q->buffer);
+        batch->msgs[i].msg_hdr.msg_name = &q->addr;
+        batch->msgs[i].msg_hdr.msg_namelen = q->addrlen;
+    }
+    return;
+}
+#endif /* SOCK_USE_MMSG */
 
 
 /**
@@ -393,13 +554,18 @@ sock_handle_udp(netio_type* ATTR_UNUSED(netio), netio_handler_type* handler,
     netio_events_type event_types)
 {
     struct udp_data* data = (struct udp_data*) handler->user_data;
+#ifndef SOCK_USE_MMSG
     int received = 0;
-    query_type* q = data->query;
+    query_type* q = data->batch->queries[0];
     query_state qstate = QUERY_PROCESSED;
+#endif
 
     if (!(event_types & NETIO_EVENT_READ)) {
         return;
     }
+#ifdef SOCK_USE_MMSG
+    sock_handle_udp_batch(handler->fd, data);
+#else
     ods_log_debug("[%s] incoming udp message", sock_str);
     query_reset(q, UDP_MAX_MESSAGE_LEN, 0);
     received = recvfrom(handler->fd, buffer_begin(q->buffer),
@@ -421,6 +587,26 @@ sock_handle_udp(netio_type* ATTR_UNUSED(netio), netio_handler_type* handler,
         buffer_flip(q->buffer);
         send_udp(data, q);
     }
+#endif /* SOCK_USE_MMSG */
+    return;
+}
+
+
+/**
+ * Clean up batch of udp queries.
+ *
+ */
+void
+sock_udp_batch_cleanup(struct udp_batch* batch, allocator_type* allocator)
+{
+    size_t i = 0;
+    if (!batch) {
+        return;
+    }
+    for (i=0; i < UDP_BATCH_SIZE; i++) {
+        query_cleanup(batch->queries[i]);
+    }
+    allocator_deallocate(allocator, (void*) batch);
     return;
 }
 
@@ -545,6 +731,7 @@ sock_handle_tcp_accept(netio_type* netio, netio_handler_type* handler,
     tcp_handler->user_data = tcp_data;
     tcp_handler->event_types = NETIO_EVENT_READ | NETIO_EVENT_TIMEOUT;
     tcp_handler->event_handler = sock_handle_tcp_read;
+    tcp_handler->node = NULL;
     netio_add_handler(netio, tcp_handler);
     return;
 }
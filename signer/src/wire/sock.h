@@ -41,6 +41,15 @@
 #include "wire/netio.h"
 #include "wire/query.h"
 
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#if defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define SOCK_USE_MMSG 1
+#endif
+
+#define UDP_BATCH_SIZE 32
+
 /**
  * Socket.
  *
@@ -61,6 +70,22 @@ struct socklist_struct {
     sock_type udp[MAX_INTERFACES];
 };
 
+/**
+ * Batch of udp queries.
+ * A ring of preallocated queries, each with its own packet buffer, so
+ * that several queries can be read with one recvmmsg() and the answers
+ * sent with one sendmmsg(). Queries are reset and ready to receive
+ * between batches.
+ *
+ */
+struct udp_batch {
+    query_type* queries[UDP_BATCH_SIZE];
+#ifdef SOCK_USE_MMSG
+    struct mmsghdr msgs[UDP_BATCH_SIZE];
+    struct iovec iovs[UDP_BATCH_SIZE];
+#endif
+};
+
 /**
  * Data for udp handlers.
  *
@@ -68,7 +93,7 @@ struct socklist_struct {
 struct udp_data {
     void* engine;
     sock_type* socket;
-    query_type* query;
+    struct udp_batch* batch;
 };
 
 /**
@@ -100,10 +125,29 @@ struct tcp_data {
  * Create sockets and listen.
  * \param[out] sockets sockets
  * \param[in] listener interfaces
+ * \param[in] reuseport share the ports with other socket lists
  * \return ods_status status
  *
  */
-ods_status sock_listen(socklist_type* sockets, listener_type* listener);
+ods_status sock_listen(socklist_type* sockets, listener_type* listener,
+    unsigned reuseport);
+
+/**
+ * Create batch of udp queries.
+ * \param[in] allocator memory allocator
+ * \return struct udp_batch* batch of udp queries
+ *
+ */
+struct udp_batch* sock_udp_batch_create(allocator_type* allocator);
+
+/**
+ * Clean up batch of udp queries.
+ * \param[in] batch batch of udp queries
+ * \param[in] allocator memory allocator
+ *
+ */
+void sock_udp_batch_cleanup(struct udp_batch* batch,
+    allocator_type* allocator);
 
 /**
  * Handle incoming udp queries.
@@ -64,6 +64,7 @@ tcp_conn_create(allocator_type* allocator)
     tcp_conn->msglen = 0;
     tcp_conn->total_bytes = 0;
     tcp_conn->fd = -1;
+    tcp_conn->to_len = 0;
     return tcp_conn;
 }
 
@@ -85,10 +86,33 @@ tcp_set_create(allocator_type* allocator)
     }
     tcp_set->tcp_waiting_first = NULL;
     tcp_set->tcp_waiting_last = NULL;
+    tcp_set->max_per_master = TCPSET_MAX;
     return tcp_set;
 }
 
 
+/**
+ * Count the connections in use for a master.
+ *
+ */
+size_t
+tcp_set_count_master(tcp_set_type* set, struct sockaddr_storage* to,
+    socklen_t to_len)
+{
+    size_t i = 0;
+    size_t count = 0;
+    ods_log_assert(set);
+    ods_log_assert(to);
+    for (i=0; i < TCPSET_MAX; i++) {
+        if (set->tcp_conn[i]->to_len == to_len &&
+            memcmp(&set->tcp_conn[i]->to, to, to_len) == 0) {
+            count++;
+        }
+    }
+    return count;
+}
+
+
 /**
  * Make tcp connection ready for reading.
  * \param[in] tcp tcp connection
@@ -40,6 +40,7 @@
 #include "wire/xfrd.h"
 
 #include <stdint.h>
+#include <sys/socket.h>
 
 #define TCPSET_MAX 50
 
@@ -56,8 +57,13 @@ struct tcp_conn_struct {
    uint16_t msglen;
    /* packet buffer of connection */
    buffer_type* packet;
+   /* master this connection is in use for */
+   struct sockaddr_storage to;
+   socklen_t to_len;
    /* state: reading or writing */
    unsigned is_reading : 1;
+   /* connection was handed over from another zone */
+   unsigned is_reused : 1;
 };
 
 /*
@@ -70,6 +76,7 @@ struct tcp_set_struct {
     xfrd_type* tcp_waiting_first;
     xfrd_type* tcp_waiting_last;
     size_t tcp_count;
+    size_t max_per_master;
 };
 
 /**
@@ -88,6 +95,17 @@ tcp_conn_type* tcp_conn_create(allocator_type* allocator);
  */
 tcp_set_type* tcp_set_create(allocator_type* allocator);
 
+/**
+ * Count the connections in use for a master.
+ * \param[in] set set of tcp connections
+ * \param[in] to address of the master
+ * \param[in] to_len length of the address
+ * \return size_t number of connections in use for the master
+ *
+ */
+size_t tcp_set_count_master(tcp_set_type* set, struct sockaddr_storage* to,
+    socklen_t to_len);
+
 /**
  * Make tcp connection ready for reading.
  * \param[in] tcp tcp connection
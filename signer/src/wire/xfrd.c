@@ -37,6 +37,7 @@
 #include "shared/duration.h"
 #include "shared/file.h"
 #include "shared/log.h"
+#include "shared/metrics.h"
 #include "shared/status.h"
 #include "shared/util.h"
 #include "signer/domain.h"
@@ -72,6 +73,7 @@ static xfrd_pkt_status xfrd_handle_packet(xfrd_type* xfrd,
 static void xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set);
+static void xfrd_tcp_pass(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_write(xfrd_type* xfrd, tcp_set_type* set);
 static void xfrd_tcp_xfr(xfrd_type* xfrd, tcp_set_type* set);
 static int xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set);
@@ -133,12 +135,28 @@ xfrd_create(void* xfrhandler, void* zone)
     xfrd->serial_disk_acquired = 0;
     xfrd->serial_notify_acquired = 0;
     lock_basic_unlock(&xfrd->serial_lock);
+    lock_basic_lock(&xfrd->rw_lock);
+    xfrd->diff_first = NULL;
+    xfrd->diff_last = NULL;
+    xfrd->diff_rr_count = 0;
+    /* the spool may hold transfers from before a restart */
+    xfrd->diff_valid = 0;
+    xfrd->xfr_received.tv_sec = 0;
+    xfrd->xfr_received.tv_usec = 0;
+    xfrd->latency_start.tv_sec = 0;
+    xfrd->latency_start.tv_usec = 0;
+    xfrd->latency_count = 0;
+    xfrd->latency_last = 0;
+    xfrd->latency_max = 0;
+    lock_basic_unlock(&xfrd->rw_lock);
     xfrd->query_id = 0;
     xfrd->msg_seq_nr = 0;
     xfrd->msg_rr_count = 0;
     xfrd->msg_old_serial = 0;
     xfrd->msg_new_serial = 0;
     xfrd->msg_is_ixfr = 0;
+    xfrd->msg_is_text = 0;
+    xfrd->msg_rrs = NULL;
     xfrd->udp_waiting = 0;
     xfrd->udp_waiting_next = NULL;
     xfrd->tcp_waiting = 0;
@@ -162,6 +180,7 @@ xfrd_create(void* xfrhandler, void* zone)
     xfrd->handler.event_types =
         NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
     xfrd->handler.event_handler = xfrd_handle_zone;
+    xfrd->handler.node = NULL;
     xfrd_set_timer_time(xfrd, 0);
     return xfrd;
 }
@@ -180,6 +199,21 @@ xfrd_time(xfrd_type* xfrd)
 }
 
 
+/**
+ * Announce handler changes to netio.
+ *
+ */
+static void
+xfrd_update_handler(xfrd_type* xfrd)
+{
+    xfrhandler_type* xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
+    if (xfrhandler) {
+        netio_update_handler(xfrhandler->netio, &xfrd->handler);
+    }
+    return;
+}
+
+
 /**
  * Set timer.
  *
@@ -203,6 +237,7 @@ xfrd_set_timer(xfrd_type* xfrd, time_t t)
     xfrd->handler.timeout = &xfrd->timeout;
     xfrd->timeout.tv_sec = t;
     xfrd->timeout.tv_nsec = 0;
+    xfrd_update_handler(xfrd);
     return;
 }
 
@@ -216,6 +251,7 @@ xfrd_unset_timer(xfrd_type* xfrd)
 {
     ods_log_assert(xfrd);
     xfrd->handler.timeout = NULL;
+    xfrd_update_handler(xfrd);
     return;
 }
 
@@ -437,6 +473,147 @@ xfrd_tsig_process(xfrd_type* xfrd, buffer_type* buffer)
 }
 
 
+/**
+ * Write record to the zone transfer spool.
+ *
+ */
+static int
+xfrd_spool_write(FILE* fd, uint16_t type, uint8_t* data, uint16_t len)
+{
+    uint8_t header[XFRD_SPOOL_HEADER_SIZE];
+    write_uint32(header, XFRD_SPOOL_MAGIC);
+    write_uint16(header + 4, type);
+    write_uint16(header + 6, len);
+    if (fwrite(header, sizeof(header), 1, fd) != 1) {
+        return 0;
+    }
+    if (len > 0 && fwrite(data, len, 1, fd) != 1) {
+        return 0;
+    }
+    return 1;
+}
+
+
+/**
+ * Drop the in-memory copy of the spool.
+ *
+ */
+static void
+xfrd_diff_invalidate(xfrd_type* xfrd)
+{
+    xfrd_diff_cleanup(xfrd->diff_first);
+    xfrd->diff_first = NULL;
+    xfrd->diff_last = NULL;
+    xfrd->diff_rr_count = 0;
+    xfrd->diff_valid = 0;
+    return;
+}
+
+
+/**
+ * Queue the IXFR that is being committed.
+ *
+ */
+static void
+xfrd_diff_commit(xfrd_type* xfrd)
+{
+    xfrd_diff_type* diff = NULL;
+    size_t count = 0;
+
+    if (!xfrd->msg_rrs || !xfrd->msg_is_ixfr || !xfrd->diff_valid) {
+        /* axfr, or too large: the adapter reads the spool */
+        goto invalidate;
+    }
+    count = ldns_rr_list_rr_count(xfrd->msg_rrs);
+    if (xfrd->diff_rr_count + count > XFRD_DIFF_MAX_RRS) {
+        goto invalidate;
+    }
+    diff = (xfrd_diff_type*) malloc(sizeof(xfrd_diff_type));
+    if (!diff) {
+        goto invalidate;
+    }
+    diff->next = NULL;
+    diff->serial = xfrd->msg_new_serial;
+    diff->rrs = xfrd->msg_rrs;
+    xfrd->msg_rrs = NULL;
+    if (xfrd->diff_last) {
+        xfrd->diff_last->next = diff;
+    } else {
+        xfrd->diff_first = diff;
+    }
+    xfrd->diff_last = diff;
+    xfrd->diff_rr_count += count;
+    return;
+
+invalidate:
+    ldns_rr_list_deep_free(xfrd->msg_rrs);
+    xfrd->msg_rrs = NULL;
+    xfrd_diff_invalidate(xfrd);
+    return;
+}
+
+
+/**
+ * Keep a parsed copy of the answer section of an IXFR in memory.
+ *
+ */
+static void
+xfrd_diff_collect(xfrd_type* xfrd, buffer_type* buffer)
+{
+    buffer_type packet;
+    ldns_rr* rr = NULL;
+    ldns_status status = LDNS_STATUS_OK;
+    uint16_t qdcount = 0;
+    uint16_t ancount = 0;
+    size_t pos = 0;
+
+    if (xfrd->msg_seq_nr == 0) {
+        ldns_rr_list_deep_free(xfrd->msg_rrs);
+        xfrd->msg_rrs = ldns_rr_list_new();
+        gettimeofday(&xfrd->msg_received, NULL);
+    }
+    if (!xfrd->msg_rrs) {
+        return;
+    }
+    if (xfrd->msg_rr_count > 1 && !xfrd->msg_is_ixfr) {
+        /* axfr */
+        goto drop;
+    }
+    buffer_create_from(&packet, buffer_begin(buffer), buffer_limit(buffer));
+    qdcount = buffer_pkt_qdcount(&packet);
+    ancount = buffer_pkt_ancount(&packet);
+    if (ldns_rr_list_rr_count(xfrd->msg_rrs) + ancount > XFRD_DIFF_MAX_RRS) {
+        goto drop;
+    }
+    buffer_skip(&packet, BUFFER_PKT_HEADER_SIZE);
+    while (qdcount > 0) {
+        if (!buffer_skip_rr(&packet, 1)) {
+            goto drop;
+        }
+        qdcount--;
+    }
+    pos = buffer_position(&packet);
+    while (ancount > 0) {
+        status = ldns_wire2rr(&rr, buffer_begin(&packet),
+            buffer_limit(&packet), &pos, LDNS_SECTION_ANSWER);
+        if (status != LDNS_STATUS_OK) {
+            goto drop;
+        }
+        if (!ldns_rr_list_push_rr(xfrd->msg_rrs, rr)) {
+            ldns_rr_free(rr);
+            goto drop;
+        }
+        ancount--;
+    }
+    return;
+
+drop:
+    ldns_rr_list_deep_free(xfrd->msg_rrs);
+    xfrd->msg_rrs = NULL;
+    return;
+}
+
+
 /**
  * Commit answer on disk.
  *
@@ -447,6 +624,9 @@ xfrd_commit_packet(xfrd_type* xfrd)
     zone_type* zone = NULL;
     char* xfrfile = NULL;
     FILE* fd = NULL;
+    int reschedule = 0;
+    struct timeval start, end;
+    unsigned long elapsed = 0;
     ods_log_assert(xfrd);
     zone = (zone_type*) xfrd->zone;
     xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
@@ -457,17 +637,33 @@ xfrd_commit_packet(xfrd_type* xfrd)
     }
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    lock_basic_lock(&zone->zone_lock);
+    gettimeofday(&start, NULL);
+    /**
+     * The zone lock is not taken: it is held by the worker for as long as
+     * it works on the zone, including signing. The new serial is published
+     * under the serial lock and the task is handed off to the scheduler.
+     */
     lock_basic_lock(&xfrd->rw_lock);
     lock_basic_lock(&xfrd->serial_lock);
     /* mark end packet */
     fd = ods_fopen(xfrfile, NULL, "a");
     free((void*)xfrfile);
     if (fd) {
-        fprintf(fd, ";;ENDPACKET\n");
+        if (xfrd->msg_is_text) {
+            fprintf(fd, ";;ENDPACKET\n");
+        } else if (!xfrd_spool_write(fd, XFRD_SPOOL_END, NULL, 0)) {
+            ods_log_crit("[%s] unable to commit xfr zone %s: fwrite() "
+                "failed (%s)", xfrd_str, zone->name, strerror(errno));
+        }
         ods_fclose(fd);
+        xfrd_diff_commit(xfrd);
+        if (!xfrd->xfr_received.tv_sec) {
+            xfrd->xfr_received = xfrd->msg_received;
+        }
     } else {
-        lock_basic_unlock(&zone->zone_lock);
+        xfrd_diff_invalidate(xfrd);
+        ldns_rr_list_deep_free(xfrd->msg_rrs);
+        xfrd->msg_rrs = NULL;
         lock_basic_unlock(&xfrd->rw_lock);
         lock_basic_unlock(&xfrd->serial_lock);
         ods_log_crit("[%s] unable to commit xfr zone %s: ods_fopen() failed "
@@ -480,18 +676,23 @@ xfrd_commit_packet(xfrd_type* xfrd)
     xfrd->soa.serial = xfrd->serial_disk;
     if (util_serial_gt(xfrd->serial_disk, xfrd->serial_xfr) &&
             xfrd->serial_disk_acquired > xfrd->serial_xfr_acquired) {
+        ods_log_debug("[%s] reschedule task for zone %s: disk serial=%u "
+            "acquired=%u, memory serial=%u acquired=%u", xfrd_str,
+            zone->name, xfrd->serial_disk,
+            xfrd->serial_disk_acquired, xfrd->serial_xfr,
+            xfrd->serial_xfr_acquired);
+        reschedule = 1;
+    }
+    lock_basic_unlock(&xfrd->serial_lock);
+    lock_basic_unlock(&xfrd->rw_lock);
+    if (reschedule) {
         /* reschedule task */
         int ret = 0;
         xfrhandler_type* xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
         engine_type* engine = (engine_type*) xfrhandler->engine;
         ods_log_assert(xfrhandler);
         ods_log_assert(engine);
-        ods_log_debug("[%s] reschedule task for zone %s: disk serial=%u "
-            "acquired=%u, memory serial=%u acquired=%u", xfrd_str,
-            zone->name, xfrd->serial_disk,
-            xfrd->serial_disk_acquired, xfrd->serial_xfr,
-            xfrd->serial_xfr_acquired);
-        ret = zone_reschedule_task(zone, engine->taskq, TASK_READ);
+        ret = zone_reschedule_task_nowait(zone, engine->taskq, TASK_READ);
         if (ret != ODS_STATUS_OK) {
             ods_log_crit("[%s] unable to reschedule task for zone %s: %s",
                 xfrd_str, zone->name, ods_status2str(ret));
@@ -499,9 +700,11 @@ xfrd_commit_packet(xfrd_type* xfrd)
             engine_wakeup_workers(engine);
         }
     }
-    lock_basic_unlock(&xfrd->serial_lock);
-    lock_basic_unlock(&xfrd->rw_lock);
-    lock_basic_unlock(&zone->zone_lock);
+    gettimeofday(&end, NULL);
+    elapsed = (end.tv_sec - start.tv_sec) * 1000 +
+        (end.tv_usec - start.tv_usec) / 1000;
+    ods_log_verbose("[%s] zone %s committed serial %u in %lu ms", xfrd_str,
+        zone->name, xfrd->msg_new_serial, elapsed);
     return;
 }
 
@@ -514,27 +717,41 @@ static void
 xfrd_dump_packet(xfrd_type* xfrd, buffer_type* buffer)
 {
     zone_type* zone = NULL;
+    dnsin_type* dnsin = NULL;
     char* xfrfile = NULL;
     FILE* fd = NULL;
     ldns_pkt* pkt = NULL;
     ldns_status status = LDNS_STATUS_OK;
+    int written = 1;
     ods_log_assert(buffer);
     ods_log_assert(xfrd);
     zone = (zone_type*) xfrd->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->name);
-    status = ldns_wire2pkt(&pkt, buffer_begin(buffer), buffer_limit(buffer));
-    if (status != LDNS_STATUS_OK) {
-        ods_log_crit("[%s] unable to dump packet zone %s: ldns_wire2pkt() "
-            "failed (%s)", xfrd_str, zone->name,
-            ldns_get_errorstr_by_id(status));
-        return;
+    if (xfrd->msg_seq_nr == 0) {
+        /* the spool format is fixed for the whole transfer */
+        ods_log_assert(zone->adinbound);
+        ods_log_assert(zone->adinbound->config);
+        dnsin = (dnsin_type*) zone->adinbound->config;
+        xfrd->msg_is_text = dnsin->text_spool;
+    }
+    xfrd_diff_collect(xfrd, buffer);
+    if (xfrd->msg_is_text) {
+        status = ldns_wire2pkt(&pkt, buffer_begin(buffer),
+            buffer_limit(buffer));
+        if (status != LDNS_STATUS_OK) {
+            ods_log_crit("[%s] unable to dump packet zone %s: "
+                "ldns_wire2pkt() failed (%s)", xfrd_str, zone->name,
+                ldns_get_errorstr_by_id(status));
+            return;
+        }
+        ods_log_assert(pkt);
     }
-    ods_log_assert(pkt);
     xfrfile = ods_build_path(zone->name, ".xfrd", 0, 1);
     if (!xfrfile) {
         ods_log_crit("[%s] unable to dump packet zone %s: build path failed",
             xfrd_str, zone->name);
+        ldns_pkt_free(pkt);
         return;
     }
     lock_basic_lock(&xfrd->rw_lock);
@@ -548,15 +765,26 @@ xfrd_dump_packet(xfrd_type* xfrd, buffer_type* buffer)
         ods_log_crit("[%s] unable to dump packet zone %s: ods_fopen() failed "
             "(%s)", xfrd_str, zone->name, strerror(errno));
         lock_basic_unlock(&xfrd->rw_lock);
+        ldns_pkt_free(pkt);
         return;
     }
     ods_log_assert(fd);
-    if (xfrd->msg_seq_nr == 0) {
-        fprintf(fd, ";;BEGINPACKET\n");
+    if (xfrd->msg_is_text) {
+        if (xfrd->msg_seq_nr == 0) {
+            fprintf(fd, ";;BEGINPACKET\n");
+        }
+        ldns_rr_list_print(fd, ldns_pkt_answer(pkt));
+    } else {
+        written = xfrd_spool_write(fd, xfrd->msg_seq_nr == 0 ?
+            XFRD_SPOOL_BEGIN : XFRD_SPOOL_PACKET, buffer_begin(buffer),
+            (uint16_t) buffer_limit(buffer));
     }
-    ldns_rr_list_print(fd, ldns_pkt_answer(pkt));
     ods_fclose(fd);
     lock_basic_unlock(&xfrd->rw_lock);
+    if (!written) {
+        ods_log_crit("[%s] unable to dump packet zone %s: fwrite() failed "
+            "(%s)", xfrd_str, zone->name, strerror(errno));
+    }
     ldns_pkt_free(pkt);
     return;
 }
@@ -971,6 +1199,7 @@ xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
         case XFRD_PKT_NOTIMPL:
         case XFRD_PKT_BAD:
         default:
+            metrics_count(METRICS_XFR_IN_FAILED);
             /* rollback */
             if (xfrd->msg_seq_nr > 0) {
                 buffer_clear(buffer);
@@ -983,6 +1212,7 @@ xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
     }
     /* dump reply on disk to diff file */
     xfrd_dump_packet(xfrd, buffer);
+    metrics_count(METRICS_XFR_IN_MESSAGES);
     /* more? */
     xfrd->msg_seq_nr++;
     if (res == XFRD_PKT_MORE) {
@@ -994,6 +1224,7 @@ xfrd_handle_packet(xfrd_type* xfrd, buffer_type* buffer)
     buffer_flip(buffer);
     /* commit packet */
     xfrd_commit_packet(xfrd);
+    metrics_count(METRICS_XFR_IN_DONE);
     /* next time */
     lock_basic_lock(&xfrd->serial_lock);
 
@@ -1084,6 +1315,7 @@ xfrd_tcp_write(xfrd_type* xfrd, tcp_set_type* set)
     tcp->is_reading = 1;
     tcp_conn_ready(tcp);
     xfrd->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    xfrd_update_handler(xfrd);
     xfrd_tcp_read(xfrd, set);
     return;
 }
@@ -1160,23 +1392,35 @@ xfrd_tcp_open(xfrd_type* xfrd, tcp_set_type* set)
 static void
 xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set)
 {
+    struct sockaddr_storage to;
+    socklen_t to_len = 0;
+    size_t per_master = 0;
     int i = 0;
+    zone_type* zone = NULL;
 
     ods_log_assert(set);
     ods_log_assert(xfrd);
+    zone = (zone_type*) xfrd->zone;
+    ods_log_assert(zone);
     ods_log_assert(xfrd->tcp_conn == -1);
     ods_log_assert(xfrd->tcp_waiting == 0);
-    if (set->tcp_count < TCPSET_MAX) {
-        ods_log_assert(!set->tcp_waiting_first);
+    ods_log_assert(xfrd->master);
+    to_len = xfrd_acl_sockaddr_to(xfrd->master, &to);
+    per_master = tcp_set_count_master(set, &to, to_len);
+    if (set->tcp_count < TCPSET_MAX && per_master < set->max_per_master) {
         set->tcp_count ++;
         /* find a free tcp_buffer */
         for (i=0; i < TCPSET_MAX; i++) {
-            if (set->tcp_conn[i]->fd == -1) {
+            if (set->tcp_conn[i]->fd == -1 &&
+                set->tcp_conn[i]->to_len == 0) {
                 xfrd->tcp_conn = i;
                 break;
             }
         }
         ods_log_assert(xfrd->tcp_conn != -1);
+        memcpy(&set->tcp_conn[xfrd->tcp_conn]->to, &to, to_len);
+        set->tcp_conn[xfrd->tcp_conn]->to_len = to_len;
+        set->tcp_conn[xfrd->tcp_conn]->is_reused = 0;
         xfrd->tcp_waiting = 0;
         /* stop udp use (if any) */
         if (xfrd->handler.fd != -1) {
@@ -1189,14 +1433,81 @@ xfrd_tcp_obtain(xfrd_type* xfrd, tcp_set_type* set)
         return;
     }
     /* wait, at end of line */
-    ods_log_verbose("[%s] max number of tcp connections (%d) reached",
-        xfrd_str, TCPSET_MAX);
+    if (set->tcp_count < TCPSET_MAX) {
+        ods_log_verbose("[%s] zone %s waits, max number of tcp connections "
+            "to %s (%u) reached", xfrd_str, zone->name,
+            xfrd->master->address, (unsigned) set->max_per_master);
+    } else {
+        ods_log_verbose("[%s] zone %s waits, max number of tcp connections "
+            "(%d) reached", xfrd_str, zone->name, TCPSET_MAX);
+    }
     xfrd->tcp_waiting = 1;
+    xfrd->tcp_waiting_next = NULL;
+    if (!set->tcp_waiting_first) {
+        set->tcp_waiting_first = xfrd;
+    }
+    if (set->tcp_waiting_last) {
+        set->tcp_waiting_last->tcp_waiting_next = xfrd;
+    }
+    set->tcp_waiting_last = xfrd;
     xfrd_unset_timer(xfrd);
     return;
 }
 
 
+/**
+ * Take the first zone off the tcp waiting list that may use a connection
+ * to the given master. If to is NULL, take the first zone that may open
+ * a new connection. If which is set, take that zone off the list.
+ *
+ */
+static xfrd_type*
+xfrd_tcp_dequeue(tcp_set_type* set, xfrd_type* which,
+    struct sockaddr_storage* to, socklen_t to_len)
+{
+    struct sockaddr_storage wto;
+    socklen_t wto_len = 0;
+    xfrd_type* prev = NULL;
+    xfrd_type* wf = NULL;
+
+    ods_log_assert(set);
+    for (wf = set->tcp_waiting_first; wf; wf = wf->tcp_waiting_next) {
+        ods_log_assert(wf->tcp_waiting);
+        if (which) {
+            if (wf == which) {
+                break;
+            }
+        } else if (wf->master) {
+            wto_len = xfrd_acl_sockaddr_to(wf->master, &wto);
+            if (to) {
+                if (wto_len == to_len && memcmp(&wto, to, to_len) == 0) {
+                    break;
+                }
+            } else if (tcp_set_count_master(set, &wto, wto_len) <
+                set->max_per_master) {
+                break;
+            }
+        }
+        prev = wf;
+    }
+    if (!wf) {
+        return NULL;
+    }
+    /* snip off waiting list */
+    if (prev) {
+        prev->tcp_waiting_next = wf->tcp_waiting_next;
+    } else {
+        set->tcp_waiting_first = wf->tcp_waiting_next;
+    }
+    if (set->tcp_waiting_last == wf) {
+        set->tcp_waiting_last = prev;
+    }
+    wf->tcp_waiting_next = NULL;
+    wf->tcp_waiting = 0;
+    return wf;
+}
+
+
 /**
  * Start xfr.
  *
@@ -1265,6 +1576,15 @@ xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set)
     tcp = set->tcp_conn[xfrd->tcp_conn];
     ret = tcp_conn_read(tcp);
     if (ret == -1) {
+        if (tcp->is_reused && xfrd->msg_seq_nr == 0) {
+            /* master closed the connection we took over, open a new one */
+            ods_log_debug("[%s] reused tcp connection to %s closed",
+                xfrd_str, xfrd->master->address);
+            xfrd_tcp_release(xfrd, set);
+            xfrd_set_timer(xfrd, xfrd_time(xfrd) + XFRD_TCP_TIMEOUT);
+            xfrd_tcp_obtain(xfrd, set);
+            return;
+        }
         xfrd_set_timer_now(xfrd);
         xfrd_tcp_release(xfrd, set);
         return;
@@ -1283,7 +1603,7 @@ xfrd_tcp_read(xfrd_type* xfrd, tcp_set_type* set)
         case XFRD_PKT_NEWLEASE:
             ods_log_debug("[%s] tcp read %s: release connection", xfrd_str,
                 XFRD_PKT_XFR?"xfr":"newlease");
-            xfrd_tcp_release(xfrd, set);
+            xfrd_tcp_pass(xfrd, set);
             ods_log_assert(xfrd->round_num == -1);
             break;
         case XFRD_PKT_NOTIMPL:
@@ -1327,12 +1647,72 @@ xfrd_tcp_release(xfrd_type* xfrd, tcp_set_type* set)
     xfrd->tcp_waiting = 0;
     xfrd->handler.fd = -1;
     xfrd->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    xfrd_update_handler(xfrd);
 
     if (set->tcp_conn[conn]->fd != -1) {
         close(set->tcp_conn[conn]->fd);
     }
     set->tcp_conn[conn]->fd = -1;
+    set->tcp_conn[conn]->to_len = 0;
     set->tcp_count --;
+    /* see if there are waiting zones */
+    if (set->tcp_count < TCPSET_MAX) {
+        xfrd_type* wf = xfrd_tcp_dequeue(set, NULL, NULL, 0);
+        if (wf) {
+            /* same as xfrd_make_request() before it had to wait */
+            xfrd_set_timer(wf, xfrd_time(wf) + XFRD_TCP_TIMEOUT);
+            xfrd_tcp_obtain(wf, set);
+        }
+    }
+    return;
+}
+
+
+/**
+ * Pass tcp connection on to a zone that waits for the same master,
+ * or release it if there is none.
+ *
+ */
+static void
+xfrd_tcp_pass(xfrd_type* xfrd, tcp_set_type* set)
+{
+    int conn = 0;
+    tcp_conn_type* tcp = NULL;
+    xfrd_type* wf = NULL;
+    zone_type* zone = NULL;
+
+    ods_log_assert(set);
+    ods_log_assert(xfrd);
+    ods_log_assert(xfrd->tcp_conn != -1);
+    conn = xfrd->tcp_conn;
+    tcp = set->tcp_conn[conn];
+    if (tcp->fd != -1) {
+        wf = xfrd_tcp_dequeue(set, NULL, &tcp->to, tcp->to_len);
+    }
+    if (!wf) {
+        xfrd_tcp_release(xfrd, set);
+        return;
+    }
+    zone = (zone_type*) wf->zone;
+    ods_log_debug("[%s] zone %s reuse tcp connection to %s", xfrd_str,
+        zone->name, wf->master->address);
+    xfrd->tcp_conn = -1;
+    xfrd->handler.fd = -1;
+    xfrd->handler.event_types = NETIO_EVENT_READ|NETIO_EVENT_TIMEOUT;
+    xfrd_update_handler(xfrd);
+    /* stop udp use (if any) */
+    if (wf->handler.fd != -1) {
+        xfrd_udp_release(wf);
+    }
+    wf->tcp_conn = conn;
+    tcp->is_reading = 0;
+    tcp->is_reused = 1;
+    tcp->total_bytes = 0;
+    tcp->msglen = 0;
+    wf->handler.fd = tcp->fd;
+    wf->handler.event_types = NETIO_EVENT_WRITE|NETIO_EVENT_TIMEOUT;
+    xfrd_set_timer(wf, xfrd_time(wf) + XFRD_TCP_TIMEOUT);
+    xfrd_tcp_xfr(wf, set);
     return;
 }
 
@@ -1453,6 +1833,7 @@ xfrd_udp_obtain(xfrd_type* xfrd)
     if (xfrhandler->udp_use_num < XFRD_MAX_UDP) {
             xfrhandler->udp_use_num++;
             xfrd->handler.fd = xfrd_udp_send_request_ixfr(xfrd);
+            xfrd_update_handler(xfrd);
             if (xfrd->handler.fd == -1) {
                     xfrhandler->udp_use_num--;
             }
@@ -1571,6 +1952,7 @@ xfrd_udp_release(xfrd_type* xfrd)
     if(xfrd->handler.fd != -1)
         close(xfrd->handler.fd);
     xfrd->handler.fd = -1;
+    xfrd_update_handler(xfrd);
     xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
     ods_log_assert(xfrhandler);
     /* see if there are waiting zones */
@@ -1587,6 +1969,7 @@ xfrd_udp_release(xfrd_type* xfrd)
             /* see if this zone needs udp connection */
             if (wf->tcp_conn == -1) {
                 wf->handler.fd = xfrd_udp_send_request_ixfr(wf);
+                xfrd_update_handler(wf);
                 if (wf->handler.fd != -1) {
                     return;
                 }
@@ -1692,21 +2075,15 @@ xfrd_make_request(xfrd_type* xfrd)
 
 
 /**
- * Handle zone transfer.
+ * Handle zone transfer event, with the tcp lock of the xfrhandler held.
  *
  */
 static void
-xfrd_handle_zone(netio_type* ATTR_UNUSED(netio),
-    netio_handler_type* handler, netio_events_type event_types)
+xfrd_handle_zone_event(xfrd_type* xfrd, netio_handler_type* handler,
+    netio_events_type event_types)
 {
-    xfrd_type* xfrd = NULL;
     zone_type* zone = NULL;
 
-    if (!handler) {
-        return;
-    }
-    xfrd = (xfrd_type*) handler->user_data;
-    ods_log_assert(xfrd);
     zone = (zone_type*) xfrd->zone;
     ods_log_assert(zone);
     ods_log_assert(zone->name);
@@ -1769,6 +2146,148 @@ xfrd_handle_zone(netio_type* ATTR_UNUSED(netio),
 }
 
 
+/**
+ * Handle zone transfer.
+ *
+ */
+static void
+xfrd_handle_zone(netio_type* ATTR_UNUSED(netio),
+    netio_handler_type* handler, netio_events_type event_types)
+{
+    xfrd_type* xfrd = NULL;
+    xfrhandler_type* xfrhandler = NULL;
+
+    if (!handler) {
+        return;
+    }
+    xfrd = (xfrd_type*) handler->user_data;
+    ods_log_assert(xfrd);
+    xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
+    ods_log_assert(xfrhandler);
+    /* the tcp set is not changed by xfrd_cleanup() meanwhile */
+    lock_basic_lock(&xfrhandler->tcp_lock);
+    xfrd_handle_zone_event(xfrd, handler, event_types);
+    lock_basic_unlock(&xfrhandler->tcp_lock);
+    return;
+}
+
+
+/**
+ * Take the in-memory copy of the spool.
+ *
+ */
+xfrd_diff_type*
+xfrd_take_diffs(xfrd_type* xfrd)
+{
+    xfrd_diff_type* diff = NULL;
+    ods_log_assert(xfrd);
+    if (xfrd->diff_valid) {
+        diff = xfrd->diff_first;
+        xfrd->diff_first = NULL;
+        xfrd->diff_last = NULL;
+        xfrd->diff_rr_count = 0;
+    } else {
+        xfrd_diff_invalidate(xfrd);
+    }
+    /* the spool is consumed, from now on the queue is complete */
+    xfrd->diff_valid = 1;
+    if (!xfrd->latency_start.tv_sec) {
+        xfrd->latency_start = xfrd->xfr_received;
+    }
+    xfrd->xfr_received.tv_sec = 0;
+    xfrd->xfr_received.tv_usec = 0;
+    return diff;
+}
+
+
+/**
+ * Report that the zone is available for transfer.
+ *
+ */
+void
+xfrd_report_latency(xfrd_type* xfrd, uint32_t serial)
+{
+    zone_type* zone = NULL;
+    struct timeval now;
+    unsigned long latency = 0;
+    if (!xfrd) {
+        return;
+    }
+    zone = (zone_type*) xfrd->zone;
+    lock_basic_lock(&xfrd->rw_lock);
+    if (!xfrd->latency_start.tv_sec) {
+        lock_basic_unlock(&xfrd->rw_lock);
+        return;
+    }
+    gettimeofday(&now, NULL);
+    latency = (now.tv_sec - xfrd->latency_start.tv_sec) * 1000 +
+        (now.tv_usec - xfrd->latency_start.tv_usec) / 1000;
+    xfrd->latency_start.tv_sec = 0;
+    xfrd->latency_start.tv_usec = 0;
+    xfrd->latency_count++;
+    xfrd->latency_last = latency;
+    if (latency > xfrd->latency_max) {
+        xfrd->latency_max = latency;
+    }
+    lock_basic_unlock(&xfrd->rw_lock);
+    ods_log_verbose("[%s] zone %s serial %u available for transfer %lu.%03lu "
+        "seconds after receiving the update", xfrd_str, zone->name, serial,
+        latency / 1000, latency % 1000);
+    return;
+}
+
+
+/**
+ * Clean up received IXFRs.
+ *
+ */
+void
+xfrd_diff_cleanup(xfrd_diff_type* diff)
+{
+    xfrd_diff_type* next = NULL;
+    while (diff) {
+        next = diff->next;
+        ldns_rr_list_deep_free(diff->rrs);
+        free((void*) diff);
+        diff = next;
+    }
+    return;
+}
+
+
+/**
+ * Take a zone that is about to be removed off the tcp waiting list of
+ * its xfrhandler and give back the tcp connection it holds, if any.
+ *
+ */
+static void
+xfrd_tcp_cleanup(xfrd_type* xfrd)
+{
+    xfrhandler_type* xfrhandler = NULL;
+    int released = 0;
+
+    xfrhandler = (xfrhandler_type*) xfrd->xfrhandler;
+    if (!xfrhandler || !xfrhandler->tcp_set) {
+        return;
+    }
+    lock_basic_lock(&xfrhandler->tcp_lock);
+    if (xfrd->tcp_waiting) {
+        (void) xfrd_tcp_dequeue(xfrhandler->tcp_set, xfrd, NULL, 0);
+    }
+    if (xfrd->tcp_conn != -1) {
+        /* hands the connection to the next waiting zone, if any */
+        xfrd_tcp_release(xfrd, xfrhandler->tcp_set);
+        released = 1;
+    }
+    lock_basic_unlock(&xfrhandler->tcp_lock);
+    if (released) {
+        /* the handler may be blocked in dispatch, waiting for the slot */
+        xfrhandler_signal(xfrhandler);
+    }
+    return;
+}
+
+
 /**
  * Cleanup zone transfer structure.
  *
@@ -1782,9 +2301,12 @@ xfrd_cleanup(xfrd_type* xfrd)
     if (!xfrd) {
         return;
     }
+    xfrd_tcp_cleanup(xfrd);
     allocator = xfrd->allocator;
     serial_lock = xfrd->serial_lock;
     rw_lock = xfrd->rw_lock;
+    xfrd_diff_cleanup(xfrd->diff_first);
+    ldns_rr_list_deep_free(xfrd->msg_rrs);
     tsig_rr_cleanup(xfrd->tsig_rr);
     allocator_deallocate(allocator, (void*) xfrd);
     allocator_cleanup(allocator);
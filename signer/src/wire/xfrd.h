@@ -43,7 +43,9 @@
 #include "wire/netio.h"
 #include "wire/tsig.h"
 
+#include <ldns/ldns.h>
 #include <stdint.h>
+#include <sys/time.h>
 #include <time.h>
 
 #define XFRD_MAX_ROUNDS 3 /* max number of rounds along the masters */
@@ -52,6 +54,38 @@
 #define XFRD_TCP_TIMEOUT 120 /* seconds, before a tcp request times out */
 #define XFRD_UDP_TIMEOUT 5 /* seconds, before a udp request times out */
 
+/**
+ * Zone transfer spool.
+ * Received transfers are appended to the <zone>.xfrd file as raw DNS
+ * messages, each preceded by a record header: magic (4 octets), record
+ * type (2 octets) and message length (2 octets), in network byte order.
+ * A transfer is a BEGIN record, zero or more PACKET records and an END
+ * record that carries no message. If the DNS input adapter is configured
+ * with <TextSpool/>, the answer sections are written as text instead.
+ *
+ */
+#define XFRD_SPOOL_MAGIC 0x4f445358 /* "ODSX" */
+#define XFRD_SPOOL_HEADER_SIZE 8
+#define XFRD_SPOOL_BEGIN 1
+#define XFRD_SPOOL_PACKET 2
+#define XFRD_SPOOL_END 3
+
+#define XFRD_DIFF_MAX_RRS 100000 /* max number of ixfr rrs kept in memory */
+
+/**
+ * Received IXFR, kept in memory.
+ * Committed IXFRs are queued in order of serial, so that the DNS input
+ * adapter can apply them without reading back the spool. The spool is
+ * still written, for durability.
+ *
+ */
+typedef struct xfrd_diff_struct xfrd_diff_type;
+struct xfrd_diff_struct {
+    xfrd_diff_type* next;
+    uint32_t serial;
+    ldns_rr_list* rrs; /* answer section, in transfer order */
+};
+
 /**
  * Packet status.
  *
@@ -114,6 +148,19 @@ struct xfrd_struct
     time_t serial_disk_acquired;
     soa_type soa;
 
+    /* in-memory copy of the spool, mutexed by rw_lock */
+    xfrd_diff_type* diff_first;
+    xfrd_diff_type* diff_last;
+    size_t diff_rr_count;
+    unsigned diff_valid : 1; /* queue holds every transfer on disk */
+    struct timeval xfr_received; /* first transfer not read by adapter */
+
+    /* transfer to signed ixfr latency */
+    struct timeval latency_start;
+    size_t latency_count;
+    unsigned long latency_last; /* milliseconds */
+    unsigned long latency_max; /* milliseconds */
+
     /* timeout and event handling */
     struct timespec timeout;
     netio_handler_type handler;
@@ -125,6 +172,9 @@ struct xfrd_struct
     uint32_t msg_new_serial;
     size_t msg_rr_count;
     uint8_t msg_is_ixfr;
+    uint8_t msg_is_text;
+    ldns_rr_list* msg_rrs; /* rrs of the ixfr in progress */
+    struct timeval msg_received;
     tsig_rr_type* tsig_rr;
 
     xfrd_type* tcp_waiting_next;
@@ -174,6 +224,32 @@ void xfrd_set_timer_refresh(xfrd_type* xfrd);
 socklen_t xfrd_acl_sockaddr_to(acl_type* acl,
     struct sockaddr_storage* to);
 
+/**
+ * Take the in-memory copy of the spool. The caller must hold the rw_lock
+ * and is about to consume the spool on disk.
+ * \param[in] xfrd zone transfer structure
+ * \return xfrd_diff_type* received IXFRs, in order of serial, or NULL if
+ *         the spool must be read from disk
+ *
+ */
+xfrd_diff_type* xfrd_take_diffs(xfrd_type* xfrd);
+
+/**
+ * Report that the zone has been signed and is available for transfer,
+ * and measure the time since the zone transfer was received.
+ * \param[in] xfrd zone transfer structure
+ * \param[in] serial outbound serial
+ *
+ */
+void xfrd_report_latency(xfrd_type* xfrd, uint32_t serial);
+
+/**
+ * Clean up received IXFRs.
+ * \param[in] diff received IXFRs
+ *
+ */
+void xfrd_diff_cleanup(xfrd_diff_type* diff);
+
 /**
  * Cleanup zone transfer structure.
  * \param[in] xfrd zone transfer structure.
@@ -0,0 +1,233 @@
+#!/usr/bin/env bash
+#
+# $Id$
+#
+# Enforcer benchmark.
+#
+# Sets up a KASP database with a large number of synthetic zones that
+# share their keys, and times ods-enforcerd in single run mode for each
+# of a list of transaction batch sizes (<TransactionBatchSize> in
+# conf.xml). Every batch size starts from the same freshly set up
+# database; the first pass allocates keys to all zones and the second
+# pass is a steady state run.
+#
+# Run it as the user that owns the installation, with no other enforcer
+# running, since the pid file is at its installed location.
+#
+
+usage ()
+{
+	cat >&2 <<EOF
+usage: $0 [options]
+  -p prefix    installation prefix of OpenDNSSEC (default: \$INSTALL_ROOT
+               or /usr/local)
+  -m module    SoftHSM PKCS#11 module (default: search the prefix)
+  -n zones     number of zones (default: 50000)
+  -b sizes     transaction batch sizes to compare, 0 meaning one
+               transaction per run (default: "1 100 0")
+  -k dir       keep the working directory here instead of a
+               temporary one
+EOF
+	exit 1
+}
+
+prefix="${INSTALL_ROOT:-/usr/local}"
+module=""
+zones=50000
+sizes="1 100 0"
+keep=""
+
+while getopts "p:m:n:b:k:h" opt; do
+	case "$opt" in
+		p ) prefix="$OPTARG" ;;
+		m ) module="$OPTARG" ;;
+		n ) zones="$OPTARG" ;;
+		b ) sizes="$OPTARG" ;;
+		k ) keep="$OPTARG" ;;
+		* ) usage ;;
+	esac
+done
+
+enforcerd="$prefix/sbin/ods-enforcerd"
+ksmutil="$prefix/bin/ods-ksmutil"
+softhsm=`command -v softhsm 2>/dev/null`
+if [ -z "$softhsm" -a -x "$prefix/bin/softhsm" ]; then
+	softhsm="$prefix/bin/softhsm"
+fi
+if [ -z "$module" ]; then
+	for path in lib64/softhsm lib/softhsm lib64 lib; do
+		if [ -f "$prefix/$path/libsofthsm.so" ]; then
+			module="$prefix/$path/libsofthsm.so"
+			break
+		fi
+	done
+fi
+for file in "$enforcerd" "$ksmutil" "$softhsm" "$module"; do
+	if [ ! -e "$file" ]; then
+		echo "$0: not found: ${file:-softhsm}" >&2
+		exit 1
+	fi
+done
+
+if [ -n "$keep" ]; then
+	work="$keep"
+	mkdir -p "$work" || exit 1
+else
+	work=`mktemp -d "${TMPDIR:-/tmp}/bench-enforcer.XXXXXX"` || exit 1
+	trap 'rm -rf "$work"' EXIT
+fi
+
+gen_conf ()
+{
+	cat <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<Configuration>
+	<RepositoryList>
+		<Repository name="SoftHSM">
+			<Module>$module</Module>
+			<TokenLabel>bench</TokenLabel>
+			<PIN>1234</PIN>
+		</Repository>
+	</RepositoryList>
+	<Common>
+		<Logging>
+			<Verbosity>3</Verbosity>
+		</Logging>
+		<PolicyFile>$work/kasp.xml</PolicyFile>
+		<ZoneListFile>$work/zonelist.xml</ZoneListFile>
+	</Common>
+	<Enforcer>
+		<Datastore><SQLite>$work/kasp.db</SQLite></Datastore>
+		<Interval>PT3600S</Interval>
+		<TransactionBatchSize>$1</TransactionBatchSize>
+	</Enforcer>
+	<Signer>
+		<WorkingDirectory>$work/tmp</WorkingDirectory>
+	</Signer>
+</Configuration>
+EOF
+}
+
+gen_kasp ()
+{
+	cat <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<KASP>
+	<Policy name="default">
+		<Description>benchmark policy</Description>
+		<Signatures>
+			<Resign>PT2H</Resign>
+			<Refresh>P3D</Refresh>
+			<Validity>
+				<Default>P14D</Default>
+				<Denial>P14D</Denial>
+			</Validity>
+			<Jitter>PT12H</Jitter>
+			<InceptionOffset>PT3600S</InceptionOffset>
+		</Signatures>
+		<Denial>
+			<NSEC/>
+		</Denial>
+		<Keys>
+			<TTL>PT3600S</TTL>
+			<RetireSafety>PT3600S</RetireSafety>
+			<PublishSafety>PT3600S</PublishSafety>
+			<ShareKeys/>
+			<KSK>
+				<Algorithm length="2048">8</Algorithm>
+				<Lifetime>P1Y</Lifetime>
+				<Repository>SoftHSM</Repository>
+			</KSK>
+			<ZSK>
+				<Algorithm length="1024">8</Algorithm>
+				<Lifetime>P90D</Lifetime>
+				<Repository>SoftHSM</Repository>
+			</ZSK>
+		</Keys>
+		<Zone>
+			<PropagationDelay>PT9999S</PropagationDelay>
+			<SOA>
+				<TTL>PT3600S</TTL>
+				<Minimum>PT3600S</Minimum>
+				<Serial>unixtime</Serial>
+			</SOA>
+		</Zone>
+		<Parent>
+			<PropagationDelay>PT9999S</PropagationDelay>
+			<DS>
+				<TTL>PT3600S</TTL>
+			</DS>
+			<SOA>
+				<TTL>PT172800S</TTL>
+				<Minimum>PT10800S</Minimum>
+			</SOA>
+		</Parent>
+	</Policy>
+</KASP>
+EOF
+}
+
+gen_zonelist ()
+{
+	awk -v zones="$zones" -v work="$work" 'BEGIN {
+		printf "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<ZoneList>\n";
+		for (i = 0; i < zones; i++) {
+			zone = sprintf("z%d.bench.example", i);
+			printf "\t<Zone name=\"%s\">\n", zone;
+			printf "\t\t<Policy>default</Policy>\n";
+			printf "\t\t<SignerConfiguration>%s/signconf/%s.xml</SignerConfiguration>\n", work, zone;
+			printf "\t\t<Adapters>\n";
+			printf "\t\t\t<Input><Adapter type=\"File\">%s/unsigned/%s</Adapter></Input>\n", work, zone;
+			printf "\t\t\t<Output><Adapter type=\"File\">%s/signed/%s</Adapter></Output>\n", work, zone;
+			printf "\t\t</Adapters>\n\t</Zone>\n";
+		}
+		printf "</ZoneList>\n";
+	}'
+}
+
+# SoftHSM token, policy, zones and the database they go in
+export SOFTHSM_CONF="$work/softhsm.conf"
+echo "0:$work/softhsm-slot0.db" > "$SOFTHSM_CONF" &&
+"$softhsm" --init-token --slot 0 --label bench --pin 1234 \
+	--so-pin 1234 > "$work/softhsm.log" 2>&1 &&
+mkdir -p "$work/tmp" "$work/signconf" &&
+gen_conf 0 > "$work/conf.xml" &&
+gen_kasp > "$work/kasp.xml" &&
+gen_zonelist > "$work/zonelist.xml" || exit 1
+echo "Setting up $zones zones..."
+if ! echo y | "$ksmutil" -c "$work/conf.xml" setup > "$work/setup.log" 2>&1; then
+	echo "$0: ods-ksmutil setup failed, see $work/setup.log" >&2
+	exit 1
+fi
+cp "$work/kasp.db" "$work/kasp.db.setup" || exit 1
+
+echo "Enforcer: $zones zones with shared keys"
+printf "%-8s %12s %12s\n" batch "first(ms)" "second(ms)"
+
+failed=0
+for size in $sizes; do
+	gen_conf "$size" > "$work/conf.xml" &&
+	cp "$work/kasp.db.setup" "$work/kasp.db" &&
+	rm -f "$work"/signconf/* || exit 1
+	ms=""
+	for pass in 1 2; do
+		log="$work/enforcer-$size-$pass.log"
+		start=`date +%s%N`
+		"$enforcerd" -1 -d -c "$work/conf.xml" > "$log" 2>&1
+		status=$?
+		end=`date +%s%N`
+		if [ "$status" -ne 0 ]; then
+			echo "$0: batch size $size pass $pass failed, see $log" >&2
+			failed=1
+			break 2
+		fi
+		ms="$ms $(( (end - start) / 1000000 ))"
+	done
+	printf "%-8s %12s %12s\n" "$size" $ms
+done
+
+echo "Batch size 0 commits once per run."
+if [ -n "$keep" ]; then
+	echo "Working directory and enforcer logs kept in $work"
+fi
+exit $failed
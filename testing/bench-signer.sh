@@ -0,0 +1,321 @@
+#!/usr/bin/env bash
+#
+# $Id$
+#
+# Signer benchmark.
+#
+# Generates a synthetic zone, signs it with ods-signerd in single run mode
+# against SoftHSM and reports the time spent in each phase, the signing
+# rate and the peak memory use of the signer. Every run starts from an
+# empty working directory, so each run is a full sign.
+#
+# The signer logs a [metrics] summary at shutdown; this script only
+# collects it. Run it as the user that owns the installation, with no
+# other signer running, since the pid file and the command socket are
+# at their installed location.
+#
+
+usage ()
+{
+	cat >&2 <<EOF
+usage: $0 [options]
+  -p prefix    installation prefix of OpenDNSSEC (default: \$INSTALL_ROOT
+               or /usr/local)
+  -m module    SoftHSM PKCS#11 module (default: search the prefix)
+  -n names     number of names in the zone (default: 100000)
+  -s shape     plain, delegation, optout or rrset (default: plain)
+  -R size      records per RRset for the rrset shape (default: 100)
+  -3           use NSEC3 instead of NSEC (implied by optout)
+  -a algorithm 8 (RSASHA256) or 13 (ECDSAP256SHA256) (default: 8)
+  -r runs      number of runs (default: 3)
+  -w workers   signer worker threads (default: 4)
+  -d drudgers  signer signing threads (default: number of cpus)
+  -k dir       keep the working directory here instead of a
+               temporary one
+EOF
+	exit 1
+}
+
+prefix="${INSTALL_ROOT:-/usr/local}"
+module=""
+names=100000
+shape=plain
+rrset_size=100
+nsec3=0
+algorithm=8
+runs=3
+workers=4
+drudgers=`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 4`
+keep=""
+
+while getopts "p:m:n:s:R:3a:r:w:d:k:h" opt; do
+	case "$opt" in
+		p ) prefix="$OPTARG" ;;
+		m ) module="$OPTARG" ;;
+		n ) names="$OPTARG" ;;
+		s ) shape="$OPTARG" ;;
+		R ) rrset_size="$OPTARG" ;;
+		3 ) nsec3=1 ;;
+		a ) algorithm="$OPTARG" ;;
+		r ) runs="$OPTARG" ;;
+		w ) workers="$OPTARG" ;;
+		d ) drudgers="$OPTARG" ;;
+		k ) keep="$OPTARG" ;;
+		* ) usage ;;
+	esac
+done
+
+case "$shape" in
+	plain | delegation | rrset ) ;;
+	optout ) nsec3=1 ;;
+	* ) usage ;;
+esac
+case "$algorithm" in
+	8 ) keytype="rsa 2048" ;;
+	13 ) keytype="ecdsa 256" ;;
+	* ) usage ;;
+esac
+
+signerd="$prefix/sbin/ods-signerd"
+hsmutil="$prefix/bin/ods-hsmutil"
+softhsm=`command -v softhsm 2>/dev/null`
+if [ -z "$softhsm" -a -x "$prefix/bin/softhsm" ]; then
+	softhsm="$prefix/bin/softhsm"
+fi
+if [ -z "$module" ]; then
+	for path in lib64/softhsm lib/softhsm lib64 lib; do
+		if [ -f "$prefix/$path/libsofthsm.so" ]; then
+			module="$prefix/$path/libsofthsm.so"
+			break
+		fi
+	done
+fi
+for file in "$signerd" "$hsmutil" "$softhsm" "$module"; do
+	if [ ! -e "$file" ]; then
+		echo "$0: not found: ${file:-softhsm}" >&2
+		exit 1
+	fi
+done
+
+if [ -n "$keep" ]; then
+	work="$keep"
+	mkdir -p "$work" || exit 1
+else
+	work=`mktemp -d "${TMPDIR:-/tmp}/bench-signer.XXXXXX"` || exit 1
+	trap 'rm -rf "$work"' EXIT
+fi
+zone="bench.example"
+
+# Generate the zone. Names are spread over the alphabet so that the
+# NSEC(3) chain and the domain tree see realistic ordering.
+gen_zone ()
+{
+	awk -v names="$names" -v shape="$shape" -v size="$rrset_size" \
+	    -v zone="$zone" 'BEGIN {
+		printf "$ORIGIN %s.\n$TTL 3600\n", zone;
+		printf "@ IN SOA ns1 hostmaster 1 7200 3600 1209600 3600\n";
+		printf "@ IN NS ns1\n@ IN NS ns2\n";
+		printf "ns1 IN A 192.0.2.1\nns2 IN A 192.0.2.2\n";
+		for (i = 0; i < names; i++) {
+			name = sprintf("n%x-%d", (i * 2654435761) % 65536, i);
+			ip = sprintf("%d.%d.%d", int(i / 65536) % 256,
+			    int(i / 256) % 256, i % 256);
+			if (shape == "plain") {
+				printf "%s IN A 10.%s\n", name, ip;
+				printf "%s IN AAAA 2001:db8::%x\n", name, i;
+				printf "%s IN TXT \"benchmark record %d\"\n", name, i;
+			} else if (shape == "rrset") {
+				for (j = 0; j < size; j++) {
+					printf "%s IN A 10.%d.%d.%d\n", name,
+					    i % 256, int(j / 256) % 256, j % 256;
+				}
+			} else {
+				printf "%s IN NS ns1.%s\n", name, name;
+				printf "%s IN NS ns2.%s.\n", name, zone;
+				if (i % 2 == 0) {
+					printf "ns1.%s IN A 10.%s\n", name, ip;
+				}
+				if (i % 10 == 0) {
+					printf "%s IN DS %d 8 2 %064x\n", name,
+					    i % 65536, i;
+				}
+			}
+		}
+	}'
+}
+
+gen_conf ()
+{
+	cat <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<Configuration>
+	<RepositoryList>
+		<Repository name="SoftHSM">
+			<Module>$module</Module>
+			<TokenLabel>bench</TokenLabel>
+			<PIN>1234</PIN>
+			<SkipPublicKey/>
+		</Repository>
+	</RepositoryList>
+	<Common>
+		<Logging>
+			<Verbosity>3</Verbosity>
+		</Logging>
+		<PolicyFile>$work/kasp.xml</PolicyFile>
+		<ZoneListFile>$work/zonelist.xml</ZoneListFile>
+	</Common>
+	<Enforcer>
+		<Datastore><SQLite>$work/kasp.db</SQLite></Datastore>
+		<Interval>PT3600S</Interval>
+	</Enforcer>
+	<Signer>
+		<WorkingDirectory>$work/tmp</WorkingDirectory>
+		<WorkerThreads>$workers</WorkerThreads>
+		<SignerThreads>$drudgers</SignerThreads>
+	</Signer>
+</Configuration>
+EOF
+}
+
+gen_zonelist ()
+{
+	cat <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<ZoneList>
+	<Zone name="$zone">
+		<Policy>default</Policy>
+		<SignerConfiguration>$work/signconf.xml</SignerConfiguration>
+		<Adapters>
+			<Input>
+				<Adapter type="File">$work/unsigned</Adapter>
+			</Input>
+			<Output>
+				<Adapter type="File">$work/signed</Adapter>
+			</Output>
+		</Adapters>
+	</Zone>
+</ZoneList>
+EOF
+}
+
+gen_signconf ()
+{
+	local denial="<NSEC/>"
+	local optout=""
+	if [ "$nsec3" -eq 1 ]; then
+		if [ "$shape" = "optout" ]; then
+			optout="<OptOut/>"
+		fi
+		denial="<NSEC3>$optout<Hash><Algorithm>1</Algorithm><Iterations>5</Iterations><Salt>aabbccdd</Salt></Hash></NSEC3>"
+	fi
+	cat <<EOF
+<?xml version="1.0" encoding="UTF-8"?>
+<SignerConfiguration>
+	<Zone name="$zone">
+		<Signatures>
+			<Resign>PT2H</Resign>
+			<Refresh>P3D</Refresh>
+			<Validity>
+				<Default>P14D</Default>
+				<Denial>P14D</Denial>
+			</Validity>
+			<Jitter>PT12H</Jitter>
+			<InceptionOffset>PT300S</InceptionOffset>
+		</Signatures>
+		<Denial>$denial</Denial>
+		<Keys>
+			<TTL>PT3600S</TTL>
+			<Key>
+				<Flags>257</Flags>
+				<Algorithm>$algorithm</Algorithm>
+				<Locator>$ksk</Locator>
+				<KSK/>
+				<Publish/>
+			</Key>
+			<Key>
+				<Flags>256</Flags>
+				<Algorithm>$algorithm</Algorithm>
+				<Locator>$zsk</Locator>
+				<ZSK/>
+				<Publish/>
+			</Key>
+		</Keys>
+		<SOA>
+			<TTL>PT3600S</TTL>
+			<Minimum>PT3600S</Minimum>
+			<Serial>counter</Serial>
+		</SOA>
+	</Zone>
+</SignerConfiguration>
+EOF
+}
+
+# Print the value of a key=value field of the last [metrics] line that
+# matches a pattern.
+metric ()
+{
+	grep "\[metrics\] $1" "$2" | tail -n 1 |
+		sed -n "s/.* $3=\([0-9]*\).*/\1/p"
+}
+
+# SoftHSM token and keys
+export SOFTHSM_CONF="$work/softhsm.conf"
+echo "0:$work/softhsm-slot0.db" > "$SOFTHSM_CONF" &&
+"$softhsm" --init-token --slot 0 --label bench --pin 1234 \
+	--so-pin 1234 > "$work/softhsm.log" 2>&1 &&
+gen_conf > "$work/conf.xml" &&
+gen_zonelist > "$work/zonelist.xml" || exit 1
+ksk=`"$hsmutil" -c "$work/conf.xml" generate SoftHSM $keytype 2>&1 |
+	sed -n 's/^Key generation successful: //p'`
+zsk=`"$hsmutil" -c "$work/conf.xml" generate SoftHSM $keytype 2>&1 |
+	sed -n 's/^Key generation successful: //p'`
+if [ -z "$ksk" -o -z "$zsk" ]; then
+	echo "$0: unable to generate keys in SoftHSM" >&2
+	exit 1
+fi
+gen_signconf > "$work/signconf.xml" &&
+gen_zone > "$work/unsigned" || exit 1
+
+rrs=`grep -vc '^\\$' "$work/unsigned"`
+echo "Zone $zone: shape $shape, $names names, $rrs records," \
+	"`[ "$nsec3" -eq 1 ] && echo NSEC3 || echo NSEC`, algorithm $algorithm"
+echo "Signer: $workers workers, $drudgers drudgers, $runs runs"
+printf "%-4s %9s %9s %9s %9s %9s %9s %9s %10s %10s\n" run read nsecify \
+	sign write backup total sigs sigs/s "rss(kB)"
+
+run=1
+failed=0
+while [ "$run" -le "$runs" ]; do
+	rm -rf "$work/tmp" "$work/signed" &&
+	mkdir -p "$work/tmp" || exit 1
+	log="$work/signer-$run.log"
+	start=`date +%s%N`
+	"$signerd" -1 -d -c "$work/conf.xml" > "$log" 2>&1
+	end=`date +%s%N`
+	if ! grep -q "\[STATS\] $zone" "$log" || [ ! -s "$work/signed" ]; then
+		echo "$0: run $run failed, see $log" >&2
+		failed=1
+		break
+	fi
+	total=$(( (end - start) / 1000000 ))
+	for phase in read nsecify sign write backup; do
+		usec=`metric "phase $phase" "$log" total`
+		eval "ms_$phase=$(( ${usec:-0} / 1000 ))"
+	done
+	sigs=`metric "hsm sign" "$log" count`
+	rss=`metric "peak" "$log" rss`
+	rate=0
+	if [ "$ms_sign" -gt 0 ]; then
+		rate=$(( ${sigs:-0} * 1000 / ms_sign ))
+	fi
+	printf "%-4s %7sms %7sms %7sms %7sms %7sms %7sms %9s %10s %10s\n" \
+		"$run" "$ms_read" "$ms_nsecify" "$ms_sign" "$ms_write" \
+		"$ms_backup" "$total" "${sigs:-0}" "$rate" "${rss:-?}"
+	run=$(( run + 1 ))
+done
+
+echo "Times in ms; read includes nsecify for zones read from file."
+if [ -n "$keep" ]; then
+	echo "Working directory and signer logs kept in $work"
+fi
+exit $failed
@@ -0,0 +1,80 @@
+#!/usr/bin/env bash
+
+#TEST: Zone transfers are not stalled while another zone is being signed
+#TEST: Start OpenDNSSEC with a small zone that is fed by the Input DNS
+#TEST: Adapter and a large zone that takes a while to sign. While the
+#TEST: large zone is being signed, the primary gets a new serial for the
+#TEST: small zone. The transfer must be committed without waiting for
+#TEST: the signing to finish.
+
+## It requires setting up a primary name server (ldns-testns).
+
+LARGE_ZONE_NAMES=200000
+
+## The configuration is the one of the output test, the adapter and the
+## first serial of the small zone are the ones of the refresh test
+output=../../test-cases.d/signer.adapters.output_basic &&
+refresh=../../test-cases.d/signer.adapters.input_with_refresh &&
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml "$output/conf-mysql.xml"
+else
+	ods_setup_conf conf.xml "$output/conf.xml"
+fi &&
+ods_setup_conf addns.xml "$refresh/addns.xml" &&
+
+ods_reset_env &&
+
+## Generate the large zone
+awk -v n="$LARGE_ZONE_NAMES" 'BEGIN {
+	print "$TTL 3600";
+	print "large. IN SOA ns1.large. postmaster.large. 1 3600 600 86400 3600";
+	print "large. IN NS ns1.large.";
+	print "ns1.large. IN A 192.0.2.1";
+	for (i = 0; i < n; i++) {
+		printf("host%d.large. IN A 192.0.2.%d\n", i, i % 254 + 1);
+	}
+}' > "$INSTALL_ROOT/var/opendnssec/unsigned/large" &&
+
+## Start master name server
+ods_ldns_testns 15353 "$refresh/ods.datafile" &&
+
+## Start OpenDNSSEC
+log_this_timeout ods-control-start 60 ods-control start &&
+syslog_waitfor 60 'ods-enforcerd: .*Sleeping for' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer started' &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods' &&
+syslog_waitfor 60 'ods-signerd: .*\[xfrd\] zone ods committed serial 1000 in' &&
+
+## Wait until the signing of the large zone starts, the worker logs
+## 'sign zone large' when it picks up the task ('... ok' when it is done)
+syslog_waitfor 300 'ods-signerd: .*\[worker\[[0-9]*\]\] sign zone large$' &&
+! syslog_grep 'ods-signerd: .*\[STATS\] large' &&
+
+## Publish a new serial on the primary, the next refresh transfers it
+ods_ldns_testns_kill &&
+ods_ldns_testns 15353 ods-1001.datafile &&
+syslog_waitfor 60 'ods-signerd: .*\[xfrd\] zone ods committed serial 1001 in' &&
+
+## The large zone must still be signing, the commit must not have waited
+! syslog_grep 'ods-signerd: .*\[STATS\] large' &&
+syslog_grep 'ods-signerd: .*\[xfrd\] zone ods committed serial 1001 in [0-9]\{1,3\} ms' &&
+
+## Both zones get signed
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods' &&
+syslog_waitfor 900 'ods-signerd: .*\[STATS\] large' &&
+test -f "$INSTALL_ROOT/var/opendnssec/signed/ods" &&
+test -f "$INSTALL_ROOT/var/opendnssec/signed/large" &&
+
+## Stop
+log_this_timeout ods-control-stop 60 ods-control stop &&
+syslog_waitfor 60 'ods-enforcerd: .*all done' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer shutdown' &&
+ods_ldns_testns_kill &&
+rm -f "$INSTALL_ROOT/var/opendnssec/unsigned/large" &&
+return 0
+
+## Test failed. Kill stuff
+ods_ldns_testns_kill
+ods_kill
+rm -f "$INSTALL_ROOT/var/opendnssec/unsigned/large"
+return 1
@@ -0,0 +1,62 @@
+#!/usr/bin/env bash
+
+#TEST: Zones are signed by earliest signature expiration when the signer
+#TEST: falls behind. Sign three zones with two week signatures and one zone
+#TEST: with one day signatures, all resigned every minute, with one worker.
+#TEST: Then stop the signer for longer than the overload lateness so all
+#TEST: resigns are late. When it continues, it must go into overload mode
+#TEST: and resign the zone whose signatures expire first before the others,
+#TEST: although that zone was scheduled last.
+
+## One worker thread, the configuration of the threads_of_1 test. The
+## zones are the ones of the multi-threaded enforcer test.
+threads=../signer.conf.threads_of_1 &&
+zones=../../test-cases.d/enforcer.conf.multithread_basic &&
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml "$threads/conf-mysql.xml"
+else
+	ods_setup_conf conf.xml "$threads/conf.xml"
+fi &&
+ods_setup_zone "$zones/unsigned/ods" &&
+ods_setup_zone "$zones/unsigned/ods2" &&
+ods_setup_zone "$zones/unsigned/ods3" &&
+ods_setup_zone "$zones/unsigned/ods4" &&
+
+ods_reset_env &&
+
+## Start OpenDNSSEC
+log_this_timeout ods-control-start 60 ods-control start &&
+syslog_waitfor 60 'ods-enforcerd: .*Sleeping for' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer started' &&
+
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods ' &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods2 ' &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods3 ' &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods4 ' &&
+
+## Sign the short lived zone once more, so its resign is scheduled last
+ods4_signed=`$GREP -c -- 'ods-signerd: .*\[STATS\] ods4 ' "_syslog.$BUILD_TAG"` &&
+log_this ods-signer-sign-ods4 ods-signer sign ods4 &&
+syslog_waitfor_count 60 $(( ods4_signed + 1 )) 'ods-signerd: .*\[STATS\] ods4 ' &&
+! syslog_grep 'ods-signerd: .*\[scheduler\] overload' &&
+
+## Let the signer fall behind
+pkill -STOP -u `id -u` ods-signerd &&
+sleep 420 &&
+pkill -CONT -u `id -u` ods-signerd &&
+
+## The resigns are late, ods4 goes first
+syslog_waitfor 60 'ods-signerd: .*\[scheduler\] overload: tasks are [0-9]* seconds late' &&
+syslog_waitfor 120 'ods-signerd: .*\[scheduler\] overload is over' &&
+sed -n '/\[scheduler\] overload: tasks are/,$p' "_syslog.$BUILD_TAG" |
+	$GREP -- '\[STATS\] ' | head -n 1 | $GREP -q -- '\[STATS\] ods4 ' &&
+
+## Stop
+log_this_timeout ods-control-stop 60 ods-control stop &&
+syslog_waitfor 60 'ods-enforcerd: .*all done' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer shutdown' &&
+return 0
+
+pkill -CONT -u `id -u` ods-signerd
+ods_kill
+return 1
@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+
+#TEST: Small zones are signed while a large zone is being signed
+#TEST: Start OpenDNSSEC with one worker, a large zone and three small
+#TEST: zones. While the large zone is being signed, have the small zones
+#TEST: signed again. The worker must sign the large zone in chunks and
+#TEST: sign the small zones in between, before the large zone is done.
+
+LARGE_ZONE_NAMES=200000
+
+## One worker thread, the configuration of the threads_of_1 test. The
+## small zones are the ones of the multi-threaded enforcer test.
+threads=../signer.conf.threads_of_1 &&
+small=../../test-cases.d/enforcer.conf.multithread_basic &&
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml "$threads/conf-mysql.xml"
+else
+	ods_setup_conf conf.xml "$threads/conf.xml"
+fi &&
+ods_setup_zone "$small/unsigned/ods" &&
+ods_setup_zone "$small/unsigned/ods2" &&
+ods_setup_zone "$small/unsigned/ods3" &&
+
+ods_reset_env &&
+
+## Generate the large zone
+awk -v n="$LARGE_ZONE_NAMES" 'BEGIN {
+	print "$TTL 3600";
+	print "large. IN SOA ns1.large. postmaster.large. 1 3600 600 86400 3600";
+	print "large. IN NS ns1.large.";
+	print "ns1.large. IN A 192.0.2.1";
+	for (i = 0; i < n; i++) {
+		printf("host%d.large. IN A 192.0.2.%d\n", i, i % 254 + 1);
+	}
+}' > "$INSTALL_ROOT/var/opendnssec/unsigned/large" &&
+
+## Start OpenDNSSEC
+log_this_timeout ods-control-start 60 ods-control start &&
+syslog_waitfor 60 'ods-enforcerd: .*Sleeping for' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer started' &&
+syslog_waitfor 10 'ods-signerd: .*\[worker\[1\]\] report for duty' &&
+
+## Wait until the signing of the large zone starts
+syslog_waitfor 300 'ods-signerd: .*\[worker\[1\]\] sign zone large$' &&
+! syslog_grep 'ods-signerd: .*\[STATS\] large ' &&
+
+## Have the small zones signed again, they must not wait for the large one
+small_signed=`$GREP -c -- 'ods-signerd: .*\[STATS\] ods[23]* ' "_syslog.$BUILD_TAG"` &&
+log_this ods-signer-sign-ods ods-signer sign ods &&
+log_this ods-signer-sign-ods2 ods-signer sign ods2 &&
+log_this ods-signer-sign-ods3 ods-signer sign ods3 &&
+syslog_waitfor_count 300 $(( small_signed + 3 )) 'ods-signerd: .*\[STATS\] ods[23]* ' &&
+! syslog_grep 'ods-signerd: .*\[STATS\] large ' &&
+syslog_grep 'ods-signerd: .*\[worker\[1\]\] yield signing zone large, [0-9]* RRsets signed so far' &&
+
+## The large zone is signed in the end
+syslog_waitfor 1800 'ods-signerd: .*\[worker\[1\]\] resume signing zone large' &&
+syslog_waitfor 1800 'ods-signerd: .*\[STATS\] large ' &&
+test -f "$INSTALL_ROOT/var/opendnssec/signed/large" &&
+test -f "$INSTALL_ROOT/var/opendnssec/signed/ods" &&
+test -f "$INSTALL_ROOT/var/opendnssec/signed/ods2" &&
+test -f "$INSTALL_ROOT/var/opendnssec/signed/ods3" &&
+
+## Stop
+log_this_timeout ods-control-stop 60 ods-control stop &&
+syslog_waitfor 60 'ods-enforcerd: .*all done' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer shutdown' &&
+return 0
+
+ods_kill
+return 1
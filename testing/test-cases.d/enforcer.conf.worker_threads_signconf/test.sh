@@ -0,0 +1,58 @@
+#!/usr/bin/env bash
+#
+#TEST: Zone workers write the same signconfs as one thread
+#TEST: Run the enforcer once with four zone workers and once with one
+#TEST: thread, each on a fresh database, and compare the signconfs. The
+#TEST: key locators differ between the runs, so they are replaced by the
+#TEST: order in which they first appear. Needs MySQL, with SQLite the
+#TEST: enforcer always uses one thread.
+
+ENFORCER_WAIT=90	# Seconds we wait for enforcer to run
+
+if [ -z "$HAVE_MYSQL" ]; then
+	return 0
+fi &&
+
+## The zones, policies and four zone workers of the multi-threaded test
+zones=../enforcer.conf.multithread_basic &&
+signconf="$INSTALL_ROOT/var/opendnssec/signconf" &&
+tmp="$INSTALL_ROOT/var/opendnssec/tmp" &&
+ods_setup_conf kasp.xml "$zones/kasp.xml" &&
+ods_setup_conf zonelist.xml "$zones/zonelist.xml" &&
+
+## Four zone workers
+ods_setup_conf conf.xml "$zones/conf-mysql.xml" &&
+ods_reset_env &&
+log_this_timeout ods-control-enforcer-start-workers $ENFORCER_WAIT ods-enforcerd -1 &&
+syslog_waitfor $ENFORCER_WAIT 'ods-enforcerd: .*all done' &&
+syslog_grep 'ods-enforcerd: .*Started 4 zone workers\.' &&
+cat "$signconf/ods.xml" "$signconf/ods2.xml" "$signconf/ods3.xml" "$signconf/ods4.xml" > "$tmp/signconf-workers.xml" &&
+rm -f "$signconf"/*.xml "$signconf"/*.xml.OLD &&
+
+## One thread
+sed 's,<WorkerThreads>4</WorkerThreads>,<WorkerThreads>1</WorkerThreads>,' "$zones/conf-mysql.xml" > "$tmp/conf-one-thread.xml" &&
+ods_setup_conf conf.xml "$tmp/conf-one-thread.xml" &&
+ods_reset_env &&
+log_this_timeout ods-control-enforcer-start-one-thread $ENFORCER_WAIT ods-enforcerd -1 &&
+syslog_waitfor_count $ENFORCER_WAIT 2 'ods-enforcerd: .*all done' &&
+syslog_grep_count 1 'ods-enforcerd: .*Started [0-9]* zone workers' &&
+cat "$signconf/ods.xml" "$signconf/ods2.xml" "$signconf/ods3.xml" "$signconf/ods4.xml" > "$tmp/signconf-one-thread.xml" &&
+
+## Same signconfs, up to the key locators
+for run in workers one-thread; do
+	awk '/<Locator>/ {
+		locator = $0;
+		sub(/.*<Locator>/, "", locator);
+		sub(/<\/Locator>.*/, "", locator);
+		if (!(locator in label)) {
+			label[locator] = "key" ++keys;
+		}
+		sub(/<Locator>.*<\/Locator>/, "<Locator>" label[locator] "</Locator>");
+	}
+	{ print }' "$tmp/signconf-$run.xml" > "$tmp/signconf-$run.norm" || return 1
+done &&
+diff "$tmp/signconf-workers.norm" "$tmp/signconf-one-thread.norm" &&
+return 0
+
+ods_kill
+return 1
@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+
+#TEST: Test that received IXFRs are applied from memory
+#TEST: Transfer and sign a zone, then have it updated by IXFR and see that
+#TEST: the DNS Input Adapter takes the IXFR from memory. Then have the
+#TEST: primary answer with the whole zone, which invalidates the IXFRs kept
+#TEST: in memory, and see that the adapter falls back to the spool file.
+
+## It requires setting up a primary name server (ldns-testns).
+
+## The configuration, the adapter, the zone list and the first two
+## serials of the zone are the ones of the basic input test
+basic=../signer.adapters.input_basic &&
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml "$basic/conf-mysql.xml"
+else
+	ods_setup_conf conf.xml "$basic/conf.xml"
+fi &&
+ods_setup_conf addns.xml "$basic/addns.xml" &&
+ods_setup_conf zonelist.xml "$basic/zonelist.xml" &&
+
+ods_reset_env &&
+
+## Start master name server
+ods_ldns_testns 15353 "$basic/ods.datafile" &&
+
+## Start OpenDNSSEC
+log_this_timeout ods-control-start 60 ods-control start &&
+syslog_waitfor 60 'ods-enforcerd: .*Sleeping for' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer started' &&
+
+## Wait for signed zone file
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods ' &&
+test -f "$INSTALL_ROOT/var/opendnssec/signed/ods" &&
+
+ods-signer verbosity 5 &&
+
+## Fake notify, the IXFR to 1001 is read from memory
+ldns-notify -p 15354 -s 1001 -r 2 -z ods 127.0.0.1 &&
+syslog_waitfor 30 'ods-signerd: .*\[xfrd\] zone ods request ixfr to 127\.0\.0\.1' &&
+syslog_waitfor 30 'ods-signerd: .*\[adapter\] read xfr zone ods from memory' &&
+! syslog_grep 'ods-signerd: .*\[adapter\] read xfr zone ods from spool' &&
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods ' &&
+! $GREP -q -- "^label34\.ods\." "$INSTALL_ROOT/var/opendnssec/signed/ods" &&
+
+## The primary now answers with the whole zone, read from the spool
+ods_ldns_testns_kill &&
+ods_ldns_testns 15353 ods-1002.datafile &&
+ldns-notify -p 15354 -s 1002 -r 2 -z ods 127.0.0.1 &&
+syslog_waitfor 30 'ods-signerd: .*\[adapter\] read xfr zone ods from spool' &&
+syslog_waitfor_count 60 3 'ods-signerd: .*\[STATS\] ods ' &&
+syslog_grep_count 1 'ods-signerd: .*\[adapter\] read xfr zone ods from memory' &&
+! $GREP -q -- "^mail\.ods\." "$INSTALL_ROOT/var/opendnssec/signed/ods" &&
+
+## Stop
+log_this_timeout ods-control-stop 60 ods-control stop &&
+syslog_waitfor 60 'ods-enforcerd: .*all done' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer shutdown' &&
+ods_ldns_testns_kill &&
+return 0
+
+## Test failed. Kill stuff
+ods_ldns_testns_kill
+ods_kill
+return 1
@@ -0,0 +1,70 @@
+#!/usr/bin/env bash
+
+#TEST: Test removing a zone while it waits for a tcp connection
+#TEST: With one transfer per master, one zone transfers (slowly) and the
+#TEST: other waits for the connection. Remove the waiting zone and see if
+#TEST: the transferring zone still gets signed and the signer keeps running.
+
+## It requires setting up zones in OpenDNSSEC with Input DNS Adapter,
+## non-default zonelist.xml, non-default conf.xml, additional addns.xml.
+## It requires setting up a primary name server (ldns-testns) that
+## answers the zone transfers with a delay.
+
+## The adapter and the policy are the ones of the retry test
+retry=../signer.adapters.input_retry_expires &&
+ods_setup_conf addns.xml "$retry/addns.xml" &&
+ods_setup_conf kasp.xml "$retry/kasp.xml" &&
+
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml conf-mysql.xml
+fi &&
+
+ods_reset_env &&
+
+## Start master name server
+ods_ldns_testns 15353 ods.datafile &&
+
+## Start OpenDNSSEC
+log_this_timeout ods-control-start 60 ods-control start &&
+syslog_waitfor 60 'ods-enforcerd: .*Sleeping for' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer started' &&
+
+## Wait until one of the zones is queued behind the other
+syslog_waitfor 60 'ods-signerd: .*\[xfrd\] zone ods2* waits, max number of tcp connections' &&
+waiting=`sed -n 's/.*\[xfrd\] zone \(ods2*\) waits, max number of tcp connections.*/\1/p' "_syslog.$BUILD_TAG" | head -n 1` &&
+case "$waiting" in
+	ods )
+		transferring=ods2
+		remaining=zonelist-without-ods.xml
+		;;
+	ods2 )
+		transferring=ods
+		remaining="$retry/zonelist.xml"
+		;;
+	* )
+		false
+		;;
+esac &&
+
+## Remove the waiting zone
+ods_setup_conf zonelist.xml "$remaining" &&
+log_this ods-signer-update ods-signer update --all &&
+log_grep ods-signer-update stdout 'Zone list updated: 1 removed, 0 added, 0 updated.' &&
+
+## The transferring zone gets signed, and gives back its connection
+syslog_waitfor 60 "ods-signerd: .*\\[STATS\\] $transferring " &&
+! syslog_grep "ods-signerd: .*\\[STATS\\] $waiting " &&
+log_this ods-signer-running ods-signer running &&
+log_grep ods-signer-running stdout 'Engine running' &&
+
+## Stop
+log_this_timeout ods-control-stop 60 ods-control stop &&
+syslog_waitfor 60 'ods-enforcerd: .*all done' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer shutdown' &&
+ods_ldns_testns_kill &&
+return 0
+
+## Test failed. Kill stuff
+ods_ldns_testns_kill
+ods_kill
+return 1
@@ -0,0 +1,71 @@
+#!/usr/bin/env bash
+
+#TEST: Test the signer metrics exported by ods-signer stats
+#TEST: Transfer and sign a zone, send a notify and see that the counters
+#TEST: and histograms in both the Prometheus and the JSON output count the
+#TEST: transfer, the signing and the notify.
+
+## It requires setting up a primary name server (ldns-testns).
+
+## The configuration, the adapter, the zone list and the zone are the
+## ones of the basic input test
+basic=../signer.adapters.input_basic &&
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml "$basic/conf-mysql.xml"
+else
+	ods_setup_conf conf.xml "$basic/conf.xml"
+fi &&
+ods_setup_conf addns.xml "$basic/addns.xml" &&
+ods_setup_conf zonelist.xml "$basic/zonelist.xml" &&
+
+ods_reset_env &&
+
+## Start master name server
+ods_ldns_testns 15353 "$basic/ods.datafile" &&
+
+## Start OpenDNSSEC
+log_this_timeout ods-control-start 60 ods-control start &&
+syslog_waitfor 60 'ods-enforcerd: .*Sleeping for' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer started' &&
+
+## Wait for signed zone file
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods ' &&
+
+## Nothing notified yet, the transfer and the signing are counted
+log_this ods-signer-stats ods-signer stats &&
+log_grep ods-signer-stats stdout '^ods_signer_uptime_seconds [0-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_xfr_in_done_total [1-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_xfr_in_messages_total [1-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_xfr_in_failed_total 0$' &&
+log_grep ods-signer-stats stdout '^ods_signer_notify_in_total 0$' &&
+log_grep ods-signer-stats stdout '^ods_signer_phase_duration_seconds_count{phase="read"} [1-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_phase_duration_seconds_count{phase="sign"} [1-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_phase_duration_seconds_count{phase="write"} [1-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_hsm_sign_duration_seconds_count{key="[0-9a-f]*"} [1-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_signq_wait_seconds_count [1-9]' &&
+log_grep ods-signer-stats stdout '^ods_signer_drudger_busy_seconds_total [0-9]' &&
+
+## Fake notify, it is counted
+ldns-notify -p 15354 -s 1001 -r 2 -z ods 127.0.0.1 &&
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods ' &&
+log_this ods-signer-stats-notify ods-signer stats &&
+log_grep ods-signer-stats-notify stdout '^ods_signer_notify_in_total [1-9]' &&
+
+## The same metrics as JSON
+log_this ods-signer-stats-json ods-signer stats json &&
+log_grep ods-signer-stats-json stdout '^  "uptime_us": [0-9]' &&
+log_grep ods-signer-stats-json stdout '^    "sign": {"count": [1-9]' &&
+log_grep ods-signer-stats-json stdout '^    "xfr_in_done": [1-9]' &&
+log_grep ods-signer-stats-json stdout '^    "notify_in": [1-9]' &&
+
+## Stop
+log_this_timeout ods-control-stop 60 ods-control stop &&
+syslog_waitfor 60 'ods-enforcerd: .*all done' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer shutdown' &&
+ods_ldns_testns_kill &&
+return 0
+
+## Test failed. Kill stuff
+ods_ldns_testns_kill
+ods_kill
+return 1
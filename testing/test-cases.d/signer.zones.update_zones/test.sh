@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+
+#TEST: Update the signer configuration of several zones with one command
+#TEST: Sign four zones, change their signconfs and have the signer pick
+#TEST: them all up through a single 'ods-signer update zones' command.
+
+## The zones, policies and configuration are the ones of the
+## multi-threaded enforcer test
+fixtures=../enforcer.conf.multithread_basic &&
+if [ -n "$HAVE_MYSQL" ]; then
+	ods_setup_conf conf.xml "$fixtures/conf-mysql.xml"
+else
+	ods_setup_conf conf.xml "$fixtures/conf.xml"
+fi &&
+ods_setup_conf kasp.xml "$fixtures/kasp.xml" &&
+ods_setup_conf zonelist.xml "$fixtures/zonelist.xml" &&
+ods_setup_zone "$fixtures/unsigned/ods" &&
+ods_setup_zone "$fixtures/unsigned/ods2" &&
+ods_setup_zone "$fixtures/unsigned/ods3" &&
+ods_setup_zone "$fixtures/unsigned/ods4" &&
+
+ods_reset_env &&
+
+log_this_timeout ods-control-enforcer-start 60 ods-control enforcer start &&
+syslog_waitfor 60 'ods-enforcerd: .*Sleeping for' &&
+
+log_this_timeout ods-control-signer-start 60 ods-control signer start &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer started' &&
+
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods ' &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods2 ' &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods3 ' &&
+syslog_waitfor 60 'ods-signerd: .*\[STATS\] ods4 ' &&
+
+## Change all signconfs, the signer only looks at the modification time
+ods-signer verbosity 5 &&
+sleep 2 &&
+touch "$INSTALL_ROOT/var/opendnssec/signconf/ods.xml" &&
+touch "$INSTALL_ROOT/var/opendnssec/signconf/ods2.xml" &&
+touch "$INSTALL_ROOT/var/opendnssec/signconf/ods3.xml" &&
+touch "$INSTALL_ROOT/var/opendnssec/signconf/ods4.xml" &&
+
+## Update all zones with one command
+log_this_timeout ods-signer-update-zones 10 ods-signer update zones ods,ods2,ods3,ods4 &&
+log_grep ods-signer-update-zones stdout '4 zone configs being updated.' &&
+! log_grep ods-signer-update-zones stdout 'not found' &&
+
+## Each zone reads its signconf again and is signed again
+syslog_waitfor 60 'ods-signerd: .*\[zone\] zone ods signconf file .*/ods\.xml is modified since' &&
+syslog_waitfor 60 'ods-signerd: .*\[zone\] zone ods2 signconf file .*/ods2\.xml is modified since' &&
+syslog_waitfor 60 'ods-signerd: .*\[zone\] zone ods3 signconf file .*/ods3\.xml is modified since' &&
+syslog_waitfor 60 'ods-signerd: .*\[zone\] zone ods4 signconf file .*/ods4\.xml is modified since' &&
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods ' &&
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods2 ' &&
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods3 ' &&
+syslog_waitfor_count 60 2 'ods-signerd: .*\[STATS\] ods4 ' &&
+
+log_this_timeout ods-control-stop 60 ods-control stop &&
+syslog_waitfor 60 'ods-enforcerd: .*all done' &&
+syslog_waitfor 60 'ods-signerd: .*\[engine\] signer shutdown' &&
+return 0
+
+ods_kill
+return 1